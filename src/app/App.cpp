@@ -13,8 +13,11 @@
 
 #include "core/auth/OAuthStore.h"
 #include "core/logging/AuditLog.h"
+#include "core/logging/ProtocolTranscript.h"
 #include "core/mail/providers/imap/FolderMirrorService.h"
+#include "core/mail/providers/imap/ImapConnectionPool.h"
 #include "core/mail/providers/imap/ImapProvider.h"
+#include "core/mail/providers/imap/ImapWarmup.h"
 #include "core/oauth/OAuthBroker.h"
 #include "core/storage/Db.h"
 #include "core/storage/Schema.h"
@@ -347,6 +350,7 @@ int App::Run(int argc, char* argv[])
     ngks::core::logging::AuditLog::Init(ngks::platform::common::AuditLogFilePath().string());
     ngks::core::logging::AuditLog::AppStart(ngks::platform::common::DbFilePath().string(), 1);
     QObject::connect(&qtApp, &QCoreApplication::aboutToQuit, []() {
+        ngks::core::mail::providers::imap::ImapConnectionPool::Instance().CloseIdle();
         ngks::core::logging::AuditLog::AppExit(1);
     });
 
@@ -366,6 +370,10 @@ int App::Run(int argc, char* argv[])
     const QCommandLineOption dbDumpFoldersOpt("db-dump-folders", "Dump folders table to artifacts/_proof/29_db_dump_folders.txt and exit.");
     const QCommandLineOption dbDumpOAuthOpt("db-dump-oauth", "Dump oauth_tokens table to artifacts/_proof/30_db_dump_oauth.txt and exit.");
     const QCommandLineOption limitOpt("limit", "Limit for --db-dump-folders rows.", "limit", "200");
+    const QCommandLineOption noWarmupOpt("no-warmup", "Skip the IMAP TLS pre-connect at startup.");
+    const QCommandLineOption compressOpt("compress", "Negotiate IMAP COMPRESS=DEFLATE true/false", "compress", "true");
+    const QCommandLineOption transcriptLevelOpt("transcript-level", "IMAP transcript level off/commands/full/elide.", "level", "full");
+    const QCommandLineOption transcriptSampleOpt("transcript-sample", "Keep one in N untagged server lines in transcripts.", "n", "1");
 
     parser.addOption(resolveOpt);
     parser.addOption(oauthConnectOpt);
@@ -379,8 +387,18 @@ int App::Run(int argc, char* argv[])
     parser.addOption(dbDumpFoldersOpt);
     parser.addOption(dbDumpOAuthOpt);
     parser.addOption(limitOpt);
+    parser.addOption(noWarmupOpt);
+    parser.addOption(compressOpt);
+    parser.addOption(transcriptLevelOpt);
+    parser.addOption(transcriptSampleOpt);
     parser.process(qtApp);
 
+    ngks::core::logging::TranscriptOptions transcriptOptions;
+    transcriptOptions.level = ngks::core::logging::TranscriptOptions::ParseLevel(
+        parser.value(transcriptLevelOpt).trimmed().toLower().toStdString(), transcriptOptions.level);
+    transcriptOptions.untaggedSampleEvery = qMax(1, parser.value(transcriptSampleOpt).toInt());
+    ngks::core::logging::ProtocolTranscript::SetDefaultOptions(transcriptOptions);
+
     bool ok = false;
     int limit = parser.value(limitOpt).toInt(&ok);
     if (!ok || limit <= 0) {
@@ -608,12 +626,16 @@ int App::Run(int argc, char* argv[])
         request.password = password;
         request.useXoauth2 = useXoauth2;
         request.oauthAccessToken = oauthAccessToken;
+        request.allowCompress = parser.value(compressOpt).trimmed().toLower() != "false";
 
         ngks::core::mail::providers::imap::ImapProvider provider;
         QVector<ngks::core::mail::providers::imap::ResolvedFolder> folders;
         QString resolveError;
         QString transcriptPath;
-        if (!provider.ResolveAccount(request, folders, resolveError, transcriptPath)) {
+        const bool resolved = provider.ResolveAccount(request, folders, resolveError, transcriptPath);
+        // One-shot CLI run: log out pooled sessions while the event loop machinery is still alive.
+        ngks::core::mail::providers::imap::ImapConnectionPool::Instance().CloseIdle();
+        if (!resolved) {
             const Xoauth2FailMeta xoauth2Meta = ParseXoauth2FailMeta(resolveError);
             if (xoauth2Meta.isXoauth2) {
                 ngks::core::logging::AuditLog::Event(
@@ -665,8 +687,20 @@ int App::Run(int argc, char* argv[])
     mainWindow_->raise();
     mainWindow_->activateWindow();
 
-    QTimer::singleShot(1000, &qtApp, []() {
-    });
+    if (!parser.isSet(noWarmupOpt)) {
+        // Pre-handshake with known servers so the first user action can resume TLS sessions.
+        QTimer::singleShot(1000, &qtApp, [&qtApp, &db]() {
+            auto* warmup = new ngks::core::mail::providers::imap::ImapWarmup(&qtApp);
+            QObject::connect(warmup, &ngks::core::mail::providers::imap::ImapWarmup::Finished, warmup,
+                             [warmup](int warmed, int attempted) {
+                                 ngks::core::logging::AuditLog::Event(
+                                     "IMAP_WARMUP",
+                                     QString("{\"warmed\":%1,\"attempted\":%2}").arg(warmed).arg(attempted).toStdString());
+                                 warmup->deleteLater();
+                             });
+            warmup->Start(ngks::core::mail::providers::imap::ImapWarmup::ResolvedEndpoints(db));
+        });
+    }
 
     return qtApp.exec();
 }
@@ -6,6 +6,9 @@
 #include <QSqlError>
 #include <QSqlQuery>
 #include <QVariant>
+#include <tuple>
+
+#include "core/storage/Query.h"
 
 namespace ngks::core::auth {
 
@@ -123,22 +126,25 @@ bool OAuthStore::GetRefreshToken(ngks::core::storage::Db& db,
         return false;
     }
 
-    QSqlQuery q(handle);
-    q.prepare("SELECT refresh_token FROM oauth_tokens WHERE provider = :provider AND email = :email LIMIT 1");
-    q.bindValue(":provider", p);
-    q.bindValue(":email", e);
+    using ngks::core::storage::Columns;
+    using ngks::core::storage::Params;
+    using ngks::core::storage::Query;
 
-    if (!q.exec()) {
-        outError = QString("OAuthStore::GetRefreshToken: %1").arg(q.lastError().text());
+    // Every OAuth login reads this, so it goes through the connection's statement cache.
+    Query<Columns<QString>, Params<QString, QString>> q(
+        db, "SELECT refresh_token FROM oauth_tokens WHERE provider = ? AND email = ? LIMIT 1");
+    if (!q.Exec(p, e)) {
+        outError = QString("OAuthStore::GetRefreshToken: %1").arg(q.Error());
         return false;
     }
 
-    if (!q.next()) {
+    const auto row = q.First();
+    if (!row) {
         // Not found is not an error; leave outError empty to distinguish.
         return false;
     }
 
-    outRefreshToken = q.value(0).toString();
+    outRefreshToken = std::get<0>(*row);
     if (outRefreshToken.isEmpty()) {
         outError = "OAuthStore::GetRefreshToken: refresh_token empty in DB";
         return false;
@@ -0,0 +1,289 @@
+#include "core/logging/ProtocolTranscript.h"
+
+#include <chrono>
+
+namespace ngks::core::logging {
+
+std::mutex ProtocolTranscript::s_mu;
+TranscriptOptions ProtocolTranscript::s_defaults;
+
+namespace {
+
+std::uint64_t RoundUpPowerOfTwo(int value)
+{
+    std::uint64_t size = 2;
+    while (size < static_cast<std::uint64_t>(value)) {
+        size <<= 1;
+    }
+    return size;
+}
+
+bool IsDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+}
+
+TranscriptLevel TranscriptOptions::ParseLevel(std::string_view text, TranscriptLevel fallback)
+{
+    if (text == "off") {
+        return TranscriptLevel::Off;
+    }
+    if (text == "commands") {
+        return TranscriptLevel::CommandsOnly;
+    }
+    if (text == "full") {
+        return TranscriptLevel::Full;
+    }
+    if (text == "elide") {
+        return TranscriptLevel::FullElideLiterals;
+    }
+    return fallback;
+}
+
+ProtocolTranscript::ProtocolTranscript(TranscriptOptions options)
+    : options_(options)
+{
+    if (options_.untaggedSampleEvery < 1) {
+        options_.untaggedSampleEvery = 1;
+    }
+    const std::uint64_t capacity = RoundUpPowerOfTwo(options_.ringCapacity);
+    mask_ = capacity - 1;
+    slots_ = std::make_unique<Slot[]>(capacity);
+    for (std::uint64_t i = 0; i < capacity; ++i) {
+        slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+ProtocolTranscript::~ProtocolTranscript()
+{
+    Close();
+}
+
+bool ProtocolTranscript::Open(const std::filesystem::path& path)
+{
+    Close();
+    if (options_.level == TranscriptLevel::Off) {
+        return true;
+    }
+
+    file_.open(path, std::ios::app | std::ios::binary);
+    if (!file_.is_open()) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        stop_ = false;
+    }
+    open_.store(true, std::memory_order_release);
+    writer_ = std::thread([this]() { Run(); });
+    return true;
+}
+
+void ProtocolTranscript::Close()
+{
+    if (!writer_.joinable()) {
+        return;
+    }
+    open_.store(false, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        stop_ = true;
+    }
+    wake_.notify_one();
+    writer_.join();
+    file_.close();
+}
+
+bool ProtocolTranscript::IsOpen() const
+{
+    return open_.load(std::memory_order_acquire);
+}
+
+void ProtocolTranscript::Append(char direction, std::string_view text)
+{
+    if (!open_.load(std::memory_order_relaxed) || !Accepts(direction, text)) {
+        return;
+    }
+
+    // Bounded multi-producer ring: claim a slot by advancing tail_, publish it through the
+    // slot's sequence number once the text is in place.
+    std::uint64_t pos = tail_.load(std::memory_order_relaxed);
+    Slot* slot = nullptr;
+    for (;;) {
+        slot = &slots_[pos & mask_];
+        const std::uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+        const auto diff = static_cast<std::int64_t>(sequence - pos);
+        if (diff == 0) {
+            if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            pos = tail_.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->text.clear();
+    slot->text.push_back(direction);
+    slot->text.push_back(' ');
+    if (direction == 'S' && options_.level == TranscriptLevel::FullElideLiterals) {
+        AppendElided(slot->text, text);
+    } else {
+        slot->text.append(text);
+    }
+    slot->text.push_back('\n');
+    slot->sequence.store(pos + 1, std::memory_order_release);
+
+    // Wake the writer early once half the ring is in use; otherwise it runs on its interval.
+    if (((pos + 1) & (mask_ >> 1)) == 0) {
+        wake_.notify_one();
+    }
+}
+
+void ProtocolTranscript::Flush()
+{
+    if (!IsOpen()) {
+        return;
+    }
+    const std::uint64_t target = tail_.load(std::memory_order_acquire);
+    std::unique_lock<std::mutex> lk(mu_);
+    wake_.notify_one();
+    flushed_.wait(lk, [this, target]() {
+        return written_.load(std::memory_order_acquire) >= target || !IsOpen();
+    });
+}
+
+TranscriptLevel ProtocolTranscript::Level() const
+{
+    return options_.level;
+}
+
+std::uint64_t ProtocolTranscript::DroppedLines() const
+{
+    return dropped_.load(std::memory_order_relaxed);
+}
+
+void ProtocolTranscript::SetDefaultOptions(const TranscriptOptions& options)
+{
+    std::lock_guard<std::mutex> lk(s_mu);
+    s_defaults = options;
+}
+
+TranscriptOptions ProtocolTranscript::DefaultOptions()
+{
+    std::lock_guard<std::mutex> lk(s_mu);
+    return s_defaults;
+}
+
+bool ProtocolTranscript::Accepts(char direction, std::string_view text)
+{
+    if (direction != 'S') {
+        return options_.level != TranscriptLevel::Off;
+    }
+    const bool untagged = !text.empty() && text.front() == '*';
+    switch (options_.level) {
+    case TranscriptLevel::Off:
+        return false;
+    case TranscriptLevel::CommandsOnly:
+        return !untagged;
+    case TranscriptLevel::Full:
+    case TranscriptLevel::FullElideLiterals:
+        break;
+    }
+    if (untagged && options_.untaggedSampleEvery > 1) {
+        return untaggedSeen_.fetch_add(1, std::memory_order_relaxed) % options_.untaggedSampleEvery == 0;
+    }
+    return true;
+}
+
+void ProtocolTranscript::AppendElided(std::string& out, std::string_view text) const
+{
+    // "{n}\r\n<n octets>" becomes "{n} <n octets elided>"; "{n!}" (already spooled) stays as-is.
+    std::size_t pos = 0;
+    while (pos < text.size()) {
+        const std::size_t brace = text.find('{', pos);
+        if (brace == std::string_view::npos) {
+            break;
+        }
+        std::size_t p = brace + 1;
+        std::uint64_t size = 0;
+        while (p < text.size() && IsDigit(text[p])) {
+            size = size * 10 + static_cast<std::uint64_t>(text[p] - '0');
+            ++p;
+        }
+        if (p < text.size() && text[p] == '+') {
+            ++p;
+        }
+        const bool header = p > brace + 1 && p + 2 < text.size() && text[p] == '}'
+            && text[p + 1] == '\r' && text[p + 2] == '\n';
+        if (!header || text.size() - (p + 3) < size) {
+            out.append(text.substr(pos, p - pos));
+            pos = p;
+            continue;
+        }
+        out.append(text.substr(pos, p + 1 - pos));
+        out.append(" <");
+        out.append(std::to_string(size));
+        out.append(" octets elided>");
+        pos = p + 3 + size;
+    }
+    if (pos < text.size()) {
+        out.append(text.substr(pos));
+    }
+}
+
+void ProtocolTranscript::Run()
+{
+    std::string batch;
+    batch.reserve(64 * 1024);
+    std::uint64_t droppedReported = 0;
+
+    std::unique_lock<std::mutex> lk(mu_);
+    for (;;) {
+        if (!stop_) {
+            wake_.wait_for(lk, std::chrono::milliseconds(options_.flushIntervalMs));
+        }
+        const bool stopping = stop_;
+        lk.unlock();
+
+        batch.clear();
+        Drain(batch);
+        const std::uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+        if (dropped != droppedReported) {
+            batch += "I transcript dropped " + std::to_string(dropped - droppedReported) + " lines\n";
+            droppedReported = dropped;
+        }
+        if (!batch.empty()) {
+            file_.write(batch.data(), static_cast<std::streamsize>(batch.size()));
+            file_.flush();
+        }
+        written_.store(head_, std::memory_order_release);
+
+        lk.lock();
+        flushed_.notify_all();
+        if (stopping) {
+            return;
+        }
+    }
+}
+
+bool ProtocolTranscript::Drain(std::string& batch)
+{
+    bool any = false;
+    for (;;) {
+        Slot& slot = slots_[head_ & mask_];
+        if (slot.sequence.load(std::memory_order_acquire) != head_ + 1) {
+            return any;
+        }
+        batch.append(slot.text);
+        slot.sequence.store(head_ + mask_ + 1, std::memory_order_release);
+        ++head_;
+        any = true;
+    }
+}
+
+} // namespace ngks::core::logging
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace ngks::core::logging {
+
+enum class TranscriptLevel {
+    Off,
+    // Client lines ("C "), diagnostics ("I ", "! ") and tagged/continuation server lines.
+    CommandsOnly,
+    Full,
+    // Full, with the octets of {n} literals replaced by a size marker.
+    FullElideLiterals
+};
+
+struct TranscriptOptions {
+    TranscriptLevel level = TranscriptLevel::Full;
+    // Keep one in N untagged server lines ("S * ..."); 1 keeps all of them.
+    int untaggedSampleEvery = 1;
+    // Lines buffered between the protocol thread and the writer; rounded up to a power of two.
+    int ringCapacity = 4096;
+    // Longest time a line waits before the writer flushes it.
+    int flushIntervalMs = 50;
+
+    static TranscriptLevel ParseLevel(std::string_view text, TranscriptLevel fallback);
+};
+
+// Protocol transcript with the file I/O taken off the hot path. Append() copies the line into a
+// bounded lock-free ring (slot strings keep their capacity, so steady state does not allocate)
+// and a background thread drains it, writing each batch with one write + flush. When the ring
+// is full the line is dropped and counted rather than stalling the protocol; the writer notes
+// the number of dropped lines in the file. Callers redact secrets before appending.
+class ProtocolTranscript {
+public:
+    explicit ProtocolTranscript(TranscriptOptions options = DefaultOptions());
+    ~ProtocolTranscript();
+
+    ProtocolTranscript(const ProtocolTranscript&) = delete;
+    ProtocolTranscript& operator=(const ProtocolTranscript&) = delete;
+
+    // Appends to path (created if missing). With level Off nothing is opened and Open succeeds.
+    bool Open(const std::filesystem::path& path);
+    // Writes everything still buffered and stops the writer thread.
+    void Close();
+    bool IsOpen() const;
+
+    // direction is 'C', 'S', 'I' or '!'; the line is written as "<direction> <text>\n".
+    // Safe to call from any thread.
+    void Append(char direction, std::string_view text);
+
+    // Blocks until every line appended so far has reached the file.
+    void Flush();
+
+    TranscriptLevel Level() const;
+    std::uint64_t DroppedLines() const;
+
+    // Process-wide defaults for transcripts opened without explicit options (CLI flags).
+    static void SetDefaultOptions(const TranscriptOptions& options);
+    static TranscriptOptions DefaultOptions();
+
+private:
+    struct Slot {
+        std::atomic<std::uint64_t> sequence{0};
+        std::string text;
+    };
+
+    bool Accepts(char direction, std::string_view text);
+    void AppendElided(std::string& out, std::string_view text) const;
+    void Run();
+    bool Drain(std::string& batch);
+
+    TranscriptOptions options_;
+    std::unique_ptr<Slot[]> slots_;
+    std::uint64_t mask_ = 0;
+    std::atomic<std::uint64_t> tail_{0};
+    std::uint64_t head_ = 0;  // writer thread only
+    std::atomic<std::uint64_t> written_{0};
+    std::atomic<std::uint64_t> dropped_{0};
+    std::atomic<std::uint64_t> untaggedSeen_{0};
+
+    std::ofstream file_;
+    std::thread writer_;
+    std::mutex mu_;
+    std::condition_variable wake_;
+    std::condition_variable flushed_;
+    bool stop_ = false;
+    std::atomic<bool> open_{false};
+
+    static std::mutex s_mu;
+    static TranscriptOptions s_defaults;
+};
+
+} // namespace ngks::core::logging
@@ -0,0 +1,156 @@
+#include "core/mail/mime/HeaderDecoding.h"
+
+#include <QByteArray>
+#include <QStringDecoder>
+
+namespace ngks::core::mail::mime {
+
+namespace {
+
+int HexValue(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+QByteArray DecodeQ(QByteArrayView text)
+{
+    QByteArray out;
+    out.reserve(text.size());
+    for (qsizetype i = 0; i < text.size(); ++i) {
+        const char c = text[i];
+        if (c == '_') {
+            out.append(' ');
+        } else if (c == '=' && i + 2 < text.size() && HexValue(text[i + 1]) >= 0 && HexValue(text[i + 2]) >= 0) {
+            out.append(static_cast<char>(HexValue(text[i + 1]) * 16 + HexValue(text[i + 2])));
+            i += 2;
+        } else {
+            out.append(c);
+        }
+    }
+    return out;
+}
+
+// Decodes one "=?charset?enc?text?=" at the start of word; returns false if it is not one.
+bool DecodeWord(QByteArrayView word, QString& out)
+{
+    if (word.size() < 8 || !word.startsWith("=?") || !word.endsWith("?=")) {
+        return false;
+    }
+    const QByteArray inner = word.sliced(2, word.size() - 4).toByteArray();
+    const qsizetype q1 = inner.indexOf('?');
+    if (q1 <= 0 || q1 + 2 >= inner.size() || inner[q1 + 2] != '?') {
+        return false;
+    }
+    QByteArray charset = inner.first(q1);
+    const qsizetype star = charset.indexOf('*');  // RFC 2231 language suffix
+    if (star >= 0) {
+        charset.truncate(star);
+    }
+    const char encoding = inner[q1 + 1];
+    const QByteArray text = inner.sliced(q1 + 3);
+
+    QByteArray octets;
+    if (encoding == 'B' || encoding == 'b') {
+        const auto decoded = QByteArray::fromBase64Encoding(text);
+        if (!decoded) {
+            return false;
+        }
+        octets = decoded.decoded;
+    } else if (encoding == 'Q' || encoding == 'q') {
+        octets = DecodeQ(text);
+    } else {
+        return false;
+    }
+
+    QStringDecoder decoder(charset.constData());
+    if (!decoder.isValid()) {
+        return false;
+    }
+    out = decoder.decode(octets);
+    return !decoder.hasError();
+}
+
+bool IsSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+}
+
+QString DecodeHeaderText(QByteArrayView raw)
+{
+    QString out;
+    out.reserve(raw.size());
+    bool lastWasEncoded = false;
+    qsizetype i = 0;
+    while (i < raw.size()) {
+        qsizetype start = i;
+        while (i < raw.size() && IsSpace(raw[i])) {
+            ++i;
+        }
+        const QByteArrayView space = raw.sliced(start, i - start);
+        start = i;
+        while (i < raw.size() && !IsSpace(raw[i])) {
+            ++i;
+        }
+        const QByteArrayView word = raw.sliced(start, i - start);
+
+        QString decoded;
+        if (!word.isEmpty() && DecodeWord(word, decoded)) {
+            if (!lastWasEncoded) {
+                out += QString::fromUtf8(space);
+            }
+            out += decoded;
+            lastWasEncoded = true;
+        } else {
+            out += QString::fromUtf8(space);
+            out += QString::fromUtf8(word);
+            lastWasEncoded = false;
+        }
+    }
+    return out;
+}
+
+QByteArray HeaderFieldValue(QByteArrayView headerBlock, QByteArrayView name)
+{
+    QByteArray value;
+    bool inField = false;
+    qsizetype pos = 0;
+    while (pos < headerBlock.size()) {
+        qsizetype end = pos;
+        while (end < headerBlock.size() && headerBlock[end] != '\n') {
+            ++end;
+        }
+        QByteArray line = headerBlock.sliced(pos, end - pos).toByteArray();
+        if (line.endsWith('\r')) {
+            line.chop(1);
+        }
+        pos = end + 1;
+
+        if (inField) {
+            if (!line.isEmpty() && (line[0] == ' ' || line[0] == '\t')) {
+                value.append(' ');
+                value.append(line.trimmed());
+                continue;
+            }
+            break;
+        }
+        if (line.size() > name.size() && line[name.size()] == ':'
+            && QByteArrayView(line).first(name.size()).compare(name, Qt::CaseInsensitive) == 0) {
+            value = line.sliced(name.size() + 1).trimmed();
+            inField = true;
+        }
+    }
+    return value;
+}
+
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <QByteArrayView>
+#include <QString>
+
+namespace ngks::core::mail::mime {
+
+// Decodes an unstructured header value: RFC 2047 encoded-words ("=?charset?B|Q?text?=") are
+// converted from their charset, whitespace between adjacent encoded-words is dropped, and
+// everything else is read as UTF-8. Malformed or unknown-charset words are kept verbatim.
+QString DecodeHeaderText(QByteArrayView raw);
+
+// Unfolds a header block and returns the value of the first field with that name
+// (case-insensitive), or an empty array. Intended for small HEADER.FIELDS responses.
+QByteArray HeaderFieldValue(QByteArrayView headerBlock, QByteArrayView name);
+
+}
@@ -0,0 +1,182 @@
+#include "core/mail/mime/TransferDecoding.h"
+
+namespace ngks::core::mail::mime {
+
+namespace {
+
+int HexValue(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+int Base64Value(char c)
+{
+    if (c >= 'A' && c <= 'Z') {
+        return c - 'A';
+    }
+    if (c >= 'a' && c <= 'z') {
+        return c - 'a' + 26;
+    }
+    if (c >= '0' && c <= '9') {
+        return c - '0' + 52;
+    }
+    if (c == '+') {
+        return 62;
+    }
+    if (c == '/') {
+        return 63;
+    }
+    return -1;
+}
+
+bool IsBlank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+}
+
+TransferDecoder::TransferDecoder(QByteArrayView encoding)
+{
+    const QByteArray lower = encoding.trimmed().toByteArray().toLower();
+    if (lower == "base64") {
+        kind_ = Kind::Base64;
+    } else if (lower == "quoted-printable") {
+        kind_ = Kind::QuotedPrintable;
+    }
+}
+
+bool TransferDecoder::Decodes() const
+{
+    return kind_ != Kind::Identity;
+}
+
+void TransferDecoder::Feed(QByteArrayView chunk, QByteArray& out)
+{
+    switch (kind_) {
+    case Kind::Base64:
+        FeedBase64(chunk, out);
+        break;
+    case Kind::QuotedPrintable:
+        FeedQuotedPrintable(chunk, out, false);
+        break;
+    case Kind::Identity:
+        out.append(chunk.data(), chunk.size());
+        break;
+    }
+}
+
+void TransferDecoder::Finish(QByteArray& out)
+{
+    if (kind_ == Kind::QuotedPrintable) {
+        FeedQuotedPrintable(QByteArrayView(), out, true);
+    }
+    // A base64 remainder under 8 bits is padding, not data.
+    bits_ = 0;
+    bitCount_ = 0;
+}
+
+void TransferDecoder::FeedBase64(QByteArrayView chunk, QByteArray& out)
+{
+    out.reserve(out.size() + chunk.size() * 3 / 4 + 1);
+    for (const char c : chunk) {
+        // Line breaks, padding and stray characters carry no bits (RFC 2045 6.8).
+        const int value = Base64Value(c);
+        if (value < 0) {
+            continue;
+        }
+        bits_ = (bits_ << 6) | quint32(value);
+        bitCount_ += 6;
+        if (bitCount_ >= 8) {
+            bitCount_ -= 8;
+            out.append(static_cast<char>((bits_ >> bitCount_) & 0xff));
+            bits_ &= (1u << bitCount_) - 1;
+        }
+    }
+}
+
+void TransferDecoder::FeedQuotedPrintable(QByteArrayView chunk, QByteArray& out, bool final)
+{
+    pending_.append(chunk.data(), chunk.size());
+    const char* data = pending_.constData();
+    const qsizetype n = pending_.size();
+    out.reserve(out.size() + n);
+    qsizetype i = 0;
+    while (i < n) {
+        const char c = data[i];
+        if (c == '=') {
+            // Soft line break, escape, or a literal '=' when what follows is not hex.
+            if (i + 1 >= n) {
+                i = final ? n : i;
+                break;
+            }
+            if (data[i + 1] == '\n') {
+                i += 2;
+                continue;
+            }
+            if (data[i + 1] == '\r') {
+                if (i + 2 >= n) {
+                    i = final ? n : i;
+                    break;
+                }
+                if (data[i + 2] == '\n') {
+                    i += 3;
+                    continue;
+                }
+            }
+            if (i + 2 >= n && !final) {
+                break;
+            }
+            const int hi = i + 2 < n ? HexValue(data[i + 1]) : -1;
+            const int lo = i + 2 < n ? HexValue(data[i + 2]) : -1;
+            if (hi >= 0 && lo >= 0) {
+                out.append(static_cast<char>(hi * 16 + lo));
+                i += 3;
+            } else {
+                out.append(c);
+                ++i;
+            }
+            continue;
+        }
+        if (IsBlank(c)) {
+            // Trailing whitespace on a line is transport padding and is dropped.
+            qsizetype j = i;
+            while (j < n && IsBlank(data[j])) {
+                ++j;
+            }
+            if (j == n && !final) {
+                break;
+            }
+            if (j == n || data[j] == '\r' || data[j] == '\n') {
+                i = j;
+                continue;
+            }
+            out.append(data + i, j - i);
+            i = j;
+            continue;
+        }
+        out.append(c);
+        ++i;
+    }
+    pending_.remove(0, i);
+}
+
+QByteArray DecodeTransferEncoding(QByteArrayView body, QByteArrayView encoding)
+{
+    TransferDecoder decoder(encoding);
+    QByteArray out;
+    decoder.Feed(body, out);
+    decoder.Finish(out);
+    return out;
+}
+
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+
+namespace ngks::core::mail::mime {
+
+// Incremental Content-Transfer-Encoding decoder for part bodies that arrive in chunks of any
+// size. base64 and quoted-printable are decoded; 7bit, 8bit, binary and unknown encodings
+// pass through unchanged. Input split mid-quantum or mid-escape is carried to the next Feed.
+class TransferDecoder {
+public:
+    explicit TransferDecoder(QByteArrayView encoding);
+
+    // True when Feed actually transforms its input.
+    bool Decodes() const;
+
+    // Appends the decoded octets of chunk to out.
+    void Feed(QByteArrayView chunk, QByteArray& out);
+    // Flushes whatever a truncated final quantum or line still holds.
+    void Finish(QByteArray& out);
+
+private:
+    enum class Kind {
+        Identity,
+        Base64,
+        QuotedPrintable
+    };
+
+    void FeedBase64(QByteArrayView chunk, QByteArray& out);
+    void FeedQuotedPrintable(QByteArrayView chunk, QByteArray& out, bool final);
+
+    Kind kind_ = Kind::Identity;
+    // base64: the sextets of a partial quantum; quoted-printable: an unfinished line tail.
+    quint32 bits_ = 0;
+    int bitCount_ = 0;
+    QByteArray pending_;
+};
+
+// Decodes a whole body at once.
+QByteArray DecodeTransferEncoding(QByteArrayView body, QByteArrayView encoding);
+
+}
@@ -1,12 +1,18 @@
 #include "core/mail/providers/imap/FolderMirrorService.h"
 
 #include <QDateTime>
+#include <QHash>
 #include <QSqlError>
 #include <QSqlQuery>
 #include <QSqlRecord>
 #include <QVariant>
+#include <optional>
+#include <tuple>
+#include <utility>
 
 #include "core/storage/Db.h"
+#include "core/storage/Query.h"
+#include "core/storage/Reindexer.h"
 
 namespace ngks::core::mail::providers::imap {
 
@@ -32,62 +38,120 @@ bool FolderMirrorService::MirrorResolvedAccount(
         return false;
     }
 
-    QSqlQuery upsert(sqlDb);
-    upsert.prepare(
+    using ngks::core::storage::Columns;
+    using ngks::core::storage::Params;
+    using ngks::core::storage::Query;
+
+    Query<Columns<>, Params<QString, QString, int, QString, QString>> upsertAccount(
+        db,
         "INSERT INTO accounts(email, provider, imap_host, imap_port, tls_mode, auth_method, credential_ref, status, sync_state, created_at) "
-        "VALUES(:email, :provider, :host, :port, :tls, :auth, :cred, 'RESOLVED', '', datetime('now')) "
+        "VALUES(?, 'imap', ?, ?, ?, 'PASSWORD', ?, 'RESOLVED', '', datetime('now')) "
         "ON CONFLICT(email) DO UPDATE SET "
         "provider=excluded.provider, imap_host=excluded.imap_host, imap_port=excluded.imap_port, "
         "tls_mode=excluded.tls_mode, auth_method=excluded.auth_method, credential_ref=excluded.credential_ref, "
         "status='RESOLVED'");
-    upsert.bindValue(":email", request.email);
-    upsert.bindValue(":provider", "imap");
-    upsert.bindValue(":host", request.host);
-    upsert.bindValue(":port", request.port);
-    upsert.bindValue(":tls", request.tls ? "TLS" : "PLAIN");
-    upsert.bindValue(":auth", "PASSWORD");
-    upsert.bindValue(":cred", credentialRef);
-
-    if (!upsert.exec()) {
-        outError = upsert.lastError().text();
+    const QString tlsMode = request.tls ? QStringLiteral("TLS") : QStringLiteral("PLAIN");
+    if (!upsertAccount.Exec(request.email, request.host, request.port, tlsMode, credentialRef)) {
+        outError = upsertAccount.Error();
         sqlDb.rollback();
         return false;
     }
 
-    QSqlQuery accountLookup(sqlDb);
-    accountLookup.prepare("SELECT id FROM accounts WHERE email=:email LIMIT 1");
-    accountLookup.bindValue(":email", request.email);
-    if (!accountLookup.exec() || !accountLookup.next()) {
+    Query<Columns<int>, Params<QString>> accountLookup(db, "SELECT id FROM accounts WHERE email=? LIMIT 1");
+    const auto account = accountLookup.Exec(request.email) ? accountLookup.First() : std::nullopt;
+    if (!account) {
         outError = "Failed to retrieve resolved account id";
         sqlDb.rollback();
         return false;
     }
 
-    outAccountId = accountLookup.value(0).toInt();
-
-    QSqlQuery clearFolders(sqlDb);
-    clearFolders.prepare("DELETE FROM folders WHERE account_id=:aid");
-    clearFolders.bindValue(":aid", outAccountId);
-    if (!clearFolders.exec()) {
-        outError = clearFolders.lastError().text();
+    outAccountId = std::get<0>(*account);
+
+    // Upsert rather than delete + insert: folder ids, their messages and sync_state must
+    // survive a re-resolve. Rows that did not change are not rewritten, so re-resolving a
+    // large account touches only what moved.
+    struct StoredFolder {
+        int id = -1;
+        QString displayName;
+        QString delimiter;
+        QString attrsJson;
+        QString specialUse;
+    };
+    QHash<QString, StoredFolder> existing;
+    Query<Columns<int, QString, QString, QString, QString, QString>, Params<int>> existingFolders(
+        db,
+        "SELECT id, remote_name, display_name, delimiter, attrs_json, special_use "
+        "FROM folders WHERE account_id=?");
+    if (!existingFolders.Exec(outAccountId)) {
+        outError = existingFolders.Error();
         sqlDb.rollback();
         return false;
     }
+    existing.reserve(folders.size());
+    while (auto row = existingFolders.Next()) {
+        auto& [id, remoteName, displayName, delimiter, attrsJson, specialUse] = *row;
+        existing.insert(remoteName, StoredFolder{id, std::move(displayName), std::move(delimiter),
+                                                 std::move(attrsJson), std::move(specialUse)});
+    }
 
-    QSqlQuery insertFolder(sqlDb);
-    insertFolder.prepare(
+    Query<Columns<>, Params<int, QString, QString, QString, QString, QString>> upsertFolder(
+        db,
         "INSERT INTO folders(account_id, remote_name, display_name, delimiter, attrs_json, special_use, sync_state, created_at) "
-        "VALUES(:aid, :remote, :display, :delim, :attrs, :special, '', datetime('now'))");
+        "VALUES(?, ?, ?, ?, ?, ?, '', datetime('now')) "
+        "ON CONFLICT(account_id, remote_name) DO UPDATE SET "
+        "display_name=excluded.display_name, delimiter=excluded.delimiter, "
+        "attrs_json=excluded.attrs_json, special_use=excluded.special_use");
+
+    Query<Columns<>, Params<qint64, qint64, qint64, qint64, qint64, int, QString>> upsertStatus(
+        db,
+        "INSERT INTO folder_status(folder_id, messages, unseen, uid_next, uid_validity, highest_modseq, updated_at) "
+        "SELECT id, ?, ?, ?, ?, ?, datetime('now') "
+        "FROM folders WHERE account_id=? AND remote_name=? "
+        "ON CONFLICT(folder_id) DO UPDATE SET "
+        "messages=excluded.messages, unseen=excluded.unseen, uid_next=excluded.uid_next, "
+        "uid_validity=excluded.uid_validity, highest_modseq=excluded.highest_modseq, updated_at=excluded.updated_at");
 
     for (const auto& folder : folders) {
-        insertFolder.bindValue(":aid", outAccountId);
-        insertFolder.bindValue(":remote", folder.remoteName);
-        insertFolder.bindValue(":display", folder.displayName);
-        insertFolder.bindValue(":delim", folder.delimiter.isEmpty() ? "/" : folder.delimiter);
-        insertFolder.bindValue(":attrs", folder.attrsJson);
-        insertFolder.bindValue(":special", folder.specialUse.isNull() ? QString("") : folder.specialUse);
-        if (!insertFolder.exec()) {
-            outError = insertFolder.lastError().text();
+        const QString delimiter = folder.delimiter.isEmpty() ? QString("/") : folder.delimiter;
+        const QString attrsJson = folder.AttrsJson();
+        const QString specialUse = folder.specialUse.isNull() ? QString("") : folder.specialUse;
+        const auto stored = existing.constFind(folder.remoteName);
+        const bool unchanged = stored != existing.constEnd()
+            && stored->displayName == folder.displayName
+            && stored->delimiter == delimiter
+            && stored->attrsJson == attrsJson
+            && stored->specialUse == specialUse;
+        if (!unchanged) {
+            if (!upsertFolder.Exec(outAccountId, folder.remoteName, folder.displayName, delimiter, attrsJson, specialUse)) {
+                outError = upsertFolder.Error();
+                sqlDb.rollback();
+                return false;
+            }
+        }
+        existing.remove(folder.remoteName);
+
+        if (!folder.hasStatus) {
+            continue;
+        }
+        if (!upsertStatus.Exec(folder.status.messages, folder.status.unseen, folder.status.uidNext,
+                               folder.status.uidValidity, folder.status.highestModSeq,
+                               outAccountId, folder.remoteName)) {
+            outError = upsertStatus.Error();
+            sqlDb.rollback();
+            return false;
+        }
+    }
+
+    // Whatever is left no longer exists on the server.
+    Query<Columns<>, Params<int>> deleteMessages(db, "DELETE FROM messages WHERE folder_id=?");
+    Query<Columns<>, Params<int>> deleteStatus(db, "DELETE FROM folder_status WHERE folder_id=?");
+    Query<Columns<>, Params<int>> deleteFolder(db, "DELETE FROM folders WHERE id=?");
+    ngks::core::storage::ReindexQueue reindex(sqlDb);
+    for (auto it = existing.constBegin(); it != existing.constEnd(); ++it) {
+        QString error;
+        if (!reindex.RemoveFolder(it->id, error) || !deleteMessages.Exec(it->id) || !deleteStatus.Exec(it->id)
+            || !deleteFolder.Exec(it->id)) {
+            outError = QString("Failed to remove stale folder %1").arg(it.key());
             sqlDb.rollback();
             return false;
         }
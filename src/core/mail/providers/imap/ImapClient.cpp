@@ -1,55 +1,110 @@
 #include "core/mail/providers/imap/ImapClient.h"
 
-#include <QFile>
-#include <QIODevice>
-#include <QSslSocket>
-#include <QTextStream>
+#include <QByteArray>
+#include <QEventLoop>
+#include <QHash>
+#include <QList>
+#include <QThread>
+
+#include "core/mail/providers/imap/ImapCommandDispatcher.h"
+#include "core/mail/providers/imap/ImapConnection.h"
 
 namespace ngks::core::mail::providers::imap {
 
+// Blocking facade over ImapConnection for the CLI paths: each call spins a local event loop
+// until the connection has produced what the caller is waiting for, or the watchdog fires.
+// Responses go to the dispatcher while pipelined commands are outstanding; otherwise they are
+// queued for the line-oriented ReadLine/ReadResponseUntilTag calls. Untagged responses no
+// command or handler claims while the pipe is busy are queued only if one of those calls is
+// waiting; nobody would read them otherwise.
 class ImapClient::Impl {
 public:
-    QSslSocket socket;
-    QFile transcript;
-    QString lastError;
-    int lastSocketErrorCode = static_cast<int>(QAbstractSocket::UnknownSocketError);
-    QString lastSocketErrorString;
-    bool encryptedReached = false;
-
-    void LogLine(const QString& direction, const QString& text)
+    ImapConnection connection;
+    ImapCommandDispatcher dispatcher{connection};
+    QList<QByteArray> responses;
+    QHash<QString, QStringList> completed;
+    QEventLoop* loop = nullptr;
+    bool waitAborted = false;
+    // ReadLine, ReadGreeting or ReadResponseUntilTag waiting for responses.
+    int lineReaders = 0;
+    // A command was given up on before its tagged response; see IsDirty.
+    bool dirty = false;
+    // IDLE submitted and not yet completed; idling once the server sent its continuation.
+    bool idlePending = false;
+    bool idling = false;
+    bool idleOk = false;
+
+    Impl()
     {
-        if (!transcript.isOpen()) {
-            return;
+        connection.SetResponseHandler([this](QByteArrayView response) {
+            if (!dispatcher.HandleResponse(response) && dispatcher.Idle()) {
+                responses.push_back(response.toByteArray());
+            }
+            WakeUp();
+        });
+        dispatcher.OnUnsolicited([this](QByteArrayView response) {
+            if (lineReaders > 0) {
+                responses.push_back(response.toByteArray());
+            }
+        });
+        QObject::connect(&connection, &ImapConnection::Opened, [this]() { WakeUp(); });
+        QObject::connect(&connection, &ImapConnection::Closed, [this]() {
+            dispatcher.FailAll();
+            Abort();
+        });
+        QObject::connect(&connection, &ImapConnection::Failed, [this](const QString&) {
+            dispatcher.FailAll();
+            Abort();
+        });
+        QObject::connect(&connection, &ImapConnection::TimedOut, [this](const QString&) { Abort(); });
+    }
+
+    void WakeUp()
+    {
+        if (loop != nullptr) {
+            loop->quit();
+        }
+    }
+
+    void Abort()
+    {
+        waitAborted = true;
+        WakeUp();
+    }
+
+    template <typename Done>
+    bool WaitUntil(Done done, int timeoutMs, const QString& timeoutContext)
+    {
+        if (done()) {
+            return true;
         }
-        QTextStream ts(&transcript);
-        ts << direction << text << '\n';
-        ts.flush();
+        if (connection.CurrentState() == ImapConnection::State::Disconnected) {
+            return false;
+        }
+
+        QEventLoop localLoop;
+        loop = &localLoop;
+        waitAborted = false;
+        connection.StartWatchdog(timeoutMs, timeoutContext);
+        while (!done() && !waitAborted) {
+            localLoop.exec();
+        }
+        connection.StopWatchdog();
+        loop = nullptr;
+        return done();
     }
 
-    void SetSocketFailure(const QString& context)
+    bool WaitForResponse(int timeoutMs, const QString& timeoutContext)
     {
-        lastSocketErrorCode = static_cast<int>(socket.error());
-        lastSocketErrorString = socket.errorString();
-        encryptedReached = socket.isEncrypted();
-        lastError = QString("%1; socket_error=%2; socket_error_string=%3; encrypted=%4")
-                        .arg(context)
-                        .arg(lastSocketErrorCode)
-                        .arg(lastSocketErrorString)
-                        .arg(encryptedReached ? "true" : "false");
-        LogLine("! ", lastError);
-    }
-
-    void SetTimeoutFailure(const QString& context)
+        ++lineReaders;
+        const bool ok = WaitUntil([this]() { return !responses.isEmpty(); }, timeoutMs, timeoutContext);
+        --lineReaders;
+        return ok;
+    }
+
+    QString TakeLine()
     {
-        lastSocketErrorCode = static_cast<int>(socket.error());
-        lastSocketErrorString = socket.errorString();
-        encryptedReached = socket.isEncrypted();
-        lastError = QString("%1; socket_error=%2; socket_error_string=%3; encrypted=%4")
-                        .arg(context)
-                        .arg(lastSocketErrorCode)
-                        .arg(lastSocketErrorString)
-                        .arg(encryptedReached ? "true" : "false");
-        LogLine("! ", lastError);
+        return QString::fromUtf8(responses.takeFirst()).trimmed();
     }
 };
 
@@ -62,77 +117,59 @@ ImapClient::~ImapClient() = default;
 
 bool ImapClient::Connect(const QString& host, int port, bool tls, const QString& transcriptPath)
 {
-    impl_->lastError.clear();
-    impl_->lastSocketErrorCode = static_cast<int>(QAbstractSocket::UnknownSocketError);
-    impl_->lastSocketErrorString.clear();
-    impl_->encryptedReached = false;
-    impl_->transcript.setFileName(transcriptPath);
-    if (!impl_->transcript.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
-        impl_->lastError = QStringLiteral("failed to open transcript");
+    impl_->responses.clear();
+    impl_->dirty = false;
+    if (!impl_->connection.OpenTranscript(transcriptPath)) {
+        impl_->connection.RecordFailure(QStringLiteral("failed to open transcript"));
         return false;
     }
 
-    if (tls) {
-        impl_->socket.connectToHostEncrypted(host, static_cast<quint16>(port));
-        if (!impl_->socket.waitForEncrypted(10000)) {
-            impl_->SetSocketFailure(QStringLiteral("connectToHostEncrypted failed"));
-            return false;
-        }
-        impl_->encryptedReached = impl_->socket.isEncrypted();
-    } else {
-        impl_->socket.connectToHost(host, static_cast<quint16>(port));
-        if (!impl_->socket.waitForConnected(10000)) {
-            impl_->SetSocketFailure(QStringLiteral("connectToHost failed"));
-            return false;
-        }
-    }
-
-    impl_->LogLine("I ", QString("CONNECTED %1:%2 tls=%3").arg(host).arg(port).arg(tls ? "true" : "false"));
-    return true;
+    impl_->connection.Open(host, port, tls);
+    const bool connected = impl_->WaitUntil(
+        [this]() { return impl_->connection.CurrentState() == ImapConnection::State::Connected; },
+        10000,
+        tls ? QStringLiteral("connectToHostEncrypted failed") : QStringLiteral("connectToHost failed"));
+    return connected;
 }
 
 void ImapClient::Disconnect()
 {
-    if (impl_->socket.state() != QAbstractSocket::UnconnectedState) {
-        impl_->socket.disconnectFromHost();
-        impl_->socket.waitForDisconnected(2000);
+    if (impl_->connection.CurrentState() != ImapConnection::State::Disconnected) {
+        impl_->connection.Close();
+        impl_->WaitUntil(
+            [this]() { return impl_->connection.CurrentState() == ImapConnection::State::Disconnected; },
+            2000,
+            QStringLiteral("timeout waiting for disconnect"));
     }
-    if (impl_->transcript.isOpen()) {
-        impl_->transcript.close();
-    }
-}
-
-static bool WriteLineWithCrlf(QSslSocket& sock, const QString& line, int timeoutMs)
-{
-    QString out = line;
-    if (!out.endsWith("\r\n")) {
-        out += "\r\n";
-    }
-    const QByteArray bytes = out.toUtf8();
-    const qint64 wrote = sock.write(bytes);
-    if (wrote != bytes.size()) {
-        return false;
-    }
-    return sock.waitForBytesWritten(timeoutMs);
+    const ImapWireStats stats = impl_->connection.WireStats();
+    impl_->connection.LogLine("I ", QString("WIRE compressed=%1 wire_in=%2 wire_out=%3 protocol_in=%4 protocol_out=%5 inflate_ms=%6 deflate_ms=%7")
+                                        .arg(stats.compressed ? "true" : "false")
+                                        .arg(stats.wireBytesIn)
+                                        .arg(stats.wireBytesOut)
+                                        .arg(stats.protocolBytesIn)
+                                        .arg(stats.protocolBytesOut)
+                                        .arg(stats.inflateNs / 1e6, 0, 'f', 2)
+                                        .arg(stats.deflateNs / 1e6, 0, 'f', 2));
+    impl_->connection.CloseTranscript();
 }
 
 bool ImapClient::SendCommand(const QString& taggedCommand, const QString& redactedCommand)
 {
-    if (!WriteLineWithCrlf(impl_->socket, taggedCommand, 5000)) {
-        impl_->SetSocketFailure(QStringLiteral("write command failed"));
+    if (!impl_->connection.Send(taggedCommand.toUtf8())) {
+        impl_->connection.RecordFailure(QStringLiteral("write command failed"));
         return false;
     }
 
     const QString logged = redactedCommand.isEmpty() ? taggedCommand : redactedCommand;
-    impl_->LogLine("C ", logged);
+    impl_->connection.LogLine("C ", logged);
     return true;
 }
 
 bool ImapClient::SendRawLine(const QString& line, const QString& redactedLine)
 {
     // This is used for SASL continuation responses (untagged).
-    if (!WriteLineWithCrlf(impl_->socket, line, 5000)) {
-        impl_->SetSocketFailure(QStringLiteral("write raw line failed"));
+    if (!impl_->connection.Send(line.toUtf8())) {
+        impl_->connection.RecordFailure(QStringLiteral("write raw line failed"));
         return false;
     }
 
@@ -146,43 +183,165 @@ bool ImapClient::SendRawLine(const QString& line, const QString& redactedLine)
         logged = line;
     }
 
-    impl_->LogLine("C ", logged);
+    impl_->connection.LogLine("C ", logged);
     return true;
 }
 
 QString ImapClient::ReadLine(int timeoutMs)
 {
-    if (!impl_->socket.canReadLine() && !impl_->socket.waitForReadyRead(timeoutMs)) {
-        impl_->SetTimeoutFailure(QStringLiteral("timeout waiting for IMAP line"));
+    if (!impl_->WaitForResponse(timeoutMs, QStringLiteral("timeout waiting for IMAP line"))) {
         return QString();
     }
-
-    const QString line = QString::fromUtf8(impl_->socket.readLine()).trimmed();
-    if (!line.isEmpty()) {
-        impl_->LogLine("S ", line);
-    }
-    return line;
+    return impl_->TakeLine();
 }
 
 QString ImapClient::ReadGreeting()
 {
-    if (!impl_->socket.waitForReadyRead(10000)) {
-        impl_->lastSocketErrorCode = static_cast<int>(impl_->socket.error());
-        impl_->lastSocketErrorString = impl_->socket.errorString();
-        impl_->encryptedReached = impl_->socket.isEncrypted();
-        impl_->lastError = QStringLiteral("timeout waiting for greeting; socket_error=%1; socket_error_string=%2; encrypted=%3")
-                              .arg(impl_->lastSocketErrorCode)
-                              .arg(impl_->lastSocketErrorString)
-                              .arg(impl_->encryptedReached ? "true" : "false");
-        impl_->LogLine("! ", impl_->lastError);
+    if (!impl_->WaitForResponse(10000, QStringLiteral("timeout waiting for greeting"))) {
         return QString();
     }
+    return impl_->TakeLine();
+}
+
+QString ImapClient::NextTag()
+{
+    return impl_->dispatcher.NextTag();
+}
+
+QString ImapClient::Submit(const QString& command, const QStringList& collect, const QString& redactedCommand)
+{
+    return SubmitStreaming(command, collect, nullptr, redactedCommand);
+}
+
+QString ImapClient::SubmitStreaming(const QString& command,
+                                    const QStringList& collect,
+                                    std::function<void(QByteArrayView response)> onUntagged,
+                                    const QString& redactedCommand)
+{
+    ImapCommand cmd;
+    cmd.onUntagged = std::move(onUntagged);
+    cmd.redacted = redactedCommand;
+    return SubmitCommand(std::move(cmd), command, collect);
+}
+
+QString ImapClient::SubmitSpooled(const QString& command,
+                                  const QStringList& collect,
+                                  ImapLiteralSinkFactory literalSink,
+                                  std::function<void(QByteArrayView response)> onUntagged)
+{
+    ImapCommand cmd;
+    cmd.onUntagged = std::move(onUntagged);
+    cmd.literalSink = std::move(literalSink);
+    return SubmitCommand(std::move(cmd), command, collect);
+}
 
-    const QString line = QString::fromUtf8(impl_->socket.readLine()).trimmed();
-    if (!line.isEmpty()) {
-        impl_->LogLine("S ", line);
+QString ImapClient::SubmitCommand(ImapCommand cmd, const QString& command, const QStringList& collect)
+{
+    cmd.text = command.toUtf8();
+    for (const QString& keyword : collect) {
+        cmd.collects.push_back(keyword.toUpper().toLatin1());
     }
-    return line;
+    Impl* impl = impl_.get();
+    cmd.onComplete = [impl](const ImapCommandResult& result) {
+        QStringList lines;
+        lines.reserve(result.untagged.size() + 1);
+        for (const QByteArray& line : result.untagged) {
+            lines.push_back(QString::fromUtf8(line).trimmed());
+        }
+        if (!result.taggedLine.isEmpty()) {
+            lines.push_back(QString::fromUtf8(result.taggedLine).trimmed());
+        }
+        impl->completed.insert(result.tag, lines);
+        impl->WakeUp();
+    };
+    return impl_->dispatcher.Submit(std::move(cmd));
+}
+
+QStringList ImapClient::Await(const QString& tag, int timeoutMs)
+{
+    if (!impl_->WaitUntil([this, &tag]() { return impl_->completed.contains(tag); },
+                          timeoutMs,
+                          QStringLiteral("timeout waiting for IMAP response"))) {
+        // The caller's handlers and sinks may go away once this returns.
+        impl_->dispatcher.Abandon(tag);
+        impl_->dirty = true;
+        return {};
+    }
+    return impl_->completed.take(tag);
+}
+
+void ImapClient::OnUntagged(const QString& keyword, std::function<void(const QString& line)> handler)
+{
+    if (!handler) {
+        impl_->dispatcher.OnUntagged(keyword.toLatin1(), nullptr);
+        return;
+    }
+    impl_->dispatcher.OnUntagged(keyword.toLatin1(), [handler = std::move(handler)](QByteArrayView response) {
+        handler(QString::fromUtf8(response).trimmed());
+    });
+}
+
+bool ImapClient::StartIdle(std::function<void()> onIdling, std::function<void(bool ok)> onDone)
+{
+    if (!IsConnected() || impl_->idlePending) {
+        return false;
+    }
+
+    ImapCommand cmd;
+    cmd.text = "IDLE";
+    Impl* impl = impl_.get();
+    cmd.onContinuation = [impl, onIdling = std::move(onIdling)](QByteArrayView) {
+        if (impl->idling) {
+            return;
+        }
+        impl->idling = true;
+        impl->WakeUp();
+        if (onIdling) {
+            onIdling();
+        }
+    };
+    cmd.onComplete = [impl, onDone = std::move(onDone)](const ImapCommandResult& result) {
+        impl->idlePending = false;
+        impl->idling = false;
+        impl->idleOk = result.Ok();
+        impl->WakeUp();
+        if (onDone) {
+            onDone(result.Ok());
+        }
+    };
+    // Set before Submit: a failed send completes the command synchronously.
+    impl_->idlePending = true;
+    impl_->idleOk = false;
+    impl_->dispatcher.Submit(std::move(cmd));
+    return impl_->idlePending;
+}
+
+bool ImapClient::StopIdle(int timeoutMs)
+{
+    if (!impl_->idlePending) {
+        return impl_->idleOk;
+    }
+    // DONE is only valid after the continuation; before it the server would take it as a command.
+    impl_->WaitUntil([this]() { return impl_->idling || !impl_->idlePending; },
+                     timeoutMs,
+                     QStringLiteral("timeout waiting for IDLE continuation"));
+    if (impl_->idlePending && (!impl_->idling || !SendRawLine(QStringLiteral("DONE")))) {
+        return false;
+    }
+    impl_->WaitUntil([this]() { return !impl_->idlePending; },
+                     timeoutMs,
+                     QStringLiteral("timeout waiting for IDLE completion"));
+    return !impl_->idlePending && impl_->idleOk;
+}
+
+bool ImapClient::IsIdling() const
+{
+    return impl_->idling;
+}
+
+bool ImapClient::IsDirty() const
+{
+    return impl_->dirty || impl_->idlePending || !impl_->dispatcher.Idle();
 }
 
 QStringList ImapClient::ReadResponseUntilTag(const QString& tag)
@@ -190,25 +349,12 @@ QStringList ImapClient::ReadResponseUntilTag(const QString& tag)
     QStringList lines;
     const QString tagPrefix = tag + ' ';
 
-    while (true) {
-        if (!impl_->socket.waitForReadyRead(10000)) {
-            impl_->lastSocketErrorCode = static_cast<int>(impl_->socket.error());
-            impl_->lastSocketErrorString = impl_->socket.errorString();
-            impl_->encryptedReached = impl_->socket.isEncrypted();
-            impl_->lastError = QStringLiteral("timeout waiting for IMAP response; socket_error=%1; socket_error_string=%2; encrypted=%3")
-                                  .arg(impl_->lastSocketErrorCode)
-                                  .arg(impl_->lastSocketErrorString)
-                                  .arg(impl_->encryptedReached ? "true" : "false");
-            impl_->LogLine("! ", impl_->lastError);
-            break;
-        }
-
-        while (impl_->socket.canReadLine()) {
-            const QString line = QString::fromUtf8(impl_->socket.readLine()).trimmed();
+    while (impl_->WaitForResponse(10000, QStringLiteral("timeout waiting for IMAP response"))) {
+        while (!impl_->responses.isEmpty()) {
+            const QString line = impl_->TakeLine();
             if (line.isEmpty()) {
                 continue;
             }
-            impl_->LogLine("S ", line);
             lines.push_back(line);
 
             if (line.startsWith(tagPrefix, Qt::CaseInsensitive)) {
@@ -217,27 +363,96 @@ QStringList ImapClient::ReadResponseUntilTag(const QString& tag)
         }
     }
 
+    impl_->dirty = true;
     return lines;
 }
 
+bool ImapClient::IsConnected() const
+{
+    return impl_->connection.CurrentState() == ImapConnection::State::Connected;
+}
+
+bool ImapClient::EnableCompression(QString& outError)
+{
+    if (impl_->connection.Compressed()) {
+        return true;
+    }
+    if (!ImapDeflate::Available()) {
+        outError = QStringLiteral("COMPRESS unavailable: built without zlib");
+        return false;
+    }
+
+    struct CompressState {
+        bool done = false;
+        bool ok = false;
+        QString error;
+    };
+    // Shared so a late completion after a timeout does not touch this stack frame.
+    auto state = std::make_shared<CompressState>();
+    ImapCommand cmd;
+    cmd.text = "COMPRESS DEFLATE";
+    Impl* impl = impl_.get();
+    cmd.onComplete = [impl, state](const ImapCommandResult& result) {
+        // Runs inside delivery of the tagged OK, before any later byte is framed.
+        if (!result.Ok()) {
+            state->error = QString("COMPRESS rejected: %1").arg(QString::fromUtf8(result.taggedLine));
+        } else {
+            state->ok = impl->connection.StartCompression(state->error);
+        }
+        state->done = true;
+        impl->WakeUp();
+    };
+    impl_->dispatcher.Submit(std::move(cmd));
+    if (!impl_->WaitUntil([&state]() { return state->done; }, 10000, QStringLiteral("timeout waiting for COMPRESS"))) {
+        impl_->dirty = true;
+        outError = impl_->connection.LastError();
+        return false;
+    }
+    outError = state->error;
+    return state->ok;
+}
+
+ImapWireStats ImapClient::WireStats() const
+{
+    return impl_->connection.WireStats();
+}
+
+void ImapClient::DetachFromThread()
+{
+    impl_->connection.moveToThread(nullptr);
+}
+
+void ImapClient::AttachToCurrentThread()
+{
+    if (impl_->connection.thread() != QThread::currentThread()) {
+        // Objects without thread affinity may be pulled into the calling thread.
+        impl_->connection.moveToThread(QThread::currentThread());
+    }
+}
+
+void ImapClient::ClearResponses()
+{
+    impl_->responses.clear();
+}
+
 QString ImapClient::LastError() const
 {
-    return impl_->lastError;
+    return impl_->connection.LastError();
 }
 
 int ImapClient::LastSocketErrorCode() const
 {
-    return impl_->lastSocketErrorCode;
+    return impl_->connection.LastSocketErrorCode();
 }
 
 QString ImapClient::LastSocketErrorString() const
 {
-    return impl_->lastSocketErrorString;
+    return impl_->connection.LastSocketErrorString();
 }
 
 bool ImapClient::WasEncrypted() const
 {
-    return impl_->encryptedReached;
+    return impl_->connection.WasEncrypted();
 }
 
 }
@@ -1,11 +1,20 @@
 #pragma once
 
+#include <QByteArrayView>
 #include <QString>
 #include <QStringList>
+#include <functional>
 #include <memory>
 
+#include "core/mail/providers/imap/ImapLiteralSink.h"
+
 namespace ngks::core::mail::providers::imap {
 
+struct ImapCommand;
+struct ImapWireStats;
+
+// Blocking IMAP client used by the CLI paths. It is a thin wrapper over the non-blocking
+// ImapConnection: every call runs a local event loop until its result is available.
 class ImapClient {
 public:
     ImapClient();
@@ -29,12 +38,79 @@ public:
 
     QString ReadGreeting();
 
+    // Allocates the next command tag ("A001", ...). Use for commands sent with SendCommand.
+    QString NextTag();
+
+    // Pipelined path: queues a command (without tag) and returns its tag immediately.
+    // Several commands may be outstanding; untagged responses whose keyword is in collect are
+    // attributed to the oldest outstanding command collecting it. AUTHENTICATE/SELECT and other
+    // state-changing verbs wait for the pipe to drain and block later commands until they finish.
+    QString Submit(const QString& command, const QStringList& collect = {}, const QString& redactedCommand = QString());
+
+    // Like Submit, but collected untagged responses are handed to onUntagged as views into the
+    // receive buffer (valid only during the call) instead of being converted and buffered.
+    // Await then returns only the tagged line.
+    QString SubmitStreaming(const QString& command,
+                            const QStringList& collect,
+                            std::function<void(QByteArrayView response)> onUntagged,
+                            const QString& redactedCommand = QString());
+
+    // Like SubmitStreaming, and every literal inside a collected response is offered to
+    // literalSink first: the octets of literals it accepts are streamed into the returned sink in
+    // fixed-size chunks and the response shows "{n!}" instead (ImapFetchSection::spooled).
+    // Sinks must stay alive until the command completes or Await gives up on it.
+    QString SubmitSpooled(const QString& command,
+                          const QStringList& collect,
+                          ImapLiteralSinkFactory literalSink,
+                          std::function<void(QByteArrayView response)> onUntagged);
+
+    // Waits for the tagged completion of a submitted command. Returns its attributed untagged
+    // lines followed by the tagged line (trimmed); the tagged line is missing on failure/timeout.
+    // After a timeout the command's handlers and literal sinks are no longer called.
+    QStringList Await(const QString& tag, int timeoutMs = 10000);
+
+    // Receives untagged responses of the given keyword that no outstanding command collects.
+    // An empty handler unregisters the keyword.
+    void OnUntagged(const QString& keyword, std::function<void(const QString& line)> handler);
+
+    // IDLE (RFC 2177) without blocking: onIdling runs once the server accepts, untagged
+    // responses meanwhile go to the OnUntagged handlers, and onDone runs with the tagged result
+    // after StopIdle or when the connection drops. Returns false if not connected or already idling.
+    bool StartIdle(std::function<void()> onIdling, std::function<void(bool ok)> onDone);
+    // Sends DONE and waits for the IDLE command to complete. Returns its tagged OK.
+    bool StopIdle(int timeoutMs = 10000);
+    bool IsIdling() const;
+
+    // True once a command was given up on (Await or ReadResponseUntilTag timed out, IDLE or
+    // COMPRESS never completed) or is still outstanding. Its responses may still arrive, so
+    // the connection cannot be handed to another caller as it is.
+    bool IsDirty() const;
+
+    bool IsConnected() const;
+
+    // Sends COMPRESS DEFLATE and switches the connection over on the tagged OK (RFC 4978).
+    // Callers check the COMPRESS=DEFLATE capability first.
+    bool EnableCompression(QString& outError);
+    // Wire vs. protocol bytes and inflate/deflate CPU time; also written to the transcript on
+    // Disconnect.
+    ImapWireStats WireStats() const;
+
+    // Thread handoff for pooled sessions: an idle client is detached from its thread and the next
+    // user pulls it into theirs. Only valid between calls, never while a command is outstanding.
+    void DetachFromThread();
+    void AttachToCurrentThread();
+    // Drops the lines queued for ReadLine that nobody read, so the next user of a pooled
+    // session does not see them.
+    void ClearResponses();
+
     QString LastError() const;
     int LastSocketErrorCode() const;
     QString LastSocketErrorString() const;
     bool WasEncrypted() const;
 
 private:
+    QString SubmitCommand(ImapCommand cmd, const QString& command, const QStringList& collect);
+
     class Impl;
     std::unique_ptr<Impl> impl_;
 };
@@ -0,0 +1,281 @@
+#include "core/mail/providers/imap/ImapCommandDispatcher.h"
+
+#include "core/mail/providers/imap/ImapConnection.h"
+
+namespace ngks::core::mail::providers::imap {
+
+namespace {
+
+QByteArrayView NextWord(QByteArrayView text, qsizetype& pos)
+{
+    while (pos < text.size() && text[pos] == ' ') {
+        ++pos;
+    }
+    const qsizetype start = pos;
+    while (pos < text.size() && text[pos] != ' ') {
+        ++pos;
+    }
+    return text.sliced(start, pos - start);
+}
+
+bool IsNumber(QByteArrayView word)
+{
+    if (word.isEmpty()) {
+        return false;
+    }
+    for (const char c : word) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+ImapCommandDispatcher::ImapCommandDispatcher(ImapConnection& connection)
+    : connection_(connection)
+{
+    connection_.SetLiteralSinkFactory([this](QByteArrayView responsePrefix, qint64 size) {
+        return LiteralSinkFor(responsePrefix, size);
+    });
+}
+
+QString ImapCommandDispatcher::Submit(ImapCommand command)
+{
+    Pending pending;
+    pending.tag = NextTag();
+    pending.wireTag = pending.tag.toLatin1();
+    pending.barrier = command.barrier || IsBarrierVerb(command.text);
+    pending.result.tag = pending.tag;
+    pending.command = std::move(command);
+    const QString tag = pending.tag;
+    queued_.push_back(std::move(pending));
+    Pump();
+    return tag;
+}
+
+void ImapCommandDispatcher::OnUntagged(const QByteArray& keyword, UntaggedHandler handler)
+{
+    if (!handler) {
+        untaggedHandlers_.remove(keyword.toUpper());
+        return;
+    }
+    untaggedHandlers_.insert(keyword.toUpper(), std::move(handler));
+}
+
+void ImapCommandDispatcher::OnUnsolicited(UntaggedHandler handler)
+{
+    unsolicited_ = std::move(handler);
+}
+
+bool ImapCommandDispatcher::HandleResponse(QByteArrayView response)
+{
+    if (response.startsWith('+')) {
+        for (auto& pending : inFlight_) {
+            if (pending.command.onContinuation) {
+                auto onContinuation = pending.command.onContinuation;
+                onContinuation(response);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    if (response.startsWith("* ")) {
+        const QByteArray keyword = UntaggedKeyword(response);
+        if (Pending* pending = CollectorFor(keyword)) {
+            if (pending->abandoned) {
+                return true;
+            }
+            if (pending->command.onUntagged) {
+                pending->command.onUntagged(response);
+            } else {
+                pending->result.untagged.push_back(response.toByteArray());
+            }
+            return true;
+        }
+        const auto handler = untaggedHandlers_.constFind(keyword);
+        if (handler != untaggedHandlers_.constEnd()) {
+            auto fn = handler.value();
+            fn(response);
+            return true;
+        }
+        if (unsolicited_) {
+            unsolicited_(response);
+            return true;
+        }
+        return false;
+    }
+
+    qsizetype pos = 0;
+    const QByteArrayView tag = NextWord(response, pos);
+    for (auto it = inFlight_.begin(); it != inFlight_.end(); ++it) {
+        if (QByteArrayView(it->wireTag).compare(tag, Qt::CaseInsensitive) == 0) {
+            Complete(it, response);
+            return true;
+        }
+    }
+    return false;
+}
+
+ImapLiteralSink* ImapCommandDispatcher::LiteralSinkFor(QByteArrayView responsePrefix, qint64 size)
+{
+    if (!responsePrefix.startsWith("* ")) {
+        return nullptr;
+    }
+    Pending* pending = CollectorFor(UntaggedKeyword(responsePrefix));
+    if (pending != nullptr && pending->abandoned) {
+        return &discard_;
+    }
+    if (pending == nullptr || !pending->command.literalSink) {
+        return nullptr;
+    }
+    pending->sink = pending->command.literalSink(responsePrefix, size);
+    return pending->sink;
+}
+
+void ImapCommandDispatcher::FailAll()
+{
+    // Whatever literal is streaming belongs to one of these commands.
+    connection_.AbortLiteral();
+    std::deque<Pending> failed;
+    for (auto& pending : inFlight_) {
+        failed.push_back(std::move(pending));
+    }
+    for (auto& pending : queued_) {
+        failed.push_back(std::move(pending));
+    }
+    inFlight_.clear();
+    queued_.clear();
+
+    for (auto& pending : failed) {
+        if (pending.command.onComplete) {
+            pending.command.onComplete(pending.result);
+        }
+    }
+}
+
+void ImapCommandDispatcher::Abandon(const QString& tag)
+{
+    for (auto* pipe : {&inFlight_, &queued_}) {
+        for (auto& pending : *pipe) {
+            if (pending.tag != tag) {
+                continue;
+            }
+            if (pending.sink != nullptr) {
+                connection_.AbortLiteral(pending.sink);
+                pending.sink = nullptr;
+            }
+            pending.abandoned = true;
+            pending.command.onUntagged = nullptr;
+            pending.command.literalSink = nullptr;
+            pending.command.onContinuation = nullptr;
+            pending.command.onComplete = nullptr;
+            pending.result.untagged.clear();
+            return;
+        }
+    }
+}
+
+QString ImapCommandDispatcher::NextTag()
+{
+    return QString("A%1").arg(nextTag_++, 3, 10, QChar('0'));
+}
+
+bool ImapCommandDispatcher::Idle() const
+{
+    return queued_.empty() && inFlight_.empty();
+}
+
+int ImapCommandDispatcher::InFlightCount() const
+{
+    return static_cast<int>(inFlight_.size());
+}
+
+bool ImapCommandDispatcher::IsBarrierVerb(QByteArrayView commandText)
+{
+    qsizetype pos = 0;
+    QByteArrayView verb = NextWord(commandText, pos);
+    if (verb.compare(QByteArrayView("UID"), Qt::CaseInsensitive) == 0) {
+        return false;
+    }
+    static const char* const kBarriers[] = {
+        "AUTHENTICATE", "LOGIN", "STARTTLS", "COMPRESS", "ENABLE",
+        "SELECT", "EXAMINE", "CLOSE", "UNSELECT", "IDLE"
+    };
+    for (const char* barrier : kBarriers) {
+        if (verb.compare(QByteArrayView(barrier), Qt::CaseInsensitive) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+QByteArray ImapCommandDispatcher::UntaggedKeyword(QByteArrayView response)
+{
+    qsizetype pos = 0;
+    NextWord(response, pos); // "*"
+    QByteArrayView word = NextWord(response, pos);
+    if (IsNumber(word)) {
+        word = NextWord(response, pos);
+    }
+    return word.toByteArray().toUpper();
+}
+
+void ImapCommandDispatcher::Pump()
+{
+    while (!queued_.empty()) {
+        if (!inFlight_.empty() && inFlight_.back().barrier) {
+            return;
+        }
+        Pending& next = queued_.front();
+        if (next.barrier && !inFlight_.empty()) {
+            return;
+        }
+
+        const QByteArray line = next.wireTag + ' ' + next.command.text;
+        if (!connection_.Send(line)) {
+            connection_.RecordFailure(QStringLiteral("write command failed"));
+            FailAll();
+            return;
+        }
+        if (connection_.TranscriptEnabled()) {
+            const QString logged = next.command.redacted.isEmpty()
+                ? QString::fromUtf8(line)
+                : QString("%1 %2").arg(next.tag, next.command.redacted);
+            connection_.LogLine("C ", logged);
+        }
+
+        inFlight_.push_back(std::move(next));
+        queued_.pop_front();
+    }
+}
+
+ImapCommandDispatcher::Pending* ImapCommandDispatcher::CollectorFor(const QByteArray& keyword)
+{
+    for (auto& pending : inFlight_) {
+        if (pending.command.collects.contains(keyword)) {
+            return &pending;
+        }
+    }
+    return nullptr;
+}
+
+void ImapCommandDispatcher::Complete(std::deque<Pending>::iterator it, QByteArrayView taggedLine)
+{
+    Pending done = std::move(*it);
+    inFlight_.erase(it);
+
+    qsizetype pos = 0;
+    NextWord(taggedLine, pos);
+    done.result.status = NextWord(taggedLine, pos).toByteArray().toUpper();
+    done.result.taggedLine = taggedLine.toByteArray();
+
+    if (done.command.onComplete) {
+        done.command.onComplete(done.result);
+    }
+    Pump();
+}
+
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <deque>
+#include <functional>
+
+#include "core/mail/providers/imap/ImapLiteralSink.h"
+
+namespace ngks::core::mail::providers::imap {
+
+class ImapConnection;
+
+struct ImapCommandResult {
+    QString tag;
+    // "OK", "NO" or "BAD"; empty when the connection failed before completion.
+    QByteArray status;
+    QByteArray taggedLine;
+    // Untagged responses attributed to this command, in arrival order.
+    QList<QByteArray> untagged;
+
+    bool Ok() const { return status == "OK"; }
+};
+
+struct ImapCommand {
+    // Command text without the tag, e.g. "LIST \"\" \"*\"".
+    QByteArray text;
+    // Transcript form of text when it carries secrets; empty logs text as-is.
+    QString redacted;
+    // Untagged keywords (upper case) this command consumes, e.g. "LIST", "CAPABILITY".
+    QList<QByteArray> collects;
+    // When set, collected untagged responses are streamed here as views into the receive
+    // buffer instead of being copied into the result.
+    std::function<void(QByteArrayView response)> onUntagged;
+    // When set, literals inside collected responses may be spooled (e.g. FETCH BODY[] to disk).
+    ImapLiteralSinkFactory literalSink;
+    // Forces barrier semantics; state-changing verbs are detected automatically.
+    bool barrier = false;
+    std::function<void(QByteArrayView continuation)> onContinuation;
+    std::function<void(const ImapCommandResult& result)> onComplete;
+};
+
+// Tag-based demultiplexer that lets several commands be in flight on one connection.
+// Untagged data is attributed to the oldest in-flight command that collects its keyword
+// (servers answer pipelined commands in order); anything unclaimed goes to the handlers
+// registered with OnUntagged, and failing those to OnUnsolicited. Barrier commands
+// (AUTHENTICATE, SELECT, ...) are only sent once the pipe is empty and hold back everything
+// queued behind them until they complete.
+// The dispatcher installs itself as the connection's literal sink factory.
+class ImapCommandDispatcher {
+public:
+    using UntaggedHandler = std::function<void(QByteArrayView response)>;
+
+    explicit ImapCommandDispatcher(ImapConnection& connection);
+
+    // Allocates a tag, queues the command and sends it as soon as ordering allows.
+    QString Submit(ImapCommand command);
+
+    // An empty handler removes the keyword's handler.
+    void OnUntagged(const QByteArray& keyword, UntaggedHandler handler);
+    // Untagged responses with no collector and no keyword handler, e.g. an EXISTS or EXPUNGE
+    // the server sends while commands are in flight.
+    void OnUnsolicited(UntaggedHandler handler);
+
+    // Feeds one framed server response. Returns false if nothing claimed it.
+    bool HandleResponse(QByteArrayView response);
+    // Asks the command that will receive this response for a sink; nullptr keeps it inline.
+    ImapLiteralSink* LiteralSinkFor(QByteArrayView responsePrefix, qint64 size);
+
+    // Completes every queued and in-flight command with an empty status.
+    void FailAll();
+    // For a command nobody waits for any more: its callbacks are dropped and a literal
+    // streaming into its sink is aborted. It stays in the pipe, its responses discarded,
+    // until the tagged line arrives, so the commands behind it stay in order.
+    void Abandon(const QString& tag);
+
+    QString NextTag();
+    bool Idle() const;
+    int InFlightCount() const;
+
+    static bool IsBarrierVerb(QByteArrayView commandText);
+    static QByteArray UntaggedKeyword(QByteArrayView response);
+
+private:
+    struct Pending {
+        QString tag;
+        QByteArray wireTag;
+        ImapCommand command;
+        ImapCommandResult result;
+        bool barrier = false;
+        bool abandoned = false;
+        // The sink last handed out for this command; the connection may still be using it.
+        ImapLiteralSink* sink = nullptr;
+    };
+
+    void Pump();
+    Pending* CollectorFor(const QByteArray& keyword);
+    void Complete(std::deque<Pending>::iterator it, QByteArrayView taggedLine);
+
+    ImapConnection& connection_;
+    std::deque<Pending> queued_;
+    std::deque<Pending> inFlight_;
+    QHash<QByteArray, UntaggedHandler> untaggedHandlers_;
+    UntaggedHandler unsolicited_;
+    DiscardLiteralSink discard_;
+    int nextTag_ = 1;
+};
+
+}
@@ -0,0 +1,584 @@
+#include "core/mail/providers/imap/ImapConnection.h"
+
+#include "core/mail/providers/imap/ImapTlsSessionCache.h"
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QIODevice>
+#include <QSslConfiguration>
+#include <QSslSocket>
+#include <QTimer>
+
+namespace ngks::core::mail::providers::imap {
+
+namespace {
+
+// A server line that never ends is a broken or hostile peer; do not buffer it forever.
+constexpr qsizetype kMaxLineBytes = 8 * 1024 * 1024;
+
+// Upper bound for one socket read. Together with the socket read buffer limit this caps what
+// a spooled literal costs in memory, regardless of its size.
+constexpr qint64 kReadChunkBytes = 256 * 1024;
+
+// Returns n for a line ending in "{n}" or "{n+}" (before CRLF), otherwise -1.
+qint64 TrailingLiteralSize(QByteArrayView line)
+{
+    qsizetype end = line.size();
+    while (end > 0 && (line[end - 1] == '\n' || line[end - 1] == '\r')) {
+        --end;
+    }
+    if (end < 3 || line[end - 1] != '}') {
+        return -1;
+    }
+    qsizetype pos = end - 2;
+    if (line[pos] == '+') {
+        --pos;
+    }
+    const qsizetype digitsEnd = pos + 1;
+    while (pos >= 0 && line[pos] >= '0' && line[pos] <= '9') {
+        --pos;
+    }
+    // 18 digits always fit in qint64; a longer size is not taken for a literal.
+    const qsizetype digits = digitsEnd - pos - 1;
+    if (digits == 0 || digits > 18 || pos < 0 || line[pos] != '{') {
+        return -1;
+    }
+    qint64 value = 0;
+    for (qsizetype i = pos + 1; i < digitsEnd; ++i) {
+        value = value * 10 + (line[i] - '0');
+    }
+    return value;
+}
+
+}
+
+ImapConnection::ImapConnection(QObject* parent)
+    : QObject(parent)
+    , socket_(new QSslSocket(this))
+    , watchdog_(new QTimer(this))
+{
+    watchdog_->setSingleShot(true);
+    socket_->setReadBufferSize(kReadChunkBytes);
+
+    connect(socket_, &QAbstractSocket::connected, this, &ImapConnection::OnConnected);
+    connect(socket_, &QSslSocket::encrypted, this, &ImapConnection::OnEncrypted);
+    // TLS 1.3 servers issue tickets after the handshake.
+    connect(socket_, &QSslSocket::newSessionTicketReceived, this, &ImapConnection::OnSessionTicket);
+    connect(socket_, &QIODevice::readyRead, this, &ImapConnection::OnReadyRead);
+    connect(socket_, &QIODevice::bytesWritten, this, &ImapConnection::OnBytesWritten);
+    connect(socket_, &QAbstractSocket::errorOccurred, this, &ImapConnection::OnSocketError);
+    connect(socket_, &QAbstractSocket::disconnected, this, &ImapConnection::OnDisconnected);
+    connect(watchdog_, &QTimer::timeout, this, &ImapConnection::OnWatchdog);
+}
+
+ImapConnection::~ImapConnection()
+{
+    AbortLiteral();
+    socket_->abort();
+    CloseTranscript();
+}
+
+void ImapConnection::Open(const QString& host, int port, bool tls)
+{
+    host_ = host;
+    port_ = port;
+    tls_ = tls;
+    lastError_.clear();
+    lastSocketErrorCode_ = static_cast<int>(QAbstractSocket::UnknownSocketError);
+    lastSocketErrorString_.clear();
+    encryptedReached_ = false;
+    AbortLiteral();
+    deflate_.Reset();
+    inflating_ = false;
+    inflatePending_ = false;
+    stats_ = ImapWireStats();
+    rx_.clear();
+    rxPos_ = 0;
+    pending_.clear();
+    literalRemaining_ = 0;
+    literalSpooled_ = false;
+    frame_ = FrameState::Line;
+
+    state_ = State::Connecting;
+    openStartedMs_ = QDateTime::currentMSecsSinceEpoch();
+    if (tls) {
+        // Offer a cached session ticket so the server can skip the full handshake.
+        QSslConfiguration config = socket_->sslConfiguration();
+        config.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+        const QByteArray ticket = ImapTlsSessionCache::Lookup(ImapTlsSessionCache::Key(host, port));
+        config.setSessionTicket(ticket);
+        socket_->setSslConfiguration(config);
+        stats_.tlsResumeOffered = !ticket.isEmpty();
+        socket_->connectToHostEncrypted(host, static_cast<quint16>(port));
+    } else {
+        socket_->connectToHost(host, static_cast<quint16>(port));
+    }
+}
+
+void ImapConnection::Close()
+{
+    StopWatchdog();
+    if (socket_->state() == QAbstractSocket::UnconnectedState) {
+        state_ = State::Disconnected;
+        return;
+    }
+    state_ = State::Closing;
+    socket_->disconnectFromHost();
+}
+
+bool ImapConnection::Send(const QByteArray& line)
+{
+    if (state_ != State::Connected) {
+        return false;
+    }
+    QByteArray out = line;
+    if (!out.endsWith("\r\n")) {
+        out += "\r\n";
+    }
+    stats_.protocolBytesOut += out.size();
+    if (deflate_.Active()) {
+        QElapsedTimer timer;
+        timer.start();
+        QByteArray compressed;
+        const bool ok = deflate_.Compress(out, compressed);
+        stats_.deflateNs += timer.nsecsElapsed();
+        if (!ok) {
+            return false;
+        }
+        out.swap(compressed);
+    }
+    stats_.wireBytesOut += out.size();
+    return socket_->write(out) == out.size();
+}
+
+void ImapConnection::SetResponseHandler(ResponseHandler handler)
+{
+    onResponse_ = std::move(handler);
+}
+
+bool ImapConnection::StartCompression(QString& outError)
+{
+    if (deflate_.Active()) {
+        return true;
+    }
+    if (!deflate_.Start(outError)) {
+        return false;
+    }
+    stats_.compressed = true;
+    // Inbound bytes already buffered past the current response are compressed; Pump switches
+    // over once the response that triggered this call has been delivered.
+    inflatePending_ = true;
+    LogLine("I ", QStringLiteral("COMPRESS=DEFLATE active"));
+    return true;
+}
+
+bool ImapConnection::Compressed() const
+{
+    return deflate_.Active();
+}
+
+ImapWireStats ImapConnection::WireStats() const
+{
+    return stats_;
+}
+
+void ImapConnection::SetLiteralSinkFactory(ImapLiteralSinkFactory factory)
+{
+    literalSinkFactory_ = std::move(factory);
+}
+
+void ImapConnection::StartWatchdog(int timeoutMs, const QString& context)
+{
+    watchdogContext_ = context;
+    watchdog_->start(timeoutMs);
+}
+
+void ImapConnection::StopWatchdog()
+{
+    watchdog_->stop();
+}
+
+bool ImapConnection::OpenTranscript(const QString& path)
+{
+    CloseTranscript();
+    transcript_ = std::make_unique<ngks::core::logging::ProtocolTranscript>();
+    if (!transcript_->Open(std::filesystem::path(path.toStdU16String()))) {
+        transcript_.reset();
+        return false;
+    }
+    return true;
+}
+
+void ImapConnection::CloseTranscript()
+{
+    transcript_.reset();
+}
+
+bool ImapConnection::TranscriptEnabled() const
+{
+    return transcript_ && transcript_->IsOpen();
+}
+
+void ImapConnection::LogLine(const QString& direction, const QString& text)
+{
+    if (!TranscriptEnabled() || direction.isEmpty()) {
+        return;
+    }
+    const QByteArray utf8 = text.toUtf8();
+    transcript_->Append(direction.at(0).toLatin1(), std::string_view(utf8.constData(), utf8.size()));
+}
+
+void ImapConnection::RecordFailure(const QString& context)
+{
+    lastSocketErrorCode_ = static_cast<int>(socket_->error());
+    lastSocketErrorString_ = socket_->errorString();
+    encryptedReached_ = socket_->isEncrypted();
+    lastError_ = QString("%1; socket_error=%2; socket_error_string=%3; encrypted=%4")
+                     .arg(context)
+                     .arg(lastSocketErrorCode_)
+                     .arg(lastSocketErrorString_)
+                     .arg(encryptedReached_ ? "true" : "false");
+    LogLine("! ", lastError_);
+}
+
+ImapConnection::State ImapConnection::CurrentState() const
+{
+    return state_;
+}
+
+QString ImapConnection::Host() const
+{
+    return host_;
+}
+
+int ImapConnection::Port() const
+{
+    return port_;
+}
+
+qint64 ImapConnection::PendingWriteBytes() const
+{
+    return socket_->bytesToWrite();
+}
+
+QString ImapConnection::LastError() const
+{
+    return lastError_;
+}
+
+int ImapConnection::LastSocketErrorCode() const
+{
+    return lastSocketErrorCode_;
+}
+
+QString ImapConnection::LastSocketErrorString() const
+{
+    return lastSocketErrorString_;
+}
+
+bool ImapConnection::WasEncrypted() const
+{
+    return encryptedReached_;
+}
+
+void ImapConnection::OnConnected()
+{
+    if (tls_) {
+        // Wait for the handshake; encrypted() completes the open.
+        return;
+    }
+    state_ = State::Connected;
+    stats_.connectMs = QDateTime::currentMSecsSinceEpoch() - openStartedMs_;
+    LogLine("I ", QString("CONNECTED %1:%2 tls=false connect_ms=%3").arg(host_).arg(port_).arg(stats_.connectMs));
+    emit Opened();
+}
+
+void ImapConnection::OnEncrypted()
+{
+    encryptedReached_ = true;
+    state_ = State::Connected;
+    stats_.connectMs = QDateTime::currentMSecsSinceEpoch() - openStartedMs_;
+    OnSessionTicket();
+    LogLine("I ", QString("CONNECTED %1:%2 tls=true resume_offered=%3 connect_ms=%4")
+                      .arg(host_)
+                      .arg(port_)
+                      .arg(stats_.tlsResumeOffered ? "true" : "false")
+                      .arg(stats_.connectMs));
+    emit Opened();
+}
+
+void ImapConnection::OnSessionTicket()
+{
+    const QSslConfiguration config = socket_->sslConfiguration();
+    ImapTlsSessionCache::Store(ImapTlsSessionCache::Key(host_, port_),
+                               config.sessionTicket(),
+                               config.sessionTicketLifeTimeHint());
+}
+
+void ImapConnection::OnReadyRead()
+{
+    if (watchdog_->isActive()) {
+        watchdog_->start();
+    }
+
+    // Read in bounded chunks and frame each one before reading the next, so a spooled literal
+    // never accumulates in rx_.
+    while (socket_->bytesAvailable() > 0) {
+        const qint64 want = qMin<qint64>(socket_->bytesAvailable(), kReadChunkBytes);
+        if (inflating_) {
+            wire_.resize(want);
+            const qint64 got = socket_->read(wire_.data(), want);
+            if (got <= 0) {
+                return;
+            }
+            stats_.wireBytesIn += got;
+            AppendInflated(QByteArrayView(wire_.constData(), got));
+        } else {
+            // Compact before growing so the buffer stays proportional to one unframed tail.
+            if (rxPos_ > 0) {
+                rx_.remove(0, rxPos_);
+                rxPos_ = 0;
+            }
+
+            const qsizetype oldSize = rx_.size();
+            rx_.resize(oldSize + want);
+            const qint64 got = socket_->read(rx_.data() + oldSize, want);
+            rx_.resize(oldSize + qMax<qint64>(got, 0));
+            if (got <= 0) {
+                return;
+            }
+            stats_.wireBytesIn += got;
+            stats_.protocolBytesIn += got;
+            Pump();
+        }
+
+        if (socket_->state() == QAbstractSocket::UnconnectedState) {
+            return;
+        }
+    }
+}
+
+void ImapConnection::AppendInflated(QByteArrayView compressed)
+{
+    // Inflate in bounded output blocks and frame each block before producing the next, so the
+    // expansion ratio cannot grow rx_ beyond one chunk plus an unframed tail.
+    qsizetype offset = 0;
+    qsizetype produced = 0;
+    do {
+        if (rxPos_ > 0) {
+            rx_.remove(0, rxPos_);
+            rxPos_ = 0;
+        }
+        const qsizetype oldSize = rx_.size();
+        rx_.resize(oldSize + kReadChunkBytes);
+        qsizetype consumed = 0;
+        QElapsedTimer timer;
+        timer.start();
+        const bool ok = deflate_.Decompress(compressed.sliced(offset), rx_.data() + oldSize, kReadChunkBytes,
+                                            consumed, produced);
+        stats_.inflateNs += timer.nsecsElapsed();
+        rx_.resize(oldSize + produced);
+        // A pass that neither reads nor writes while input is left would repeat forever.
+        const bool stalled = consumed == 0 && produced == 0 && offset < compressed.size();
+        if (!ok || stalled) {
+            RecordFailure(ok ? QStringLiteral("inflate made no progress") : deflate_.LastError());
+            socket_->abort();
+            emit Failed(lastError_);
+            return;
+        }
+        offset += consumed;
+        stats_.protocolBytesIn += produced;
+        Pump();
+    } while (offset < compressed.size() || produced == kReadChunkBytes);
+}
+
+void ImapConnection::ActivateInflate()
+{
+    inflatePending_ = false;
+    inflating_ = true;
+    const QByteArray tail = rx_.mid(rxPos_);
+    stats_.protocolBytesIn -= tail.size();
+    rx_.clear();
+    rxPos_ = 0;
+    if (!tail.isEmpty()) {
+        AppendInflated(tail);
+    }
+}
+
+void ImapConnection::OnBytesWritten(qint64 bytes)
+{
+    Q_UNUSED(bytes);
+    if (socket_->bytesToWrite() == 0) {
+        emit Drained();
+    }
+}
+
+void ImapConnection::OnSocketError()
+{
+    if (state_ == State::Closing && socket_->error() == QAbstractSocket::RemoteHostClosedError) {
+        return;
+    }
+
+    QString context = QStringLiteral("socket error");
+    if (state_ == State::Connecting) {
+        context = tls_ ? QStringLiteral("connectToHostEncrypted failed") : QStringLiteral("connectToHost failed");
+        if (stats_.tlsResumeOffered) {
+            // Do not offer a ticket the server may have choked on again.
+            ImapTlsSessionCache::Forget(ImapTlsSessionCache::Key(host_, port_));
+        }
+    }
+    StopWatchdog();
+    RecordFailure(context);
+    if (socket_->state() == QAbstractSocket::UnconnectedState) {
+        state_ = State::Disconnected;
+    }
+    emit Failed(lastError_);
+}
+
+void ImapConnection::OnDisconnected()
+{
+    StopWatchdog();
+    AbortLiteral();
+    state_ = State::Disconnected;
+    emit Closed();
+}
+
+void ImapConnection::OnWatchdog()
+{
+    RecordFailure(watchdogContext_);
+    emit TimedOut(lastError_);
+}
+
+void ImapConnection::Pump()
+{
+    while (rxPos_ < rx_.size()) {
+        if (inflatePending_) {
+            ActivateInflate();
+            return;
+        }
+        if (frame_ == FrameState::Literal) {
+            const qint64 take = qMin<qint64>(literalRemaining_, rx_.size() - rxPos_);
+            const QByteArrayView chunk(rx_.constData() + rxPos_, take);
+            if (!literalSpooled_) {
+                pending_.append(chunk.data(), chunk.size());
+            } else if (literalSink_ != nullptr && !literalSinkFailed_ && !literalSink_->Write(chunk)) {
+                // Keep consuming the octets so framing survives; the response still arrives.
+                literalSinkFailed_ = true;
+                LogLine("! ", QString("literal sink write failed: %1").arg(literalSink_->Error()));
+            }
+            rxPos_ += take;
+            literalRemaining_ -= take;
+            if (literalRemaining_ == 0) {
+                if (literalSink_ != nullptr) {
+                    if (!literalSink_->Finish() && !literalSinkFailed_) {
+                        LogLine("! ", QString("literal sink finish failed: %1").arg(literalSink_->Error()));
+                    }
+                    literalSink_ = nullptr;
+                }
+                literalSpooled_ = false;
+                frame_ = FrameState::Line;
+            }
+            continue;
+        }
+
+        const qsizetype eol = rx_.indexOf('\n', rxPos_);
+        if (eol < 0) {
+            if (rx_.size() - rxPos_ > kMaxLineBytes) {
+                RecordFailure(QStringLiteral("IMAP line exceeds limit"));
+                socket_->abort();
+                emit Failed(lastError_);
+            }
+            return;
+        }
+
+        const QByteArrayView line(rx_.constData() + rxPos_, eol + 1 - rxPos_);
+        rxPos_ = eol + 1;
+
+        const qint64 literal = TrailingLiteralSize(line);
+        if (literal >= 0) {
+            // The response continues after the literal octets.
+            pending_.append(line.data(), line.size());
+            literalRemaining_ = literal;
+            frame_ = literal > 0 ? FrameState::Literal : FrameState::Line;
+            if (literal > 0) {
+                BeginLiteral(literal);
+            }
+            continue;
+        }
+
+        if (pending_.isEmpty()) {
+            Deliver(line);
+        } else {
+            pending_.append(line.data(), line.size());
+            Deliver(pending_);
+            pending_.resize(0);
+        }
+    }
+    if (inflatePending_) {
+        ActivateInflate();
+    }
+}
+
+void ImapConnection::BeginLiteral(qint64 size)
+{
+    if (!literalSinkFactory_) {
+        return;
+    }
+    ImapLiteralSink* sink = literalSinkFactory_(QByteArrayView(pending_), size);
+    if (sink == nullptr) {
+        return;
+    }
+    if (!sink->Begin(size)) {
+        // Fall back to buffering inline rather than losing the data.
+        LogLine("! ", QString("literal sink begin failed: %1").arg(sink->Error()));
+        return;
+    }
+
+    // Rewrite the header so parsers see a spooled literal with no payload: "{n}" -> "{n!}".
+    const qsizetype brace = pending_.lastIndexOf('{');
+    pending_.truncate(brace);
+    pending_ += '{';
+    pending_ += QByteArray::number(size);
+    pending_ += "!}\r\n";
+
+    literalSink_ = sink;
+    literalSinkFailed_ = false;
+    literalSpooled_ = true;
+}
+
+void ImapConnection::AbortLiteral(const ImapLiteralSink* sink)
+{
+    if (sink != nullptr && sink != literalSink_) {
+        return;
+    }
+    if (literalSink_ != nullptr) {
+        literalSink_->Abort();
+        literalSink_ = nullptr;
+    }
+    literalSinkFailed_ = false;
+}
+
+void ImapConnection::Deliver(QByteArrayView response)
+{
+    qsizetype end = response.size();
+    while (end > 0 && (response[end - 1] == '\n' || response[end - 1] == '\r')) {
+        --end;
+    }
+    response = response.first(end);
+
+    if (TranscriptEnabled()) {
+        qsizetype start = 0;
+        while (start < response.size() && (response[start] == ' ' || response[start] == '\t')) {
+            ++start;
+        }
+        if (start < response.size()) {
+            const QByteArrayView text = response.sliced(start);
+            transcript_->Append('S', std::string_view(text.data(), text.size()));
+        }
+    }
+    if (onResponse_) {
+        onResponse_(response);
+    }
+}
+
+}
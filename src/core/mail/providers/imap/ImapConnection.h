@@ -0,0 +1,172 @@
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QObject>
+#include <QString>
+#include <functional>
+#include <memory>
+
+#include "core/logging/ProtocolTranscript.h"
+#include "core/mail/providers/imap/ImapDeflate.h"
+#include "core/mail/providers/imap/ImapLiteralSink.h"
+
+class QSslSocket;
+class QTimer;
+
+namespace ngks::core::mail::providers::imap {
+
+// Byte and CPU accounting for one connection. Wire bytes are what crossed the socket (after
+// TLS, before/after DEFLATE); protocol bytes are the IMAP stream the parser sees.
+struct ImapWireStats {
+    bool compressed = false;
+    qint64 wireBytesIn = 0;
+    qint64 wireBytesOut = 0;
+    qint64 protocolBytesIn = 0;
+    qint64 protocolBytesOut = 0;
+    qint64 inflateNs = 0;
+    qint64 deflateNs = 0;
+    // Connect through TLS handshake; tlsResumeOffered means a cached session ticket was sent.
+    qint64 connectMs = -1;
+    bool tlsResumeOffered = false;
+};
+
+// Non-blocking IMAP transport. The socket is driven purely by readyRead/bytesWritten and a
+// small framing state machine turns the byte stream into complete server responses (a line
+// plus any {n} literals it announces). Nothing here waits, so one event loop can drive many
+// connections. All methods must be called on the connection's thread.
+class ImapConnection : public QObject {
+    Q_OBJECT
+
+public:
+    enum class State {
+        Disconnected,
+        Connecting,
+        Connected,
+        Closing
+    };
+
+    // Called once per framed server response, without the final CRLF.
+    // The view points into the receive buffer and is only valid for the duration of the call.
+    using ResponseHandler = std::function<void(QByteArrayView response)>;
+
+    explicit ImapConnection(QObject* parent = nullptr);
+    ~ImapConnection() override;
+
+    // Starts connecting; Opened() or Failed() follows.
+    void Open(const QString& host, int port, bool tls);
+    // Starts a graceful close; Closed() follows.
+    void Close();
+
+    // Queues one protocol line (CRLF appended if missing). The socket flushes it from the event loop.
+    bool Send(const QByteArray& line);
+
+    void SetResponseHandler(ResponseHandler handler);
+
+    // Switches to COMPRESS=DEFLATE. Call from the handler of the tagged OK to "COMPRESS DEFLATE":
+    // everything sent afterwards is compressed, and received data is inflated from the first
+    // byte after that response.
+    bool StartCompression(QString& outError);
+    bool Compressed() const;
+    ImapWireStats WireStats() const;
+
+    // Consulted for every non-empty literal. When it returns a sink, the octets are streamed into
+    // it chunk by chunk and the delivered response carries "{n!}" in place of "{n}" + payload.
+    void SetLiteralSinkFactory(ImapLiteralSinkFactory factory);
+    // Stops streaming into the sink in use (only if it is sink, when one is given) and aborts
+    // it; the rest of the literal is read and dropped, so framing holds. For callers that give
+    // up on a command before its literal is complete.
+    void AbortLiteral(const ImapLiteralSink* sink = nullptr);
+
+    // Watchdog for callers that expect traffic: fires TimedOut() if no byte arrives within timeoutMs.
+    // Any received data restarts an armed watchdog.
+    void StartWatchdog(int timeoutMs, const QString& context);
+    void StopWatchdog();
+
+    // Transcripts use ProtocolTranscript::DefaultOptions() (level, sampling); writes are batched
+    // on a background thread, so logging stays off the receive path.
+    bool OpenTranscript(const QString& path);
+    void CloseTranscript();
+    bool TranscriptEnabled() const;
+    void LogLine(const QString& direction, const QString& text);
+
+    // Records the socket state under the given context as the last error and logs it.
+    void RecordFailure(const QString& context);
+
+    State CurrentState() const;
+    QString Host() const;
+    int Port() const;
+    qint64 PendingWriteBytes() const;
+
+    QString LastError() const;
+    int LastSocketErrorCode() const;
+    QString LastSocketErrorString() const;
+    bool WasEncrypted() const;
+
+signals:
+    void Opened();
+    void Failed(const QString& error);
+    void TimedOut(const QString& error);
+    void Drained();
+    void Closed();
+
+private slots:
+    void OnConnected();
+    void OnEncrypted();
+    void OnSessionTicket();
+    void OnReadyRead();
+    void OnBytesWritten(qint64 bytes);
+    void OnSocketError();
+    void OnDisconnected();
+    void OnWatchdog();
+
+private:
+    enum class FrameState {
+        Line,
+        Literal
+    };
+
+    void Pump();
+    void Deliver(QByteArrayView response);
+    void BeginLiteral(qint64 size);
+    void AppendInflated(QByteArrayView compressed);
+    void ActivateInflate();
+
+    QSslSocket* socket_ = nullptr;
+    QTimer* watchdog_ = nullptr;
+    QString watchdogContext_;
+    ResponseHandler onResponse_;
+    ImapLiteralSinkFactory literalSinkFactory_;
+    std::unique_ptr<ngks::core::logging::ProtocolTranscript> transcript_;
+
+    State state_ = State::Disconnected;
+    QString host_;
+    int port_ = 0;
+    bool tls_ = true;
+    qint64 openStartedMs_ = 0;
+
+    // Receive side framing.
+    QByteArray rx_;
+    qsizetype rxPos_ = 0;
+    QByteArray pending_;
+    qint64 literalRemaining_ = 0;
+    FrameState frame_ = FrameState::Line;
+    ImapLiteralSink* literalSink_ = nullptr;
+    bool literalSinkFailed_ = false;
+    // The current literal was offered to a sink ("{n!}"); its octets never go to pending_.
+    bool literalSpooled_ = false;
+
+    // COMPRESS=DEFLATE.
+    ImapDeflate deflate_;
+    bool inflating_ = false;
+    bool inflatePending_ = false;
+    QByteArray wire_;
+    ImapWireStats stats_;
+
+    QString lastError_;
+    int lastSocketErrorCode_ = -1;
+    QString lastSocketErrorString_;
+    bool encryptedReached_ = false;
+};
+
+}
@@ -0,0 +1,436 @@
+#include "core/mail/providers/imap/ImapConnectionPool.h"
+
+#include <QDateTime>
+#include <chrono>
+
+namespace ngks::core::mail::providers::imap {
+
+namespace {
+
+QString QuoteMailbox(const QString& mailbox)
+{
+    QString out = mailbox;
+    out.replace("\\", "\\\\");
+    out.replace("\"", "\\\"");
+    return QString("\"%1\"").arg(out);
+}
+
+bool IsTaggedOk(const QStringList& lines, const QString& tag)
+{
+    return !lines.isEmpty() && lines.last().startsWith(tag + " OK", Qt::CaseInsensitive);
+}
+
+}
+
+ImapSession::ImapSession(QString accountKey, QString hostKey)
+    : accountKey_(std::move(accountKey))
+    , hostKey_(std::move(hostKey))
+{
+}
+
+ImapSession::~ImapSession()
+{
+    client_.AttachToCurrentThread();
+    client_.Disconnect();
+}
+
+ImapClient& ImapSession::Client()
+{
+    return client_;
+}
+
+QString ImapSession::AccountKey() const
+{
+    return accountKey_;
+}
+
+QString ImapSession::HostKey() const
+{
+    return hostKey_;
+}
+
+QString ImapSession::TranscriptPath() const
+{
+    return transcriptPath_;
+}
+
+void ImapSession::SetCapabilities(const QList<QByteArray>& upperAtoms)
+{
+    capabilities_ = upperAtoms;
+}
+
+bool ImapSession::HasCapability(const char* upperName) const
+{
+    return capabilities_.contains(QByteArray(upperName));
+}
+
+bool ImapSession::Select(const QString& mailbox, bool readOnly, QString& outError, const QString& selectParameters)
+{
+    if (selectParameters.isEmpty() && !selectedMailbox_.isEmpty() && selectedMailbox_ == mailbox
+        && selectedReadOnly_ == readOnly) {
+        return true;
+    }
+
+    const QString verb = readOnly ? QStringLiteral("EXAMINE") : QStringLiteral("SELECT");
+    QStringList collect = {"FLAGS", "EXISTS", "RECENT", "OK", "NO"};
+    QString command = QString("%1 %2").arg(verb, QuoteMailbox(mailbox));
+    if (!selectParameters.isEmpty()) {
+        command += ' ' + selectParameters;
+        collect << "FETCH" << "VANISHED";
+    }
+    const QString tag = client_.Submit(command, collect);
+    const QStringList lines = client_.Await(tag, selectParameters.isEmpty() ? 10000 : 120000);
+    if (!IsTaggedOk(lines, tag)) {
+        // A failed SELECT leaves no mailbox selected (RFC 3501 6.3.1).
+        ForgetSelection();
+        outError = QString("%1 failed").arg(verb);
+        if (lines.isEmpty()) {
+            MarkBroken();
+        }
+        return false;
+    }
+    selectedMailbox_ = mailbox;
+    selectedReadOnly_ = readOnly;
+    selectResponses_ = lines;
+    return true;
+}
+
+QString ImapSession::SelectedMailbox() const
+{
+    return selectedMailbox_;
+}
+
+bool ImapSession::SelectedReadOnly() const
+{
+    return selectedReadOnly_;
+}
+
+QStringList ImapSession::SelectResponses() const
+{
+    return selectResponses_;
+}
+
+void ImapSession::ForgetSelection()
+{
+    selectedMailbox_.clear();
+    selectedReadOnly_ = false;
+    selectResponses_.clear();
+}
+
+bool ImapSession::EnableQresync(QString& outError)
+{
+    if (qresyncEnabled_) {
+        return true;
+    }
+    const QString tag = client_.Submit("ENABLE QRESYNC", {"ENABLED"});
+    const QStringList lines = client_.Await(tag);
+    if (!IsTaggedOk(lines, tag)) {
+        outError = QStringLiteral("ENABLE QRESYNC failed");
+        if (lines.isEmpty()) {
+            MarkBroken();
+        }
+        return false;
+    }
+    for (const QString& line : lines) {
+        if (line.startsWith("* ENABLED", Qt::CaseInsensitive) && line.contains("QRESYNC", Qt::CaseInsensitive)) {
+            qresyncEnabled_ = true;
+        }
+    }
+    if (!qresyncEnabled_) {
+        outError = QStringLiteral("server did not enable QRESYNC");
+    }
+    return qresyncEnabled_;
+}
+
+bool ImapSession::QresyncEnabled() const
+{
+    return qresyncEnabled_;
+}
+
+bool ImapSession::Noop(int timeoutMs)
+{
+    const QString tag = client_.Submit("NOOP");
+    const bool ok = IsTaggedOk(client_.Await(tag, timeoutMs), tag);
+    if (!ok) {
+        MarkBroken();
+    }
+    return ok;
+}
+
+void ImapSession::Logout()
+{
+    if (client_.IsConnected()) {
+        const QString tag = client_.Submit("LOGOUT", {"BYE"});
+        client_.Await(tag, 2000);
+    }
+    client_.Disconnect();
+    ForgetSelection();
+}
+
+void ImapSession::MarkBroken()
+{
+    broken_ = true;
+}
+
+bool ImapSession::IsBroken() const
+{
+    return broken_ || !client_.IsConnected();
+}
+
+ImapSessionLease::ImapSessionLease(ImapConnectionPool* pool, std::unique_ptr<ImapSession> session)
+    : pool_(pool)
+    , session_(std::move(session))
+{
+}
+
+ImapSessionLease::ImapSessionLease(ImapSessionLease&& other) noexcept
+    : pool_(other.pool_)
+    , session_(std::move(other.session_))
+{
+    other.pool_ = nullptr;
+}
+
+ImapSessionLease& ImapSessionLease::operator=(ImapSessionLease&& other) noexcept
+{
+    if (this != &other) {
+        Reset();
+        pool_ = other.pool_;
+        session_ = std::move(other.session_);
+        other.pool_ = nullptr;
+    }
+    return *this;
+}
+
+ImapSessionLease::~ImapSessionLease()
+{
+    Reset();
+}
+
+void ImapSessionLease::Discard()
+{
+    if (session_) {
+        session_->MarkBroken();
+    }
+    Reset();
+}
+
+void ImapSessionLease::Reset()
+{
+    if (pool_ != nullptr && session_) {
+        pool_->Release(std::move(session_));
+    }
+    session_.reset();
+    pool_ = nullptr;
+}
+
+ImapConnectionPool::ImapConnectionPool(ImapPoolOptions options)
+    : options_(options)
+{
+}
+
+ImapConnectionPool::~ImapConnectionPool()
+{
+    CloseIdle();
+}
+
+ImapConnectionPool& ImapConnectionPool::Instance()
+{
+    static ImapConnectionPool pool;
+    return pool;
+}
+
+QString ImapConnectionPool::AccountKey(const ResolveRequest& request)
+{
+    return QString("%1|%2|%3|%4")
+        .arg(request.host.toLower())
+        .arg(request.port)
+        .arg(request.tls ? "tls" : "plain")
+        .arg(request.username.isEmpty() ? request.email : request.username);
+}
+
+QString ImapConnectionPool::HostKey(const ResolveRequest& request)
+{
+    return QString("%1:%2").arg(request.host.toLower()).arg(request.port);
+}
+
+ImapSessionLease ImapConnectionPool::Acquire(const ResolveRequest& request, QString& outError)
+{
+    outError.clear();
+    const QString accountKey = AccountKey(request);
+    const QString hostKey = HostKey(request);
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(options_.acquireTimeoutMs);
+
+    for (;;) {
+        std::unique_ptr<ImapSession> reuse;
+        std::unique_ptr<ImapSession> evict;
+        bool openNew = false;
+        {
+            std::unique_lock<std::mutex> lk(mu_);
+            reuse = TakeIdle(accountKey);
+            if (!reuse) {
+                if (openPerHost_.value(hostKey) < hostLimits_.value(hostKey, options_.maxPerHost)) {
+                    openPerHost_[hostKey] += 1;
+                    openNew = true;
+                } else if ((evict = TakeIdleForOtherAccount(hostKey, accountKey))) {
+                    // The evicted connection's slot goes straight to the new one.
+                    openNew = true;
+                } else if (slotFreed_.wait_until(lk, deadline) == std::cv_status::timeout) {
+                    outError = QString("IMAP connection limit reached for %1").arg(hostKey);
+                    return {};
+                } else {
+                    continue;
+                }
+            }
+        }
+
+        if (evict) {
+            evict->client_.AttachToCurrentThread();
+            evict->Logout();
+            evict.reset();
+        }
+
+        if (reuse) {
+            reuse->client_.AttachToCurrentThread();
+            reuse->client_.ClearResponses();
+            const qint64 idleMs = QDateTime::currentMSecsSinceEpoch() - reuse->lastUsedMs_;
+            bool healthy = !reuse->IsBroken() && idleMs < options_.maxIdleMs;
+            if (healthy && idleMs >= options_.healthCheckAfterMs) {
+                {
+                    std::lock_guard<std::mutex> lk(mu_);
+                    ++stats_.healthChecks;
+                }
+                healthy = reuse->Noop(5000);
+            }
+            if (!healthy) {
+                Close(std::move(reuse));
+                continue;
+            }
+            std::lock_guard<std::mutex> lk(mu_);
+            ++stats_.reused;
+            return ImapSessionLease(this, std::move(reuse));
+        }
+
+        if (openNew) {
+            auto session = std::make_unique<ImapSession>(accountKey, hostKey);
+            if (!ImapProvider::OpenSession(request, *session, outError)) {
+                session->MarkBroken();
+                Close(std::move(session));
+                return {};
+            }
+            std::lock_guard<std::mutex> lk(mu_);
+            ++stats_.opened;
+            return ImapSessionLease(this, std::move(session));
+        }
+    }
+}
+
+void ImapConnectionPool::SetHostLimit(const QString& hostKey, int maxConnections)
+{
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        hostLimits_.insert(hostKey, qMax(1, maxConnections));
+    }
+    slotFreed_.notify_all();
+}
+
+int ImapConnectionPool::HostLimit(const QString& hostKey) const
+{
+    std::lock_guard<std::mutex> lk(mu_);
+    return hostLimits_.value(hostKey, options_.maxPerHost);
+}
+
+void ImapConnectionPool::CloseIdle()
+{
+    std::map<QString, std::deque<std::unique_ptr<ImapSession>>> idle;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        idle.swap(idle_);
+    }
+    for (auto& entry : idle) {
+        for (auto& session : entry.second) {
+            Close(std::move(session));
+        }
+    }
+}
+
+ImapPoolStats ImapConnectionPool::Stats() const
+{
+    std::lock_guard<std::mutex> lk(mu_);
+    return stats_;
+}
+
+void ImapConnectionPool::Release(std::unique_ptr<ImapSession> session)
+{
+    // The next user would get the answers to commands this one gave up on.
+    if (session->client_.IsDirty()) {
+        session->MarkBroken();
+    }
+    if (session->IsBroken()) {
+        Close(std::move(session));
+        return;
+    }
+
+    session->lastUsedMs_ = QDateTime::currentMSecsSinceEpoch();
+    session->client_.ClearResponses();
+    std::unique_ptr<ImapSession> surplus;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        auto& idle = idle_[session->accountKey_];
+        if (static_cast<int>(idle.size()) >= options_.maxIdlePerAccount) {
+            surplus = std::move(session);
+        } else {
+            session->client_.DetachFromThread();
+            idle.push_back(std::move(session));
+        }
+    }
+    if (surplus) {
+        Close(std::move(surplus));
+        return;
+    }
+    slotFreed_.notify_all();
+}
+
+std::unique_ptr<ImapSession> ImapConnectionPool::TakeIdle(const QString& accountKey)
+{
+    auto it = idle_.find(accountKey);
+    if (it == idle_.end() || it->second.empty()) {
+        return nullptr;
+    }
+    // Most recently used first: it is the least likely to have been dropped by the server.
+    std::unique_ptr<ImapSession> session = std::move(it->second.back());
+    it->second.pop_back();
+    return session;
+}
+
+std::unique_ptr<ImapSession> ImapConnectionPool::TakeIdleForOtherAccount(const QString& hostKey,
+                                                                          const QString& accountKey)
+{
+    for (auto& entry : idle_) {
+        if (entry.first == accountKey || entry.second.empty() || entry.second.front()->hostKey_ != hostKey) {
+            continue;
+        }
+        // Oldest first.
+        std::unique_ptr<ImapSession> session = std::move(entry.second.front());
+        entry.second.pop_front();
+        return session;
+    }
+    return nullptr;
+}
+
+void ImapConnectionPool::Close(std::unique_ptr<ImapSession> session)
+{
+    const QString hostKey = session->hostKey_;
+    session->client_.AttachToCurrentThread();
+    if (!session->IsBroken()) {
+        session->Logout();
+    }
+    session.reset();
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        ++stats_.discarded;
+        openPerHost_[hostKey] -= 1;
+    }
+    slotFreed_.notify_all();
+}
+
+}
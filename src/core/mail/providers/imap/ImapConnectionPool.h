@@ -0,0 +1,162 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "core/mail/providers/imap/ImapClient.h"
+#include "core/mail/providers/imap/ImapProvider.h"
+
+namespace ngks::core::mail::providers::imap {
+
+class ImapConnectionPool;
+
+// One authenticated IMAP connection plus the state that survives between leases: the server
+// capabilities and which mailbox is selected, so a caller can skip a redundant SELECT.
+class ImapSession {
+public:
+    ImapSession(QString accountKey, QString hostKey);
+    ~ImapSession();
+
+    ImapClient& Client();
+    QString AccountKey() const;
+    QString HostKey() const;
+    QString TranscriptPath() const;
+
+    void SetCapabilities(const QList<QByteArray>& upperAtoms);
+    bool HasCapability(const char* upperName) const;
+
+    // Selects (or EXAMINEs) the mailbox unless it is already selected in that mode. The untagged
+    // responses of the SELECT that established the current selection stay available.
+    // selectParameters, e.g. "(CONDSTORE)" or "(QRESYNC (uidvalidity modseq))", always re-issues
+    // the SELECT (the caller wants fresh state) and also collects the FETCH and VANISHED
+    // responses a QRESYNC SELECT carries.
+    bool Select(const QString& mailbox, bool readOnly, QString& outError, const QString& selectParameters = QString());
+    QString SelectedMailbox() const;
+    bool SelectedReadOnly() const;
+    QStringList SelectResponses() const;
+    void ForgetSelection();
+
+    // ENABLE QRESYNC (RFC 7162), once per connection; implies CONDSTORE. From then on the
+    // server reports expunges as VANISHED instead of EXPUNGE.
+    bool EnableQresync(QString& outError);
+    bool QresyncEnabled() const;
+
+    bool Noop(int timeoutMs);
+    // Sends LOGOUT and drops the connection.
+    void Logout();
+
+    // A broken session is closed instead of going back to the pool.
+    void MarkBroken();
+    bool IsBroken() const;
+
+private:
+    friend class ImapConnectionPool;
+    friend class ImapProvider;
+
+    ImapClient client_;
+    QString accountKey_;
+    QString hostKey_;
+    QString transcriptPath_;
+    QList<QByteArray> capabilities_;
+    QString selectedMailbox_;
+    bool selectedReadOnly_ = false;
+    QStringList selectResponses_;
+    bool qresyncEnabled_ = false;
+    bool broken_ = false;
+    qint64 lastUsedMs_ = 0;
+};
+
+// Hands a session back to its pool when it goes out of scope.
+class ImapSessionLease {
+public:
+    ImapSessionLease() = default;
+    ImapSessionLease(ImapConnectionPool* pool, std::unique_ptr<ImapSession> session);
+    ImapSessionLease(ImapSessionLease&& other) noexcept;
+    ImapSessionLease& operator=(ImapSessionLease&& other) noexcept;
+    ~ImapSessionLease();
+
+    ImapSession* operator->() const { return session_.get(); }
+    ImapSession& operator*() const { return *session_; }
+    explicit operator bool() const { return session_ != nullptr; }
+
+    // Closes the session instead of returning it (protocol error, unknown state).
+    void Discard();
+
+private:
+    void Reset();
+
+    ImapConnectionPool* pool_ = nullptr;
+    std::unique_ptr<ImapSession> session_;
+};
+
+struct ImapPoolOptions {
+    // Open connections per server (host:port), leased and idle together.
+    int maxPerHost = 4;
+    int maxIdlePerAccount = 2;
+    // Idle sessions older than this get a NOOP before being handed out.
+    int healthCheckAfterMs = 30 * 1000;
+    // Servers drop idle connections after 30 minutes; retire ours before that.
+    int maxIdleMs = 25 * 60 * 1000;
+    int acquireTimeoutMs = 60 * 1000;
+};
+
+struct ImapPoolStats {
+    int opened = 0;
+    int reused = 0;
+    int healthChecks = 0;
+    int discarded = 0;
+};
+
+// Keeps authenticated sessions alive per account so repeated operations skip TCP, TLS and
+// authentication. Thread-safe: idle sessions are detached from any thread and pulled into the
+// acquiring one. Acquire blocks while the per-server cap is reached, so call it from worker
+// threads or CLI paths rather than the GUI thread.
+class ImapConnectionPool {
+public:
+    explicit ImapConnectionPool(ImapPoolOptions options = {});
+    ~ImapConnectionPool();
+
+    static ImapConnectionPool& Instance();
+
+    // Returns an authenticated session for the account, reusing an idle one when possible.
+    // On failure the lease is empty and outError is set.
+    ImapSessionLease Acquire(const ResolveRequest& request, QString& outError);
+
+    // Overrides maxPerHost for one server (HostKey), e.g. a provider known to allow more.
+    void SetHostLimit(const QString& hostKey, int maxConnections);
+    int HostLimit(const QString& hostKey) const;
+
+    // Logs out every idle session (e.g. on shutdown).
+    void CloseIdle();
+
+    ImapPoolStats Stats() const;
+
+    static QString AccountKey(const ResolveRequest& request);
+    static QString HostKey(const ResolveRequest& request);
+
+private:
+    friend class ImapSessionLease;
+
+    void Release(std::unique_ptr<ImapSession> session);
+    std::unique_ptr<ImapSession> TakeIdle(const QString& accountKey);
+    std::unique_ptr<ImapSession> TakeIdleForOtherAccount(const QString& hostKey, const QString& accountKey);
+    void Close(std::unique_ptr<ImapSession> session);
+
+    ImapPoolOptions options_;
+    mutable std::mutex mu_;
+    std::condition_variable slotFreed_;
+    QHash<QString, int> openPerHost_;
+    QHash<QString, int> hostLimits_;
+    std::map<QString, std::deque<std::unique_ptr<ImapSession>>> idle_;
+    ImapPoolStats stats_;
+};
+
+}
@@ -0,0 +1,153 @@
+#include "core/mail/providers/imap/ImapDeflate.h"
+
+#ifdef NGKSMAIL_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace ngks::core::mail::providers::imap {
+
+#ifdef NGKSMAIL_HAVE_ZLIB
+
+struct ImapDeflate::Streams {
+    z_stream deflater{};
+    z_stream inflater{};
+    bool deflaterReady = false;
+    bool inflaterReady = false;
+
+    ~Streams()
+    {
+        if (deflaterReady) {
+            deflateEnd(&deflater);
+        }
+        if (inflaterReady) {
+            inflateEnd(&inflater);
+        }
+    }
+};
+
+ImapDeflate::ImapDeflate() = default;
+ImapDeflate::~ImapDeflate() = default;
+
+bool ImapDeflate::Available()
+{
+    return true;
+}
+
+bool ImapDeflate::Start(QString& outError)
+{
+    streams_ = std::make_unique<Streams>();
+    // Negative windowBits: raw DEFLATE without zlib header or checksum, as RFC 4978 requires.
+    if (deflateInit2(&streams_->deflater, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        outError = QStringLiteral("deflateInit2 failed");
+        streams_.reset();
+        return false;
+    }
+    streams_->deflaterReady = true;
+    if (inflateInit2(&streams_->inflater, -15) != Z_OK) {
+        outError = QStringLiteral("inflateInit2 failed");
+        streams_.reset();
+        return false;
+    }
+    streams_->inflaterReady = true;
+    return true;
+}
+
+bool ImapDeflate::Compress(QByteArrayView data, QByteArray& out)
+{
+    z_stream& zs = streams_->deflater;
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    zs.avail_in = static_cast<uInt>(data.size());
+    do {
+        const qsizetype oldSize = out.size();
+        const qsizetype room = qMax<qsizetype>(256, data.size() + 64);
+        out.resize(oldSize + room);
+        zs.next_out = reinterpret_cast<Bytef*>(out.data() + oldSize);
+        zs.avail_out = static_cast<uInt>(room);
+        const int rc = deflate(&zs, Z_SYNC_FLUSH);
+        out.resize(oldSize + room - zs.avail_out);
+        if (rc != Z_OK && rc != Z_BUF_ERROR) {
+            lastError_ = QString("deflate failed: %1").arg(rc);
+            return false;
+        }
+    } while (zs.avail_out == 0);
+    return true;
+}
+
+bool ImapDeflate::Decompress(QByteArrayView in, char* out, qsizetype capacity, qsizetype& consumed, qsizetype& produced)
+{
+    z_stream& zs = streams_->inflater;
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    zs.avail_in = static_cast<uInt>(in.size());
+    zs.next_out = reinterpret_cast<Bytef*>(out);
+    zs.avail_out = static_cast<uInt>(capacity);
+    const int rc = inflate(&zs, Z_SYNC_FLUSH);
+    consumed = in.size() - zs.avail_in;
+    produced = capacity - zs.avail_out;
+    // Z_BUF_ERROR only means no progress was possible (no input left); not an error here.
+    if (rc != Z_OK && rc != Z_BUF_ERROR && rc != Z_STREAM_END) {
+        lastError_ = QString("inflate failed: %1").arg(zs.msg != nullptr ? zs.msg : "unknown");
+        return false;
+    }
+    // The stream lasts as long as the connection; anything after its end cannot be inflated.
+    if (rc == Z_STREAM_END && zs.avail_in > 0) {
+        lastError_ = QStringLiteral("inflate failed: data after the end of the stream");
+        return false;
+    }
+    return true;
+}
+
+#else
+
+struct ImapDeflate::Streams {
+};
+
+ImapDeflate::ImapDeflate() = default;
+ImapDeflate::~ImapDeflate() = default;
+
+bool ImapDeflate::Available()
+{
+    return false;
+}
+
+bool ImapDeflate::Start(QString& outError)
+{
+    outError = QStringLiteral("built without zlib");
+    return false;
+}
+
+bool ImapDeflate::Compress(QByteArrayView data, QByteArray& out)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(out);
+    return false;
+}
+
+bool ImapDeflate::Decompress(QByteArrayView in, char* out, qsizetype capacity, qsizetype& consumed, qsizetype& produced)
+{
+    Q_UNUSED(in);
+    Q_UNUSED(out);
+    Q_UNUSED(capacity);
+    consumed = 0;
+    produced = 0;
+    return false;
+}
+
+#endif
+
+void ImapDeflate::Reset()
+{
+    streams_.reset();
+    lastError_.clear();
+}
+
+bool ImapDeflate::Active() const
+{
+    return streams_ != nullptr;
+}
+
+QString ImapDeflate::LastError() const
+{
+    return lastError_;
+}
+
+}
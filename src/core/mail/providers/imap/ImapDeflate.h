@@ -0,0 +1,38 @@
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QString>
+#include <memory>
+
+namespace ngks::core::mail::providers::imap {
+
+// Raw DEFLATE streams for COMPRESS=DEFLATE (RFC 4978): one compressor for what we send and one
+// decompressor for what we receive, both without zlib headers (windowBits -15). Only functional
+// when the build found zlib (NGKSMAIL_HAVE_ZLIB); otherwise Available() is false.
+class ImapDeflate {
+public:
+    ImapDeflate();
+    ~ImapDeflate();
+
+    static bool Available();
+
+    bool Start(QString& outError);
+    void Reset();
+    bool Active() const;
+
+    // Compresses data and appends it to out, sync-flushed so the server can decode every command.
+    bool Compress(QByteArrayView data, QByteArray& out);
+    // Inflates from in into out[0, capacity). consumed/produced report progress; call again with
+    // the remaining input (or empty input while produced == capacity) to drain.
+    bool Decompress(QByteArrayView in, char* out, qsizetype capacity, qsizetype& consumed, qsizetype& produced);
+
+    QString LastError() const;
+
+private:
+    struct Streams;
+    std::unique_ptr<Streams> streams_;
+    QString lastError_;
+};
+
+}
@@ -0,0 +1,256 @@
+#include "core/mail/providers/imap/ImapFolderList.h"
+
+#include <QByteArray>
+
+#include "core/mail/providers/imap/ImapResponseParsers.h"
+#include "core/mail/providers/imap/ImapTokenizer.h"
+
+namespace ngks::core::mail::providers::imap {
+
+namespace {
+
+struct AttributeName {
+    const char* name;
+    FolderAttribute bit;
+};
+
+// Spelling used when writing attrs_json.
+const AttributeName kAttributes[] = {
+    {"\\Noselect", FolderAttribute::NoSelect},
+    {"\\NonExistent", FolderAttribute::NonExistent},
+    {"\\Noinferiors", FolderAttribute::NoInferiors},
+    {"\\HasChildren", FolderAttribute::HasChildren},
+    {"\\HasNoChildren", FolderAttribute::HasNoChildren},
+    {"\\Marked", FolderAttribute::Marked},
+    {"\\Unmarked", FolderAttribute::Unmarked},
+    {"\\Subscribed", FolderAttribute::Subscribed},
+    {"\\Remote", FolderAttribute::Remote},
+    {"\\All", FolderAttribute::All},
+    {"\\Archive", FolderAttribute::Archive},
+    {"\\Drafts", FolderAttribute::Drafts},
+    {"\\Flagged", FolderAttribute::Flagged},
+    {"\\Junk", FolderAttribute::Junk},
+    {"\\Sent", FolderAttribute::Sent},
+    {"\\Trash", FolderAttribute::Trash},
+    {"\\Inbox", FolderAttribute::Inbox},
+    {"\\Important", FolderAttribute::Important},
+};
+
+// The roles stored in folders.special_use, in the order they win.
+const AttributeName kSpecialUse[] = {
+    {"\\Inbox", FolderAttribute::Inbox},
+    {"\\Sent", FolderAttribute::Sent},
+    {"\\Drafts", FolderAttribute::Drafts},
+    {"\\Archive", FolderAttribute::Archive},
+    {"\\Trash", FolderAttribute::Trash},
+    {"\\Junk", FolderAttribute::Junk},
+};
+
+quint32 Bit(FolderAttribute attribute)
+{
+    return static_cast<quint32>(attribute);
+}
+
+QString SpecialUseFromBits(quint32 bits)
+{
+    for (const AttributeName& role : kSpecialUse) {
+        if (bits & Bit(role.bit)) {
+            return QString::fromLatin1(role.name);
+        }
+    }
+    return QString();
+}
+
+void AppendJsonString(QString& out, const QString& value)
+{
+    out += '"';
+    for (const QChar c : value) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c.unicode() < 0x20) {
+            out += QString("\\u%1").arg(c.unicode(), 4, 16, QChar('0'));
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+// Parses a LIST/XLIST response into a folder without its delimiter default or status.
+bool ParseFolder(QByteArrayView response, ResolvedFolder& out)
+{
+    ImapListEntry entry;
+    if (!ParseListResponse(response, entry)) {
+        return false;
+    }
+    out.remoteName = entry.MailboxName();
+    if (out.remoteName.isEmpty()) {
+        return false;
+    }
+    out.delimiter = QString::fromUtf8(ImapTokenizer::Unescape(entry.delimiter));
+
+    for (const QByteArrayView attr : entry.attributes) {
+        const quint32 bit = FolderAttributeBit(attr);
+        if (bit != 0) {
+            out.attributes |= bit;
+        } else {
+            out.extraAttributes.push_back(QString::fromLatin1(attr));
+        }
+    }
+    out.specialUse = SpecialUseFromBits(out.attributes);
+
+    // Last non-empty level of the hierarchy.
+    const QChar separator = out.delimiter.isEmpty() ? QChar('/') : out.delimiter[0];
+    qsizetype end = out.remoteName.size();
+    while (end > 0 && out.remoteName[end - 1] == separator) {
+        --end;
+    }
+    const qsizetype start = out.remoteName.lastIndexOf(separator, end - 1) + 1;
+    out.displayName = end > start ? out.remoteName.mid(start, end - start) : out.remoteName;
+    return true;
+}
+
+}
+
+quint32 FolderAttributeBit(QByteArrayView attribute)
+{
+    for (const AttributeName& known : kAttributes) {
+        if (qstrnicmp(attribute.data(), attribute.size(), known.name) == 0) {
+            return Bit(known.bit);
+        }
+    }
+    return 0;
+}
+
+bool ResolvedFolder::HasAttribute(FolderAttribute attribute) const
+{
+    return (attributes & Bit(attribute)) != 0;
+}
+
+bool ResolvedFolder::Selectable() const
+{
+    return !HasAttribute(FolderAttribute::NoSelect) && !HasAttribute(FolderAttribute::NonExistent);
+}
+
+QString ResolvedFolder::AttrsJson() const
+{
+    QString out = QStringLiteral("{\"attrs\":[");
+    bool first = true;
+    for (const AttributeName& known : kAttributes) {
+        if (!(attributes & Bit(known.bit))) {
+            continue;
+        }
+        if (!first) {
+            out += ',';
+        }
+        first = false;
+        AppendJsonString(out, QString::fromLatin1(known.name));
+    }
+    for (const QString& attr : extraAttributes) {
+        if (!first) {
+            out += ',';
+        }
+        first = false;
+        AppendJsonString(out, attr);
+    }
+    out += QStringLiteral("]}");
+    return out;
+}
+
+void FolderListBuilder::Reserve(int folders)
+{
+    folders_.reserve(folders);
+    index_.reserve(folders);
+}
+
+void FolderListBuilder::AddListResponse(QByteArrayView response)
+{
+    ResolvedFolder folder;
+    if (!ParseFolder(response, folder)) {
+        return;
+    }
+    const QString key = Key(folder.remoteName);
+    if (index_.contains(key)) {
+        return;
+    }
+    if (folder.specialUse.isEmpty()) {
+        folder.specialUse = pendingSpecialUse_.take(key);
+    }
+    const auto status = pendingStatus_.constFind(key);
+    if (status != pendingStatus_.constEnd()) {
+        folder.hasStatus = true;
+        folder.status = status.value();
+        pendingStatus_.erase(status);
+    }
+    index_.insert(key, static_cast<int>(folders_.size()));
+    folders_.push_back(std::move(folder));
+}
+
+void FolderListBuilder::AddSpecialUseResponse(QByteArrayView response)
+{
+    ResolvedFolder folder;
+    if (!ParseFolder(response, folder) || folder.specialUse.isEmpty()) {
+        return;
+    }
+    const QString key = Key(folder.remoteName);
+    const auto it = index_.constFind(key);
+    if (it != index_.constEnd()) {
+        folders_[it.value()].specialUse = folder.specialUse;
+    } else {
+        pendingSpecialUse_.insert(key, folder.specialUse);
+    }
+}
+
+void FolderListBuilder::AddStatusResponse(QByteArrayView response)
+{
+    ImapStatusEntry entry;
+    if (!ParseStatusResponse(response, entry)) {
+        return;
+    }
+    ResolvedFolderStatus status;
+    status.messages = entry.messages;
+    status.unseen = entry.unseen;
+    status.uidNext = entry.uidNext;
+    status.uidValidity = entry.uidValidity;
+    status.highestModSeq = entry.highestModSeq;
+
+    const QString key = Key(entry.MailboxName());
+    const auto it = index_.constFind(key);
+    if (it != index_.constEnd()) {
+        ResolvedFolder& folder = folders_[it.value()];
+        folder.hasStatus = true;
+        folder.status = status;
+    } else {
+        pendingStatus_.insert(key, status);
+    }
+}
+
+int FolderListBuilder::Size() const
+{
+    return static_cast<int>(folders_.size());
+}
+
+QVector<ResolvedFolder> FolderListBuilder::Finish(const QString& defaultDelimiter)
+{
+    for (ResolvedFolder& folder : folders_) {
+        if (folder.delimiter.isEmpty()) {
+            folder.delimiter = defaultDelimiter;
+        }
+    }
+    index_.clear();
+    pendingSpecialUse_.clear();
+    pendingStatus_.clear();
+    return std::move(folders_);
+}
+
+QString FolderListBuilder::Key(const QString& remoteName)
+{
+    // Mailbox names are case-sensitive, except INBOX (RFC 3501 5.1).
+    if (remoteName.compare(QLatin1String("INBOX"), Qt::CaseInsensitive) == 0) {
+        return QStringLiteral("INBOX");
+    }
+    return remoteName;
+}
+
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <QByteArrayView>
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+#include "core/mail/providers/imap/ImapProvider.h"
+
+namespace ngks::core::mail::providers::imap {
+
+// Maps one LIST attribute (any case) to its FolderAttribute bit; 0 when unknown.
+quint32 FolderAttributeBit(QByteArrayView attribute);
+
+// Collects ResolveAccount's LIST, special-use LIST/XLIST and STATUS responses into folders as
+// they stream in. Each response is parsed once, in place; folders are indexed by name so
+// special-use and STATUS entries are merged with a hash lookup no matter the order they
+// arrive in, which keeps accounts with tens of thousands of mailboxes linear.
+class FolderListBuilder {
+public:
+    void Reserve(int folders);
+
+    void AddListResponse(QByteArrayView response);
+    // Only the special-use role of the entry is taken; the folder itself comes from LIST.
+    void AddSpecialUseResponse(QByteArrayView response);
+    void AddStatusResponse(QByteArrayView response);
+
+    int Size() const;
+
+    // Fills in the delimiter of entries that had none and hands the folders over.
+    QVector<ResolvedFolder> Finish(const QString& defaultDelimiter);
+
+private:
+    static QString Key(const QString& remoteName);
+
+    QVector<ResolvedFolder> folders_;
+    QHash<QString, int> index_;
+    // Special-use roles and counts that arrived before their folder's LIST line.
+    QHash<QString, QString> pendingSpecialUse_;
+    QHash<QString, ResolvedFolderStatus> pendingStatus_;
+};
+
+}
@@ -0,0 +1,489 @@
+#include "core/mail/providers/imap/ImapIdleManager.h"
+
+#include <QTimer>
+
+#include "core/mail/providers/imap/ImapResponseParsers.h"
+#include "core/mail/sync/JobQueue.h"
+
+namespace ngks::core::mail::providers::imap {
+
+using ngks::core::mail::sync::SyncJob;
+using ngks::core::mail::sync::SyncJobKind;
+
+namespace {
+
+const QByteArray kWatchedKeywords[] = {"EXISTS", "EXPUNGE", "FETCH"};
+
+QString QuoteMailbox(const QString& mailbox)
+{
+    QString out = mailbox;
+    out.replace("\\", "\\\\");
+    out.replace("\"", "\\\"");
+    return QString("\"%1\"").arg(out);
+}
+
+// "* <n> EXISTS" and "* <n> EXPUNGE".
+qint64 MessageNumber(const QString& line)
+{
+    bool ok = false;
+    const qint64 number = line.section(' ', 1, 1).toLongLong(&ok);
+    return ok ? number : -1;
+}
+
+qint64 ExistsFrom(const QStringList& selectResponses)
+{
+    for (const QString& line : selectResponses) {
+        if (line.endsWith(" EXISTS", Qt::CaseInsensitive)) {
+            return MessageNumber(line);
+        }
+    }
+    return -1;
+}
+
+ImapPoolOptions IdlePoolOptions(const ImapIdleOptions& options)
+{
+    ImapPoolOptions pool;
+    pool.maxPerHost = options.maxIdlePerHost;
+    // An IDLE session serves one mailbox for its lifetime; nothing is worth keeping idle.
+    pool.maxIdlePerAccount = 0;
+    // A full pool means "poll this one", not "wait".
+    pool.acquireTimeoutMs = 0;
+    return pool;
+}
+
+}
+
+struct ImapIdleManager::WatchState {
+    QString key;
+    ResolveRequest account;
+    QString mailbox;
+    ImapSessionLease lease;
+    qint64 exists = -1;
+    qint64 statusMessages = -1;
+    qint64 statusUidNext = -1;
+    int pollMs = 0;
+    bool idleUnsupported = false;
+    bool polling = false;
+    bool everIdled = false;
+    // A blocking step is running; nested event delivery must not tear the session down.
+    bool busy = false;
+    bool lost = false;
+    bool removeRequested = false;
+    bool stoppingIdle = false;
+    bool hasPending = false;
+    SyncJob pending;
+    QTimer pollTimer;
+    QTimer reissueTimer;
+    QTimer coalesceTimer;
+};
+
+ImapIdleManager::ImapIdleManager(ngks::core::mail::sync::JobQueue& jobs, ImapIdleOptions options, QObject* parent)
+    : QObject(parent)
+    , jobs_(jobs)
+    , options_(options)
+    , idlePool_(IdlePoolOptions(options))
+{
+}
+
+ImapIdleManager::~ImapIdleManager()
+{
+    StopAll();
+}
+
+QString ImapIdleManager::WatchKey(const ResolveRequest& account, const QString& mailbox)
+{
+    return ImapConnectionPool::AccountKey(account) + '\n' + mailbox;
+}
+
+void ImapIdleManager::Watch(const ResolveRequest& account, const QString& mailbox)
+{
+    const QString key = WatchKey(account, mailbox);
+    if (watches_.count(key) != 0) {
+        return;
+    }
+
+    auto state = std::make_unique<WatchState>();
+    WatchState& w = *state;
+    w.key = key;
+    w.account = account;
+    w.mailbox = mailbox;
+    w.pollTimer.setSingleShot(true);
+    w.reissueTimer.setSingleShot(true);
+    w.coalesceTimer.setSingleShot(true);
+    connect(&w.pollTimer, &QTimer::timeout, this, [this, key]() { Tick(key); });
+    connect(&w.reissueTimer, &QTimer::timeout, this, [this, key]() { Reissue(key); });
+    connect(&w.coalesceTimer, &QTimer::timeout, this, [this, key]() {
+        auto it = watches_.find(key);
+        if (it != watches_.end()) {
+            FlushPending(*it->second);
+        }
+    });
+    watches_.emplace(key, std::move(state));
+    w.pollTimer.start(0);
+}
+
+void ImapIdleManager::Unwatch(const ResolveRequest& account, const QString& mailbox)
+{
+    auto it = watches_.find(WatchKey(account, mailbox));
+    if (it == watches_.end()) {
+        return;
+    }
+    WatchState& w = *it->second;
+    if (w.busy) {
+        w.removeRequested = true;
+        return;
+    }
+    w.busy = true;
+    FlushPending(w);
+    DropSession(w);
+    watches_.erase(it);
+}
+
+void ImapIdleManager::StopAll()
+{
+    QStringList keys;
+    for (const auto& entry : watches_) {
+        keys.push_back(entry.first);
+    }
+    for (const QString& key : keys) {
+        auto it = watches_.find(key);
+        if (it == watches_.end()) {
+            continue;
+        }
+        if (it->second->busy) {
+            it->second->removeRequested = true;
+            continue;
+        }
+        it->second->busy = true;
+        FlushPending(*it->second);
+        DropSession(*it->second);
+        watches_.erase(it);
+    }
+}
+
+int ImapIdleManager::IdlingCount() const
+{
+    int count = 0;
+    for (const auto& entry : watches_) {
+        count += entry.second->lease ? 1 : 0;
+    }
+    return count;
+}
+
+int ImapIdleManager::PollingCount() const
+{
+    int count = 0;
+    for (const auto& entry : watches_) {
+        count += entry.second->polling ? 1 : 0;
+    }
+    return count;
+}
+
+void ImapIdleManager::Tick(const QString& key)
+{
+    auto it = watches_.find(key);
+    if (it == watches_.end() || it->second->busy || it->second->lease) {
+        return;
+    }
+    WatchState& w = *it->second;
+    w.busy = true;
+    if (!w.idleUnsupported && Establish(w)) {
+        w.polling = false;
+        w.pollMs = 0;
+    } else {
+        w.polling = true;
+        Poll(w);
+    }
+    w.busy = false;
+    Settle(key);
+}
+
+bool ImapIdleManager::Establish(WatchState& w)
+{
+    QString error;
+    ImapSessionLease lease = idlePool_.Acquire(w.account, error);
+    if (!lease) {
+        return false;
+    }
+    if (!lease->HasCapability("IDLE")) {
+        w.idleUnsupported = true;
+        return false;
+    }
+    // EXAMINE: watching must not clear \Recent or change anything else on the server.
+    if (!lease->Select(w.mailbox, true, error)) {
+        return false;
+    }
+
+    const qint64 exists = ExistsFrom(lease->SelectResponses());
+    ImapClient& client = lease->Client();
+    WatchState* state = &w;
+    for (const QByteArray& keyword : kWatchedKeywords) {
+        client.OnUntagged(QString::fromLatin1(keyword), [this, state, keyword](const QString& line) {
+            OnUntaggedLine(*state, keyword, line);
+        });
+    }
+    w.lease = std::move(lease);
+    if (!BeginIdle(w)) {
+        DropSession(w);
+        return false;
+    }
+
+    // Changes made while nobody was listening are unknown; let the sync engine catch up.
+    if (w.everIdled || w.polling) {
+        SyncJob job;
+        job.kind = SyncJobKind::FolderResync;
+        Queue(w, std::move(job));
+    }
+    w.exists = exists;
+    w.everIdled = true;
+    return true;
+}
+
+bool ImapIdleManager::BeginIdle(WatchState& w)
+{
+    const QString key = w.key;
+    return w.lease->Client().StartIdle(
+        [this, key]() {
+            auto it = watches_.find(key);
+            if (it != watches_.end()) {
+                it->second->reissueTimer.start(options_.reissueAfterMs);
+            }
+        },
+        [this, key](bool) {
+            auto it = watches_.find(key);
+            if (it == watches_.end() || it->second->stoppingIdle) {
+                return;
+            }
+            // The server ended IDLE on its own (BYE, dropped connection). Handle it outside the
+            // connection's callback, which is still on the stack.
+            QTimer::singleShot(0, this, [this, key]() { Lost(key); });
+        });
+}
+
+void ImapIdleManager::Reissue(const QString& key)
+{
+    auto it = watches_.find(key);
+    if (it == watches_.end() || !it->second->lease) {
+        return;
+    }
+    WatchState& w = *it->second;
+    if (w.busy) {
+        w.reissueTimer.start(1000);
+        return;
+    }
+
+    w.busy = true;
+    w.stoppingIdle = true;
+    bool ok = w.lease->Client().StopIdle();
+    w.stoppingIdle = false;
+    ok = ok && BeginIdle(w);
+    if (!ok) {
+        w.lost = true;
+    }
+    w.busy = false;
+    Settle(key);
+}
+
+void ImapIdleManager::Lost(const QString& key)
+{
+    auto it = watches_.find(key);
+    if (it == watches_.end() || !it->second->lease) {
+        return;
+    }
+    WatchState& w = *it->second;
+    if (w.busy) {
+        w.lost = true;
+        return;
+    }
+
+    w.busy = true;
+    FlushPending(w);
+    DropSession(w);
+    w.polling = true;
+    w.pollMs = options_.pollMinMs;
+    w.pollTimer.start(w.pollMs);
+    w.busy = false;
+    Settle(key);
+}
+
+void ImapIdleManager::DropSession(WatchState& w)
+{
+    w.reissueTimer.stop();
+    if (!w.lease) {
+        return;
+    }
+    ImapClient& client = w.lease->Client();
+    for (const QByteArray& keyword : kWatchedKeywords) {
+        client.OnUntagged(QString::fromLatin1(keyword), nullptr);
+    }
+    w.stoppingIdle = true;
+    const bool clean = client.IsConnected() && client.StopIdle(5000);
+    w.stoppingIdle = false;
+    if (clean) {
+        w.lease = ImapSessionLease();
+    } else {
+        w.lease.Discard();
+    }
+}
+
+void ImapIdleManager::Poll(WatchState& w)
+{
+    QString error;
+    ImapSessionLease lease = ImapConnectionPool::Instance().Acquire(w.account, error);
+    if (!lease) {
+        ArmPoll(w, false);
+        return;
+    }
+
+    ImapClient& client = lease->Client();
+    const QString tag = client.Submit(QString("STATUS %1 (MESSAGES UIDNEXT)").arg(QuoteMailbox(w.mailbox)),
+                                      {"STATUS"});
+    const QStringList lines = client.Await(tag);
+    if (lines.isEmpty() || !lines.last().startsWith(tag + " OK", Qt::CaseInsensitive)) {
+        if (lines.isEmpty()) {
+            lease.Discard();
+        }
+        ArmPoll(w, false);
+        return;
+    }
+
+    ImapStatusEntry status;
+    for (const QString& line : lines) {
+        const QByteArray raw = line.toUtf8();
+        if (ParseStatusResponse(raw, status)) {
+            break;
+        }
+    }
+
+    bool changed = false;
+    if (w.statusUidNext >= 0 && status.uidNext > w.statusUidNext) {
+        SyncJob job;
+        job.kind = SyncJobKind::NewMessages;
+        job.uidFrom = w.statusUidNext;
+        Queue(w, std::move(job));
+        changed = true;
+    }
+    // Fewer messages than the new arrivals account for: something was expunged, and STATUS
+    // cannot say what.
+    const qint64 arrived = w.statusUidNext >= 0 && status.uidNext >= 0 ? status.uidNext - w.statusUidNext : 0;
+    if (w.statusMessages >= 0 && status.messages >= 0 && status.messages < w.statusMessages + arrived) {
+        SyncJob job;
+        job.kind = SyncJobKind::FolderResync;
+        Queue(w, std::move(job));
+        changed = true;
+    }
+    w.statusMessages = status.messages;
+    w.statusUidNext = status.uidNext;
+    ArmPoll(w, changed);
+}
+
+void ImapIdleManager::ArmPoll(WatchState& w, bool changed)
+{
+    if (w.pollMs <= 0) {
+        w.pollMs = options_.pollInitialMs;
+    } else if (changed) {
+        w.pollMs = qMax(options_.pollMinMs, w.pollMs / 2);
+    } else {
+        w.pollMs = qMin(options_.pollMaxMs, w.pollMs + w.pollMs / 2);
+    }
+    w.pollTimer.start(w.pollMs);
+}
+
+void ImapIdleManager::OnUntaggedLine(WatchState& w, const QByteArray& keyword, const QString& line)
+{
+    if (keyword == "EXISTS") {
+        const qint64 exists = MessageNumber(line);
+        if (exists < 0 || exists == w.exists) {
+            return;
+        }
+        if (w.exists < 0 || exists < w.exists) {
+            // EXISTS never shrinks without EXPUNGE; the count we track is off.
+            Record(w, SyncJobKind::FolderResync);
+        } else {
+            SyncJob& job = Record(w, SyncJobKind::NewMessages);
+            if (job.firstSequence < 0) {
+                job.firstSequence = w.exists + 1;
+            }
+            job.lastSequence = exists;
+        }
+        w.exists = exists;
+        return;
+    }
+
+    if (keyword == "EXPUNGE") {
+        const qint64 sequence = MessageNumber(line);
+        if (sequence < 0) {
+            return;
+        }
+        Record(w, SyncJobKind::Expunged).sequences.push_back(sequence);
+        if (w.exists > 0) {
+            --w.exists;
+        }
+        return;
+    }
+
+    const QByteArray raw = line.toUtf8();
+    ImapFetchEntry entry;
+    if (!ParseFetchResponse(raw, entry) || !entry.hasFlags) {
+        return;
+    }
+    SyncJob& job = Record(w, SyncJobKind::FlagsChanged);
+    job.sequences.push_back(entry.sequence);
+    if (entry.uid >= 0) {
+        job.uids.push_back(entry.uid);
+    }
+}
+
+SyncJob& ImapIdleManager::Record(WatchState& w, SyncJobKind kind)
+{
+    if (w.hasPending && w.pending.kind != kind) {
+        FlushPending(w);
+    }
+    if (!w.hasPending) {
+        w.pending = SyncJob();
+        w.pending.kind = kind;
+        w.hasPending = true;
+        w.coalesceTimer.start(options_.coalesceMs);
+    }
+    return w.pending;
+}
+
+void ImapIdleManager::FlushPending(WatchState& w)
+{
+    w.coalesceTimer.stop();
+    if (!w.hasPending) {
+        return;
+    }
+    w.hasPending = false;
+    Queue(w, std::move(w.pending));
+}
+
+void ImapIdleManager::Queue(WatchState& w, SyncJob job)
+{
+    job.accountEmail = w.account.email;
+    job.mailbox = w.mailbox;
+    jobs_.Enqueue(std::move(job));
+    emit JobQueued(w.account.email, w.mailbox);
+}
+
+void ImapIdleManager::Settle(const QString& key)
+{
+    auto it = watches_.find(key);
+    if (it == watches_.end()) {
+        return;
+    }
+    WatchState& w = *it->second;
+    if (w.removeRequested) {
+        w.busy = true;
+        FlushPending(w);
+        DropSession(w);
+        watches_.erase(it);
+        return;
+    }
+    if (w.lost) {
+        w.lost = false;
+        Lost(key);
+    }
+}
+
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <map>
+#include <memory>
+
+#include "core/mail/providers/imap/ImapConnectionPool.h"
+#include "core/mail/providers/imap/ImapProvider.h"
+#include "core/mail/sync/SyncJob.h"
+
+namespace ngks::core::mail::sync {
+class JobQueue;
+}
+
+namespace ngks::core::mail::providers::imap {
+
+struct ImapIdleOptions {
+    // RFC 2177: servers may drop an IDLE after 30 minutes; re-issue well before that.
+    int reissueAfterMs = 28 * 60 * 1000;
+    // IDLE connections per server. They come from a pool of their own so that watching many
+    // mailboxes cannot starve the shared pool; mailboxes beyond the cap are polled instead.
+    int maxIdlePerHost = 8;
+    // Untagged responses arriving within this window are merged into one job per kind.
+    int coalesceMs = 250;
+    // Polling interval when IDLE is unavailable: starts at pollInitialMs, halves (down to
+    // pollMinMs) when a poll finds changes and grows by half (up to pollMaxMs) when it does not.
+    int pollMinMs = 30 * 1000;
+    int pollInitialMs = 2 * 60 * 1000;
+    int pollMaxMs = 15 * 60 * 1000;
+};
+
+// Push notifications for watched mailboxes. Each mailbox gets its own session that EXAMINEs it
+// and sits in IDLE; EXISTS, EXPUNGE and FETCH responses become targeted SyncJobs instead of a
+// folder refresh. IDLE is re-issued before the server's inactivity limit. When the server does
+// not advertise IDLE, no IDLE connection is free or the session drops, the mailbox is polled
+// with STATUS at an adaptive interval, and IDLE is retried on each poll where it may succeed.
+// Connecting and polling block, so the manager belongs on a worker thread with an event loop,
+// not the GUI thread.
+class ImapIdleManager : public QObject {
+    Q_OBJECT
+
+public:
+    explicit ImapIdleManager(ngks::core::mail::sync::JobQueue& jobs,
+                             ImapIdleOptions options = {},
+                             QObject* parent = nullptr);
+    ~ImapIdleManager() override;
+
+    // Call on the manager's thread; the first connect happens asynchronously.
+    void Watch(const ResolveRequest& account, const QString& mailbox);
+    void Unwatch(const ResolveRequest& account, const QString& mailbox);
+    void StopAll();
+
+    int IdlingCount() const;
+    int PollingCount() const;
+
+signals:
+    void JobQueued(const QString& accountEmail, const QString& mailbox);
+
+private:
+    struct WatchState;
+
+    static QString WatchKey(const ResolveRequest& account, const QString& mailbox);
+
+    void Tick(const QString& key);
+    bool Establish(WatchState& w);
+    bool BeginIdle(WatchState& w);
+    void Reissue(const QString& key);
+    void Lost(const QString& key);
+    void DropSession(WatchState& w);
+    void Poll(WatchState& w);
+    void ArmPoll(WatchState& w, bool changed);
+    void OnUntaggedLine(WatchState& w, const QByteArray& keyword, const QString& line);
+    // Starts or extends the pending job; a different kind flushes the pending one first so
+    // jobs keep the order the server reported the changes in.
+    ngks::core::mail::sync::SyncJob& Record(WatchState& w, ngks::core::mail::sync::SyncJobKind kind);
+    void FlushPending(WatchState& w);
+    void Queue(WatchState& w, ngks::core::mail::sync::SyncJob job);
+    // Ends a blocking step: applies a loss or removal that arrived meanwhile. w may be destroyed.
+    void Settle(const QString& key);
+
+    ngks::core::mail::sync::JobQueue& jobs_;
+    ImapIdleOptions options_;
+    ImapConnectionPool idlePool_;
+    std::map<QString, std::unique_ptr<WatchState>> watches_;
+};
+
+}
@@ -0,0 +1,129 @@
+#include "core/mail/providers/imap/ImapLiteralSink.h"
+
+#include <cstring>
+
+namespace ngks::core::mail::providers::imap {
+
+FileLiteralSink::FileLiteralSink(const QString& path)
+    : file_(path)
+{
+}
+
+bool FileLiteralSink::Begin(qint64 size)
+{
+    error_.clear();
+    expected_ = size;
+    written_ = 0;
+    if (!file_.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        error_ = QString("open failed: %1").arg(file_.errorString());
+        return false;
+    }
+    return true;
+}
+
+bool FileLiteralSink::Write(QByteArrayView chunk)
+{
+    if (file_.write(chunk.data(), chunk.size()) != chunk.size()) {
+        error_ = QString("write failed: %1").arg(file_.errorString());
+        return false;
+    }
+    written_ += chunk.size();
+    return true;
+}
+
+bool FileLiteralSink::Finish()
+{
+    file_.close();
+    if (error_.isEmpty() && written_ != expected_) {
+        error_ = QString("literal truncated: %1 of %2 bytes").arg(written_).arg(expected_);
+    }
+    return error_.isEmpty();
+}
+
+void FileLiteralSink::Abort()
+{
+    file_.close();
+    file_.remove();
+}
+
+MappedFileLiteralSink::MappedFileLiteralSink(const QString& path)
+    : file_(path)
+{
+}
+
+MappedFileLiteralSink::~MappedFileLiteralSink()
+{
+    if (map_ != nullptr) {
+        file_.unmap(map_);
+    }
+}
+
+bool MappedFileLiteralSink::Begin(qint64 size)
+{
+    error_.clear();
+    size_ = size;
+    offset_ = 0;
+    if (!file_.open(QIODevice::ReadWrite | QIODevice::Truncate) || !file_.resize(size)) {
+        error_ = QString("open failed: %1").arg(file_.errorString());
+        return false;
+    }
+    map_ = file_.map(0, size);
+    if (map_ == nullptr) {
+        error_ = QString("map failed: %1").arg(file_.errorString());
+        file_.close();
+        return false;
+    }
+    return true;
+}
+
+bool MappedFileLiteralSink::Write(QByteArrayView chunk)
+{
+    if (offset_ + chunk.size() > size_) {
+        error_ = QStringLiteral("literal overflow");
+        return false;
+    }
+    std::memcpy(map_ + offset_, chunk.data(), static_cast<size_t>(chunk.size()));
+    offset_ += chunk.size();
+    return true;
+}
+
+bool MappedFileLiteralSink::Finish()
+{
+    if (map_ != nullptr) {
+        file_.unmap(map_);
+        map_ = nullptr;
+    }
+    file_.close();
+    return error_.isEmpty() && offset_ == size_;
+}
+
+void MappedFileLiteralSink::Abort()
+{
+    Finish();
+    file_.remove();
+}
+
+BufferLiteralSink::BufferLiteralSink(QByteArray& target)
+    : target_(target)
+{
+}
+
+bool BufferLiteralSink::Begin(qint64 size)
+{
+    target_.resize(0);
+    target_.reserve(size);
+    return true;
+}
+
+bool BufferLiteralSink::Write(QByteArrayView chunk)
+{
+    target_.append(chunk);
+    return true;
+}
+
+bool BufferLiteralSink::Finish()
+{
+    return true;
+}
+
+}
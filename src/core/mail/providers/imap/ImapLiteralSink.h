@@ -0,0 +1,90 @@
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QFile>
+#include <QString>
+#include <functional>
+
+namespace ngks::core::mail::providers::imap {
+
+// Destination for the octets of one {n} literal. The connection streams the payload in
+// receive-sized chunks, so memory stays bounded no matter how large the literal is.
+// Sinks are owned by whoever hands them out; the connection only borrows them.
+class ImapLiteralSink {
+public:
+    virtual ~ImapLiteralSink() = default;
+
+    virtual bool Begin(qint64 size) = 0;
+    virtual bool Write(QByteArrayView chunk) = 0;
+    virtual bool Finish() = 0;
+    // The connection dropped before the literal was complete.
+    virtual void Abort() {}
+
+    QString Error() const { return error_; }
+
+protected:
+    QString error_;
+};
+
+// Decides per literal whether it is spooled: return a sink, or nullptr to keep it inline.
+// responsePrefix is the response up to and including the "{n}" header.
+using ImapLiteralSinkFactory = std::function<ImapLiteralSink*(QByteArrayView responsePrefix, qint64 size)>;
+
+// Streams into a file through regular writes.
+class FileLiteralSink : public ImapLiteralSink {
+public:
+    explicit FileLiteralSink(const QString& path);
+
+    bool Begin(qint64 size) override;
+    bool Write(QByteArrayView chunk) override;
+    bool Finish() override;
+    void Abort() override;
+
+private:
+    QFile file_;
+    qint64 expected_ = 0;
+    qint64 written_ = 0;
+};
+
+// Pre-sizes the file and copies chunks straight into a memory mapping of it.
+class MappedFileLiteralSink : public ImapLiteralSink {
+public:
+    explicit MappedFileLiteralSink(const QString& path);
+    ~MappedFileLiteralSink() override;
+
+    bool Begin(qint64 size) override;
+    bool Write(QByteArrayView chunk) override;
+    bool Finish() override;
+    void Abort() override;
+
+private:
+    QFile file_;
+    uchar* map_ = nullptr;
+    qint64 size_ = 0;
+    qint64 offset_ = 0;
+};
+
+// Collects into a caller-owned buffer; reusing the same QByteArray across fetches keeps its
+// capacity, which makes it a pooled buffer for small and medium parts.
+class BufferLiteralSink : public ImapLiteralSink {
+public:
+    explicit BufferLiteralSink(QByteArray& target);
+
+    bool Begin(qint64 size) override;
+    bool Write(QByteArrayView chunk) override;
+    bool Finish() override;
+
+private:
+    QByteArray& target_;
+};
+
+// Drops the octets; for literals nobody is waiting for any more.
+class DiscardLiteralSink : public ImapLiteralSink {
+public:
+    bool Begin(qint64) override { return true; }
+    bool Write(QByteArrayView) override { return true; }
+    bool Finish() override { return true; }
+};
+
+}
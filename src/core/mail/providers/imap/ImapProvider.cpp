@@ -4,22 +4,23 @@
 #include <QByteArray>
 #include <QDateTime>
 #include <QDir>
-#include <QJsonArray>
-#include <QJsonDocument>
-#include <QJsonObject>
+#include <QHash>
 #include <QRegularExpression>
+#include <deque>
 
 #include "core/mail/providers/imap/ImapClient.h"
+#include "core/mail/providers/imap/ImapConnectionPool.h"
+#include "core/mail/providers/imap/ImapDeflate.h"
+#include "core/mail/providers/imap/ImapFolderList.h"
+#include "core/mail/providers/imap/ImapResponseParsers.h"
+#include "core/mail/providers/imap/ImapTokenizer.h"
 #include "platform/common/Paths.h"
 
 namespace ngks::core::mail::providers::imap {
 
 namespace {
 
-QString MakeTag(int index)
-{
-    return QString("A%1").arg(index, 3, 10, QChar('0'));
-}
+constexpr int kListTimeoutMs = 120000;
 
 QString SanitizeForPath(const QString& value)
 {
@@ -38,53 +39,6 @@ QString EscapeQuoted(const QString& value)
     return out;
 }
 
-QVector<ResolvedFolder> ParseListLines(const QStringList& lines)
-{
-    QVector<ResolvedFolder> folders;
-    const QRegularExpression re(
-        "^\\*\\s+(?:LIST|XLIST)\\s+\\(([^)]*)\\)\\s+\"([^\"]*)\"\\s+(.+)$",
-        QRegularExpression::CaseInsensitiveOption);
-
-    for (const QString& line : lines) {
-        const QRegularExpressionMatch m = re.match(line);
-        if (!m.hasMatch()) continue;
-
-        QString attrs = m.captured(1).trimmed();
-        QString delimiter = m.captured(2);
-        QString mailbox = m.captured(3).trimmed();
-        if (mailbox.startsWith('"') && mailbox.endsWith('"') && mailbox.size() >= 2) {
-            mailbox = mailbox.mid(1, mailbox.size() - 2);
-        }
-        if (mailbox.isEmpty()) continue;
-
-        QString specialUse;
-        if (attrs.contains("\\Inbox", Qt::CaseInsensitive)) specialUse = "\\Inbox";
-        else if (attrs.contains("\\Sent", Qt::CaseInsensitive)) specialUse = "\\Sent";
-        else if (attrs.contains("\\Drafts", Qt::CaseInsensitive)) specialUse = "\\Drafts";
-        else if (attrs.contains("\\Archive", Qt::CaseInsensitive)) specialUse = "\\Archive";
-        else if (attrs.contains("\\Trash", Qt::CaseInsensitive)) specialUse = "\\Trash";
-        else if (attrs.contains("\\Junk", Qt::CaseInsensitive)) specialUse = "\\Junk";
-
-        QJsonObject attrsObj;
-        QJsonArray attrsArray;
-        for (const QString& attr : attrs.split(' ', Qt::SkipEmptyParts)) {
-            attrsArray.push_back(attr);
-        }
-        attrsObj.insert("attrs", attrsArray);
-
-        ResolvedFolder f;
-        f.remoteName = mailbox;
-        const QStringList parts = mailbox.split(delimiter.isEmpty() ? '/' : delimiter[0], Qt::SkipEmptyParts);
-        f.displayName = parts.isEmpty() ? mailbox : parts.last();
-        f.delimiter = delimiter;
-        f.attrsJson = QString::fromUtf8(QJsonDocument(attrsObj).toJson(QJsonDocument::Compact));
-        f.specialUse = specialUse;
-        folders.push_back(f);
-    }
-
-    return folders;
-}
-
 bool IsTaggedOk(const QStringList& lines, const QString& tag)
 {
     for (const QString& line : lines) {
@@ -232,6 +186,21 @@ QString BuildXoauth2FailError(const QString& lastReply,
         .arg(sawPlusContinuation ? "true" : "false");
 }
 
+// False if the response carries no capability list.
+bool UpdateCapabilities(QByteArrayView response, ImapSession& session)
+{
+    ImapCapabilities caps;
+    if (!ParseCapabilityResponse(response, caps)) {
+        return false;
+    }
+    QList<QByteArray> atoms;
+    for (const QByteArrayView atom : caps.atoms) {
+        atoms.push_back(atom.toByteArray().toUpper());
+    }
+    session.SetCapabilities(atoms);
+    return true;
+}
+
 void ExtractLastTaggedAndUntagged(const QStringList& lines,
                                   const QString& tag,
                                   QString& outTagged,
@@ -255,25 +224,21 @@ std::string ImapProvider::Name() const
     return "imap";
 }
 
-bool ImapProvider::ResolveAccount(const ResolveRequest& request,
-                                  QVector<ResolvedFolder>& outFolders,
-                                  QString& outError,
-                                  QString& transcriptPath)
+bool ImapProvider::OpenSession(const ResolveRequest& request, ImapSession& session, QString& outError)
 {
-    outFolders.clear();
     outError.clear();
 
     const auto imapLogRoot =
         QString::fromStdString((ngks::platform::common::ArtifactsDir() / "logs" / "imap").string());
     QDir().mkpath(imapLogRoot);
 
-    transcriptPath = QString("%1/%2_%3.txt")
+    session.transcriptPath_ = QString("%1/%2_%3.txt")
         .arg(imapLogRoot,
              SanitizeForPath(request.email),
              QDateTime::currentDateTimeUtc().toString("yyyyMMdd_HHmmss_zzz"));
 
-    ImapClient client;
-    if (!client.Connect(request.host, request.port, request.tls, transcriptPath)) {
+    ImapClient& client = session.client_;
+    if (!client.Connect(request.host, request.port, request.tls, session.transcriptPath_)) {
         outError = QString("%1; socket_error=%2; socket_error_string=%3; encrypted=%4")
                        .arg(client.LastError())
                        .arg(client.LastSocketErrorCode())
@@ -284,35 +249,22 @@ bool ImapProvider::ResolveAccount(const ResolveRequest& request,
 
     client.ReadGreeting();
 
-    int commandIndex = 1;
-
-    const QString capabilityTag = MakeTag(commandIndex++);
-    if (!client.SendCommand(capabilityTag + " CAPABILITY")) {
-        outError = client.LastError();
-        client.Disconnect();
-        return false;
-    }
-
-    const QStringList capabilityLines = client.ReadResponseUntilTag(capabilityTag);
-    if (!IsTaggedOk(capabilityLines, capabilityTag)) {
+    auto queryCapabilities = [&client, &session]() {
+        const QString tag = client.SubmitStreaming("CAPABILITY", {"CAPABILITY"}, [&session](QByteArrayView response) {
+            UpdateCapabilities(response, session);
+        });
+        return IsTaggedOk(client.Await(tag), tag);
+    };
+    if (!queryCapabilities()) {
         outError = "CAPABILITY failed";
         client.Disconnect();
         return false;
     }
 
-    QString capabilityLine;
-    for (const QString& line : capabilityLines) {
-        if (line.startsWith("* CAPABILITY", Qt::CaseInsensitive)) {
-            capabilityLine = line;
-            break;
-        }
-    }
-
-    const bool hasNamespace = capabilityLine.contains("NAMESPACE", Qt::CaseInsensitive);
-    const bool hasSpecialUse = capabilityLine.contains("SPECIAL-USE", Qt::CaseInsensitive);
-
     // --- AUTH ---
-    const QString authTag = MakeTag(commandIndex++);
+    const QString authTag = client.NextTag();
+    QString authCompletion;
+    QStringList authUntagged;
 
     if (request.useXoauth2) {
         // IMPORTANT: Gmail IMAP ties XOAUTH2 to the authenticated user.
@@ -401,6 +353,7 @@ bool ImapProvider::ResolveAccount(const ResolveRequest& request,
 
             if (line.startsWith("*")) {
                 imapLastUntagged = line;
+                authUntagged.push_back(line);
                 continue;
             }
 
@@ -442,6 +395,7 @@ bool ImapProvider::ResolveAccount(const ResolveRequest& request,
             return false;
         }
 
+        authCompletion = taggedCompletion;
         if (!taggedCompletion.startsWith(authTag + " OK", Qt::CaseInsensitive)) {
             outError = BuildXoauth2FailError(taggedCompletion,
                                             xoauth2ShapeOk,
@@ -475,89 +429,172 @@ bool ImapProvider::ResolveAccount(const ResolveRequest& request,
             client.Disconnect();
             return false;
         }
+        authCompletion = loginLines.last();
+        for (const QString& line : loginLines) {
+            if (line.startsWith("*")) {
+                authUntagged.push_back(line);
+            }
+        }
     }
 
-    // --- NAMESPACE delimiter ---
+    // Capabilities change with authentication. Servers announce the new list in an untagged
+    // CAPABILITY or in the OK response code; ask again if they did neither.
+    bool capabilitiesAnnounced = false;
+    for (const QString& line : authUntagged) {
+        capabilitiesAnnounced = UpdateCapabilities(line.toUtf8(), session) || capabilitiesAnnounced;
+    }
+    capabilitiesAnnounced = UpdateCapabilities(authCompletion.toUtf8(), session) || capabilitiesAnnounced;
+    if (!capabilitiesAnnounced && !queryCapabilities()) {
+        outError = "CAPABILITY failed";
+        client.Disconnect();
+        return false;
+    }
+
+    // --- COMPRESS=DEFLATE (RFC 4978) ---
+    if (request.allowCompress && session.HasCapability("COMPRESS=DEFLATE") && ImapDeflate::Available()) {
+        QString compressError;
+        if (!client.EnableCompression(compressError)) {
+            if (!client.IsConnected()) {
+                outError = compressError;
+                return false;
+            }
+            // Rejected: carry on uncompressed.
+        }
+    }
+
+    return true;
+}
+
+bool ImapProvider::ResolveAccount(const ResolveRequest& request,
+                                  QVector<ResolvedFolder>& outFolders,
+                                  QString& outError,
+                                  QString& transcriptPath)
+{
+    outFolders.clear();
+    outError.clear();
+
+    // Reuses an authenticated session for this account when one is idle in the pool.
+    ImapSessionLease session = ImapConnectionPool::Instance().Acquire(request, outError);
+    if (!session) {
+        return false;
+    }
+    transcriptPath = session->TranscriptPath();
+    ImapClient& client = session->Client();
+    const bool hasNamespace = session->HasCapability("NAMESPACE");
+    const bool hasSpecialUse = session->HasCapability("SPECIAL-USE");
+    const bool hasListStatus = request.withStatus && session->HasCapability("LIST-STATUS");
+    const QString statusItems = session->HasCapability("CONDSTORE") || session->HasCapability("QRESYNC")
+        ? QStringLiteral("MESSAGES UNSEEN UIDNEXT UIDVALIDITY HIGHESTMODSEQ")
+        : QStringLiteral("MESSAGES UNSEEN UIDNEXT UIDVALIDITY");
+
+    // --- Discovery pipeline ---
+    // Everything after authentication is independent, so NAMESPACE and both LISTs go out in
+    // one flight and cost a single round trip instead of one per command. Responses are
+    // parsed as they arrive and merged by name, never held as text.
     QString delimiter = "/";
+    FolderListBuilder builder;
+
+    const QString namespaceTag = !hasNamespace ? QString() : client.SubmitStreaming(
+        "NAMESPACE", {"NAMESPACE"}, [&delimiter](QByteArrayView response) {
+            QByteArrayView prefix;
+            QByteArrayView personalDelimiter;
+            if (ParseNamespaceResponse(response, prefix, personalDelimiter) && prefix.isEmpty()) {
+                delimiter = QString::fromUtf8(ImapTokenizer::Unescape(personalDelimiter));
+            }
+        });
+
+    // With LIST-STATUS the counts (and, with SPECIAL-USE, the special-use attributes) come
+    // back inside the one LIST, each STATUS right after its mailbox's LIST line.
+    QString listTag;
+    if (hasListStatus) {
+        const QString command = QString("LIST \"\" \"*\" RETURN (%1STATUS (%2))")
+                                    .arg(hasSpecialUse ? "SPECIAL-USE " : "", statusItems);
+        listTag = client.SubmitStreaming(command, {"LIST", "STATUS"}, [&builder](QByteArrayView response) {
+            builder.AddListResponse(response);
+            builder.AddStatusResponse(response);
+        });
+    } else {
+        listTag = client.SubmitStreaming("LIST \"\" \"*\"", {"LIST"}, [&builder](QByteArrayView response) {
+            builder.AddListResponse(response);
+        });
+    }
+    const auto collectSpecial = [&builder](QByteArrayView response) {
+        builder.AddSpecialUseResponse(response);
+    };
+    QString suTag;
+    if (!hasSpecialUse) {
+        suTag = client.SubmitStreaming("XLIST \"\" \"*\"", {"XLIST"}, collectSpecial);
+    } else if (!hasListStatus) {
+        suTag = client.SubmitStreaming("LIST (SPECIAL-USE) \"\" \"*\"", {"LIST"}, collectSpecial);
+    }
 
+    // --- NAMESPACE delimiter ---
     if (hasNamespace) {
-        const QString namespaceTag = MakeTag(commandIndex++);
-        if (!client.SendCommand(namespaceTag + " NAMESPACE")) {
-            outError = client.LastError();
-            client.Disconnect();
-            return false;
-        }
-        const QStringList nsLines = client.ReadResponseUntilTag(namespaceTag);
+        const QStringList nsLines = client.Await(namespaceTag);
         if (!IsTaggedOk(nsLines, namespaceTag)) {
             outError = "NAMESPACE failed";
-            client.Disconnect();
+            session.Discard();
             return false;
         }
-        const QRegularExpression delimRe("\"\"\\s+\"([^\"]*)\"");
-        for (const QString& line : nsLines) {
-            const QRegularExpressionMatch m = delimRe.match(line);
-            if (m.hasMatch()) {
-                delimiter = m.captured(1);
-                break;
-            }
-        }
     }
 
     // --- LIST folders ---
-    const QString listTag = MakeTag(commandIndex++);
-    if (!client.SendCommand(listTag + " LIST \"\" \"*\"")) {
-        outError = client.LastError();
-        client.Disconnect();
-        return false;
-    }
-    const QStringList listLines = client.ReadResponseUntilTag(listTag);
+    // Large hierarchies take a while to list; allow for it.
+    const QStringList listLines = client.Await(listTag, kListTimeoutMs);
     if (!IsTaggedOk(listLines, listTag)) {
         outError = "LIST failed";
-        client.Disconnect();
+        session.Discard();
         return false;
     }
-    outFolders = ParseListLines(listLines);
-
-    // --- Special-use mapping ---
-    if (hasSpecialUse) {
-        const QString suTag = MakeTag(commandIndex++);
-        if (client.SendCommand(suTag + " LIST (SPECIAL-USE) \"\" \"*\"")) {
-            const QStringList suLines = client.ReadResponseUntilTag(suTag);
-            const QVector<ResolvedFolder> suFolders = ParseListLines(suLines);
-            for (const auto& folder : suFolders) {
-                for (auto& existing : outFolders) {
-                    if (existing.remoteName.compare(folder.remoteName, Qt::CaseInsensitive) == 0 &&
-                        !folder.specialUse.isEmpty()) {
-                        existing.specialUse = folder.specialUse;
-                    }
-                }
+
+    // --- Special-use mapping (SPECIAL-USE, or XLIST on older servers) ---
+    if (!suTag.isEmpty()) {
+        client.Await(suTag, kListTimeoutMs);
+    }
+
+    outFolders = builder.Finish(delimiter);
+
+    // --- Counts without LIST-STATUS: STATUS per folder, pipelined ---
+    if (request.withStatus && !hasListStatus) {
+        // A sliding window bounds what is queued while still costing about one round trip.
+        constexpr int kStatusInFlight = 128;
+        QHash<QString, int> byName;
+        std::deque<QString> inFlight;
+        const auto collect = [&outFolders, &byName](QByteArrayView response) {
+            ImapStatusEntry entry;
+            if (!ParseStatusResponse(response, entry)) {
+                return;
             }
-        }
-    } else {
-        const QString xlistTag = MakeTag(commandIndex++);
-        if (client.SendCommand(xlistTag + " XLIST \"\" \"*\"")) {
-            const QStringList xlLines = client.ReadResponseUntilTag(xlistTag);
-            const QVector<ResolvedFolder> xlFolders = ParseListLines(xlLines);
-            for (const auto& folder : xlFolders) {
-                for (auto& existing : outFolders) {
-                    if (existing.remoteName.compare(folder.remoteName, Qt::CaseInsensitive) == 0 &&
-                        !folder.specialUse.isEmpty()) {
-                        existing.specialUse = folder.specialUse;
-                    }
-                }
+            const auto it = byName.constFind(entry.MailboxName());
+            if (it == byName.constEnd()) {
+                return;
+            }
+            ResolvedFolder& folder = outFolders[it.value()];
+            folder.hasStatus = true;
+            folder.status.messages = entry.messages;
+            folder.status.unseen = entry.unseen;
+            folder.status.uidNext = entry.uidNext;
+            folder.status.uidValidity = entry.uidValidity;
+            folder.status.highestModSeq = entry.highestModSeq;
+        };
+        for (int i = 0; i < outFolders.size(); ++i) {
+            const ResolvedFolder& folder = outFolders[i];
+            if (!folder.Selectable()) {
+                continue;
             }
+            byName.insert(folder.remoteName, i);
+            if (static_cast<int>(inFlight.size()) >= kStatusInFlight) {
+                client.Await(inFlight.front());
+                inFlight.pop_front();
+            }
+            inFlight.push_back(client.SubmitStreaming(
+                QString("STATUS \"%1\" (%2)").arg(EscapeQuoted(folder.remoteName), statusItems), {"STATUS"}, collect));
+        }
+        for (const QString& tag : inFlight) {
+            client.Await(tag);
         }
     }
 
-    for (auto& folder : outFolders) {
-        if (folder.delimiter.isEmpty()) folder.delimiter = delimiter;
-    }
-
-    const QString logoutTag = MakeTag(commandIndex++);
-    client.SendCommand(logoutTag + " LOGOUT");
-    client.ReadResponseUntilTag(logoutTag);
-    client.Disconnect();
-
     if (outFolders.isEmpty()) {
         outError = "No folders returned by server";
         return false;
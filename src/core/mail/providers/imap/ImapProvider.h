@@ -1,12 +1,15 @@
 #pragma once
 
-#include <QVector>
 #include <QString>
+#include <QStringList>
+#include <QVector>
 
 #include "core/mail/providers/Provider.h"
 
 namespace ngks::core::mail::providers::imap {
 
+class ImapSession;
+
 struct ResolveRequest {
     QString email;
     QString host;
@@ -16,20 +19,72 @@ struct ResolveRequest {
     QString password;
     bool useXoauth2 = false;
     QString oauthAccessToken;
+    // Negotiate COMPRESS=DEFLATE when the server offers it.
+    bool allowCompress = true;
+    // Also fetch per-folder counts during ResolveAccount.
+    bool withStatus = true;
+};
+
+// STATUS counts; -1 when the server did not report the item.
+struct ResolvedFolderStatus {
+    qint64 messages = -1;
+    qint64 unseen = -1;
+    qint64 uidNext = -1;
+    qint64 uidValidity = -1;
+    qint64 highestModSeq = -1;
+};
+
+// LIST attributes (RFC 3501, 3348, 5258, 6154 and XLIST) as bits; unknown ones are kept as
+// text in ResolvedFolder::extraAttributes.
+enum class FolderAttribute : quint32 {
+    NoSelect = 1u << 0,
+    NonExistent = 1u << 1,
+    NoInferiors = 1u << 2,
+    HasChildren = 1u << 3,
+    HasNoChildren = 1u << 4,
+    Marked = 1u << 5,
+    Unmarked = 1u << 6,
+    Subscribed = 1u << 7,
+    Remote = 1u << 8,
+    All = 1u << 9,
+    Archive = 1u << 10,
+    Drafts = 1u << 11,
+    Flagged = 1u << 12,
+    Junk = 1u << 13,
+    Sent = 1u << 14,
+    Trash = 1u << 15,
+    Inbox = 1u << 16,
+    Important = 1u << 17
 };
 
 struct ResolvedFolder {
     QString remoteName;
     QString displayName;
     QString delimiter;
-    QString attrsJson;
     QString specialUse;
+    quint32 attributes = 0;
+    QStringList extraAttributes;
+    bool hasStatus = false;
+    ResolvedFolderStatus status;
+
+    bool HasAttribute(FolderAttribute attribute) const;
+    // False for \Noselect and \NonExistent entries.
+    bool Selectable() const;
+    // {"attrs":[...]} as stored in folders.attrs_json; built on demand.
+    QString AttrsJson() const;
 };
 
 class ImapProvider : public Provider {
 public:
     std::string Name() const override;
+    // Lists the account's folders. With request.withStatus the counts come along: in the LIST
+    // itself when the server has LIST-STATUS (RFC 5819), otherwise from pipelined STATUS
+    // commands, so either way it costs about one extra round trip rather than one per folder.
     bool ResolveAccount(const ResolveRequest& request, QVector<ResolvedFolder>& outFolders, QString& outError, QString& transcriptPath);
+
+    // Connects, reads the greeting and CAPABILITY, and authenticates (LOGIN or XOAUTH2).
+    // Used by ImapConnectionPool to open new sessions.
+    static bool OpenSession(const ResolveRequest& request, ImapSession& session, QString& outError);
 };
 
 }
@@ -0,0 +1,693 @@
+#include "core/mail/providers/imap/ImapResponseParsers.h"
+
+#include "core/mail/providers/imap/ImapTokenizer.h"
+
+#include <utility>
+
+namespace ngks::core::mail::providers::imap {
+
+namespace {
+
+bool EqualsUpper(QByteArrayView text, const char* upperName)
+{
+    return ImapTokenizer::IsAtom(ImapToken{ImapTokenType::Atom, text, 0}, upperName);
+}
+
+bool StartsWithUpper(QByteArrayView text, const char* upperPrefix)
+{
+    qsizetype i = 0;
+    for (; upperPrefix[i] != '\0'; ++i) {
+        if (i >= text.size()) {
+            return false;
+        }
+        char c = text[i];
+        if (c >= 'a' && c <= 'z') {
+            c = static_cast<char>(c - 'a' + 'A');
+        }
+        if (c != upperPrefix[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool IsStar(const ImapToken& token)
+{
+    return token.type == ImapTokenType::Atom && token.text.size() == 1 && token.text[0] == '*';
+}
+
+bool IsString(const ImapToken& token)
+{
+    return token.type == ImapTokenType::Atom || token.type == ImapTokenType::Quoted
+        || token.type == ImapTokenType::Literal;
+}
+
+bool NextNumber(ImapTokenizer& tok, qint64& out)
+{
+    const ImapToken token = tok.Next();
+    return token.type == ImapTokenType::Atom && ImapTokenizer::ToNumber(token.text, out);
+}
+
+// Consumes "* KEYWORD" and returns false if the response is not that untagged response.
+bool ExpectUntagged(ImapTokenizer& tok, const char* upperKeyword)
+{
+    if (!IsStar(tok.Next())) {
+        return false;
+    }
+    return EqualsUpper(tok.Next().text, upperKeyword);
+}
+
+qsizetype IndexOf(QByteArrayView text, char c, qsizetype from = 0)
+{
+    for (qsizetype i = from; i < text.size(); ++i) {
+        if (text[i] == c) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool NextNString(ImapTokenizer& tok, ImapNString& out)
+{
+    const ImapToken token = tok.Next();
+    out = ImapNString();
+    if (token.type == ImapTokenType::Nil) {
+        return true;
+    }
+    if (!IsString(token)) {
+        return false;
+    }
+    out.text = token.text;
+    out.quoted = token.type == ImapTokenType::Quoted;
+    out.isNil = false;
+    return true;
+}
+
+// "((name adl mailbox host) ...)" or NIL.
+template <typename List>
+bool NextAddressList(ImapTokenizer& tok, List& out)
+{
+    const ImapToken open = tok.Next();
+    if (open.type == ImapTokenType::Nil) {
+        return true;
+    }
+    if (open.type != ImapTokenType::ListOpen) {
+        return false;
+    }
+    for (ImapToken next = tok.Next(); next.type != ImapTokenType::ListClose; next = tok.Next()) {
+        if (next.type != ImapTokenType::ListOpen) {
+            return false;
+        }
+        ImapAddress address;
+        ImapNString adl;
+        if (!NextNString(tok, address.name) || !NextNString(tok, adl) || !NextNString(tok, address.mailbox)
+            || !NextNString(tok, address.host) || tok.Next().type != ImapTokenType::ListClose) {
+            return false;
+        }
+        if (!address.host.isNil) {
+            out.push_back(address);
+        }
+    }
+    return true;
+}
+
+// "(key value ...)" or NIL; picks out the values of the two keys asked for.
+bool NextBodyParams(ImapTokenizer& tok, const char* upperKey1, ImapNString& out1, const char* upperKey2, ImapNString& out2)
+{
+    const ImapToken open = tok.Next();
+    if (open.type == ImapTokenType::Nil) {
+        return true;
+    }
+    if (open.type != ImapTokenType::ListOpen) {
+        return false;
+    }
+    while (tok.Peek().type != ImapTokenType::ListClose) {
+        ImapNString key;
+        ImapNString value;
+        if (!NextNString(tok, key) || !NextNString(tok, value)) {
+            return false;
+        }
+        if (EqualsUpper(key.text, upperKey1)) {
+            out1 = value;
+        } else if (upperKey2 != nullptr && EqualsUpper(key.text, upperKey2)) {
+            out2 = value;
+        }
+    }
+    tok.Next();
+    return true;
+}
+
+// Skips what is left of the current list, including its closing parenthesis.
+bool SkipRestOfList(ImapTokenizer& tok)
+{
+    for (;;) {
+        const ImapTokenType next = tok.Peek().type;
+        if (next == ImapTokenType::ListClose) {
+            tok.Next();
+            return true;
+        }
+        if (next == ImapTokenType::End || next == ImapTokenType::Error || !tok.SkipValue()) {
+            return false;
+        }
+    }
+}
+
+// One body after its opening parenthesis. Nesting is bounded so a hostile server cannot
+// exhaust the stack.
+bool NextBodyPart(ImapTokenizer& tok, const QByteArray& section, int depth, QVector<ImapBodyPart>& out)
+{
+    if (depth > 32) {
+        return false;
+    }
+    if (tok.Peek().type == ImapTokenType::ListOpen) {
+        // multipart: the children, then subtype and extension data.
+        int child = 1;
+        while (tok.Peek().type == ImapTokenType::ListOpen) {
+            tok.Next();
+            const QByteArray number = QByteArray::number(child++);
+            if (!NextBodyPart(tok, section.isEmpty() ? number : section + '.' + number, depth + 1, out)) {
+                return false;
+            }
+        }
+        return SkipRestOfList(tok);
+    }
+
+    ImapBodyPart part;
+    part.section = section.isEmpty() ? QByteArray("1") : section;
+    ImapNString unused;
+    ImapNString description;
+    if (!NextNString(tok, part.type) || !NextNString(tok, part.subtype)
+        || !NextBodyParams(tok, "CHARSET", part.charset, "NAME", part.name) || !NextNString(tok, part.id)
+        || !NextNString(tok, description) || !NextNString(tok, part.encoding) || !NextNumber(tok, part.size)) {
+        return false;
+    }
+    if (EqualsUpper(part.type.text, "MESSAGE") && EqualsUpper(part.subtype.text, "RFC822")) {
+        // envelope, body and line count of the embedded message
+        if (!tok.SkipValue() || !tok.SkipValue() || !tok.SkipValue()) {
+            return false;
+        }
+    } else if (EqualsUpper(part.type.text, "TEXT")) {
+        if (!tok.SkipValue()) {
+            return false;
+        }
+    }
+    // Extension data: md5, then disposition ("attachment" ("filename" "x")).
+    if (tok.Peek().type != ImapTokenType::ListClose && !tok.SkipValue()) {
+        return false;
+    }
+    if (tok.Peek().type == ImapTokenType::ListOpen) {
+        tok.Next();
+        if (!NextNString(tok, part.disposition)
+            || !NextBodyParams(tok, "FILENAME", part.filename, nullptr, unused)
+            || !SkipRestOfList(tok)) {
+            return false;
+        }
+    }
+    out.push_back(part);
+    return SkipRestOfList(tok);
+}
+
+QString DecodeMailbox(QByteArrayView mailbox, bool quoted)
+{
+    if (quoted) {
+        return QString::fromUtf8(ImapTokenizer::Unescape(mailbox));
+    }
+    return QString::fromUtf8(mailbox);
+}
+
+}
+
+bool ImapCapabilities::Has(const char* upperName) const
+{
+    for (const QByteArrayView atom : atoms) {
+        if (EqualsUpper(atom, upperName)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ImapListEntry::HasAttribute(const char* upperName) const
+{
+    for (const QByteArrayView attr : attributes) {
+        if (EqualsUpper(attr, upperName)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+QString ImapListEntry::MailboxName() const
+{
+    return DecodeMailbox(mailbox, mailboxQuoted);
+}
+
+QString ImapStatusEntry::MailboxName() const
+{
+    return DecodeMailbox(mailbox, mailboxQuoted);
+}
+
+QByteArray ImapNString::Bytes() const
+{
+    if (isNil) {
+        return QByteArray();
+    }
+    return quoted ? ImapTokenizer::Unescape(text) : text.toByteArray();
+}
+
+bool ParseCapabilityResponse(QByteArrayView response, ImapCapabilities& out)
+{
+    out.atoms.clear();
+
+    qsizetype start = -1;
+    qsizetype end = response.size();
+    if (StartsWithUpper(response, "* CAPABILITY ")) {
+        start = 13;
+    } else {
+        const qsizetype code = response.indexOf("[CAPABILITY ");
+        if (code < 0) {
+            return false;
+        }
+        start = code + 12;
+        end = response.indexOf(']', start);
+        if (end < 0) {
+            return false;
+        }
+    }
+
+    qsizetype pos = start;
+    while (pos < end) {
+        while (pos < end && response[pos] == ' ') {
+            ++pos;
+        }
+        const qsizetype atomStart = pos;
+        while (pos < end && response[pos] != ' ') {
+            ++pos;
+        }
+        if (pos > atomStart) {
+            out.atoms.push_back(response.sliced(atomStart, pos - atomStart));
+        }
+    }
+    return !out.atoms.isEmpty();
+}
+
+bool ParseListResponse(QByteArrayView response, ImapListEntry& out)
+{
+    out = ImapListEntry();
+
+    ImapTokenizer tok(response);
+    if (!IsStar(tok.Next())) {
+        return false;
+    }
+    const ImapToken verb = tok.Next();
+    if (ImapTokenizer::IsAtom(verb, "XLIST")) {
+        out.isXlist = true;
+    } else if (!ImapTokenizer::IsAtom(verb, "LIST")) {
+        return false;
+    }
+
+    if (tok.Next().type != ImapTokenType::ListOpen) {
+        return false;
+    }
+    for (ImapToken attr = tok.Next(); attr.type != ImapTokenType::ListClose; attr = tok.Next()) {
+        if (attr.type != ImapTokenType::Atom) {
+            return false;
+        }
+        out.attributes.push_back(attr.text);
+    }
+
+    const ImapToken delimiter = tok.Next();
+    if (delimiter.type == ImapTokenType::Quoted) {
+        out.delimiter = delimiter.text;
+    } else if (delimiter.type != ImapTokenType::Nil) {
+        return false;
+    }
+
+    const ImapToken mailbox = tok.Next();
+    if (!IsString(mailbox) && mailbox.type != ImapTokenType::Nil) {
+        return false;
+    }
+    out.mailbox = mailbox.text;
+    out.mailboxQuoted = mailbox.type == ImapTokenType::Quoted;
+    return !out.mailbox.isEmpty();
+}
+
+bool ParseStatusResponse(QByteArrayView response, ImapStatusEntry& out)
+{
+    out = ImapStatusEntry();
+
+    ImapTokenizer tok(response);
+    if (!ExpectUntagged(tok, "STATUS")) {
+        return false;
+    }
+    const ImapToken mailbox = tok.Next();
+    if (!IsString(mailbox)) {
+        return false;
+    }
+    out.mailbox = mailbox.text;
+    out.mailboxQuoted = mailbox.type == ImapTokenType::Quoted;
+
+    if (tok.Next().type != ImapTokenType::ListOpen) {
+        return false;
+    }
+    for (ImapToken key = tok.Next(); key.type != ImapTokenType::ListClose; key = tok.Next()) {
+        qint64 value = -1;
+        if (key.type != ImapTokenType::Atom || !NextNumber(tok, value)) {
+            return false;
+        }
+        if (EqualsUpper(key.text, "MESSAGES")) {
+            out.messages = value;
+        } else if (EqualsUpper(key.text, "RECENT")) {
+            out.recent = value;
+        } else if (EqualsUpper(key.text, "UIDNEXT")) {
+            out.uidNext = value;
+        } else if (EqualsUpper(key.text, "UIDVALIDITY")) {
+            out.uidValidity = value;
+        } else if (EqualsUpper(key.text, "UNSEEN")) {
+            out.unseen = value;
+        } else if (EqualsUpper(key.text, "HIGHESTMODSEQ")) {
+            out.highestModSeq = value;
+        }
+    }
+    return true;
+}
+
+bool ParseFetchResponse(QByteArrayView response, ImapFetchEntry& out)
+{
+    out = ImapFetchEntry();
+
+    ImapTokenizer tok(response);
+    if (!IsStar(tok.Next())) {
+        return false;
+    }
+    if (!NextNumber(tok, out.sequence) || !ImapTokenizer::IsAtom(tok.Next(), "FETCH")) {
+        return false;
+    }
+    if (tok.Next().type != ImapTokenType::ListOpen) {
+        return false;
+    }
+
+    for (ImapToken key = tok.Next(); key.type != ImapTokenType::ListClose; key = tok.Next()) {
+        if (key.type != ImapTokenType::Atom) {
+            return false;
+        }
+
+        if (EqualsUpper(key.text, "UID")) {
+            if (!NextNumber(tok, out.uid)) {
+                return false;
+            }
+        } else if (EqualsUpper(key.text, "RFC822.SIZE")) {
+            if (!NextNumber(tok, out.size)) {
+                return false;
+            }
+        } else if (EqualsUpper(key.text, "FLAGS")) {
+            if (tok.Next().type != ImapTokenType::ListOpen) {
+                return false;
+            }
+            for (ImapToken flag = tok.Next(); flag.type != ImapTokenType::ListClose; flag = tok.Next()) {
+                if (flag.type != ImapTokenType::Atom) {
+                    return false;
+                }
+                out.flags.push_back(flag.text);
+            }
+            out.hasFlags = true;
+        } else if (EqualsUpper(key.text, "INTERNALDATE")) {
+            const ImapToken date = tok.Next();
+            if (date.type != ImapTokenType::Quoted) {
+                return false;
+            }
+            out.internalDate = date.text;
+        } else if (EqualsUpper(key.text, "MODSEQ")) {
+            if (tok.Next().type != ImapTokenType::ListOpen || !NextNumber(tok, out.modSeq)
+                || tok.Next().type != ImapTokenType::ListClose) {
+                return false;
+            }
+        } else if (EqualsUpper(key.text, "ENVELOPE")) {
+            out.envelope = tok.NextValueSpan();
+            if (out.envelope.isEmpty()) {
+                return false;
+            }
+        } else if (EqualsUpper(key.text, "BODYSTRUCTURE") || EqualsUpper(key.text, "BODY")) {
+            out.bodyStructure = tok.NextValueSpan();
+            if (out.bodyStructure.isEmpty()) {
+                return false;
+            }
+        } else if (StartsWithUpper(key.text, "BODY[") || StartsWithUpper(key.text, "BINARY[")
+                   || StartsWithUpper(key.text, "BINARY.SIZE[") || StartsWithUpper(key.text, "RFC822")) {
+            const ImapToken data = tok.Next();
+            if (!IsString(data) && data.type != ImapTokenType::Nil) {
+                return false;
+            }
+            ImapFetchSection section;
+            section.name = key.text;
+            section.isNil = data.type == ImapTokenType::Nil;
+            section.data = section.isNil ? QByteArrayView() : data.text;
+            section.spooled = data.spooled;
+            section.size = data.type == ImapTokenType::Literal ? data.literalSize : section.data.size();
+            out.sections.push_back(section);
+        } else if (!tok.SkipValue()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ParseEnvelope(QByteArrayView span, ImapEnvelope& out)
+{
+    out = ImapEnvelope();
+
+    ImapTokenizer tok(span);
+    if (tok.Next().type != ImapTokenType::ListOpen) {
+        return false;
+    }
+    QVarLengthArray<ImapAddress, 1> sender;
+    QVarLengthArray<ImapAddress, 1> replyTo;
+    QVarLengthArray<ImapAddress, 1> bcc;
+    if (!NextNString(tok, out.date) || !NextNString(tok, out.subject) || !NextAddressList(tok, out.from)
+        || !NextAddressList(tok, sender) || !NextAddressList(tok, replyTo) || !NextAddressList(tok, out.to)
+        || !NextAddressList(tok, out.cc) || !NextAddressList(tok, bcc) || !NextNString(tok, out.inReplyTo)
+        || !NextNString(tok, out.messageId)) {
+        return false;
+    }
+    return tok.Next().type == ImapTokenType::ListClose;
+}
+
+bool ParseBodyStructure(QByteArrayView span, QVector<ImapBodyPart>& out)
+{
+    out.clear();
+    ImapTokenizer tok(span);
+    if (tok.Next().type != ImapTokenType::ListOpen) {
+        return false;
+    }
+    return NextBodyPart(tok, QByteArray(), 0, out);
+}
+
+bool ParseEsearchResponse(QByteArrayView response, ImapEsearchEntry& out)
+{
+    out = ImapEsearchEntry();
+
+    ImapTokenizer tok(response);
+    if (!ExpectUntagged(tok, "ESEARCH")) {
+        return false;
+    }
+
+    if (tok.Peek().type == ImapTokenType::ListOpen) {
+        tok.Next();
+        if (!ImapTokenizer::IsAtom(tok.Next(), "TAG")) {
+            return false;
+        }
+        const ImapToken tag = tok.Next();
+        if (!IsString(tag) || tok.Next().type != ImapTokenType::ListClose) {
+            return false;
+        }
+        out.tag = tag.text;
+    }
+
+    while (!tok.AtEnd()) {
+        const ImapToken key = tok.Next();
+        if (key.type != ImapTokenType::Atom) {
+            return false;
+        }
+        if (EqualsUpper(key.text, "UID")) {
+            out.uid = true;
+        } else if (EqualsUpper(key.text, "MIN")) {
+            if (!NextNumber(tok, out.min)) {
+                return false;
+            }
+        } else if (EqualsUpper(key.text, "MAX")) {
+            if (!NextNumber(tok, out.max)) {
+                return false;
+            }
+        } else if (EqualsUpper(key.text, "COUNT")) {
+            if (!NextNumber(tok, out.count)) {
+                return false;
+            }
+        } else if (EqualsUpper(key.text, "MODSEQ")) {
+            if (!NextNumber(tok, out.modSeq)) {
+                return false;
+            }
+        } else if (EqualsUpper(key.text, "ALL")) {
+            const ImapToken set = tok.Next();
+            if (set.type != ImapTokenType::Atom) {
+                return false;
+            }
+            out.all = set.text;
+        } else if (!tok.SkipValue()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ParseSearchResponse(QByteArrayView response, QVector<qint64>& out)
+{
+    ImapTokenizer tok(response);
+    if (!ExpectUntagged(tok, "SEARCH")) {
+        return false;
+    }
+    while (!tok.AtEnd()) {
+        const ImapToken token = tok.Next();
+        if (token.type == ImapTokenType::ListOpen) {
+            // CONDSTORE's trailing (MODSEQ n).
+            break;
+        }
+        qint64 number = 0;
+        if (token.type != ImapTokenType::Atom || !ImapTokenizer::ToNumber(token.text, number)) {
+            return false;
+        }
+        out.push_back(number);
+    }
+    return true;
+}
+
+bool ParseNamespaceResponse(QByteArrayView response, QByteArrayView& outPrefix, QByteArrayView& outDelimiter)
+{
+    outPrefix = QByteArrayView();
+    outDelimiter = QByteArrayView();
+
+    ImapTokenizer tok(response);
+    if (!ExpectUntagged(tok, "NAMESPACE")) {
+        return false;
+    }
+    // Personal namespaces: NIL or ((prefix delim ext...) ...).
+    const ImapToken personal = tok.Next();
+    if (personal.type != ImapTokenType::ListOpen || tok.Next().type != ImapTokenType::ListOpen) {
+        return false;
+    }
+    const ImapToken prefix = tok.Next();
+    const ImapToken delimiter = tok.Next();
+    if (!IsString(prefix) || (delimiter.type != ImapTokenType::Quoted && delimiter.type != ImapTokenType::Nil)) {
+        return false;
+    }
+    outPrefix = prefix.text;
+    outDelimiter = delimiter.text;
+    return true;
+}
+
+bool ParseSelectResponse(QByteArrayView response, ImapMailboxState& out)
+{
+    if (!response.startsWith("* ")) {
+        return false;
+    }
+    const QByteArrayView rest = response.sliced(2);
+
+    const qsizetype space = IndexOf(rest, ' ');
+    qint64 number = -1;
+    if (space > 0 && ImapTokenizer::ToNumber(rest.first(space), number)) {
+        if (!StartsWithUpper(rest.sliced(space + 1), "EXISTS")) {
+            return false;
+        }
+        out.exists = number;
+        return true;
+    }
+
+    if (!StartsWithUpper(rest, "OK [")) {
+        return false;
+    }
+    QByteArrayView code = rest.sliced(4);
+    const qsizetype close = IndexOf(code, ']');
+    if (close < 0) {
+        return false;
+    }
+    code = code.first(close);
+    const qsizetype split = IndexOf(code, ' ');
+    const QByteArrayView key = split < 0 ? code : code.first(split);
+    const QByteArrayView value = split < 0 ? QByteArrayView() : code.sliced(split + 1);
+
+    if (EqualsUpper(key, "NOMODSEQ")) {
+        out.noModSeq = true;
+        return true;
+    }
+    if (!ImapTokenizer::ToNumber(value, number)) {
+        return false;
+    }
+    if (EqualsUpper(key, "UIDVALIDITY")) {
+        out.uidValidity = number;
+    } else if (EqualsUpper(key, "UIDNEXT")) {
+        out.uidNext = number;
+    } else if (EqualsUpper(key, "HIGHESTMODSEQ")) {
+        out.highestModSeq = number;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool ParseVanishedResponse(QByteArrayView response, bool& outEarlier, QByteArrayView& outSet)
+{
+    outEarlier = false;
+    outSet = QByteArrayView();
+
+    ImapTokenizer tok(response);
+    if (!ExpectUntagged(tok, "VANISHED")) {
+        return false;
+    }
+    if (tok.Peek().type == ImapTokenType::ListOpen) {
+        tok.Next();
+        if (!ImapTokenizer::IsAtom(tok.Next(), "EARLIER") || tok.Next().type != ImapTokenType::ListClose) {
+            return false;
+        }
+        outEarlier = true;
+    }
+    const ImapToken set = tok.Next();
+    if (set.type != ImapTokenType::Atom) {
+        return false;
+    }
+    outSet = set.text;
+    return true;
+}
+
+bool ParseSequenceSet(QByteArrayView set, qint64 star, QVector<ImapSequenceRange>& out)
+{
+    qsizetype pos = 0;
+    while (pos < set.size()) {
+        qsizetype end = IndexOf(set, ',', pos);
+        if (end < 0) {
+            end = set.size();
+        }
+        const QByteArrayView part = set.sliced(pos, end - pos);
+        const qsizetype colon = IndexOf(part, ':');
+        const QByteArrayView lo = colon < 0 ? part : part.first(colon);
+        const QByteArrayView hi = colon < 0 ? part : part.sliced(colon + 1);
+
+        ImapSequenceRange range;
+        if (lo == QByteArrayView("*")) {
+            range.first = star;
+        } else if (!ImapTokenizer::ToNumber(lo, range.first)) {
+            return false;
+        }
+        if (hi == QByteArrayView("*")) {
+            range.last = star;
+        } else if (!ImapTokenizer::ToNumber(hi, range.last)) {
+            return false;
+        }
+        if (range.first > range.last) {
+            std::swap(range.first, range.last);
+        }
+        out.push_back(range);
+        pos = end + 1;
+    }
+    return true;
+}
+
+}
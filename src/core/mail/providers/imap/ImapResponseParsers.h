@@ -0,0 +1,159 @@
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QString>
+#include <QVarLengthArray>
+#include <QVector>
+
+namespace ngks::core::mail::providers::imap {
+
+// Typed parsers on top of ImapTokenizer. Results hold views into the parsed response and are
+// only valid while that buffer is alive; nothing is allocated unless a caller converts a view.
+// Numeric fields are -1 when the server did not send them.
+
+struct ImapCapabilities {
+    QVarLengthArray<QByteArrayView, 32> atoms;
+
+    bool Has(const char* upperName) const;
+};
+
+struct ImapListEntry {
+    QVarLengthArray<QByteArrayView, 8> attributes;
+    QByteArrayView delimiter;  // empty for NIL
+    QByteArrayView mailbox;    // raw; escapes remain when mailboxQuoted
+    bool mailboxQuoted = false;
+    bool isXlist = false;
+
+    bool HasAttribute(const char* upperName) const;
+    QString MailboxName() const;
+};
+
+struct ImapStatusEntry {
+    QByteArrayView mailbox;
+    bool mailboxQuoted = false;
+    qint64 messages = -1;
+    qint64 recent = -1;
+    qint64 uidNext = -1;
+    qint64 uidValidity = -1;
+    qint64 unseen = -1;
+    qint64 highestModSeq = -1;
+
+    QString MailboxName() const;
+};
+
+struct ImapFetchSection {
+    QByteArrayView name;  // e.g. "BODY[HEADER.FIELDS (FROM)]", "BINARY[1]"
+    QByteArrayView data;  // literal/quoted octets; empty for NIL or when spooled
+    qint64 size = 0;      // octet count, also known for spooled literals
+    bool isNil = false;
+    bool spooled = false;
+};
+
+struct ImapFetchEntry {
+    qint64 sequence = -1;
+    qint64 uid = -1;
+    qint64 size = -1;
+    qint64 modSeq = -1;
+    bool hasFlags = false;
+    QVarLengthArray<QByteArrayView, 8> flags;
+    QByteArrayView internalDate;
+    QByteArrayView envelope;       // raw parenthesized span
+    QByteArrayView bodyStructure;  // raw parenthesized span
+    QVarLengthArray<ImapFetchSection, 2> sections;
+};
+
+// One string or NIL from structured FETCH data such as ENVELOPE.
+struct ImapNString {
+    QByteArrayView text;  // escapes remain when quoted
+    bool quoted = false;
+    bool isNil = true;
+
+    // Octets with escapes resolved; empty for NIL.
+    QByteArray Bytes() const;
+};
+
+struct ImapAddress {
+    ImapNString name;
+    ImapNString mailbox;
+    ImapNString host;
+};
+
+// RFC 3501 envelope. Group markers (address with NIL host) are dropped from the address lists.
+struct ImapEnvelope {
+    ImapNString date;
+    ImapNString subject;
+    QVarLengthArray<ImapAddress, 1> from;
+    QVarLengthArray<ImapAddress, 4> to;
+    QVarLengthArray<ImapAddress, 2> cc;
+    ImapNString inReplyTo;
+    ImapNString messageId;
+};
+
+// One leaf of a BODYSTRUCTURE. message/rfc822 parts are leaves too (fetched whole).
+struct ImapBodyPart {
+    QByteArray section;  // part number for BODY[...]/BINARY[...], e.g. "1", "2.1"
+    ImapNString type;
+    ImapNString subtype;
+    ImapNString charset;
+    ImapNString name;  // Content-Type name parameter
+    ImapNString id;
+    ImapNString encoding;
+    qint64 size = 0;   // encoded octets
+    ImapNString disposition;  // "inline", "attachment" or NIL
+    ImapNString filename;     // Content-Disposition filename parameter
+};
+
+struct ImapEsearchEntry {
+    QByteArrayView tag;
+    bool uid = false;
+    qint64 min = -1;
+    qint64 max = -1;
+    qint64 count = -1;
+    qint64 modSeq = -1;
+    QByteArrayView all;  // sequence-set, e.g. "2,10:11"
+};
+
+struct ImapMailboxState {
+    qint64 exists = -1;
+    qint64 uidValidity = -1;
+    qint64 uidNext = -1;
+    qint64 highestModSeq = -1;
+    // [NOMODSEQ]: the mailbox does not support persistent mod-sequences (RFC 7162 3.1.2.2).
+    bool noModSeq = false;
+};
+
+struct ImapSequenceRange {
+    qint64 first = 0;
+    qint64 last = 0;
+};
+
+// Accepts "* CAPABILITY ..." as well as any response carrying a "[CAPABILITY ...]" code.
+bool ParseCapabilityResponse(QByteArrayView response, ImapCapabilities& out);
+// "* LIST (attrs) delim mailbox" and "* XLIST ...".
+bool ParseListResponse(QByteArrayView response, ImapListEntry& out);
+// "* STATUS mailbox (MESSAGES n UIDNEXT n ...)".
+bool ParseStatusResponse(QByteArrayView response, ImapStatusEntry& out);
+// "* n FETCH (...)".
+bool ParseFetchResponse(QByteArrayView response, ImapFetchEntry& out);
+// The parenthesized span in ImapFetchEntry::envelope.
+bool ParseEnvelope(QByteArrayView span, ImapEnvelope& out);
+// The parenthesized span in ImapFetchEntry::bodyStructure, flattened to its leaf parts in
+// document order.
+bool ParseBodyStructure(QByteArrayView span, QVector<ImapBodyPart>& out);
+// "* ESEARCH (TAG "x") UID MIN n MAX n COUNT n ALL set".
+bool ParseEsearchResponse(QByteArrayView response, ImapEsearchEntry& out);
+// "* SEARCH n n ..." (RFC 3501), optionally ending in "(MODSEQ n)"; appends the numbers to out.
+bool ParseSearchResponse(QByteArrayView response, QVector<qint64>& out);
+// Folds one untagged SELECT/EXAMINE response into out: "* n EXISTS" or "* OK [UIDVALIDITY n]",
+// "[UIDNEXT n]", "[HIGHESTMODSEQ n]", "[NOMODSEQ]". Returns false if it carries none of these.
+bool ParseSelectResponse(QByteArrayView response, ImapMailboxState& out);
+// "* VANISHED (EARLIER) set" and "* VANISHED set" (RFC 7162).
+bool ParseVanishedResponse(QByteArrayView response, bool& outEarlier, QByteArrayView& outSet);
+// Sequence or UID set such as "1:3,7,9:*"; '*' stands for star. Ranges come out ordered
+// (first <= last) but are neither sorted nor merged.
+bool ParseSequenceSet(QByteArrayView set, qint64 star, QVector<ImapSequenceRange>& out);
+// "* NAMESPACE ((prefix delim) ...) other shared"; yields the first personal namespace.
+bool ParseNamespaceResponse(QByteArrayView response, QByteArrayView& outPrefix, QByteArrayView& outDelimiter);
+
+}
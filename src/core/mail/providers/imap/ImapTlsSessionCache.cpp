@@ -0,0 +1,63 @@
+#include "core/mail/providers/imap/ImapTlsSessionCache.h"
+
+#include <QDateTime>
+
+namespace ngks::core::mail::providers::imap {
+
+namespace {
+
+// Servers rarely honour tickets longer than this; also the fallback when no hint is sent.
+constexpr int kDefaultLifetimeSeconds = 2 * 60 * 60;
+
+}
+
+std::mutex ImapTlsSessionCache::s_mu;
+QHash<QString, ImapTlsSessionCache::Entry> ImapTlsSessionCache::s_entries;
+
+QString ImapTlsSessionCache::Key(const QString& host, int port)
+{
+    return QString("%1:%2").arg(host.toLower()).arg(port);
+}
+
+QByteArray ImapTlsSessionCache::Lookup(const QString& key)
+{
+    std::lock_guard<std::mutex> lk(s_mu);
+    const auto it = s_entries.constFind(key);
+    if (it == s_entries.constEnd()) {
+        return QByteArray();
+    }
+    if (it->expiresAtMs <= QDateTime::currentMSecsSinceEpoch()) {
+        s_entries.erase(it);
+        return QByteArray();
+    }
+    return it->ticket;
+}
+
+void ImapTlsSessionCache::Store(const QString& key, const QByteArray& ticket, int lifetimeHintSeconds)
+{
+    if (ticket.isEmpty()) {
+        return;
+    }
+    const int lifetime = (lifetimeHintSeconds > 0 && lifetimeHintSeconds < kDefaultLifetimeSeconds)
+        ? lifetimeHintSeconds
+        : kDefaultLifetimeSeconds;
+
+    std::lock_guard<std::mutex> lk(s_mu);
+    Entry& entry = s_entries[key];
+    entry.ticket = ticket;
+    entry.expiresAtMs = QDateTime::currentMSecsSinceEpoch() + static_cast<qint64>(lifetime) * 1000;
+}
+
+void ImapTlsSessionCache::Forget(const QString& key)
+{
+    std::lock_guard<std::mutex> lk(s_mu);
+    s_entries.remove(key);
+}
+
+int ImapTlsSessionCache::Size()
+{
+    std::lock_guard<std::mutex> lk(s_mu);
+    return static_cast<int>(s_entries.size());
+}
+
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <mutex>
+
+namespace ngks::core::mail::providers::imap {
+
+// Process-wide TLS session tickets keyed by "host:port". ImapConnection offers a cached ticket
+// on connect so the server can resume the session (abbreviated handshake) instead of running a
+// full one, and stores every ticket the server issues. Thread-safe.
+class ImapTlsSessionCache {
+public:
+    static QString Key(const QString& host, int port);
+
+    // Returns an empty ticket when none is cached or the cached one has expired.
+    static QByteArray Lookup(const QString& key);
+    // lifetimeHintSeconds <= 0 uses a conservative default.
+    static void Store(const QString& key, const QByteArray& ticket, int lifetimeHintSeconds);
+    static void Forget(const QString& key);
+
+    static int Size();
+
+private:
+    struct Entry {
+        QByteArray ticket;
+        qint64 expiresAtMs = 0;
+    };
+
+    static std::mutex s_mu;
+    static QHash<QString, Entry> s_entries;
+};
+
+}
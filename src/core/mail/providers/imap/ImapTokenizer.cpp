@@ -0,0 +1,249 @@
+#include "core/mail/providers/imap/ImapTokenizer.h"
+
+#include <limits>
+
+namespace ngks::core::mail::providers::imap {
+
+namespace {
+
+char AsciiUpper(char c)
+{
+    return (c >= 'a' && c <= 'z') ? static_cast<char>(c - 'a' + 'A') : c;
+}
+
+bool IsAtomEnd(char c)
+{
+    return c == ' ' || c == '(' || c == ')' || c == '\r' || c == '\n';
+}
+
+}
+
+ImapTokenizer::ImapTokenizer(QByteArrayView input)
+    : in_(input)
+{
+}
+
+void ImapTokenizer::SkipSpaces()
+{
+    while (pos_ < in_.size() && (in_[pos_] == ' ' || in_[pos_] == '\r' || in_[pos_] == '\n')) {
+        ++pos_;
+    }
+}
+
+ImapToken ImapTokenizer::Next()
+{
+    ImapToken token;
+    SkipSpaces();
+    if (pos_ >= in_.size()) {
+        token.type = ImapTokenType::End;
+        return token;
+    }
+
+    const char c = in_[pos_];
+    if (c == '(') {
+        token.type = ImapTokenType::ListOpen;
+        token.text = in_.sliced(pos_++, 1);
+        return token;
+    }
+    if (c == ')') {
+        token.type = ImapTokenType::ListClose;
+        token.text = in_.sliced(pos_++, 1);
+        return token;
+    }
+
+    if (c == '"') {
+        const qsizetype start = ++pos_;
+        while (pos_ < in_.size() && in_[pos_] != '"') {
+            pos_ += (in_[pos_] == '\\' && pos_ + 1 < in_.size()) ? 2 : 1;
+        }
+        if (pos_ >= in_.size()) {
+            token.type = ImapTokenType::Error;
+            return token;
+        }
+        token.type = ImapTokenType::Quoted;
+        token.text = in_.sliced(start, pos_ - start);
+        ++pos_;
+        return token;
+    }
+
+    // {n}, {n+} (LITERAL+), ~{n} (literal8, BINARY) and {n!}, which ImapConnection leaves in
+    // place of a literal it streamed into a sink.
+    if (c == '{' || (c == '~' && pos_ + 1 < in_.size() && in_[pos_ + 1] == '{')) {
+        qsizetype p = pos_ + (c == '~' ? 2 : 1);
+        const qsizetype digits = p;
+        while (p < in_.size() && in_[p] >= '0' && in_[p] <= '9') {
+            ++p;
+        }
+        // Also rejects a size too large for qint64.
+        qint64 size = 0;
+        const bool sawDigit = ToNumber(in_.sliced(digits, p - digits), size);
+        bool spooled = false;
+        if (p < in_.size() && (in_[p] == '+' || in_[p] == '!')) {
+            spooled = in_[p] == '!';
+            ++p;
+        }
+        if (!sawDigit || p >= in_.size() || in_[p] != '}') {
+            token.type = ImapTokenType::Error;
+            return token;
+        }
+        ++p;
+        if (p < in_.size() && in_[p] == '\r') {
+            ++p;
+        }
+        if (p < in_.size() && in_[p] == '\n') {
+            ++p;
+        }
+        token.literalSize = size;
+        if (spooled) {
+            token.type = ImapTokenType::Literal;
+            token.spooled = true;
+            pos_ = p;
+            return token;
+        }
+        if (in_.size() - p < size) {
+            token.type = ImapTokenType::Error;
+            return token;
+        }
+        token.type = ImapTokenType::Literal;
+        token.text = in_.sliced(p, size);
+        pos_ = p + size;
+        return token;
+    }
+
+    const qsizetype start = pos_;
+    int bracketDepth = 0;
+    while (pos_ < in_.size()) {
+        const char ch = in_[pos_];
+        if (ch == '[') {
+            ++bracketDepth;
+        } else if (ch == ']' && bracketDepth > 0) {
+            --bracketDepth;
+        } else if (bracketDepth == 0 && IsAtomEnd(ch)) {
+            break;
+        }
+        ++pos_;
+    }
+    token.text = in_.sliced(start, pos_ - start);
+    token.type = IsAtom(ImapToken{ImapTokenType::Atom, token.text, 0}, "NIL") ? ImapTokenType::Nil : ImapTokenType::Atom;
+    return token;
+}
+
+ImapToken ImapTokenizer::Peek()
+{
+    const qsizetype saved = pos_;
+    const ImapToken token = Next();
+    pos_ = saved;
+    return token;
+}
+
+bool ImapTokenizer::AtEnd()
+{
+    SkipSpaces();
+    return pos_ >= in_.size();
+}
+
+bool ImapTokenizer::SkipValue()
+{
+    ImapToken token = Next();
+    if (token.type == ImapTokenType::End || token.type == ImapTokenType::Error
+        || token.type == ImapTokenType::ListClose) {
+        return false;
+    }
+    if (token.type != ImapTokenType::ListOpen) {
+        return true;
+    }
+
+    int depth = 1;
+    while (depth > 0) {
+        token = Next();
+        switch (token.type) {
+        case ImapTokenType::ListOpen:
+            ++depth;
+            break;
+        case ImapTokenType::ListClose:
+            --depth;
+            break;
+        case ImapTokenType::End:
+        case ImapTokenType::Error:
+            return false;
+        default:
+            break;
+        }
+    }
+    return true;
+}
+
+QByteArrayView ImapTokenizer::NextValueSpan()
+{
+    SkipSpaces();
+    const qsizetype start = pos_;
+    if (!SkipValue()) {
+        return QByteArrayView();
+    }
+    return in_.sliced(start, pos_ - start);
+}
+
+QByteArrayView ImapTokenizer::Rest()
+{
+    if (pos_ < in_.size() && in_[pos_] == ' ') {
+        ++pos_;
+    }
+    return in_.sliced(pos_);
+}
+
+qsizetype ImapTokenizer::Position() const
+{
+    return pos_;
+}
+
+bool ImapTokenizer::IsAtom(const ImapToken& token, const char* upperText)
+{
+    if (token.type != ImapTokenType::Atom && token.type != ImapTokenType::Nil) {
+        return false;
+    }
+    qsizetype i = 0;
+    for (; upperText[i] != '\0'; ++i) {
+        if (i >= token.text.size() || AsciiUpper(token.text[i]) != upperText[i]) {
+            return false;
+        }
+    }
+    return i == token.text.size();
+}
+
+bool ImapTokenizer::ToNumber(QByteArrayView text, qint64& out)
+{
+    if (text.isEmpty() || text.size() > 19) {
+        return false;
+    }
+    qint64 value = 0;
+    for (const char c : text) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        const int digit = c - '0';
+        if (value > (std::numeric_limits<qint64>::max() - digit) / 10) {
+            return false;
+        }
+        value = value * 10 + digit;
+    }
+    out = value;
+    return true;
+}
+
+QByteArray ImapTokenizer::Unescape(QByteArrayView quoted)
+{
+    if (!quoted.contains('\\')) {
+        return quoted.toByteArray();
+    }
+    QByteArray out;
+    out.reserve(quoted.size());
+    for (qsizetype i = 0; i < quoted.size(); ++i) {
+        if (quoted[i] == '\\' && i + 1 < quoted.size()) {
+            ++i;
+        }
+        out.append(quoted[i]);
+    }
+    return out;
+}
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+
+namespace ngks::core::mail::providers::imap {
+
+enum class ImapTokenType {
+    End,
+    Atom,
+    Quoted,
+    Literal,
+    ListOpen,
+    ListClose,
+    Nil,
+    Error
+};
+
+struct ImapToken {
+    ImapTokenType type = ImapTokenType::End;
+    // Atom text, quoted content (escapes still in place) or literal octets.
+    QByteArrayView text;
+    // Declared octet count for literals.
+    qint64 literalSize = 0;
+    // The octets went to an ImapLiteralSink; text is empty.
+    bool spooled = false;
+};
+
+// Byte-level tokenizer over one framed IMAP response. It never copies or allocates: every
+// token is a view into the input, so it can run directly on the connection's receive buffer.
+// Atoms absorb bracketed sections ("BODY[HEADER.FIELDS (FROM)]<0>") as a single token.
+class ImapTokenizer {
+public:
+    explicit ImapTokenizer(QByteArrayView input);
+
+    ImapToken Next();
+    ImapToken Peek();
+    bool AtEnd();
+
+    // Skips one value, including a whole parenthesized list. Returns false on malformed input.
+    bool SkipValue();
+    // Raw span of the next value (a parenthesized list stays intact), e.g. ENVELOPE data.
+    QByteArrayView NextValueSpan();
+    // Everything after the current position (one leading space removed), e.g. response text.
+    QByteArrayView Rest();
+
+    qsizetype Position() const;
+
+    static bool IsAtom(const ImapToken& token, const char* upperText);
+    static bool ToNumber(QByteArrayView text, qint64& out);
+    // Resolves \" and \\ escapes of a quoted token; returns the view's bytes unchanged otherwise.
+    static QByteArray Unescape(QByteArrayView quoted);
+
+private:
+    void SkipSpaces();
+
+    QByteArrayView in_;
+    qsizetype pos_ = 0;
+};
+
+}
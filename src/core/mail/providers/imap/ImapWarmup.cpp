@@ -0,0 +1,92 @@
+#include "core/mail/providers/imap/ImapWarmup.h"
+
+#include <QSqlQuery>
+#include <QVariant>
+
+#include "core/mail/providers/imap/ImapConnection.h"
+#include "core/storage/Db.h"
+
+namespace ngks::core::mail::providers::imap {
+
+ImapWarmup::ImapWarmup(QObject* parent)
+    : QObject(parent)
+{
+}
+
+QVector<ImapEndpoint> ImapWarmup::ResolvedEndpoints(ngks::core::storage::Db& db)
+{
+    QVector<ImapEndpoint> endpoints;
+    if (!db.IsOpen()) {
+        return endpoints;
+    }
+
+    QSqlQuery query(db.Handle());
+    if (!query.exec("SELECT DISTINCT imap_host, imap_port FROM accounts "
+                    "WHERE status='RESOLVED' AND tls_mode='TLS' ORDER BY imap_host, imap_port")) {
+        return endpoints;
+    }
+    while (query.next()) {
+        ImapEndpoint endpoint;
+        endpoint.host = query.value(0).toString();
+        endpoint.port = query.value(1).toInt();
+        endpoint.tls = true;
+        if (!endpoint.host.isEmpty() && endpoint.port > 0) {
+            endpoints.push_back(endpoint);
+        }
+    }
+    return endpoints;
+}
+
+void ImapWarmup::Start(const QVector<ImapEndpoint>& endpoints, int timeoutMs)
+{
+    for (const ImapEndpoint& endpoint : endpoints) {
+        if (!endpoint.tls) {
+            continue;
+        }
+        auto* connection = new ImapConnection(this);
+        pending_.insert(connection);
+        ++attempted_;
+
+        // The greeting proves the handshake finished; TLS 1.3 tickets arrive with or before it.
+        connection->SetResponseHandler([this, connection](QByteArrayView) {
+            if (pending_.contains(connection)) {
+                connection->StopWatchdog();
+                connection->Close();
+                Done(connection, true);
+            }
+        });
+        connect(connection, &ImapConnection::Failed, this, [this, connection](const QString&) {
+            Done(connection, false);
+        });
+        connect(connection, &ImapConnection::TimedOut, this, [this, connection](const QString&) {
+            connection->Close();
+            Done(connection, false);
+        });
+        connect(connection, &ImapConnection::Closed, this, [this, connection]() {
+            Done(connection, false);
+        });
+
+        connection->Open(endpoint.host, endpoint.port, true);
+        connection->StartWatchdog(timeoutMs, QStringLiteral("warm-up timeout"));
+    }
+
+    if (pending_.isEmpty()) {
+        emit Finished(0, attempted_);
+    }
+}
+
+void ImapWarmup::Done(ImapConnection* connection, bool warmed)
+{
+    if (!pending_.remove(connection)) {
+        return;
+    }
+    if (warmed) {
+        ++warmed_;
+    }
+    connection->deleteLater();
+    if (pending_.isEmpty()) {
+        emit Finished(warmed_, attempted_);
+    }
+}
+
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QVector>
+
+namespace ngks::core::storage {
+class Db;
+}
+
+namespace ngks::core::mail::providers::imap {
+
+class ImapConnection;
+
+struct ImapEndpoint {
+    QString host;
+    int port = 993;
+    bool tls = true;
+};
+
+// Background pre-connect at startup: opens one TLS connection per known server, waits for the
+// greeting and closes again. That leaves a session ticket in ImapTlsSessionCache (and a warm
+// DNS entry), so the first real connection resumes instead of paying for a full handshake.
+// Nothing is authenticated. Runs on the caller's event loop without blocking it.
+class ImapWarmup : public QObject {
+    Q_OBJECT
+
+public:
+    explicit ImapWarmup(QObject* parent = nullptr);
+
+    // Distinct TLS endpoints of accounts whose status is RESOLVED.
+    static QVector<ImapEndpoint> ResolvedEndpoints(ngks::core::storage::Db& db);
+
+    void Start(const QVector<ImapEndpoint>& endpoints, int timeoutMs = 10000);
+
+signals:
+    // warmed counts endpoints that completed a TLS handshake.
+    void Finished(int warmed, int attempted);
+
+private:
+    void Done(ImapConnection* connection, bool warmed);
+
+    QSet<ImapConnection*> pending_;
+    int warmed_ = 0;
+    int attempted_ = 0;
+};
+
+}
@@ -0,0 +1,191 @@
+#include "core/mail/search/SearchQuery.h"
+
+#include <QStringList>
+
+namespace ngks::core::mail::search {
+
+namespace {
+
+const char* const kMonths[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+// RFC 3501 date: 1-Jul-2024. Month names are fixed English, whatever the locale.
+QString ImapDate(const QDate& date)
+{
+    return QString("%1-%2-%3").arg(date.day()).arg(QLatin1String(kMonths[date.month() - 1])).arg(date.year());
+}
+
+// Date part of an INTERNALDATE, which may have a space-padded day (" 7-Jul-2024 ...").
+QDate ParseInternalDate(const QString& value)
+{
+    const QStringList parts = value.trimmed().section(' ', 0, 0).split('-');
+    if (parts.size() != 3) {
+        return QDate();
+    }
+    int month = 0;
+    for (int i = 0; i < 12; ++i) {
+        if (parts[1].compare(QLatin1String(kMonths[i]), Qt::CaseInsensitive) == 0) {
+            month = i + 1;
+            break;
+        }
+    }
+    return QDate(parts[2].toInt(), month, parts[0].toInt());
+}
+
+bool IsAscii(const QString& value)
+{
+    for (const QChar c : value) {
+        if (c.unicode() > 0x7e) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Quoted string; CR and LF cannot be quoted and are dropped.
+QString Quote(const QString& value)
+{
+    QString out = QStringLiteral("\"");
+    for (const QChar c : value) {
+        if (c == '\r' || c == '\n') {
+            continue;
+        }
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += c;
+    }
+    out += '"';
+    return out;
+}
+
+QString LikePattern(const QString& value)
+{
+    QString out = QStringLiteral("%");
+    for (const QChar c : value) {
+        if (c == '%' || c == '_' || c == '!') {
+            out += '!';
+        }
+        out += c;
+    }
+    out += '%';
+    return out;
+}
+
+void AddString(QStringList& criteria, bool& utf8, const char* key, const QString& value)
+{
+    if (value.isEmpty()) {
+        return;
+    }
+    utf8 = utf8 || !IsAscii(value);
+    criteria.push_back(QString("%1 %2").arg(QLatin1String(key), Quote(value)));
+}
+
+void AddFlag(QStringList& criteria, FlagFilter filter, const char* set, const char* unset)
+{
+    if (filter == FlagFilter::Set) {
+        criteria.push_back(QLatin1String(set));
+    } else if (filter == FlagFilter::Unset) {
+        criteria.push_back(QLatin1String(unset));
+    }
+}
+
+void AddLike(QStringList& where, QVariantList& binds, const char* column, const QString& value)
+{
+    if (value.isEmpty()) {
+        return;
+    }
+    where.push_back(QString("%1 LIKE ? ESCAPE '!'").arg(QLatin1String(column)));
+    binds.push_back(LikePattern(value));
+}
+
+void AddFlagFilter(QStringList& where, QVariantList& binds, FlagFilter filter, const char* flag)
+{
+    if (filter == FlagFilter::Any) {
+        return;
+    }
+    // flags is a space-separated list such as "\Seen \Flagged".
+    where.push_back(QString("(' ' || flags || ' ') %1 ?").arg(filter == FlagFilter::Set ? "LIKE" : "NOT LIKE"));
+    binds.push_back(QString("% %1 %").arg(QLatin1String(flag)));
+}
+
+}
+
+bool SearchQuery::IsEmpty() const
+{
+    return text.isEmpty() && from.isEmpty() && to.isEmpty() && subject.isEmpty() && body.isEmpty() && !since.isValid()
+        && !before.isValid() && seen == FlagFilter::Any && flagged == FlagFilter::Any && answered == FlagFilter::Any
+        && largerThan < 0 && smallerThan < 0;
+}
+
+bool SearchQuery::NeedsBodies() const
+{
+    return !text.isEmpty() || !body.isEmpty();
+}
+
+bool SearchQuery::NeedsHeaders() const
+{
+    return !from.isEmpty() || !to.isEmpty() || !subject.isEmpty() || since.isValid() || before.isValid()
+        || largerThan >= 0 || smallerThan >= 0;
+}
+
+QString SearchQuery::ToImapCriteria(bool& outUtf8) const
+{
+    outUtf8 = false;
+    QStringList criteria;
+    AddString(criteria, outUtf8, "TEXT", text);
+    AddString(criteria, outUtf8, "FROM", from);
+    AddString(criteria, outUtf8, "TO", to);
+    AddString(criteria, outUtf8, "SUBJECT", subject);
+    AddString(criteria, outUtf8, "BODY", body);
+    if (since.isValid()) {
+        criteria.push_back("SINCE " + ImapDate(since));
+    }
+    if (before.isValid()) {
+        criteria.push_back("BEFORE " + ImapDate(before));
+    }
+    AddFlag(criteria, seen, "SEEN", "UNSEEN");
+    AddFlag(criteria, flagged, "FLAGGED", "UNFLAGGED");
+    AddFlag(criteria, answered, "ANSWERED", "UNANSWERED");
+    if (largerThan >= 0) {
+        criteria.push_back(QString("LARGER %1").arg(largerThan));
+    }
+    if (smallerThan >= 0) {
+        criteria.push_back(QString("SMALLER %1").arg(smallerThan));
+    }
+    return criteria.isEmpty() ? QStringLiteral("ALL") : criteria.join(' ');
+}
+
+QString SearchQuery::ToSqlFilter(QVariantList& outBinds) const
+{
+    outBinds.clear();
+    QStringList where;
+    AddLike(where, outBinds, "from_addr", from);
+    AddLike(where, outBinds, "to_addrs", to);
+    AddLike(where, outBinds, "subject", subject);
+    AddFlagFilter(where, outBinds, seen, "\\Seen");
+    AddFlagFilter(where, outBinds, flagged, "\\Flagged");
+    AddFlagFilter(where, outBinds, answered, "\\Answered");
+    if (largerThan >= 0) {
+        where.push_back("size > ?");
+        outBinds.push_back(largerThan);
+    }
+    if (smallerThan >= 0) {
+        where.push_back("size < ?");
+        outBinds.push_back(smallerThan);
+    }
+    return where.isEmpty() ? QStringLiteral("1") : where.join(" AND ");
+}
+
+bool SearchQuery::MatchesDate(const QString& internalDate) const
+{
+    if (!since.isValid() && !before.isValid()) {
+        return true;
+    }
+    const QDate date = ParseInternalDate(internalDate);
+    if (!date.isValid()) {
+        return false;
+    }
+    return (!since.isValid() || date >= since) && (!before.isValid() || date < before);
+}
+
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <QDate>
+#include <QString>
+#include <QVariantList>
+
+namespace ngks::core::mail::search {
+
+enum class FlagFilter {
+    Any,
+    Set,
+    Unset
+};
+
+// What to look for in one folder. All given criteria must match (AND); strings match as
+// case-insensitive substrings, as IMAP SEARCH does.
+struct SearchQuery {
+    // Anywhere in the headers or body (IMAP TEXT).
+    QString text;
+    QString from;
+    QString to;
+    QString subject;
+    QString body;
+    // Internal date, day granularity: since is inclusive, before exclusive.
+    QDate since;
+    QDate before;
+    FlagFilter seen = FlagFilter::Any;
+    FlagFilter flagged = FlagFilter::Any;
+    FlagFilter answered = FlagFilter::Any;
+    qint64 largerThan = -1;
+    qint64 smallerThan = -1;
+
+    bool IsEmpty() const;
+    // TEXT and BODY look into message bodies, which are not stored locally.
+    bool NeedsBodies() const;
+    // Criteria other than flags need the header stage to have run for a message.
+    bool NeedsHeaders() const;
+
+    // IMAP SEARCH criteria, e.g. FROM "ann" SINCE 1-Jul-2024 UNSEEN; "ALL" when empty.
+    // outUtf8 is set when a string is not ASCII and the command needs CHARSET UTF-8.
+    QString ToImapCriteria(bool& outUtf8) const;
+
+    // The same criteria as a WHERE clause over messages (positional placeholders, values in
+    // outBinds). Dates are not in it: internal_date is stored in IMAP form; see MatchesDate.
+    QString ToSqlFilter(QVariantList& outBinds) const;
+    // Checks since/before against an IMAP INTERNALDATE ("17-Jul-2024 02:44:25 -0700").
+    bool MatchesDate(const QString& internalDate) const;
+};
+
+}
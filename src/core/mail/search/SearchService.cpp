@@ -0,0 +1,270 @@
+#include "core/mail/search/SearchService.h"
+
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QStringList>
+#include <QVariant>
+#include <QVector>
+
+#include "core/mail/providers/imap/ImapClient.h"
+#include "core/mail/providers/imap/ImapConnectionPool.h"
+#include "core/mail/providers/imap/ImapResponseParsers.h"
+#include "core/storage/Db.h"
+
+namespace ngks::core::mail::search {
+
+using namespace ngks::core::mail::providers::imap;
+
+namespace {
+
+bool IsTaggedOk(const QStringList& lines, const QString& tag)
+{
+    return !lines.isEmpty() && lines.last().startsWith(tag + " OK", Qt::CaseInsensitive);
+}
+
+}
+
+SearchService::SearchService(ngks::core::storage::Db& db, SearchOptions options)
+    : db_(db)
+    , options_(options)
+{
+}
+
+bool SearchService::Plan(const QString& accountEmail,
+                         const QString& remoteName,
+                         const SearchQuery& query,
+                         SearchPlan& outPlan,
+                         QString& outError)
+{
+    outPlan = SearchPlan();
+    outError.clear();
+    if (!db_.IsOpen()) {
+        outError = "DB is not open";
+        return false;
+    }
+    QSqlDatabase& sqlDb = db_.Handle();
+
+    QSqlQuery folder(sqlDb);
+    folder.prepare("SELECT f.id FROM folders f JOIN accounts a ON a.id=f.account_id "
+                   "WHERE a.email=:email AND f.remote_name=:remote LIMIT 1");
+    folder.bindValue(":email", accountEmail);
+    folder.bindValue(":remote", remoteName);
+    if (!folder.exec()) {
+        outError = folder.lastError().text();
+        return false;
+    }
+    if (!folder.next()) {
+        outError = QString("unknown folder %1 for %2").arg(remoteName, accountEmail);
+        return false;
+    }
+    outPlan.folderId = folder.value(0).toLongLong();
+
+    if (query.NeedsBodies()) {
+        if (options_.mode == SearchMode::LocalOnly) {
+            outError = "body search needs the server";
+            return false;
+        }
+        return true;
+    }
+    if (options_.mode == SearchMode::RemoteOnly) {
+        return true;
+    }
+
+    // Flags exist for every synced message; the other criteria need its headers.
+    qint64 cached = 0;
+    UidSet uncached;
+    QSqlQuery rows(sqlDb);
+    rows.setForwardOnly(true);
+    rows.prepare("SELECT uid, has_header FROM messages WHERE folder_id=:fid ORDER BY uid");
+    rows.bindValue(":fid", outPlan.folderId);
+    if (!rows.exec()) {
+        outError = rows.lastError().text();
+        return false;
+    }
+    const bool needsHeaders = query.NeedsHeaders();
+    while (rows.next()) {
+        if (!needsHeaders || rows.value(1).toInt() != 0) {
+            ++cached;
+        } else {
+            uncached.Add(rows.value(0).toLongLong());
+        }
+    }
+
+    if (options_.mode == SearchMode::LocalOnly) {
+        outPlan.source = SearchSource::Local;
+        outPlan.partial = !uncached.IsEmpty();
+        return true;
+    }
+    if (cached == 0) {
+        // Never synced, or no headers yet: the server has everything.
+        return true;
+    }
+    if (uncached.IsEmpty()) {
+        outPlan.source = SearchSource::Local;
+        return true;
+    }
+    if (uncached.Ranges().size() > options_.maxRemoteRanges) {
+        return true;
+    }
+    outPlan.source = SearchSource::Mixed;
+    outPlan.remoteUids = uncached;
+    return true;
+}
+
+bool SearchService::Search(const ResolveRequest& account,
+                           const QString& remoteName,
+                           const SearchQuery& query,
+                           SearchResult& outResult,
+                           QString& outError)
+{
+    outResult = SearchResult();
+    SearchPlan plan;
+    if (!Plan(account.email, remoteName, query, plan, outError)) {
+        return false;
+    }
+    if (plan.source == SearchSource::Local) {
+        return Execute(nullptr, remoteName, query, plan, outResult, outError);
+    }
+    ImapSessionLease session = ImapConnectionPool::Instance().Acquire(account, outError);
+    if (!session) {
+        return false;
+    }
+    const bool ok = Execute(&*session, remoteName, query, plan, outResult, outError);
+    if (!ok && !session->Client().IsConnected()) {
+        session.Discard();
+    }
+    return ok;
+}
+
+bool SearchService::Search(ImapSession& session,
+                           const QString& accountEmail,
+                           const QString& remoteName,
+                           const SearchQuery& query,
+                           SearchResult& outResult,
+                           QString& outError)
+{
+    outResult = SearchResult();
+    SearchPlan plan;
+    if (!Plan(accountEmail, remoteName, query, plan, outError)) {
+        return false;
+    }
+    return Execute(&session, remoteName, query, plan, outResult, outError);
+}
+
+bool SearchService::Execute(ImapSession* session,
+                            const QString& remoteName,
+                            const SearchQuery& query,
+                            const SearchPlan& plan,
+                            SearchResult& outResult,
+                            QString& outError)
+{
+    outResult.source = plan.source;
+    outResult.partial = plan.partial;
+
+    UidSet local;
+    if (plan.source != SearchSource::Remote && !SearchLocal(plan.folderId, query, local, outError)) {
+        return false;
+    }
+    UidSet remote;
+    if (plan.source != SearchSource::Local
+        && !SearchRemote(*session, remoteName, query, plan.remoteUids, remote, outResult.roundTrips, outError)) {
+        return false;
+    }
+    outResult.uids = local.IsEmpty() ? remote : (remote.IsEmpty() ? local : local.United(remote));
+    return true;
+}
+
+bool SearchService::SearchLocal(qint64 folderId, const SearchQuery& query, UidSet& out, QString& outError)
+{
+    QVariantList binds;
+    const QString filter = query.ToSqlFilter(binds);
+    QSqlQuery rows(db_.Handle());
+    rows.setForwardOnly(true);
+    rows.prepare(QString("SELECT uid, internal_date FROM messages WHERE folder_id=?%1 AND %2 ORDER BY uid")
+                     .arg(query.NeedsHeaders() ? " AND has_header=1" : "", filter));
+    rows.addBindValue(folderId);
+    for (const QVariant& value : binds) {
+        rows.addBindValue(value);
+    }
+    if (!rows.exec()) {
+        outError = rows.lastError().text();
+        return false;
+    }
+    while (rows.next()) {
+        if (query.MatchesDate(rows.value(1).toString())) {
+            out.Add(rows.value(0).toLongLong());
+        }
+    }
+    return true;
+}
+
+bool SearchService::SearchRemote(ImapSession& session,
+                                 const QString& remoteName,
+                                 const SearchQuery& query,
+                                 const UidSet& within,
+                                 UidSet& out,
+                                 int& roundTrips,
+                                 QString& outError)
+{
+    // Searching needs a selected mailbox but not write access; keep a current selection as is.
+    if (session.SelectedMailbox() != remoteName) {
+        if (!session.Select(remoteName, true, outError)) {
+            return false;
+        }
+        ++roundTrips;
+    }
+
+    bool utf8 = false;
+    const QString criteria = query.ToImapCriteria(utf8);
+    const bool esearch = session.HasCapability("ESEARCH");
+    QString command = QStringLiteral("UID SEARCH");
+    if (esearch) {
+        command += QStringLiteral(" RETURN (MIN MAX COUNT ALL)");
+    }
+    if (utf8) {
+        command += QStringLiteral(" CHARSET UTF-8");
+    }
+    if (!within.IsEmpty()) {
+        command += " UID " + within.ToSequenceSet();
+    }
+    command += ' ' + criteria;
+
+    ImapClient& client = session.Client();
+    bool parsed = true;
+    QVector<qint64> uids;
+    QString tag;
+    if (esearch) {
+        tag = client.SubmitStreaming(command, {"ESEARCH"}, [&out, &parsed](QByteArrayView response) {
+            ImapEsearchEntry entry;
+            if (!ParseEsearchResponse(response, entry)) {
+                parsed = false;
+                return;
+            }
+            // No ALL means no matches.
+            if (!entry.all.isEmpty() && !UidSet::FromSequenceSet(entry.all, out)) {
+                parsed = false;
+            }
+        });
+    } else {
+        tag = client.SubmitStreaming(command, {"SEARCH"}, [&uids, &parsed](QByteArrayView response) {
+            parsed = ParseSearchResponse(response, uids) && parsed;
+        });
+    }
+    const QStringList lines = client.Await(tag, options_.timeoutMs);
+    ++roundTrips;
+    if (!IsTaggedOk(lines, tag)) {
+        outError = lines.isEmpty() ? client.LastError() : lines.last();
+        return false;
+    }
+    if (!parsed) {
+        outError = "Malformed SEARCH response";
+        return false;
+    }
+    if (!esearch) {
+        out = UidSet::FromUids(std::move(uids));
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <QString>
+
+#include "core/mail/providers/imap/ImapProvider.h"
+#include "core/mail/search/SearchQuery.h"
+#include "core/mail/search/UidSet.h"
+
+namespace ngks::core::storage {
+class Db;
+}
+
+namespace ngks::core::mail::providers::imap {
+class ImapSession;
+}
+
+namespace ngks::core::mail::search {
+
+enum class SearchMode {
+    Auto,
+    // Offline: only what the messages table holds.
+    LocalOnly,
+    RemoteOnly
+};
+
+enum class SearchSource {
+    Local,
+    Remote,
+    // Cached messages locally, the rest on the server.
+    Mixed
+};
+
+struct SearchOptions {
+    SearchMode mode = SearchMode::Auto;
+    // Past this many ranges of uncached UIDs the server searches the whole folder instead of a
+    // long UID restriction.
+    int maxRemoteRanges = 500;
+    int timeoutMs = 120000;
+};
+
+struct SearchPlan {
+    SearchSource source = SearchSource::Remote;
+    qint64 folderId = -1;
+    // Messages the server is asked about; empty means the whole folder.
+    UidSet remoteUids;
+    // LocalOnly over a folder whose headers are not all in yet.
+    bool partial = false;
+};
+
+struct SearchResult {
+    // Matching UIDs; page through with UidSet::Page.
+    UidSet uids;
+    SearchSource source = SearchSource::Local;
+    bool partial = false;
+    int roundTrips = 0;
+};
+
+// Searches one folder. A query whose criteria the messages table can answer (headers, flags,
+// size, date) runs locally over the messages that have their headers; whatever has not been
+// fetched yet is left to the server with a UID-restricted SEARCH, and the two results are
+// merged. Body and full-text criteria always go to the server. Remote searches use
+// UID SEARCH RETURN (MIN MAX COUNT ALL) when the server has ESEARCH (RFC 4731), so a large
+// result arrives as a compact sequence set. Local results reflect the last sync.
+class SearchService {
+public:
+    explicit SearchService(ngks::core::storage::Db& db, SearchOptions options = {});
+
+    bool Plan(const QString& accountEmail,
+              const QString& remoteName,
+              const SearchQuery& query,
+              SearchPlan& outPlan,
+              QString& outError);
+
+    // Acquires a pooled session only when the plan needs the server.
+    bool Search(const ngks::core::mail::providers::imap::ResolveRequest& account,
+                const QString& remoteName,
+                const SearchQuery& query,
+                SearchResult& outResult,
+                QString& outError);
+    // Same, on a session the caller already holds.
+    bool Search(ngks::core::mail::providers::imap::ImapSession& session,
+                const QString& accountEmail,
+                const QString& remoteName,
+                const SearchQuery& query,
+                SearchResult& outResult,
+                QString& outError);
+
+private:
+    bool Execute(ngks::core::mail::providers::imap::ImapSession* session,
+                 const QString& remoteName,
+                 const SearchQuery& query,
+                 const SearchPlan& plan,
+                 SearchResult& outResult,
+                 QString& outError);
+    bool SearchLocal(qint64 folderId, const SearchQuery& query, UidSet& out, QString& outError);
+    bool SearchRemote(ngks::core::mail::providers::imap::ImapSession& session,
+                      const QString& remoteName,
+                      const SearchQuery& query,
+                      const UidSet& within,
+                      UidSet& out,
+                      int& roundTrips,
+                      QString& outError);
+
+    ngks::core::storage::Db& db_;
+    SearchOptions options_;
+};
+
+}
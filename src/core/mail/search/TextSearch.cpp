@@ -0,0 +1,66 @@
+#include "core/mail/search/TextSearch.h"
+
+#include <QRegularExpression>
+#include <QStringList>
+#include <utility>
+
+#include "core/storage/Db.h"
+#include "core/storage/Query.h"
+
+namespace ngks::core::mail::search {
+
+using ngks::core::storage::Columns;
+using ngks::core::storage::Params;
+using ngks::core::storage::Query;
+
+TextSearch::TextSearch(ngks::core::storage::Db& db, TextSearchOptions options)
+    : db_(db)
+    , options_(std::move(options))
+{
+}
+
+QString TextSearch::MatchExpression(const QString& text)
+{
+    const QStringList words = text.split(QRegularExpression(QStringLiteral("\\s+")), Qt::SkipEmptyParts);
+    QStringList terms;
+    for (QString word : words) {
+        word.replace('"', QStringLiteral("\"\""));
+        terms.push_back('"' + word + '"');
+    }
+    if (!terms.isEmpty() && !text.back().isSpace()) {
+        terms.last() += '*';
+    }
+    return terms.join(' ');
+}
+
+bool TextSearch::Search(const QString& text, std::vector<TextSearchHit>& outHits, QString& outError)
+{
+    outHits.clear();
+    outError.clear();
+    const QString match = MatchExpression(text);
+    if (match.isEmpty()) {
+        return true;
+    }
+    // The inner query lets FTS5 stop after the best `limit` matches (rank is configured by
+    // Reindexer); snippets are built for those rows only.
+    Query<Columns<qint64, qint64, qint64, double, QString, QString>, Params<QString, QString, QString, QString, QString, int>>
+        query(db_,
+              "SELECT m.id, m.folder_id, m.uid, h.rank, h.subject, h.body FROM ("
+              "SELECT rowid, rank, snippet(message_fts, 0, ?, ?, '…', 12) AS subject, "
+              "snippet(message_fts, 2, ?, ?, '…', 24) AS body "
+              "FROM message_fts WHERE message_fts MATCH ? ORDER BY rank LIMIT ?) h "
+              "JOIN messages m ON m.id=h.rowid ORDER BY h.rank");
+    if (!query.Exec(options_.highlightOpen, options_.highlightClose, options_.highlightOpen, options_.highlightClose,
+                    match, options_.limit)) {
+        outError = query.Error();
+        return false;
+    }
+    while (auto row = query.Next()) {
+        TextSearchHit hit;
+        std::tie(hit.messageId, hit.folderId, hit.uid, hit.rank, hit.subject, hit.snippet) = std::move(*row);
+        outHits.push_back(std::move(hit));
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <QString>
+#include <vector>
+
+namespace ngks::core::storage {
+class Db;
+}
+
+namespace ngks::core::mail::search {
+
+struct TextSearchOptions {
+    int limit = 50;
+    // Around matched terms in the snippets; rich text for Qt labels by default.
+    QString highlightOpen = QStringLiteral("<b>");
+    QString highlightClose = QStringLiteral("</b>");
+};
+
+struct TextSearchHit {
+    qint64 messageId = -1;
+    qint64 folderId = -1;
+    qint64 uid = -1;
+    // bm25; lower is better.
+    double rank = 0;
+    QString subject;
+    QString snippet;
+};
+
+// Ranked full-text search over every folder, answered from the local FTS5 index that
+// storage::Reindexer maintains, so it works offline and never waits on a server. Messages
+// whose bodies have not been fetched match on subject and addresses only.
+class TextSearch {
+public:
+    explicit TextSearch(ngks::core::storage::Db& db, TextSearchOptions options = {});
+
+    // Best matches first for every word of text; the last word also matches as a prefix, for
+    // search as you type.
+    bool Search(const QString& text, std::vector<TextSearchHit>& outHits, QString& outError);
+
+    // text as an FTS5 query: each word quoted, so operators and column filters typed by the
+    // user are searched for rather than interpreted. Empty if text has no words.
+    static QString MatchExpression(const QString& text);
+
+private:
+    ngks::core::storage::Db& db_;
+    TextSearchOptions options_;
+};
+
+}
@@ -0,0 +1,175 @@
+#include "core/mail/search/UidSet.h"
+
+#include <algorithm>
+
+namespace ngks::core::mail::search {
+
+using namespace ngks::core::mail::providers::imap;
+
+bool UidSet::FromSequenceSet(QByteArrayView set, UidSet& out)
+{
+    out = UidSet();
+    if (!ParseSequenceSet(set, kUnbounded, out.ranges_)) {
+        return false;
+    }
+    out.Normalize();
+    return true;
+}
+
+UidSet UidSet::FromUids(QVector<qint64> uids)
+{
+    std::sort(uids.begin(), uids.end());
+    UidSet out;
+    for (const qint64 uid : uids) {
+        out.Add(uid);
+    }
+    return out;
+}
+
+void UidSet::Add(qint64 first, qint64 last)
+{
+    if (first > last) {
+        std::swap(first, last);
+    }
+    // Ascending input, the common case, extends or appends without re-sorting.
+    if (ranges_.isEmpty() || (ranges_.last().last != kUnbounded && first > ranges_.last().last + 1)) {
+        ranges_.push_back(UidRange{first, last});
+        return;
+    }
+    if (first >= ranges_.last().first) {
+        ranges_.last().last = qMax(ranges_.last().last, last);
+        return;
+    }
+    ranges_.push_back(UidRange{first, last});
+    Normalize();
+}
+
+void UidSet::Add(qint64 uid)
+{
+    Add(uid, uid);
+}
+
+bool UidSet::IsEmpty() const
+{
+    return ranges_.isEmpty();
+}
+
+qint64 UidSet::Count() const
+{
+    qint64 count = 0;
+    for (const UidRange& range : ranges_) {
+        if (range.last == kUnbounded) {
+            return kUnbounded;
+        }
+        count += range.last - range.first + 1;
+    }
+    return count;
+}
+
+qint64 UidSet::Min() const
+{
+    return ranges_.isEmpty() ? -1 : ranges_.first().first;
+}
+
+qint64 UidSet::Max() const
+{
+    return ranges_.isEmpty() ? -1 : ranges_.last().last;
+}
+
+bool UidSet::Contains(qint64 uid) const
+{
+    const auto it = std::upper_bound(ranges_.begin(), ranges_.end(), uid,
+                                     [](qint64 value, const UidRange& range) { return value < range.first; });
+    return it != ranges_.begin() && uid <= (it - 1)->last;
+}
+
+UidSet UidSet::United(const UidSet& other) const
+{
+    UidSet out;
+    out.ranges_.reserve(ranges_.size() + other.ranges_.size());
+    out.ranges_ += ranges_;
+    out.ranges_ += other.ranges_;
+    out.Normalize();
+    return out;
+}
+
+UidSet UidSet::Page(qint64 offset, qint64 limit) const
+{
+    UidSet out;
+    if (offset < 0 || limit <= 0) {
+        return out;
+    }
+    QVector<UidRange> reversed;
+    for (qsizetype i = ranges_.size() - 1; i >= 0 && limit > 0; --i) {
+        const UidRange& range = ranges_[i];
+        const qint64 size = range.last - range.first + 1;
+        if (offset >= size) {
+            offset -= size;
+            continue;
+        }
+        const qint64 last = range.last - offset;
+        const qint64 take = qMin(limit, last - range.first + 1);
+        reversed.push_back(UidRange{last - take + 1, last});
+        limit -= take;
+        offset = 0;
+    }
+    out.ranges_.reserve(reversed.size());
+    for (qsizetype i = reversed.size() - 1; i >= 0; --i) {
+        out.ranges_.push_back(reversed[i]);
+    }
+    return out;
+}
+
+QVector<qint64> UidSet::ToDescendingVector() const
+{
+    QVector<qint64> out;
+    const qint64 count = Count();
+    if (count != kUnbounded) {
+        out.reserve(count);
+    }
+    for (qsizetype i = ranges_.size() - 1; i >= 0; --i) {
+        for (qint64 uid = ranges_[i].last; uid >= ranges_[i].first && uid != kUnbounded; --uid) {
+            out.push_back(uid);
+        }
+    }
+    return out;
+}
+
+QString UidSet::ToSequenceSet() const
+{
+    QString out;
+    for (const UidRange& range : ranges_) {
+        if (!out.isEmpty()) {
+            out += ',';
+        }
+        out += QString::number(range.first);
+        if (range.last == kUnbounded) {
+            out += QStringLiteral(":*");
+        } else if (range.last != range.first) {
+            out += ':';
+            out += QString::number(range.last);
+        }
+    }
+    return out;
+}
+
+const QVector<UidRange>& UidSet::Ranges() const
+{
+    return ranges_;
+}
+
+void UidSet::Normalize()
+{
+    std::sort(ranges_.begin(), ranges_.end(), [](const UidRange& a, const UidRange& b) { return a.first < b.first; });
+    qsizetype out = 0;
+    for (qsizetype i = 0; i < ranges_.size(); ++i) {
+        if (out > 0 && (ranges_[out - 1].last == kUnbounded || ranges_[i].first <= ranges_[out - 1].last + 1)) {
+            ranges_[out - 1].last = qMax(ranges_[out - 1].last, ranges_[i].last);
+        } else {
+            ranges_[out++] = ranges_[i];
+        }
+    }
+    ranges_.resize(out);
+}
+
+}
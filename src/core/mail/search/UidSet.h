@@ -0,0 +1,54 @@
+#pragma once
+
+#include <QByteArrayView>
+#include <QString>
+#include <QVector>
+#include <limits>
+
+#include "core/mail/providers/imap/ImapResponseParsers.h"
+
+namespace ngks::core::mail::search {
+
+using UidRange = ngks::core::mail::providers::imap::ImapSequenceRange;
+
+// A set of UIDs kept as sorted, disjoint ranges, the way ESEARCH returns it ("1:500,731").
+// A million-hit result of mostly consecutive UIDs stays a handful of ranges; callers page
+// through it instead of materializing the UIDs.
+class UidSet {
+public:
+    static constexpr qint64 kUnbounded = std::numeric_limits<qint64>::max();
+
+    // Parses an IMAP sequence set; '*' is taken as unbounded.
+    static bool FromSequenceSet(QByteArrayView set, UidSet& out);
+    // From UIDs in any order; duplicates are fine.
+    static UidSet FromUids(QVector<qint64> uids);
+
+    void Add(qint64 first, qint64 last);
+    void Add(qint64 uid);
+
+    bool IsEmpty() const;
+    qint64 Count() const;
+    // -1 when empty.
+    qint64 Min() const;
+    qint64 Max() const;
+    bool Contains(qint64 uid) const;
+
+    UidSet United(const UidSet& other) const;
+
+    // Newest first, as message lists show them: skips the offset highest UIDs and returns up
+    // to limit of the next ones.
+    UidSet Page(qint64 offset, qint64 limit) const;
+    // Highest first. Only for small sets, e.g. a page.
+    QVector<qint64> ToDescendingVector() const;
+    // "1:5,9"; an unbounded range ends in '*'.
+    QString ToSequenceSet() const;
+
+    const QVector<UidRange>& Ranges() const;
+
+private:
+    void Normalize();
+
+    QVector<UidRange> ranges_;
+};
+
+}
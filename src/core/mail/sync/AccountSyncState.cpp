@@ -0,0 +1,150 @@
+#include "core/mail/sync/AccountSyncState.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QVariant>
+#include <mutex>
+
+namespace ngks::core::mail::sync {
+
+namespace {
+
+std::mutex& ModifyMutex()
+{
+    static std::mutex mu;
+    return mu;
+}
+
+bool Matches(const PendingPart& part, qint64 folderId, qint64 uid, const QString& partId)
+{
+    return part.folderId == folderId && part.uid == uid && part.partId == partId;
+}
+
+}
+
+bool AccountSyncState::HasPendingPart(qint64 folderId, qint64 uid, const QString& partId) const
+{
+    for (const PendingPart& part : pendingParts) {
+        if (Matches(part, folderId, uid, partId)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void AccountSyncState::AddPendingPart(qint64 folderId, qint64 uid, const QString& partId)
+{
+    if (!HasPendingPart(folderId, uid, partId)) {
+        pendingParts.push_back(PendingPart{folderId, uid, partId});
+    }
+}
+
+void AccountSyncState::RemovePendingPart(qint64 folderId, qint64 uid, const QString& partId)
+{
+    pendingParts.removeIf([&](const PendingPart& part) { return Matches(part, folderId, uid, partId); });
+}
+
+QString AccountSyncState::ToJson() const
+{
+    if (pendingParts.isEmpty()) {
+        return QString();
+    }
+    QJsonArray parts;
+    for (const PendingPart& part : pendingParts) {
+        QJsonObject obj;
+        obj.insert("folder", part.folderId);
+        obj.insert("uid", part.uid);
+        obj.insert("part", part.partId);
+        parts.push_back(obj);
+    }
+    QJsonObject obj;
+    obj.insert("pendingparts", parts);
+    return QString::fromUtf8(QJsonDocument(obj).toJson(QJsonDocument::Compact));
+}
+
+AccountSyncState AccountSyncState::FromJson(const QString& text)
+{
+    AccountSyncState state;
+    if (text.isEmpty()) {
+        return state;
+    }
+    const QJsonDocument doc = QJsonDocument::fromJson(text.toUtf8());
+    if (!doc.isObject()) {
+        return state;
+    }
+    for (const QJsonValue& value : doc.object().value("pendingparts").toArray()) {
+        const QJsonObject obj = value.toObject();
+        PendingPart part;
+        part.folderId = static_cast<qint64>(obj.value("folder").toDouble(-1));
+        part.uid = static_cast<qint64>(obj.value("uid").toDouble(-1));
+        part.partId = obj.value("part").toString();
+        if (part.folderId > 0 && part.uid > 0 && !part.partId.isEmpty()) {
+            state.pendingParts.push_back(part);
+        }
+    }
+    return state;
+}
+
+bool AccountSyncState::Load(QSqlDatabase& db, qint64 folderId, AccountSyncState& out, QString& outError)
+{
+    out = AccountSyncState();
+    QSqlQuery query(db);
+    query.prepare("SELECT a.sync_state FROM accounts a JOIN folders f ON f.account_id=a.id WHERE f.id=:fid");
+    query.bindValue(":fid", folderId);
+    if (!query.exec()) {
+        outError = query.lastError().text();
+        return false;
+    }
+    if (query.next()) {
+        out = FromJson(query.value(0).toString());
+    }
+    return true;
+}
+
+bool AccountSyncState::Modify(QSqlDatabase& db,
+                              qint64 folderId,
+                              const std::function<void(AccountSyncState& state)>& change,
+                              const std::function<bool(QString& outError)>& write,
+                              QString& outError)
+{
+    std::lock_guard<std::mutex> lk(ModifyMutex());
+    // Takes the write lock up front. A deferred transaction that reads first cannot upgrade
+    // once another connection has committed in WAL mode (SQLITE_BUSY_SNAPSHOT), and the mutex
+    // only orders writers inside this process.
+    QSqlQuery begin(db);
+    if (!begin.exec("BEGIN IMMEDIATE")) {
+        outError = begin.lastError().text();
+        return false;
+    }
+    AccountSyncState state;
+    if (!Load(db, folderId, state, outError)) {
+        db.rollback();
+        return false;
+    }
+    change(state);
+
+    QSqlQuery save(db);
+    save.prepare("UPDATE accounts SET sync_state=:state WHERE id=(SELECT account_id FROM folders WHERE id=:fid)");
+    save.bindValue(":state", state.ToJson());
+    save.bindValue(":fid", folderId);
+    if (!save.exec()) {
+        outError = save.lastError().text();
+        db.rollback();
+        return false;
+    }
+    if (write && !write(outError)) {
+        db.rollback();
+        return false;
+    }
+    if (!db.commit()) {
+        outError = "Failed to commit account sync state";
+        return false;
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <QString>
+#include <QVector>
+#include <functional>
+
+class QSqlDatabase;
+
+namespace ngks::core::mail::sync {
+
+struct PendingPart {
+    qint64 folderId = -1;
+    qint64 uid = -1;
+    QString partId;
+};
+
+// Account-wide sync progress, persisted as JSON in accounts.sync_state: part downloads that
+// were started but have not landed yet, so the next sync of their folder finishes them.
+struct AccountSyncState {
+    QVector<PendingPart> pendingParts;
+
+    bool HasPendingPart(qint64 folderId, qint64 uid, const QString& partId) const;
+    void AddPendingPart(qint64 folderId, qint64 uid, const QString& partId);
+    void RemovePendingPart(qint64 folderId, qint64 uid, const QString& partId);
+
+    QString ToJson() const;
+    // Empty or malformed text yields an empty state.
+    static AccountSyncState FromJson(const QString& text);
+
+    static bool Load(QSqlDatabase& db, qint64 folderId, AccountSyncState& out, QString& outError);
+    // Changes the state of the account that owns folderId and runs write (if any) in the same
+    // transaction. Serialized process-wide: each thread has its own connection, and two
+    // read-modify-writes of one row must not interleave.
+    static bool Modify(QSqlDatabase& db,
+                       qint64 folderId,
+                       const std::function<void(AccountSyncState& state)>& change,
+                       const std::function<bool(QString& outError)>& write,
+                       QString& outError);
+};
+
+}
@@ -0,0 +1,229 @@
+#include "core/mail/sync/FolderSyncScheduler.h"
+
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QThread>
+#include <QVariant>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "core/mail/providers/imap/ImapClient.h"
+#include "core/mail/providers/imap/ImapConnectionPool.h"
+#include "core/mail/sync/FolderSyncState.h"
+#include "core/mail/sync/JobQueue.h"
+#include "core/mail/sync/SyncEngine.h"
+#include "core/storage/BlobStore.h"
+#include "core/storage/Db.h"
+#include "core/storage/Reindexer.h"
+
+namespace ngks::core::mail::sync {
+
+using namespace ngks::core::mail::providers::imap;
+
+namespace {
+
+bool IsSelectable(const QString& attrsJson)
+{
+    const QJsonArray attrs = QJsonDocument::fromJson(attrsJson.toUtf8()).object().value("attrs").toArray();
+    for (const QJsonValue& attr : attrs) {
+        const QString name = attr.toString();
+        if (name.compare("\\Noselect", Qt::CaseInsensitive) == 0
+            || name.compare("\\NonExistent", Qt::CaseInsensitive) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+int FolderSyncSchedulerOptions::ConnectionsFor(const QString& host) const
+{
+    const QString lower = host.trimmed().toLower();
+    for (const auto& entry : connectionsByHostSuffix) {
+        if (lower == entry.first || lower.endsWith('.' + entry.first)) {
+            return qMax(1, entry.second);
+        }
+    }
+    return qMax(1, defaultConnections);
+}
+
+FolderSyncScheduler::FolderSyncScheduler(ngks::core::storage::Db& db, FolderSyncSchedulerOptions options)
+    : db_(db)
+    , options_(std::move(options))
+{
+}
+
+int FolderSyncScheduler::PriorityFor(const QString& remoteName, const QString& specialUse)
+{
+    if (remoteName.compare("INBOX", Qt::CaseInsensitive) == 0 || specialUse.compare("\\Inbox", Qt::CaseInsensitive) == 0) {
+        return 0;
+    }
+    if (specialUse.compare("\\Sent", Qt::CaseInsensitive) == 0) {
+        return 1;
+    }
+    if (specialUse.compare("\\Drafts", Qt::CaseInsensitive) == 0 || specialUse.compare("\\Flagged", Qt::CaseInsensitive) == 0) {
+        return 2;
+    }
+    if (specialUse.compare("\\Archive", Qt::CaseInsensitive) == 0 || specialUse.compare("\\All", Qt::CaseInsensitive) == 0) {
+        return 4;
+    }
+    if (specialUse.compare("\\Junk", Qt::CaseInsensitive) == 0 || specialUse.compare("\\Trash", Qt::CaseInsensitive) == 0) {
+        return 5;
+    }
+    return 3;
+}
+
+bool FolderSyncScheduler::PlanFolders(const QString& accountEmail, QVector<ScheduledFolder>& outFolders, QString& outError)
+{
+    outFolders.clear();
+    outError.clear();
+    if (!db_.IsOpen()) {
+        outError = "DB is not open";
+        return false;
+    }
+
+    QSqlQuery query(db_.Handle());
+    query.prepare("SELECT f.id, f.remote_name, f.special_use, f.attrs_json, f.sync_state "
+                  "FROM folders f JOIN accounts a ON a.id=f.account_id WHERE a.email=:email");
+    query.bindValue(":email", accountEmail);
+    if (!query.exec()) {
+        outError = query.lastError().text();
+        return false;
+    }
+    while (query.next()) {
+        if (!IsSelectable(query.value(3).toString())) {
+            continue;
+        }
+        ScheduledFolder folder;
+        folder.folderId = query.value(0).toLongLong();
+        folder.remoteName = query.value(1).toString();
+        folder.specialUse = query.value(2).toString();
+        folder.messages = qMax<qint64>(0, FolderSyncState::FromJson(query.value(4).toString()).exists);
+        folder.priority = PriorityFor(folder.remoteName, folder.specialUse);
+        outFolders.push_back(folder);
+    }
+
+    std::stable_sort(outFolders.begin(), outFolders.end(), [](const ScheduledFolder& a, const ScheduledFolder& b) {
+        if (a.priority != b.priority) {
+            return a.priority < b.priority;
+        }
+        return a.messages > b.messages;
+    });
+    return true;
+}
+
+bool FolderSyncScheduler::SyncAccount(const ResolveRequest& account, FolderSyncReport& outReport, QString& outError)
+{
+    outReport = FolderSyncReport();
+    QVector<ScheduledFolder> folders;
+    if (!PlanFolders(account.email, folders, outError)) {
+        return false;
+    }
+    if (folders.isEmpty()) {
+        return true;
+    }
+
+    ImapConnectionPool& pool = ImapConnectionPool::Instance();
+    const QString hostKey = ImapConnectionPool::HostKey(account);
+    const int budget = options_.ConnectionsFor(account.host);
+    if (pool.HostLimit(hostKey) < budget) {
+        pool.SetHostLimit(hostKey, budget);
+    }
+    outReport.connections = qMin(budget, static_cast<int>(folders.size()));
+
+    // Workers use their thread's own connection to the same database file.
+    const std::string dbPath = db_.Handle().databaseName().toStdString();
+    std::mutex mu;
+    int next = 0;
+    QElapsedTimer clock;
+    clock.start();
+
+    auto worker = [&](int index) {
+        ngks::core::storage::Db& workerDb = ngks::core::storage::Db::ForThread(dbPath);
+        if (!workerDb.IsOpen()) {
+            std::lock_guard<std::mutex> lk(mu);
+            outReport.errors.push_back(QString("worker %1: cannot open database").arg(index));
+            return;
+        }
+        JobQueue unused;
+        SyncEngine engine(workerDb, unused);
+        ImapSessionLease session;
+
+        for (;;) {
+            ScheduledFolder folder;
+            {
+                std::lock_guard<std::mutex> lk(mu);
+                if (next >= folders.size()) {
+                    break;
+                }
+                folder = folders[next++];
+            }
+
+            QString error;
+            if (!session) {
+                session = pool.Acquire(account, error);
+            }
+            FolderSyncStats stats;
+            const bool ok = session && engine.SyncFolder(*session, account.email, folder.remoteName, stats, error);
+            if (session && !ok && !session->Client().IsConnected()) {
+                session.Discard();
+            }
+
+            std::lock_guard<std::mutex> lk(mu);
+            if (ok) {
+                outReport.synced += 1;
+                outReport.newMessages += stats.newMessages;
+                outReport.headersFetched += stats.headersFetched;
+            } else {
+                outReport.failed += 1;
+                outReport.errors.push_back(QString("%1: %2").arg(folder.remoteName, error));
+            }
+        }
+    };
+
+    std::vector<std::unique_ptr<QThread>> threads;
+    for (int i = 0; i < outReport.connections; ++i) {
+        threads.emplace_back(QThread::create(worker, i));
+        threads.back()->start();
+    }
+    for (auto& thread : threads) {
+        thread->wait();
+    }
+
+    // Everything the workers stored is queued for the full-text index; one pass here indexes
+    // it (the first pass on a store builds the index on all cores). Search is optional, so a
+    // failure is reported but does not fail the sync.
+    ngks::core::storage::ReindexStats indexStats;
+    QString indexError;
+    if (ngks::core::storage::Reindexer(db_).Run(indexStats, indexError)) {
+        outReport.indexed = indexStats.indexed;
+    } else {
+        outReport.errors.push_back(QString("index: %1").arg(indexError));
+    }
+
+    // Expunged and vanished messages dropped their parts' blob references; reclaim the space.
+    ngks::core::storage::BlobCollectStats blobStats;
+    QString blobError;
+    if (ngks::core::storage::BlobStore::Instance().Collect(db_, blobStats, blobError)) {
+        outReport.blobBytesReclaimed = blobStats.bytesReclaimed;
+    } else {
+        outReport.errors.push_back(QString("blobs: %1").arg(blobError));
+    }
+
+    outReport.elapsedMs = clock.elapsed();
+    if (outReport.synced == 0 && outReport.failed > 0) {
+        outError = outReport.errors.first();
+        return false;
+    }
+    return true;
+}
+
+}
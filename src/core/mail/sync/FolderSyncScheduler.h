@@ -0,0 +1,78 @@
+#pragma once
+
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "core/mail/providers/imap/ImapProvider.h"
+
+namespace ngks::core::storage {
+class Db;
+}
+
+namespace ngks::core::mail::sync {
+
+struct FolderSyncSchedulerOptions {
+    int defaultConnections = 4;
+    // Per-provider budgets, matched against the end of the IMAP host name. Gmail allows 15
+    // simultaneous connections per account across all clients; keep room for IDLE and phones.
+    QList<QPair<QString, int>> connectionsByHostSuffix = {
+        {"gmail.com", 8},
+        {"googlemail.com", 8},
+        {"office365.com", 8},
+        {"outlook.com", 8},
+        {"yahoo.com", 5},
+    };
+
+    int ConnectionsFor(const QString& host) const;
+};
+
+struct ScheduledFolder {
+    qint64 folderId = -1;
+    QString remoteName;
+    QString specialUse;
+    qint64 messages = 0;
+    // Lower runs first: 0 Inbox, 1 Sent, 2 Drafts/Flagged, 3 other, 4 Archive/All, 5 Junk/Trash.
+    int priority = 3;
+};
+
+struct FolderSyncReport {
+    int connections = 0;
+    int synced = 0;
+    int failed = 0;
+    int newMessages = 0;
+    int headersFetched = 0;
+    // Messages added to the full-text index after the folders were synced.
+    qint64 indexed = 0;
+    // Space the BlobStore freed from content no message references any more.
+    qint64 blobBytesReclaimed = 0;
+    qint64 elapsedMs = 0;
+    QStringList errors;
+};
+
+// Syncs every selectable folder of an account over several connections at once. Folders go
+// into one queue ordered by priority (Inbox, then Sent, ...) and, within a priority, largest
+// first; each connection's worker thread takes the next folder as it finishes one, so big
+// folders start early and small ones fill in behind them. Workers have their own database
+// connection and SyncEngine. Blocks until all folders are done.
+class FolderSyncScheduler {
+public:
+    explicit FolderSyncScheduler(ngks::core::storage::Db& db, FolderSyncSchedulerOptions options = {});
+
+    // Sync order for the account's folders, as the workers will take them.
+    bool PlanFolders(const QString& accountEmail, QVector<ScheduledFolder>& outFolders, QString& outError);
+
+    bool SyncAccount(const ngks::core::mail::providers::imap::ResolveRequest& account,
+                     FolderSyncReport& outReport,
+                     QString& outError);
+
+    static int PriorityFor(const QString& remoteName, const QString& specialUse);
+
+private:
+    ngks::core::storage::Db& db_;
+    FolderSyncSchedulerOptions options_;
+};
+
+}
@@ -0,0 +1,51 @@
+#include "core/mail/sync/FolderSyncState.h"
+
+#include <QJsonDocument>
+#include <QJsonObject>
+
+namespace ngks::core::mail::sync {
+
+bool FolderSyncState::IsKnown() const
+{
+    return uidValidity > 0 && uidNext > 0;
+}
+
+bool FolderSyncState::IsScanning() const
+{
+    return uidValidity > 0 && scanFloor > 1;
+}
+
+QString FolderSyncState::ToJson() const
+{
+    QJsonObject obj;
+    obj.insert("uidvalidity", uidValidity);
+    obj.insert("uidnext", uidNext);
+    obj.insert("highestmodseq", highestModSeq);
+    obj.insert("exists", exists);
+    if (scanFloor > 0) {
+        obj.insert("scanfloor", scanFloor);
+    }
+    return QString::fromUtf8(QJsonDocument(obj).toJson(QJsonDocument::Compact));
+}
+
+FolderSyncState FolderSyncState::FromJson(const QString& text)
+{
+    FolderSyncState state;
+    if (text.isEmpty()) {
+        return state;
+    }
+    const QJsonDocument doc = QJsonDocument::fromJson(text.toUtf8());
+    if (!doc.isObject()) {
+        return state;
+    }
+    const QJsonObject obj = doc.object();
+    // Doubles hold every mod-sequence a server will realistically reach (< 2^53).
+    state.uidValidity = static_cast<qint64>(obj.value("uidvalidity").toDouble(-1));
+    state.uidNext = static_cast<qint64>(obj.value("uidnext").toDouble(-1));
+    state.highestModSeq = static_cast<qint64>(obj.value("highestmodseq").toDouble(-1));
+    state.exists = static_cast<qint64>(obj.value("exists").toDouble(-1));
+    state.scanFloor = static_cast<qint64>(obj.value("scanfloor").toDouble(-1));
+    return state;
+}
+
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <QString>
+
+namespace ngks::core::mail::sync {
+
+// What the last completed sync of a folder saw, persisted as JSON in folders.sync_state.
+// -1 means unknown; a folder with no state gets a full sync. The checkpoints are written in
+// the same transaction as the window they describe, so after a crash they never claim more
+// than the messages table holds.
+struct FolderSyncState {
+    qint64 uidValidity = -1;
+    qint64 uidNext = -1;
+    qint64 highestModSeq = -1;
+    qint64 exists = -1;
+    // A full UID scan in progress has listed every UID from here up; the next sync resumes
+    // below it. -1 when no scan is in progress.
+    qint64 scanFloor = -1;
+
+    bool IsKnown() const;
+    bool IsScanning() const;
+    QString ToJson() const;
+    // Empty or malformed text yields an unknown state.
+    static FolderSyncState FromJson(const QString& text);
+};
+
+}
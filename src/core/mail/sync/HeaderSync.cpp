@@ -0,0 +1,348 @@
+#include "core/mail/sync/HeaderSync.h"
+
+#include <QElapsedTimer>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QStringList>
+#include <QVariant>
+#include <QVector>
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <memory>
+
+#include "core/mail/mime/HeaderDecoding.h"
+#include "core/mail/providers/imap/ImapClient.h"
+#include "core/mail/providers/imap/ImapConnection.h"
+#include "core/mail/providers/imap/ImapConnectionPool.h"
+#include "core/mail/providers/imap/ImapResponseParsers.h"
+#include "core/mail/sync/MessageRows.h"
+#include "core/mail/sync/PartFetcher.h"
+#include "core/storage/Db.h"
+#include "core/storage/Reindexer.h"
+
+namespace ngks::core::mail::sync {
+
+using namespace ngks::core::mail::providers::imap;
+
+namespace {
+
+constexpr const char* kFetchItems =
+    "(UID FLAGS INTERNALDATE RFC822.SIZE ENVELOPE BODYSTRUCTURE BODY.PEEK[HEADER.FIELDS (REFERENCES)])";
+
+struct HeaderRow {
+    qint64 uid = -1;
+    qint64 modSeq = 0;
+    QString flags;
+    QString internalDate;
+    qint64 size = 0;
+    QString subject;
+    QString from;
+    QString to;
+    QString date;
+    QString messageId;
+    QString inReplyTo;
+    QString references;
+    QVector<MessageAddress> addresses;
+    std::vector<ngks::core::mail::types::MimePart> parts;
+};
+
+struct Window {
+    QString tag;
+    int count = 0;
+    qint64 submittedNs = 0;
+    qint64 firstResponseNs = -1;
+    QVector<HeaderRow> rows;
+};
+
+// The display form for the messages row; each address also goes to outRows.
+template <typename List>
+QString FormatAddressList(const List& addresses, AddressRole role, QVector<MessageAddress>& outRows)
+{
+    QStringList out;
+    for (const ImapAddress& address : addresses) {
+        const QString email = QString::fromUtf8(address.mailbox.Bytes() + '@' + address.host.Bytes());
+        const QString name = ngks::core::mail::mime::DecodeHeaderText(address.name.Bytes()).trimmed();
+        out.push_back(name.isEmpty() ? email : QString("%1 <%2>").arg(name, email));
+        outRows.push_back(MessageAddress{role, name, email});
+    }
+    return out.join(", ");
+}
+
+bool ToHeaderRow(QByteArrayView response, HeaderRow& out)
+{
+    ImapFetchEntry entry;
+    if (!ParseFetchResponse(response, entry) || entry.uid < 0) {
+        return false;
+    }
+    out.uid = entry.uid;
+    out.modSeq = entry.modSeq < 0 ? 0 : entry.modSeq;
+    for (const QByteArrayView flag : entry.flags) {
+        if (!out.flags.isEmpty()) {
+            out.flags += ' ';
+        }
+        out.flags += QString::fromUtf8(flag);
+    }
+    out.internalDate = QString::fromUtf8(entry.internalDate);
+    out.size = entry.size < 0 ? 0 : entry.size;
+
+    ImapEnvelope envelope;
+    if (!entry.envelope.isEmpty() && ParseEnvelope(entry.envelope, envelope)) {
+        out.subject = ngks::core::mail::mime::DecodeHeaderText(envelope.subject.Bytes());
+        out.from = FormatAddressList(envelope.from, AddressRole::From, out.addresses);
+        out.to = FormatAddressList(envelope.to, AddressRole::To, out.addresses);
+        FormatAddressList(envelope.cc, AddressRole::Cc, out.addresses);
+        out.date = QString::fromUtf8(envelope.date.Bytes());
+        out.messageId = QString::fromUtf8(envelope.messageId.Bytes());
+        out.inReplyTo = QString::fromUtf8(envelope.inReplyTo.Bytes());
+    }
+    QVector<ImapBodyPart> structure;
+    if (!entry.bodyStructure.isEmpty() && ParseBodyStructure(entry.bodyStructure, structure)) {
+        out.parts = ToMimeParts(structure);
+    }
+    for (const ImapFetchSection& section : entry.sections) {
+        if (!section.isNil && !section.spooled) {
+            out.references = QString::fromUtf8(ngks::core::mail::mime::HeaderFieldValue(section.data, "References"));
+        }
+    }
+    return true;
+}
+
+// "9:7,5,3:2" for the descending run 9 8 7 5 3 2.
+QString UidSet(const QVector<qint64>& uids, qsizetype begin, qsizetype end)
+{
+    QString out;
+    qsizetype i = begin;
+    while (i < end) {
+        qsizetype j = i;
+        while (j + 1 < end && uids[j + 1] == uids[j] - 1) {
+            ++j;
+        }
+        if (!out.isEmpty()) {
+            out += ',';
+        }
+        out += j == i ? QString::number(uids[i]) : QString("%1:%2").arg(uids[i]).arg(uids[j]);
+        i = j + 1;
+    }
+    return out;
+}
+
+bool IsTaggedOk(const QStringList& lines, const QString& tag)
+{
+    return !lines.isEmpty() && lines.last().startsWith(tag + " OK", Qt::CaseInsensitive);
+}
+
+// Stores a window's headers in one transaction. has_header is the checkpoint: a restarted
+// sync asks only for the messages still without one.
+bool Commit(QSqlDatabase& db, qint64 folderId, const QVector<HeaderRow>& rows, QString& outError)
+{
+    if (!db.transaction()) {
+        outError = "Failed to start transaction";
+        return false;
+    }
+    QSqlQuery query(db);
+    query.prepare(
+        "INSERT INTO messages(folder_id, uid, modseq, flags, seen, flagged, internal_date, received_at, size, subject, "
+        "from_addr, to_addrs, date_header, message_id, in_reply_to, references_hdr, thread_id, has_header) "
+        "VALUES(:fid, :uid, :modseq, :flags, :seen, :flagged, :idate, :received, :size, :subject, :from, :to, :date, "
+        ":mid, :irt, :refs, :thread, 1) "
+        "ON CONFLICT(folder_id, uid) DO UPDATE SET modseq=excluded.modseq, flags=excluded.flags, seen=excluded.seen, "
+        "flagged=excluded.flagged, internal_date=excluded.internal_date, received_at=excluded.received_at, "
+        "size=excluded.size, subject=excluded.subject, "
+        "from_addr=excluded.from_addr, to_addrs=excluded.to_addrs, date_header=excluded.date_header, "
+        "message_id=excluded.message_id, in_reply_to=excluded.in_reply_to, "
+        "references_hdr=excluded.references_hdr, thread_id=excluded.thread_id, has_header=1");
+    PartWriter parts(db);
+    FlagWriter flagRows(db);
+    AddressWriter addressRows(db);
+    ngks::core::storage::ReindexQueue reindex(db);
+    for (const HeaderRow& row : rows) {
+        const MessageFlags flags = MessageFlags::Parse(row.flags);
+        query.bindValue(":fid", folderId);
+        query.bindValue(":uid", row.uid);
+        query.bindValue(":modseq", row.modSeq);
+        query.bindValue(":flags", row.flags);
+        query.bindValue(":seen", flags.seen ? 1 : 0);
+        query.bindValue(":flagged", flags.flagged ? 1 : 0);
+        query.bindValue(":idate", row.internalDate);
+        query.bindValue(":received", ParseInternalDateUtc(row.internalDate));
+        query.bindValue(":size", row.size);
+        query.bindValue(":subject", row.subject);
+        query.bindValue(":from", row.from);
+        query.bindValue(":to", row.to);
+        query.bindValue(":date", row.date);
+        query.bindValue(":mid", row.messageId);
+        query.bindValue(":irt", row.inReplyTo);
+        query.bindValue(":refs", row.references);
+        query.bindValue(":thread", ThreadId(row.messageId, row.inReplyTo, row.references, folderId, row.uid));
+        if (!query.exec()) {
+            outError = query.lastError().text();
+            db.rollback();
+            return false;
+        }
+        if (!flagRows.Write(folderId, row.uid, flags, outError)
+            || !addressRows.Write(folderId, row.uid, row.addresses, outError)
+            || !parts.Write(folderId, row.uid, row.parts, outError)
+            || !reindex.Add(folderId, row.uid, outError)) {
+            db.rollback();
+            return false;
+        }
+    }
+    if (!db.commit()) {
+        outError = "Failed to commit header window";
+        return false;
+    }
+    return true;
+}
+
+}
+
+HeaderSync::HeaderSync(ngks::core::storage::Db& db, HeaderSyncOptions options)
+    : db_(db)
+    , options_(options)
+{
+}
+
+void HeaderSync::SetProgressCallback(ProgressCallback callback)
+{
+    progress_ = std::move(callback);
+}
+
+bool HeaderSync::Run(ImapSession& session, qint64 folderId, HeaderSyncStats& outStats, QString& outError)
+{
+    outStats = HeaderSyncStats();
+    outError.clear();
+    if (!db_.IsOpen()) {
+        outError = "DB is not open";
+        return false;
+    }
+    QSqlDatabase& sqlDb = db_.Handle();
+
+    QVector<qint64> pending;
+    {
+        QSqlQuery query(sqlDb);
+        query.setForwardOnly(true);
+        query.prepare("SELECT uid FROM messages WHERE folder_id=:fid AND has_header=0 ORDER BY uid DESC");
+        query.bindValue(":fid", folderId);
+        if (!query.exec()) {
+            outError = query.lastError().text();
+            return false;
+        }
+        while (query.next()) {
+            pending.push_back(query.value(0).toLongLong());
+        }
+    }
+    if (pending.isEmpty()) {
+        return true;
+    }
+
+    ImapClient& client = session.Client();
+    QElapsedTimer clock;
+    clock.start();
+
+    const qint64 targetNs = qint64(options_.targetWindowMs) * 1000000;
+    int windowSize = std::clamp(options_.initialWindow, options_.minWindow, options_.maxWindow);
+    int depth = qMin(2, options_.maxInFlight);
+    double nsPerMessage = 0;
+    double bytesPerMessage = 0;
+    qint64 roundTripNs = -1;
+    qint64 lastCompletionNs = 0;
+    qint64 lastBytes = client.WireStats().protocolBytesIn;
+    const qint64 startBytes = lastBytes;
+    qsizetype next = 0;
+    std::deque<std::unique_ptr<Window>> inFlight;
+
+    auto submit = [&]() {
+        auto window = std::make_unique<Window>();
+        const qsizetype end = qMin<qsizetype>(pending.size(), next + windowSize);
+        window->count = static_cast<int>(end - next);
+        window->submittedNs = clock.nsecsElapsed();
+        Window* target = window.get();
+        window->tag = client.SubmitStreaming(QString("UID FETCH %1 %2").arg(UidSet(pending, next, end), kFetchItems),
+                                             {"FETCH"},
+                                             [target, &clock](QByteArrayView response) {
+                                                 if (target->firstResponseNs < 0) {
+                                                     target->firstResponseNs = clock.nsecsElapsed();
+                                                 }
+                                                 HeaderRow row;
+                                                 if (ToHeaderRow(response, row)) {
+                                                     target->rows.push_back(std::move(row));
+                                                 }
+                                             });
+        next = end;
+        inFlight.push_back(std::move(window));
+    };
+
+    while (next < pending.size() || !inFlight.empty()) {
+        while (next < pending.size() && static_cast<int>(inFlight.size()) < depth) {
+            submit();
+        }
+        outStats.maxInFlight = qMax(outStats.maxInFlight, static_cast<int>(inFlight.size()));
+
+        std::unique_ptr<Window> window = std::move(inFlight.front());
+        inFlight.pop_front();
+        if (!IsTaggedOk(client.Await(window->tag, options_.timeoutMs), window->tag)) {
+            // Drain what is still in flight so the session stays usable.
+            for (const auto& rest : inFlight) {
+                client.Await(rest->tag, options_.timeoutMs);
+            }
+            outError = client.LastError().isEmpty() ? "UID FETCH failed" : client.LastError();
+            outStats.elapsedMs = clock.elapsed();
+            return false;
+        }
+
+        const qint64 nowNs = clock.nsecsElapsed();
+        const qint64 bytes = client.WireStats().protocolBytesIn;
+        // Time this window spent streaming: from its first response (or the end of the previous
+        // window, if that came later) to its completion.
+        const qint64 streamStartNs = qMax(window->firstResponseNs, lastCompletionNs);
+        const qint64 serviceNs = qMax<qint64>(1, nowNs - streamStartNs);
+        const qint64 windowBytes = bytes - lastBytes;
+        lastCompletionNs = nowNs;
+        lastBytes = bytes;
+
+        if (!Commit(sqlDb, folderId, window->rows, outError)) {
+            for (const auto& rest : inFlight) {
+                client.Await(rest->tag, options_.timeoutMs);
+            }
+            return false;
+        }
+        outStats.windows += 1;
+        outStats.messages += window->rows.size();
+        outStats.lastWindow = window->count;
+        if (progress_) {
+            progress_(folderId, outStats.messages);
+        }
+
+        if (!window->rows.isEmpty() && window->firstResponseNs >= 0) {
+            const double messages = window->rows.size();
+            constexpr double kWeight = 0.3;
+            const double sampleNs = serviceNs / messages;
+            const double sampleBytes = windowBytes / messages;
+            nsPerMessage = nsPerMessage == 0 ? sampleNs : nsPerMessage * (1 - kWeight) + sampleNs * kWeight;
+            bytesPerMessage = bytesPerMessage == 0 ? sampleBytes : bytesPerMessage * (1 - kWeight) + sampleBytes * kWeight;
+
+            // Round trip: no window can see its first response sooner than one round trip after
+            // it was sent, and the first window went out on an idle connection.
+            const qint64 rttSample = window->firstResponseNs - window->submittedNs;
+            roundTripNs = roundTripNs < 0 ? rttSample : qMin(roundTripNs, rttSample);
+
+            const double byTime = targetNs / qMax(1.0, nsPerMessage);
+            const double byBytes = options_.maxWindowBytes / qMax(1.0, bytesPerMessage);
+            // Grow at most 2x per window so one fast sample cannot overshoot.
+            const double wanted = std::min({byTime, byBytes, windowSize * 2.0});
+            windowSize = std::clamp(static_cast<int>(wanted), options_.minWindow, options_.maxWindow);
+            // Keep a round trip's worth of windows queued behind the one streaming.
+            const int wantedDepth = 1 + static_cast<int>(std::ceil(double(roundTripNs) / qMax<qint64>(1, targetNs)));
+            depth = std::clamp(wantedDepth, 2, qMax(2, options_.maxInFlight));
+        }
+    }
+
+    outStats.bytes = client.WireStats().protocolBytesIn - startBytes;
+    outStats.elapsedMs = clock.elapsed();
+    outStats.roundTripMs = roundTripNs < 0 ? 0 : roundTripNs / 1000000;
+    return true;
+}
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <QString>
+#include <functional>
+
+namespace ngks::core::storage {
+class Db;
+}
+
+namespace ngks::core::mail::providers::imap {
+class ImapSession;
+}
+
+namespace ngks::core::mail::sync {
+
+struct HeaderSyncOptions {
+    // Messages in the first window: small, so the newest messages show up quickly.
+    int initialWindow = 50;
+    int minWindow = 25;
+    int maxWindow = 2000;
+    // Windows are sized to stream in about this long once they start arriving...
+    int targetWindowMs = 300;
+    // ...and to stay under this many response bytes.
+    qint64 maxWindowBytes = 2 * 1024 * 1024;
+    // Upper bound on pipelined windows; the actual depth follows the measured round trip.
+    int maxInFlight = 6;
+    int timeoutMs = 2 * 60 * 1000;
+};
+
+struct HeaderSyncStats {
+    int windows = 0;
+    int messages = 0;
+    qint64 bytes = 0;
+    qint64 elapsedMs = 0;
+    int lastWindow = 0;
+    int maxInFlight = 0;
+    qint64 roundTripMs = 0;
+};
+
+// Initial header download for a folder: UID FETCH of flags, INTERNALDATE, size, ENVELOPE,
+// BODYSTRUCTURE (into message_parts, for PartFetcher) and References in UID windows, newest UID first, several windows in flight. Window size follows
+// the measured per-message transfer time and size; pipeline depth follows the round trip.
+// Every window is committed on its own, so an interrupted run loses at most the windows in
+// flight and the list can show the newest messages while older ones are still arriving.
+class HeaderSync {
+public:
+    // Called after each committed window with the folder's running total.
+    using ProgressCallback = std::function<void(qint64 folderId, int fetched)>;
+
+    explicit HeaderSync(ngks::core::storage::Db& db, HeaderSyncOptions options = {});
+
+    void SetProgressCallback(ProgressCallback callback);
+
+    // Fetches headers for the folder's messages that have none yet (has_header=0). The session
+    // must have the folder selected.
+    bool Run(ngks::core::mail::providers::imap::ImapSession& session,
+             qint64 folderId,
+             HeaderSyncStats& outStats,
+             QString& outError);
+
+private:
+    ngks::core::storage::Db& db_;
+    HeaderSyncOptions options_;
+    ProgressCallback progress_;
+};
+
+}
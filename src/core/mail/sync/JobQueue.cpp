@@ -1,6 +1,385 @@
 #include "core/mail/sync/JobQueue.h"
 
+#include <QThread>
+
 namespace ngks::core::mail::sync {
-void JobQueue::Enqueue() {
+
+namespace {
+
+int PriorityIndex(JobPriority priority)
+{
+    return static_cast<int>(priority);
+}
+
+}
+
+bool JobContext::IsCancelled() const
+{
+    return cancelled_.load();
+}
+
+bool JobContext::ShouldYield() const
+{
+    if (cancelled_.load()) {
+        return true;
+    }
+    std::lock_guard<std::mutex> lk(queue_->mu_);
+    return queue_->ShouldYieldLocked(*job_);
+}
+
+int JobContext::WorkerIndex() const
+{
+    return worker_;
+}
+
+JobQueue::JobQueue(JobQueueOptions options)
+    : options_(options)
+    , queues_(static_cast<size_t>(qMax(1, options.workers)))
+{
+}
+
+JobQueue::~JobQueue()
+{
+    Stop();
+}
+
+QString JobQueue::DedupKey(const SyncJob& job)
+{
+    QString key = QString("%1|%2|%3").arg(static_cast<int>(job.type)).arg(job.accountEmail, job.mailbox);
+    if (job.type == JobType::FolderSync) {
+        // A folder sync finds out for itself what changed, so one pending sync covers all.
+        return key;
+    }
+    key += '|';
+    for (const qint64 uid : job.uids) {
+        key += QString::number(uid);
+        key += ',';
+    }
+    key += '|';
+    key += job.payload;
+    return key;
+}
+
+quint64 JobQueue::Enqueue(SyncJob job)
+{
+    quint64 id = 0;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        const QString key = DedupKey(job);
+        if (std::shared_ptr<Entry> existing = FindPendingLocked(key)) {
+            ++stats_.deduplicated;
+            SyncJob& pending = existing->job;
+            if (job.type == JobType::FolderSync && pending.kind != SyncJobKind::FolderResync) {
+                // Sequence numbers of two change sets cannot be combined; sync the folder.
+                pending.kind = SyncJobKind::FolderResync;
+                pending.firstSequence = -1;
+                pending.lastSequence = -1;
+                pending.uidFrom = -1;
+                pending.sequences.clear();
+                pending.uids.clear();
+            }
+            if (job.priority < pending.priority) {
+                for (WorkerQueue& queue : queues_) {
+                    auto& bucket = queue.byPriority[PriorityIndex(pending.priority)];
+                    for (auto it = bucket.begin(); it != bucket.end(); ++it) {
+                        if (*it == existing) {
+                            bucket.erase(it);
+                            queue.byPriority[PriorityIndex(job.priority)].push_back(existing);
+                            break;
+                        }
+                    }
+                }
+                pendingByPriority_[PriorityIndex(pending.priority)] -= 1;
+                pendingByPriority_[PriorityIndex(job.priority)] += 1;
+                if (job.priority == JobPriority::Interactive) {
+                    pendingInteractive_[pending.accountEmail] += 1;
+                }
+                pending.priority = job.priority;
+            }
+            id = pending.id;
+        } else {
+            job.id = nextId_++;
+            id = job.id;
+            auto entry = std::make_shared<Entry>();
+            entry->job = std::move(job);
+            const SyncJob& queued = entry->job;
+            const int home = homeWorker_.value(queued.accountEmail,
+                                               static_cast<int>(qHash(queued.accountEmail) % queues_.size()));
+            queues_[home].byPriority[PriorityIndex(queued.priority)].push_back(entry);
+            pendingByKey_.insert(key, entry);
+            pendingByPriority_[PriorityIndex(queued.priority)] += 1;
+            if (queued.priority == JobPriority::Interactive) {
+                pendingInteractive_[queued.accountEmail] += 1;
+            }
+            ++stats_.enqueued;
+        }
+    }
+    wake_.notify_all();
+    return id;
+}
+
+bool JobQueue::TryDequeue(JobType type, SyncJob& out)
+{
+    std::lock_guard<std::mutex> lk(mu_);
+    std::shared_ptr<Entry> entry = TakeLocked(-1, false, type);
+    if (!entry) {
+        return false;
+    }
+    out = std::move(entry->job);
+    return true;
+}
+
+int JobQueue::Size() const
+{
+    std::lock_guard<std::mutex> lk(mu_);
+    return pendingByPriority_[0] + pendingByPriority_[1] + pendingByPriority_[2];
+}
+
+void JobQueue::SetHandler(JobType type, JobHandler handler)
+{
+    std::lock_guard<std::mutex> lk(mu_);
+    handlers_[static_cast<size_t>(type)] = std::move(handler);
+}
+
+void JobQueue::Start()
+{
+    std::lock_guard<std::mutex> lk(mu_);
+    if (!threads_.empty()) {
+        return;
+    }
+    stopping_ = false;
+    for (int i = 0; i < static_cast<int>(queues_.size()); ++i) {
+        QThread* thread = QThread::create([this, i]() { RunWorker(i); });
+        threads_.push_back(thread);
+        thread->start();
+    }
+}
+
+void JobQueue::Stop()
+{
+    std::vector<QThread*> threads;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        stopping_ = true;
+        for (JobContext* context : running_) {
+            context->cancelled_ = true;
+        }
+        for (WorkerQueue& queue : queues_) {
+            for (auto& bucket : queue.byPriority) {
+                stats_.cancelled += static_cast<qint64>(bucket.size());
+                bucket.clear();
+            }
+        }
+        pendingByKey_.clear();
+        pendingInteractive_.clear();
+        pendingByPriority_[0] = pendingByPriority_[1] = pendingByPriority_[2] = 0;
+        threads.swap(threads_);
+    }
+    wake_.notify_all();
+    for (QThread* thread : threads) {
+        thread->wait();
+        delete thread;
+    }
+}
+
+bool JobQueue::Cancel(quint64 id)
+{
+    std::lock_guard<std::mutex> lk(mu_);
+    if (JobContext* context = running_.value(id, nullptr)) {
+        context->cancelled_ = true;
+        return true;
+    }
+    for (WorkerQueue& queue : queues_) {
+        for (auto& bucket : queue.byPriority) {
+            for (auto it = bucket.begin(); it != bucket.end(); ++it) {
+                if ((*it)->job.id == id) {
+                    ForgetPendingLocked(**it);
+                    bucket.erase(it);
+                    ++stats_.cancelled;
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+int JobQueue::CancelAccount(const QString& accountEmail)
+{
+    std::lock_guard<std::mutex> lk(mu_);
+    int cancelled = 0;
+    for (JobContext* context : running_) {
+        if (context->job_->accountEmail == accountEmail) {
+            context->cancelled_ = true;
+            ++cancelled;
+        }
+    }
+    for (WorkerQueue& queue : queues_) {
+        for (auto& bucket : queue.byPriority) {
+            for (auto it = bucket.begin(); it != bucket.end();) {
+                if ((*it)->job.accountEmail == accountEmail) {
+                    ForgetPendingLocked(**it);
+                    it = bucket.erase(it);
+                    ++stats_.cancelled;
+                    ++cancelled;
+                } else {
+                    ++it;
+                }
+            }
+        }
+    }
+    return cancelled;
+}
+
+JobQueueStats JobQueue::Stats() const
+{
+    std::lock_guard<std::mutex> lk(mu_);
+    return stats_;
+}
+
+void JobQueue::RunWorker(int index)
+{
+    std::unique_lock<std::mutex> lk(mu_);
+    for (;;) {
+        if (stopping_) {
+            return;
+        }
+        std::shared_ptr<Entry> entry = TakeLocked(index, true);
+        if (!entry) {
+            wake_.wait(lk);
+            continue;
+        }
+
+        const SyncJob& job = entry->job;
+        const JobHandler handler = handlers_[static_cast<size_t>(job.type)];
+        JobContext context;
+        context.queue_ = this;
+        context.job_ = &job;
+        context.worker_ = index;
+        running_.insert(job.id, &context);
+        runningPerAccount_[job.accountEmail] += 1;
+        if (!job.host.isEmpty()) {
+            runningPerHost_[job.host] += 1;
+        }
+        homeWorker_.insert(job.accountEmail, index);
+        ++busyWorkers_;
+
+        lk.unlock();
+        const JobResult result = handler ? handler(job, context) : JobResult::Failed;
+        lk.lock();
+
+        running_.remove(job.id);
+        if (--runningPerAccount_[job.accountEmail] <= 0) {
+            runningPerAccount_.remove(job.accountEmail);
+        }
+        if (!job.host.isEmpty() && --runningPerHost_[job.host] <= 0) {
+            runningPerHost_.remove(job.host);
+        }
+        --busyWorkers_;
+
+        if (context.cancelled_.load()) {
+            ++stats_.cancelled;
+        } else if (result == JobResult::Yielded && !stopping_) {
+            ++stats_.yielded;
+            const QString key = DedupKey(job);
+            if (FindPendingLocked(key)) {
+                // Something newer already covers it.
+                ++stats_.deduplicated;
+            } else {
+                // Back to the front of its line, behind whatever it yielded to.
+                queues_[index].byPriority[PriorityIndex(job.priority)].push_front(entry);
+                pendingByKey_.insert(key, entry);
+                pendingByPriority_[PriorityIndex(job.priority)] += 1;
+                if (job.priority == JobPriority::Interactive) {
+                    pendingInteractive_[job.accountEmail] += 1;
+                }
+            }
+        } else if (result == JobResult::Done) {
+            ++stats_.completed;
+        } else {
+            ++stats_.failed;
+        }
+        wake_.notify_all();
+    }
+}
+
+std::shared_ptr<JobQueue::Entry> JobQueue::TakeLocked(int worker, bool respectLimits, std::optional<JobType> type)
+{
+    const int count = static_cast<int>(queues_.size());
+    for (int priority = 0; priority < 3; ++priority) {
+        for (int offset = 0; offset < count; ++offset) {
+            const bool own = worker >= 0 && offset == 0;
+            auto& bucket = queues_[worker >= 0 ? (worker + offset) % count : offset].byPriority[priority];
+            if (bucket.empty()) {
+                continue;
+            }
+            // The owner takes the oldest job; thieves take from the other end.
+            for (qsizetype i = 0; i < static_cast<qsizetype>(bucket.size()); ++i) {
+                const qsizetype at = own || worker < 0 ? i : static_cast<qsizetype>(bucket.size()) - 1 - i;
+                std::shared_ptr<Entry> entry = bucket[at];
+                if (type && entry->job.type != *type) {
+                    continue;
+                }
+                if (respectLimits && !CanStartLocked(entry->job)) {
+                    continue;
+                }
+                bucket.erase(bucket.begin() + at);
+                ForgetPendingLocked(*entry);
+                if (!own && worker >= 0) {
+                    ++stats_.stolen;
+                }
+                return entry;
+            }
+        }
+    }
+    return nullptr;
 }
+
+bool JobQueue::CanStartLocked(const SyncJob& job) const
+{
+    if (runningPerAccount_.value(job.accountEmail) >= options_.maxPerAccount) {
+        return false;
+    }
+    return job.host.isEmpty() || runningPerHost_.value(job.host) < options_.maxPerHost;
+}
+
+std::shared_ptr<JobQueue::Entry> JobQueue::FindPendingLocked(const QString& dedupKey) const
+{
+    return pendingByKey_.value(dedupKey);
+}
+
+bool JobQueue::ShouldYieldLocked(const SyncJob& job) const
+{
+    if (job.priority == JobPriority::Interactive) {
+        return false;
+    }
+    // The account's slots are what an interactive job of the same account is waiting for.
+    if (pendingInteractive_.value(job.accountEmail) > 0) {
+        return true;
+    }
+    // Otherwise yield only when every worker is busy and something more urgent waits.
+    if (busyWorkers_ < static_cast<int>(queues_.size())) {
+        return false;
+    }
+    for (int priority = 0; priority < PriorityIndex(job.priority); ++priority) {
+        if (pendingByPriority_[priority] > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void JobQueue::ForgetPendingLocked(const Entry& entry)
+{
+    const SyncJob& job = entry.job;
+    const QString key = DedupKey(job);
+    if (pendingByKey_.value(key).get() == &entry) {
+        pendingByKey_.remove(key);
+    }
+    pendingByPriority_[PriorityIndex(job.priority)] -= 1;
+    if (job.priority == JobPriority::Interactive && --pendingInteractive_[job.accountEmail] <= 0) {
+        pendingInteractive_.remove(job.accountEmail);
+    }
+}
+
 }
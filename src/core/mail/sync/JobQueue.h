@@ -1,8 +1,143 @@
 #pragma once
 
+#include <QHash>
+#include <QString>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "core/mail/sync/SyncJob.h"
+
+class QThread;
+
 namespace ngks::core::mail::sync {
+
+class JobQueue;
+
+enum class JobResult {
+    Done,
+    Failed,
+    // Stopped early at ShouldYield(); the job goes back into the queue.
+    Yielded
+};
+
+// Handed to a running job.
+class JobContext {
+public:
+    bool IsCancelled() const;
+    // True when more urgent work for the same account (or any work, if all workers are busy)
+    // is waiting. Long jobs check it between steps and return JobResult::Yielded.
+    bool ShouldYield() const;
+    int WorkerIndex() const;
+
+private:
+    friend class JobQueue;
+
+    JobQueue* queue_ = nullptr;
+    const SyncJob* job_ = nullptr;
+    int worker_ = -1;
+    std::atomic<bool> cancelled_{false};
+};
+
+using JobHandler = std::function<JobResult(const SyncJob& job, JobContext& context)>;
+
+struct JobQueueOptions {
+    int workers = 4;
+    int maxPerAccount = 2;
+    int maxPerHost = 4;
+};
+
+struct JobQueueStats {
+    qint64 enqueued = 0;
+    qint64 deduplicated = 0;
+    qint64 stolen = 0;
+    qint64 yielded = 0;
+    qint64 cancelled = 0;
+    qint64 completed = 0;
+    qint64 failed = 0;
+};
+
+// Priority job scheduler for sync work. Jobs sit in per-worker deques, one per priority, and
+// go to the worker that last ran their account so session and cache state stay warm; a worker
+// with nothing runnable steals from the others, always taking the most urgent job first. A job
+// only starts while its account and host are under their concurrency limits. An identical
+// pending job is merged instead of queued twice (for FolderSync, any pending sync of the same
+// mailbox). Running jobs can be cancelled and are asked to yield when an Interactive job waits.
+// Without Start(), TryDequeue drains one type of job from one thread (SyncEngine::Tick takes
+// the folder syncs).
 class JobQueue {
 public:
-    void Enqueue();
+    explicit JobQueue(JobQueueOptions options = {});
+    ~JobQueue();
+
+    JobQueue(const JobQueue&) = delete;
+    JobQueue& operator=(const JobQueue&) = delete;
+
+    // Returns the job's id, or the id of the pending job it was merged into (whose priority
+    // is raised if this one is more urgent).
+    quint64 Enqueue(SyncJob job);
+    // Takes the most urgent pending job of the given type regardless of limits; jobs of other
+    // types stay queued.
+    bool TryDequeue(JobType type, SyncJob& out);
+    int Size() const;
+
+    void SetHandler(JobType type, JobHandler handler);
+    // Starts the worker threads; handlers must be set first.
+    void Start();
+    // Cancels running jobs, drops pending ones and joins the workers.
+    void Stop();
+
+    // Removes a pending job or flags a running one. Returns false if the id is unknown.
+    bool Cancel(quint64 id);
+    // Cancels every pending and running job of the account; returns how many.
+    int CancelAccount(const QString& accountEmail);
+
+    JobQueueStats Stats() const;
+
+private:
+    friend class JobContext;
+
+    struct Entry {
+        SyncJob job;
+    };
+    struct WorkerQueue {
+        std::deque<std::shared_ptr<Entry>> byPriority[3];
+    };
+
+    void RunWorker(int index);
+    // Picks the next job a worker may start, own deques first, then stealing; only jobs of
+    // type, if given. Needs mu_.
+    std::shared_ptr<Entry> TakeLocked(int worker, bool respectLimits, std::optional<JobType> type = std::nullopt);
+    bool CanStartLocked(const SyncJob& job) const;
+    std::shared_ptr<Entry> FindPendingLocked(const QString& dedupKey) const;
+    bool ShouldYieldLocked(const SyncJob& job) const;
+    void ForgetPendingLocked(const Entry& entry);
+
+    static QString DedupKey(const SyncJob& job);
+
+    JobQueueOptions options_;
+    mutable std::mutex mu_;
+    std::condition_variable wake_;
+    std::vector<WorkerQueue> queues_;
+    std::vector<QThread*> threads_;
+    QHash<QString, std::shared_ptr<Entry>> pendingByKey_;
+    QHash<QString, int> homeWorker_;
+    QHash<QString, int> runningPerAccount_;
+    QHash<QString, int> runningPerHost_;
+    QHash<QString, int> pendingInteractive_;
+    QHash<quint64, JobContext*> running_;
+    std::array<JobHandler, 4> handlers_;
+    quint64 nextId_ = 1;
+    int pendingByPriority_[3] = {0, 0, 0};
+    int busyWorkers_ = 0;
+    bool stopping_ = false;
+    JobQueueStats stats_;
 };
+
 }
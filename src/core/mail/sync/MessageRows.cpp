@@ -0,0 +1,171 @@
+#include "core/mail/sync/MessageRows.h"
+
+#include <QDate>
+#include <QDateTime>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QTime>
+#include <QTimeZone>
+#include <QVariant>
+
+namespace ngks::core::mail::sync {
+
+namespace {
+
+const char* const kMonths[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+// The first <...> in a header value, or the trimmed value if it has none.
+QString FirstMessageId(const QString& value)
+{
+    const qsizetype open = value.indexOf('<');
+    const qsizetype close = open < 0 ? -1 : value.indexOf('>', open);
+    if (close < 0) {
+        return value.trimmed();
+    }
+    return value.mid(open, close - open + 1);
+}
+
+// FNV-1a; qHash is seeded per process and the key is stored.
+qint64 StableHash(const QString& value)
+{
+    quint64 hash = 14695981039346656037ull;
+    for (const char c : value.toUtf8()) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return static_cast<qint64>(hash & 0x7fffffffffffffffull);
+}
+
+}
+
+MessageFlags MessageFlags::Parse(const QString& flags)
+{
+    MessageFlags out;
+    for (const QString& flag : flags.split(' ', Qt::SkipEmptyParts)) {
+        if (flag.compare(QLatin1String("\\Seen"), Qt::CaseInsensitive) == 0) {
+            out.seen = true;
+        } else if (flag.compare(QLatin1String("\\Flagged"), Qt::CaseInsensitive) == 0) {
+            out.flagged = true;
+        } else {
+            out.others.push_back(flag);
+        }
+    }
+    return out;
+}
+
+qint64 ParseInternalDateUtc(const QString& value)
+{
+    const QStringList fields = value.simplified().split(' ');
+    if (fields.size() != 3) {
+        return 0;
+    }
+    const QStringList day = fields[0].split('-');
+    if (day.size() != 3) {
+        return 0;
+    }
+    int month = 0;
+    for (int i = 0; i < 12; ++i) {
+        if (day[1].compare(QLatin1String(kMonths[i]), Qt::CaseInsensitive) == 0) {
+            month = i + 1;
+            break;
+        }
+    }
+    const QDate date(day[2].toInt(), month, day[0].toInt());
+    const QTime time = QTime::fromString(fields[1], QStringLiteral("HH:mm:ss"));
+    const QString& zone = fields[2];
+    if (!date.isValid() || !time.isValid() || zone.size() != 5 || (zone[0] != '+' && zone[0] != '-')) {
+        return 0;
+    }
+    bool ok = false;
+    const int hhmm = zone.mid(1).toInt(&ok);
+    if (!ok) {
+        return 0;
+    }
+    const int offset = (zone[0] == '-' ? -1 : 1) * ((hhmm / 100) * 3600 + (hhmm % 100) * 60);
+    return QDateTime(date, time, QTimeZone::utc()).toSecsSinceEpoch() - offset;
+}
+
+qint64 ThreadId(const QString& messageId,
+                const QString& inReplyTo,
+                const QString& references,
+                qint64 folderId,
+                qint64 uid)
+{
+    QString root = FirstMessageId(references);
+    if (root.isEmpty()) {
+        root = FirstMessageId(inReplyTo);
+    }
+    if (root.isEmpty()) {
+        root = FirstMessageId(messageId);
+    }
+    if (root.isEmpty()) {
+        return -((folderId << 32) | uid);
+    }
+    return StableHash(root);
+}
+
+FlagWriter::FlagWriter(QSqlDatabase& db)
+    : clear_(db)
+    , insert_(db)
+{
+    clear_.prepare("DELETE FROM message_flags WHERE message_id=(SELECT id FROM messages WHERE folder_id=:fid AND uid=:uid)");
+    insert_.prepare("INSERT OR IGNORE INTO message_flags(message_id, flag) "
+                    "SELECT id, :flag FROM messages WHERE folder_id=:fid AND uid=:uid");
+}
+
+bool FlagWriter::Write(qint64 folderId, qint64 uid, const MessageFlags& flags, QString& outError)
+{
+    clear_.bindValue(":fid", folderId);
+    clear_.bindValue(":uid", uid);
+    if (!clear_.exec()) {
+        outError = clear_.lastError().text();
+        return false;
+    }
+    for (const QString& flag : flags.others) {
+        insert_.bindValue(":flag", flag);
+        insert_.bindValue(":fid", folderId);
+        insert_.bindValue(":uid", uid);
+        if (!insert_.exec()) {
+            outError = insert_.lastError().text();
+            return false;
+        }
+    }
+    return true;
+}
+
+AddressWriter::AddressWriter(QSqlDatabase& db)
+    : clear_(db)
+    , insert_(db)
+{
+    clear_.prepare(
+        "DELETE FROM message_addresses WHERE message_id=(SELECT id FROM messages WHERE folder_id=:fid AND uid=:uid)");
+    insert_.prepare("INSERT INTO message_addresses(message_id, role, position, name, email) "
+                    "SELECT id, :role, :pos, :name, :email FROM messages WHERE folder_id=:fid AND uid=:uid");
+}
+
+bool AddressWriter::Write(qint64 folderId, qint64 uid, const QVector<MessageAddress>& addresses, QString& outError)
+{
+    clear_.bindValue(":fid", folderId);
+    clear_.bindValue(":uid", uid);
+    if (!clear_.exec()) {
+        outError = clear_.lastError().text();
+        return false;
+    }
+    for (qsizetype i = 0; i < addresses.size(); ++i) {
+        const MessageAddress& address = addresses[i];
+        insert_.bindValue(":role", static_cast<int>(address.role));
+        insert_.bindValue(":pos", static_cast<int>(i));
+        insert_.bindValue(":name", address.name);
+        // Lower-cased so "mail from x" is an exact index lookup.
+        insert_.bindValue(":email", address.email.toLower());
+        insert_.bindValue(":fid", folderId);
+        insert_.bindValue(":uid", uid);
+        if (!insert_.exec()) {
+            outError = insert_.lastError().text();
+            return false;
+        }
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <QSqlQuery>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class QSqlDatabase;
+
+namespace ngks::core::mail::sync {
+
+// A FLAGS list split the way it is stored: \Seen and \Flagged as columns on messages, which
+// the list views filter and count on, and every other flag or keyword as a message_flags row.
+// messages.flags keeps the list as the server sent it.
+struct MessageFlags {
+    bool seen = false;
+    bool flagged = false;
+    QStringList others;
+
+    static MessageFlags Parse(const QString& flags);
+};
+
+enum class AddressRole {
+    From = 0,
+    To = 1,
+    Cc = 2
+};
+
+struct MessageAddress {
+    AddressRole role = AddressRole::From;
+    QString name;
+    QString email;
+};
+
+// INTERNALDATE ("17-Jul-1996 02:44:25 -0700") as UTC seconds since the epoch; 0 if malformed.
+qint64 ParseInternalDateUtc(const QString& value);
+
+// Thread key of a message: a stable hash of its thread's root Message-ID, the first entry of
+// References, else In-Reply-To, else its own. Replies carry the root, so a thread groups
+// without its messages having to arrive in order. A message with none of the three is its own
+// thread, keyed negative by folder and UID.
+qint64 ThreadId(const QString& messageId,
+                const QString& inReplyTo,
+                const QString& references,
+                qint64 folderId,
+                qint64 uid);
+
+// Replaces a message's message_flags rows with flags.others.
+class FlagWriter {
+public:
+    explicit FlagWriter(QSqlDatabase& db);
+
+    bool Write(qint64 folderId, qint64 uid, const MessageFlags& flags, QString& outError);
+
+private:
+    QSqlQuery clear_;
+    QSqlQuery insert_;
+};
+
+// Replaces a message's message_addresses rows.
+class AddressWriter {
+public:
+    explicit AddressWriter(QSqlDatabase& db);
+
+    bool Write(qint64 folderId, qint64 uid, const QVector<MessageAddress>& addresses, QString& outError);
+
+private:
+    QSqlQuery clear_;
+    QSqlQuery insert_;
+};
+
+}
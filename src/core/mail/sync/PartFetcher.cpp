@@ -0,0 +1,518 @@
+#include "core/mail/sync/PartFetcher.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QStringDecoder>
+#include <QStringList>
+#include <QVariant>
+
+#include "core/mail/mime/HeaderDecoding.h"
+#include "core/mail/mime/TransferDecoding.h"
+#include "core/mail/providers/imap/ImapClient.h"
+#include "core/mail/providers/imap/ImapConnectionPool.h"
+#include "core/mail/providers/imap/ImapLiteralSink.h"
+#include "core/mail/providers/imap/ImapResponseParsers.h"
+#include "core/mail/sync/AccountSyncState.h"
+#include "core/storage/BlobStore.h"
+#include "core/storage/Db.h"
+#include "core/storage/Reindexer.h"
+#include "core/storage/Query.h"
+
+namespace ngks::core::mail::sync {
+
+using namespace ngks::core::mail::providers::imap;
+using ngks::core::mail::types::MimePart;
+using ngks::core::storage::BlobStore;
+using ngks::core::storage::Columns;
+using ngks::core::storage::Params;
+using ngks::core::storage::Query;
+
+namespace {
+
+bool IsTaggedOk(const QStringList& lines, const QString& tag)
+{
+    return !lines.isEmpty() && lines.last().startsWith(tag + " OK", Qt::CaseInsensitive);
+}
+
+std::string ToStd(const ImapNString& value)
+{
+    return value.isNil ? std::string() : value.Bytes().toStdString();
+}
+
+std::string Lower(const ImapNString& value)
+{
+    return value.isNil ? std::string() : value.Bytes().toLower().toStdString();
+}
+
+// Writes a literal to a file, decoding its transfer encoding on the way; "binary" (or any
+// identity encoding) is copied as is.
+class DecodingFileSink : public ImapLiteralSink {
+public:
+    DecodingFileSink(const QString& path, QByteArrayView encoding)
+        : file_(path)
+        , decoder_(encoding)
+    {
+    }
+
+    bool Begin(qint64 size) override
+    {
+        error_.clear();
+        begun_ = true;
+        expected_ = size;
+        received_ = 0;
+        if (!file_.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            error_ = QString("open failed: %1").arg(file_.errorString());
+            return false;
+        }
+        return true;
+    }
+
+    bool Write(QByteArrayView chunk) override
+    {
+        received_ += chunk.size();
+        buffer_.clear();
+        decoder_.Feed(chunk, buffer_);
+        return Flush();
+    }
+
+    bool Finish() override
+    {
+        buffer_.clear();
+        decoder_.Finish(buffer_);
+        const bool ok = Flush();
+        file_.close();
+        // Counted before decoding: the announced size is that of the encoded octets.
+        if (ok && error_.isEmpty() && received_ != expected_) {
+            error_ = QString("literal truncated: %1 of %2 bytes").arg(received_).arg(expected_);
+        }
+        finished_ = ok && error_.isEmpty();
+        return finished_;
+    }
+
+    void Abort() override
+    {
+        file_.close();
+        file_.remove();
+    }
+
+    bool Begun() const { return begun_; }
+    bool Finished() const { return finished_; }
+
+private:
+    bool Flush()
+    {
+        if (!buffer_.isEmpty() && file_.write(buffer_) != buffer_.size()) {
+            error_ = QString("write failed: %1").arg(file_.errorString());
+            return false;
+        }
+        return true;
+    }
+
+    QFile file_;
+    ngks::core::mail::mime::TransferDecoder decoder_;
+    QByteArray buffer_;
+    qint64 expected_ = 0;
+    qint64 received_ = 0;
+    bool begun_ = false;
+    bool finished_ = false;
+};
+
+const MimePart* FirstInline(const std::vector<MimePart>& parts, const char* type)
+{
+    for (const MimePart& part : parts) {
+        if (!part.attachment && part.contentType == type) {
+            return &part;
+        }
+    }
+    return nullptr;
+}
+
+QString DecodeCharset(QByteArrayView bytes, const std::string& charset)
+{
+    if (!charset.empty()) {
+        QStringDecoder decoder(charset.c_str());
+        if (decoder.isValid()) {
+            return decoder.decode(bytes);
+        }
+    }
+    return QString::fromUtf8(bytes);
+}
+
+}
+
+std::vector<MimePart> ToMimeParts(const QVector<ImapBodyPart>& parts)
+{
+    std::vector<MimePart> out;
+    out.reserve(parts.size());
+    for (const ImapBodyPart& part : parts) {
+        MimePart mime;
+        mime.partId = part.section.toStdString();
+        mime.contentType = Lower(part.type) + '/' + Lower(part.subtype);
+        mime.charset = Lower(part.charset);
+        mime.transferEncoding = Lower(part.encoding);
+        const ImapNString& name = part.filename.isNil ? part.name : part.filename;
+        if (!name.isNil) {
+            mime.filename = ngks::core::mail::mime::DecodeHeaderText(name.Bytes()).toStdString();
+        }
+        mime.contentId = ToStd(part.id);
+        mime.size = part.size;
+        // Named parts count as attachments unless the sender marked them inline.
+        const std::string disposition = Lower(part.disposition);
+        mime.attachment = disposition == "attachment" || (!mime.filename.empty() && disposition != "inline");
+        out.push_back(std::move(mime));
+    }
+    return out;
+}
+
+PartWriter::PartWriter(QSqlDatabase& db)
+    : insert_(db)
+{
+    insert_.prepare(
+        "INSERT INTO message_parts(message_id, part_id, content_type, charset, transfer_encoding, filename, "
+        "content_id, size, is_attachment) "
+        "SELECT id, :part, :type, :charset, :encoding, :filename, :cid, :size, :attachment "
+        "FROM messages WHERE folder_id=:fid AND uid=:uid "
+        "ON CONFLICT(message_id, part_id) DO NOTHING");
+}
+
+bool PartWriter::Write(qint64 folderId, qint64 uid, const std::vector<MimePart>& parts, QString& outError)
+{
+    for (const MimePart& part : parts) {
+        insert_.bindValue(":part", QString::fromStdString(part.partId));
+        insert_.bindValue(":type", QString::fromStdString(part.contentType));
+        insert_.bindValue(":charset", QString::fromStdString(part.charset));
+        insert_.bindValue(":encoding", QString::fromStdString(part.transferEncoding));
+        insert_.bindValue(":filename", QString::fromStdString(part.filename));
+        insert_.bindValue(":cid", QString::fromStdString(part.contentId));
+        insert_.bindValue(":size", qint64(part.size));
+        insert_.bindValue(":attachment", part.attachment ? 1 : 0);
+        insert_.bindValue(":fid", folderId);
+        insert_.bindValue(":uid", uid);
+        if (!insert_.exec()) {
+            outError = insert_.lastError().text();
+            return false;
+        }
+    }
+    return true;
+}
+
+PartFetcher::PartFetcher(ngks::core::storage::Db& db, PartFetchOptions options)
+    : db_(db)
+    , options_(options)
+{
+}
+
+const MimePart* PartFetcher::DisplayPart(const std::vector<MimePart>& parts)
+{
+    const MimePart* text = FirstInline(parts, "text/plain");
+    return text != nullptr ? text : FirstInline(parts, "text/html");
+}
+
+QString PartFetcher::StagingPath(qint64 folderId, qint64 uid, const QString& partId)
+{
+    return BlobStore::Instance().StagingPath(QString("%1-%2-%3.partial").arg(folderId).arg(uid).arg(partId));
+}
+
+bool PartFetcher::LoadParts(ImapSession& session,
+                            qint64 folderId,
+                            qint64 uid,
+                            std::vector<MimePart>& outParts,
+                            QString& outError)
+{
+    outParts.clear();
+    outError.clear();
+    if (!db_.IsOpen()) {
+        outError = "DB is not open";
+        return false;
+    }
+    if (!StoredParts(folderId, uid, outParts, outError)) {
+        return false;
+    }
+    if (!outParts.empty()) {
+        return true;
+    }
+
+    if (!SelectFolder(session, folderId, outError)) {
+        return false;
+    }
+    ImapClient& client = session.Client();
+    QVector<ImapBodyPart> structure;
+    bool parsed = false;
+    const QString tag = client.SubmitStreaming(QString("UID FETCH %1 (UID BODYSTRUCTURE)").arg(uid),
+                                               {"FETCH"},
+                                               [&structure, &parsed, uid](QByteArrayView response) {
+                                                   ImapFetchEntry entry;
+                                                   if (ParseFetchResponse(response, entry) && entry.uid == uid
+                                                       && !entry.bodyStructure.isEmpty()) {
+                                                       parsed = ParseBodyStructure(entry.bodyStructure, structure);
+                                                   }
+                                               });
+    const QStringList lines = client.Await(tag, options_.timeoutMs);
+    if (!IsTaggedOk(lines, tag)) {
+        outError = lines.isEmpty() ? client.LastError() : lines.last();
+        return false;
+    }
+    if (!parsed) {
+        outError = QString("No BODYSTRUCTURE for UID %1").arg(uid);
+        return false;
+    }
+    PartWriter writer(db_.Handle());
+    if (!writer.Write(folderId, uid, ToMimeParts(structure), outError)) {
+        return false;
+    }
+    return StoredParts(folderId, uid, outParts, outError);
+}
+
+bool PartFetcher::FetchDisplayText(ImapSession& session,
+                                   qint64 folderId,
+                                   qint64 uid,
+                                   MimePart& outPart,
+                                   QString& outText,
+                                   QString& outError)
+{
+    outPart = MimePart();
+    outText.clear();
+    std::vector<MimePart> parts;
+    if (!LoadParts(session, folderId, uid, parts, outError)) {
+        return false;
+    }
+    const MimePart* text = DisplayPart(parts);
+    if (text == nullptr) {
+        return true;
+    }
+    outPart = *text;
+    QString hash;
+    if (!FetchPart(session, folderId, uid, QString::fromStdString(text->partId), hash, outError)) {
+        return false;
+    }
+    ngks::core::storage::BlobView content;
+    if (!BlobStore::Instance().Read(db_, hash, content, outError)) {
+        return false;
+    }
+    outPart.blobHash = hash.toStdString();
+    outPart.localPath.clear();
+    outText = DecodeCharset(content.Data(), text->charset);
+    return true;
+}
+
+bool PartFetcher::FetchPart(ImapSession& session,
+                            qint64 folderId,
+                            qint64 uid,
+                            const QString& partId,
+                            QString& outHash,
+                            QString& outError)
+{
+    outHash.clear();
+    outError.clear();
+    std::vector<MimePart> parts;
+    if (!LoadParts(session, folderId, uid, parts, outError)) {
+        return false;
+    }
+    const MimePart* part = nullptr;
+    for (const MimePart& candidate : parts) {
+        if (candidate.partId == partId.toStdString()) {
+            part = &candidate;
+            break;
+        }
+    }
+    if (part == nullptr) {
+        outError = QString("UID %1 has no part %2").arg(uid).arg(partId);
+        return false;
+    }
+    BlobStore& blobs = BlobStore::Instance();
+    if (!part->blobHash.empty() && blobs.Contains(db_, QString::fromStdString(part->blobHash))) {
+        outHash = QString::fromStdString(part->blobHash);
+        return true;
+    }
+
+    QSqlDatabase& sqlDb = db_.Handle();
+    QString hash;
+    const QString legacyPath = QString::fromStdString(part->localPath);
+    if (!legacyPath.isEmpty() && QFileInfo::exists(legacyPath)) {
+        // Fetched before the blob store existed.
+        if (!blobs.PutFile(db_, legacyPath, hash, outError)) {
+            return false;
+        }
+    }
+
+    if (hash.isEmpty()) {
+        if (!SelectFolder(session, folderId, outError)) {
+            return false;
+        }
+        // Recorded before the first byte is requested, so a download cut short by a crash is
+        // picked up again by ResumePending.
+        auto add = [&](AccountSyncState& state) { state.AddPendingPart(folderId, uid, partId); };
+        if (!AccountSyncState::Modify(sqlDb, folderId, add, nullptr, outError)) {
+            return false;
+        }
+        // Some servers refuse BINARY for an encoding they cannot undo ([UNKNOWN-CTE]); decode
+        // locally then.
+        const QString path = StagingPath(folderId, uid, partId);
+        const bool binary = session.HasCapability("BINARY");
+        if (!Download(session, uid, *part, binary, path, outError)
+            && (!binary || !session.Client().IsConnected() || !Download(session, uid, *part, false, path, outError))) {
+            return false;
+        }
+        if (!blobs.PutFile(db_, path, hash, outError)) {
+            QFile::remove(path);
+            return false;
+        }
+    }
+
+    auto remove = [&](AccountSyncState& state) { state.RemovePendingPart(folderId, uid, partId); };
+    auto record = [&](QString& error) {
+        Query<Columns<>, Params<QString, QString, qint64, qint64>> update(
+            db_,
+            "UPDATE message_parts SET blob_hash=?, local_path='' WHERE part_id=? AND message_id="
+            "(SELECT id FROM messages WHERE folder_id=? AND uid=?)");
+        if (!update.Exec(hash, partId, folderId, uid)) {
+            error = update.Error();
+            return false;
+        }
+        // Body text is indexed once it is stored.
+        if (!part->attachment && QString::fromStdString(part->contentType).startsWith("text/")) {
+            return ngks::core::storage::ReindexQueue(sqlDb).Add(folderId, uid, error);
+        }
+        return true;
+    };
+    if (!AccountSyncState::Modify(sqlDb, folderId, remove, record, outError)) {
+        return false;
+    }
+    outHash = hash;
+    return true;
+}
+
+bool PartFetcher::ResumePending(ImapSession& session, qint64 folderId, int& outFetched, QString& outError)
+{
+    outFetched = 0;
+    outError.clear();
+    AccountSyncState state;
+    if (!AccountSyncState::Load(db_.Handle(), folderId, state, outError)) {
+        return false;
+    }
+    for (const PendingPart& pending : state.pendingParts) {
+        if (pending.folderId != folderId) {
+            continue;
+        }
+        QString hash;
+        QString error;
+        if (FetchPart(session, folderId, pending.uid, pending.partId, hash, error)) {
+            ++outFetched;
+            continue;
+        }
+        if (!session.Client().IsConnected()) {
+            outError = error;
+            return false;
+        }
+        // Expunged since, or refused by the server: retrying on every sync would not help.
+        auto drop = [&pending](AccountSyncState& next) {
+            next.RemovePendingPart(pending.folderId, pending.uid, pending.partId);
+        };
+        if (!AccountSyncState::Modify(db_.Handle(), folderId, drop, nullptr, outError)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool PartFetcher::StoredParts(qint64 folderId, qint64 uid, std::vector<MimePart>& outParts, QString& outError)
+{
+    outParts.clear();
+    // Runs for every message opened or prefetched: a cached statement with typed columns.
+    Query<Columns<QString, QString, QString, QString, QString, QString, qint64, bool, QString, QString>,
+          Params<qint64, qint64>>
+        query(db_,
+              "SELECT p.part_id, p.content_type, p.charset, p.transfer_encoding, p.filename, p.content_id, p.size, "
+              "p.is_attachment, p.local_path, p.blob_hash FROM message_parts p JOIN messages m ON m.id=p.message_id "
+              "WHERE m.folder_id=? AND m.uid=? ORDER BY p.id");
+    if (!query.Exec(folderId, uid)) {
+        outError = query.Error();
+        return false;
+    }
+    while (auto row = query.Next()) {
+        const auto& [partId, contentType, charset, encoding, filename, contentId, size, attachment, localPath, blobHash] =
+            *row;
+        MimePart part;
+        part.partId = partId.toStdString();
+        part.contentType = contentType.toStdString();
+        part.charset = charset.toStdString();
+        part.transferEncoding = encoding.toStdString();
+        part.filename = filename.toStdString();
+        part.contentId = contentId.toStdString();
+        part.size = size;
+        part.attachment = attachment;
+        part.localPath = localPath.toStdString();
+        part.blobHash = blobHash.toStdString();
+        outParts.push_back(std::move(part));
+    }
+    return true;
+}
+
+bool PartFetcher::SelectFolder(ImapSession& session, qint64 folderId, QString& outError)
+{
+    QSqlQuery query(db_.Handle());
+    query.prepare("SELECT remote_name FROM folders WHERE id=:fid");
+    query.bindValue(":fid", folderId);
+    if (!query.exec()) {
+        outError = query.lastError().text();
+        return false;
+    }
+    if (!query.next()) {
+        outError = QString("unknown folder %1").arg(folderId);
+        return false;
+    }
+    // Fetching with .PEEK needs no write access; keep a current selection as is.
+    const QString remoteName = query.value(0).toString();
+    return session.SelectedMailbox() == remoteName || session.Select(remoteName, true, outError);
+}
+
+bool PartFetcher::Download(ImapSession& session,
+                           qint64 uid,
+                           const MimePart& part,
+                           bool binary,
+                           const QString& path,
+                           QString& outError)
+{
+    // A staging file: only complete downloads reach the BlobStore.
+    DecodingFileSink sink(path, binary ? QByteArrayView("binary") : QByteArrayView(part.transferEncoding));
+    const QString section = QString::fromStdString(part.partId);
+    const QString item = binary ? QString("BINARY.PEEK[%1]").arg(section) : QString("BODY.PEEK[%1]").arg(section);
+
+    ImapClient& client = session.Client();
+    bool found = false;
+    bool inlineOk = true;
+    const QString tag = client.SubmitSpooled(
+        QString("UID FETCH %1 (UID %2)").arg(uid).arg(item),
+        {"FETCH"},
+        [&sink](QByteArrayView, qint64) -> ImapLiteralSink* { return sink.Begun() ? nullptr : &sink; },
+        [&](QByteArrayView response) {
+            ImapFetchEntry entry;
+            if (!ParseFetchResponse(response, entry) || entry.uid != uid) {
+                return;
+            }
+            for (const ImapFetchSection& fetched : entry.sections) {
+                found = true;
+                if (fetched.spooled || sink.Begun()) {
+                    continue;
+                }
+                // Empty parts and short quoted strings come inline.
+                inlineOk = sink.Begin(fetched.size) && sink.Write(fetched.data) && sink.Finish();
+            }
+        });
+    const QStringList lines = client.Await(tag, options_.timeoutMs);
+    if (!IsTaggedOk(lines, tag)) {
+        outError = lines.isEmpty() ? client.LastError() : lines.last();
+        QFile::remove(path);
+        return false;
+    }
+    if (!found || !inlineOk || !sink.Finished()) {
+        outError = !sink.Error().isEmpty() ? sink.Error() : QString("No %1 for UID %2").arg(item).arg(uid);
+        QFile::remove(path);
+        return false;
+    }
+    return true;
+}
+
+}
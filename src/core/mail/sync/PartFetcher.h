@@ -0,0 +1,113 @@
+#pragma once
+
+#include <QSqlQuery>
+#include <QString>
+#include <QVector>
+#include <vector>
+
+#include "core/mail/types/Mime.h"
+
+class QSqlDatabase;
+
+namespace ngks::core::storage {
+class Db;
+}
+
+namespace ngks::core::mail::providers::imap {
+class ImapSession;
+struct ImapBodyPart;
+}
+
+namespace ngks::core::mail::sync {
+
+struct PartFetchOptions {
+    int timeoutMs = 5 * 60 * 1000;
+};
+
+// BODYSTRUCTURE leaves as MimeParts; filenames are RFC 2047-decoded.
+std::vector<ngks::core::mail::types::MimePart> ToMimeParts(
+    const QVector<ngks::core::mail::providers::imap::ImapBodyPart>& parts);
+
+// Records a message's parts in message_parts. Rows that already exist are kept as they are,
+// together with any content fetched for them.
+class PartWriter {
+public:
+    explicit PartWriter(QSqlDatabase& db);
+
+    bool Write(qint64 folderId,
+               qint64 uid,
+               const std::vector<ngks::core::mail::types::MimePart>& parts,
+               QString& outError);
+
+private:
+    QSqlQuery insert_;
+};
+
+// Loads message content one MIME part at a time instead of whole messages. The structure
+// normally arrives with the headers (HeaderSync); opening a message fetches just its display
+// text, and an attachment is fetched when it is opened or saved. Parts are requested with
+// BINARY.PEEK (RFC 3516) when the server has BINARY, so it sends decoded octets; otherwise
+// BODY.PEEK is decoded from base64/quoted-printable while it streams. Either way the content
+// streams to a staging file without being held in memory and is then handed to the BlobStore,
+// which keeps one copy per distinct content.
+class PartFetcher {
+public:
+    explicit PartFetcher(ngks::core::storage::Db& db, PartFetchOptions options = {});
+
+    // The message's parts; fetches BODYSTRUCTURE if HeaderSync has not stored them.
+    bool LoadParts(ngks::core::mail::providers::imap::ImapSession& session,
+                   qint64 folderId,
+                   qint64 uid,
+                   std::vector<ngks::core::mail::types::MimePart>& outParts,
+                   QString& outError);
+
+    // Text for the reading pane: the first text/plain part, else text/html, decoded from its
+    // charset. Leaves outPart.partId empty if the message has neither.
+    bool FetchDisplayText(ngks::core::mail::providers::imap::ImapSession& session,
+                          qint64 folderId,
+                          qint64 uid,
+                          ngks::core::mail::types::MimePart& outPart,
+                          QString& outText,
+                          QString& outError);
+
+    // Makes one part's decoded content available in the BlobStore and returns its hash; a part
+    // fetched before is not fetched again.
+    bool FetchPart(ngks::core::mail::providers::imap::ImapSession& session,
+                   qint64 folderId,
+                   qint64 uid,
+                   const QString& partId,
+                   QString& outHash,
+                   QString& outError);
+
+    // Finishes the folder's part downloads that an earlier run started but did not complete
+    // (see AccountSyncState); outFetched counts those that landed.
+    bool ResumePending(ngks::core::mail::providers::imap::ImapSession& session,
+                       qint64 folderId,
+                       int& outFetched,
+                       QString& outError);
+
+    // Parts as stored, without going to the server; empty if the structure is not known yet.
+    bool StoredParts(qint64 folderId,
+                     qint64 uid,
+                     std::vector<ngks::core::mail::types::MimePart>& outParts,
+                     QString& outError);
+
+    // The part FetchDisplayText shows, or nullptr.
+    static const ngks::core::mail::types::MimePart* DisplayPart(
+        const std::vector<ngks::core::mail::types::MimePart>& parts);
+
+private:
+    static QString StagingPath(qint64 folderId, qint64 uid, const QString& partId);
+    bool SelectFolder(ngks::core::mail::providers::imap::ImapSession& session, qint64 folderId, QString& outError);
+    bool Download(ngks::core::mail::providers::imap::ImapSession& session,
+                  qint64 uid,
+                  const ngks::core::mail::types::MimePart& part,
+                  bool binary,
+                  const QString& path,
+                  QString& outError);
+
+    ngks::core::storage::Db& db_;
+    PartFetchOptions options_;
+};
+
+}
@@ -0,0 +1,285 @@
+#include "core/mail/sync/Prefetcher.h"
+
+#include <QFileInfo>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QStringList>
+#include <QVariant>
+
+#include "core/mail/providers/imap/ImapClient.h"
+#include "core/mail/providers/imap/ImapConnectionPool.h"
+#include "core/mail/sync/PartFetcher.h"
+#include "core/storage/Db.h"
+
+namespace ngks::core::mail::sync {
+
+using namespace ngks::core::mail::providers::imap;
+using ngks::core::mail::types::MimePart;
+
+namespace {
+
+QString MessageKey(qint64 folderId, qint64 uid)
+{
+    return QString("%1:%2").arg(folderId).arg(uid);
+}
+
+bool IsFetched(const MimePart* part)
+{
+    return part != nullptr
+        && (!part->blobHash.empty()
+            || (!part->localPath.empty() && QFileInfo::exists(QString::fromStdString(part->localPath))));
+}
+
+}
+
+Prefetcher::Prefetcher(ngks::core::storage::Db& db, JobQueue& jobs, PrefetchOptions options)
+    : db_(db)
+    , dbPath_(db.IsOpen() ? db.Handle().databaseName().toStdString() : std::string())
+    , jobs_(jobs)
+    , options_(options)
+    , available_(options.budgetBytes)
+{
+    refillClock_.start();
+}
+
+void Prefetcher::SetAccountResolver(SyncEngine::AccountResolver resolver)
+{
+    resolver_ = std::move(resolver);
+}
+
+void Prefetcher::OnListChanged(const QString& accountEmail,
+                               const QString& host,
+                               const QString& remoteName,
+                               qint64 folderId,
+                               const QVector<qint64>& uids,
+                               int selected,
+                               int firstVisible,
+                               int lastVisible)
+{
+    if (!db_.IsOpen()) {
+        return;
+    }
+
+    QVector<qint64> candidates;
+    QSet<qint64> seen;
+    auto add = [&](qint64 uid) {
+        if (!seen.contains(uid)) {
+            seen.insert(uid);
+            candidates.push_back(uid);
+        }
+    };
+    if (selected >= 0) {
+        // The selected message itself is being opened right now, interactively.
+        seen.insert(uids.value(selected, -1));
+        for (int i = selected + 1; i < uids.size() && i <= selected + options_.lookAhead; ++i) {
+            add(uids[i]);
+        }
+    }
+    firstVisible = qMax(0, firstVisible);
+    lastVisible = qMin(lastVisible, static_cast<int>(uids.size()) - 1);
+    if (options_.visibleUnread && firstVisible <= lastVisible) {
+        QStringList set;
+        for (int i = firstVisible; i <= lastVisible; ++i) {
+            set.push_back(QString::number(uids[i]));
+        }
+        QSet<qint64> unread;
+        QSqlQuery query(db_.Handle());
+        query.setForwardOnly(true);
+        query.prepare(QString("SELECT uid FROM messages WHERE folder_id=:fid AND uid IN (%1) AND seen=0")
+                          .arg(set.join(',')));
+        query.bindValue(":fid", folderId);
+        if (query.exec()) {
+            while (query.next()) {
+                unread.insert(query.value(0).toLongLong());
+            }
+        }
+        for (int i = firstVisible; i <= lastVisible; ++i) {
+            if (unread.contains(uids[i])) {
+                add(uids[i]);
+            }
+        }
+    }
+
+    SyncJob job;
+    job.type = JobType::BodyFetch;
+    job.priority = JobPriority::Background;
+    job.accountEmail = accountEmail;
+    job.host = host;
+    job.mailbox = remoteName;
+    for (const qint64 uid : candidates) {
+        if (!IsCached(folderId, uid)) {
+            job.uids.push_back(uid);
+        }
+    }
+
+    // What the previous list state wanted is no longer next in line.
+    quint64 previous = 0;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        previous = pendingJob_;
+        pendingJob_ = 0;
+    }
+    if (previous != 0) {
+        jobs_.Cancel(previous);
+    }
+    if (job.uids.isEmpty()) {
+        return;
+    }
+    const qint64 count = job.uids.size();
+    const quint64 id = jobs_.Enqueue(std::move(job));
+    std::lock_guard<std::mutex> lk(mu_);
+    pendingJob_ = id;
+    stats_.queued += count;
+}
+
+void Prefetcher::OnOpened(qint64 folderId, qint64 uid)
+{
+    const bool cached = db_.IsOpen() && IsCached(folderId, uid);
+    std::lock_guard<std::mutex> lk(mu_);
+    stats_.opened += 1;
+    if (cached) {
+        stats_.hits += 1;
+    } else {
+        stats_.misses += 1;
+    }
+    if (prefetched_.remove(MessageKey(folderId, uid))) {
+        stats_.used += 1;
+    }
+}
+
+JobResult Prefetcher::Run(const SyncJob& job, JobContext& context)
+{
+    ResolveRequest account;
+    if (!resolver_ || !resolver_(job.accountEmail, account)) {
+        return JobResult::Failed;
+    }
+    if (dbPath_.empty()) {
+        return JobResult::Failed;
+    }
+    ngks::core::storage::Db& workerDb = ngks::core::storage::Db::ForThread(dbPath_);
+    if (!workerDb.IsOpen()) {
+        return JobResult::Failed;
+    }
+    qint64 folderId = -1;
+    {
+        QSqlQuery folder(workerDb.Handle());
+        folder.prepare("SELECT f.id FROM folders f JOIN accounts a ON a.id=f.account_id "
+                       "WHERE a.email=:email AND f.remote_name=:remote LIMIT 1");
+        folder.bindValue(":email", job.accountEmail);
+        folder.bindValue(":remote", job.mailbox);
+        if (!folder.exec() || !folder.next()) {
+            return JobResult::Failed;
+        }
+        folderId = folder.value(0).toLongLong();
+    }
+
+    PartFetcher fetcher(workerDb);
+    ImapSessionLease session;
+    QString error;
+    for (qsizetype i = 0; i < job.uids.size(); ++i) {
+        if (context.IsCancelled()) {
+            return JobResult::Done;
+        }
+        // Messages done so far are cached, so a yielded job skips them when it runs again.
+        if (context.ShouldYield()) {
+            return JobResult::Yielded;
+        }
+        const qint64 uid = job.uids[i];
+
+        std::vector<MimePart> parts;
+        if (!fetcher.StoredParts(folderId, uid, parts, error)) {
+            return JobResult::Failed;
+        }
+        if (parts.empty()) {
+            if (!session) {
+                session = ImapConnectionPool::Instance().Acquire(account, error);
+                if (!session) {
+                    return JobResult::Failed;
+                }
+            }
+            if (!fetcher.LoadParts(*session, folderId, uid, parts, error)) {
+                if (!session->Client().IsConnected()) {
+                    session.Discard();
+                    return JobResult::Failed;
+                }
+                continue;
+            }
+        }
+        const MimePart* text = PartFetcher::DisplayPart(parts);
+        if (text == nullptr || IsFetched(text)) {
+            continue;
+        }
+        if (text->size > options_.maxPartBytes) {
+            std::lock_guard<std::mutex> lk(mu_);
+            stats_.skippedLarge += 1;
+            continue;
+        }
+        if (!Spend(text->size)) {
+            std::lock_guard<std::mutex> lk(mu_);
+            stats_.skippedBudget += job.uids.size() - i;
+            return JobResult::Done;
+        }
+
+        if (!session) {
+            session = ImapConnectionPool::Instance().Acquire(account, error);
+            if (!session) {
+                Refund(text->size);
+                return JobResult::Failed;
+            }
+        }
+        QString hash;
+        if (!fetcher.FetchPart(*session, folderId, uid, QString::fromStdString(text->partId), hash, error)) {
+            Refund(text->size);
+            if (!session->Client().IsConnected()) {
+                session.Discard();
+                return JobResult::Failed;
+            }
+            continue;
+        }
+        std::lock_guard<std::mutex> lk(mu_);
+        stats_.fetched += 1;
+        stats_.bytes += text->size;
+        prefetched_.insert(MessageKey(folderId, uid));
+    }
+    return JobResult::Done;
+}
+
+PrefetchStats Prefetcher::Stats() const
+{
+    std::lock_guard<std::mutex> lk(mu_);
+    return stats_;
+}
+
+bool Prefetcher::IsCached(qint64 folderId, qint64 uid)
+{
+    std::vector<MimePart> parts;
+    QString error;
+    PartFetcher fetcher(db_);
+    return fetcher.StoredParts(folderId, uid, parts, error) && IsFetched(PartFetcher::DisplayPart(parts));
+}
+
+bool Prefetcher::Spend(qint64 bytes)
+{
+    std::lock_guard<std::mutex> lk(mu_);
+    const qint64 elapsedMs = refillClock_.elapsed();
+    if (elapsedMs > 0) {
+        refillClock_.restart();
+        const qint64 refill = options_.budgetWindowMs <= 0
+            ? options_.budgetBytes
+            : elapsedMs * options_.budgetBytes / options_.budgetWindowMs;
+        available_ = qMin(options_.budgetBytes, available_ + refill);
+    }
+    if (bytes > available_) {
+        return false;
+    }
+    available_ -= bytes;
+    return true;
+}
+
+void Prefetcher::Refund(qint64 bytes)
+{
+    std::lock_guard<std::mutex> lk(mu_);
+    available_ = qMin(options_.budgetBytes, available_ + bytes);
+}
+
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QSet>
+#include <QString>
+#include <QVector>
+#include <mutex>
+#include <string>
+
+#include "core/mail/sync/JobQueue.h"
+#include "core/mail/sync/SyncEngine.h"
+
+namespace ngks::core::storage {
+class Db;
+}
+
+namespace ngks::core::mail::sync {
+
+struct PrefetchOptions {
+    // Messages below the selection whose text is fetched ahead.
+    int lookAhead = 5;
+    // Also fetch unread messages that are on screen.
+    bool visibleUnread = true;
+    // Byte budget, refilled evenly over budgetWindowMs.
+    qint64 budgetBytes = 8 * 1024 * 1024;
+    int budgetWindowMs = 60 * 1000;
+    // Text parts larger than this wait until the message is opened.
+    qint64 maxPartBytes = 512 * 1024;
+};
+
+struct PrefetchStats {
+    qint64 opened = 0;
+    // Opened with the display text already on disk.
+    qint64 hits = 0;
+    qint64 misses = 0;
+    qint64 queued = 0;
+    qint64 fetched = 0;
+    qint64 bytes = 0;
+    // Prefetched messages that were later opened.
+    qint64 used = 0;
+    qint64 skippedLarge = 0;
+    qint64 skippedBudget = 0;
+
+    double HitRate() const { return opened == 0 ? 0.0 : double(hits) / double(opened); }
+};
+
+// Fetches the display text of messages the user is likely to open next, so opening one rarely
+// waits on the network. The message list reports its selection and visible rows; the next
+// lookAhead messages after the selection, then the unread messages on screen, that are not
+// cached yet go into one Background BodyFetch job. A newer list state replaces the pending
+// job. The job yields to interactive work between messages and stops when the byte budget is
+// spent. Opens are counted as hits or misses against the cache.
+class Prefetcher {
+public:
+    Prefetcher(ngks::core::storage::Db& db, JobQueue& jobs, PrefetchOptions options = {});
+
+    void SetAccountResolver(SyncEngine::AccountResolver resolver);
+
+    // uids are in display order; selected and the visible rows are indexes into it (-1 for
+    // no selection). Runs on the thread that owns db.
+    void OnListChanged(const QString& accountEmail,
+                       const QString& host,
+                       const QString& remoteName,
+                       qint64 folderId,
+                       const QVector<qint64>& uids,
+                       int selected,
+                       int firstVisible,
+                       int lastVisible);
+
+    // Call when a message is shown, before its text is fetched. Runs on the thread that owns db.
+    void OnOpened(qint64 folderId, qint64 uid);
+
+    // Handler for JobType::BodyFetch; runs on a JobQueue worker with its own database connection.
+    JobResult Run(const SyncJob& job, JobContext& context);
+
+    PrefetchStats Stats() const;
+
+private:
+    bool IsCached(qint64 folderId, qint64 uid);
+    // Takes bytes from the budget if it has them.
+    bool Spend(qint64 bytes);
+    void Refund(qint64 bytes);
+
+    ngks::core::storage::Db& db_;
+    std::string dbPath_;
+    JobQueue& jobs_;
+    PrefetchOptions options_;
+    SyncEngine::AccountResolver resolver_;
+
+    mutable std::mutex mu_;
+    quint64 pendingJob_ = 0;
+    qint64 available_ = 0;
+    QElapsedTimer refillClock_;
+    QSet<QString> prefetched_;
+    PrefetchStats stats_;
+};
+
+}
@@ -1,6 +1,643 @@
 #include "core/mail/sync/SyncEngine.h"
 
+#include <QHash>
+#include <QSet>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QStringList>
+#include <QVariant>
+#include <QVector>
+#include <algorithm>
+#include <limits>
+
+#include "core/mail/providers/imap/ImapClient.h"
+#include "core/mail/providers/imap/ImapConnectionPool.h"
+#include "core/mail/providers/imap/ImapResponseParsers.h"
+#include "core/mail/sync/JobQueue.h"
+#include "core/mail/sync/MessageRows.h"
+#include "core/mail/sync/PartFetcher.h"
+#include "core/storage/Db.h"
+#include "core/storage/Reindexer.h"
+
 namespace ngks::core::mail::sync {
-void SyncEngine::Tick() {
+
+using namespace ngks::core::mail::providers::imap;
+
+namespace {
+
+constexpr int kFetchTimeoutMs = 10 * 60 * 1000;
+// Messages per full-scan window; each window is committed with its checkpoint.
+constexpr qsizetype kScanWindowMessages = 25000;
+
+struct MessageUpdate {
+    qint64 uid = -1;
+    qint64 modSeq = 0;
+    QString flags;
+};
+
+bool IsTaggedOk(const QStringList& lines, const QString& tag)
+{
+    return !lines.isEmpty() && lines.last().startsWith(tag + " OK", Qt::CaseInsensitive);
+}
+
+constexpr const char* kUpsertFlagsSql =
+    "INSERT INTO messages(folder_id, uid, modseq, flags, seen, flagged) "
+    "VALUES(:fid, :uid, :modseq, :flags, :seen, :flagged) "
+    "ON CONFLICT(folder_id, uid) DO UPDATE SET modseq=excluded.modseq, flags=excluded.flags, "
+    "seen=excluded.seen, flagged=excluded.flagged";
+
+// One message's flags, on the messages row (upsert prepared with kUpsertFlagsSql) and in
+// message_flags.
+bool WriteFlags(QSqlQuery& upsert, FlagWriter& flagRows, qint64 folderId, const MessageUpdate& update, QString& outError)
+{
+    const MessageFlags flags = MessageFlags::Parse(update.flags);
+    upsert.bindValue(":fid", folderId);
+    upsert.bindValue(":uid", update.uid);
+    upsert.bindValue(":modseq", update.modSeq);
+    upsert.bindValue(":flags", update.flags);
+    upsert.bindValue(":seen", flags.seen ? 1 : 0);
+    upsert.bindValue(":flagged", flags.flagged ? 1 : 0);
+    if (!upsert.exec()) {
+        outError = upsert.lastError().text();
+        return false;
+    }
+    return flagRows.Write(folderId, update.uid, flags, outError);
+}
+
+bool ToUpdate(QByteArrayView response, MessageUpdate& out)
+{
+    ImapFetchEntry entry;
+    if (!ParseFetchResponse(response, entry) || entry.uid < 0 || !entry.hasFlags) {
+        return false;
+    }
+    out.uid = entry.uid;
+    out.modSeq = entry.modSeq < 0 ? 0 : entry.modSeq;
+    out.flags.clear();
+    for (const QByteArrayView flag : entry.flags) {
+        if (!out.flags.isEmpty()) {
+            out.flags += ' ';
+        }
+        out.flags += QString::fromUtf8(flag);
+    }
+    return true;
+}
+
+bool LoadFolder(QSqlDatabase& db, const QString& accountEmail, const QString& remoteName,
+                qint64& outFolderId, FolderSyncState& outState, QString& outError)
+{
+    QSqlQuery query(db);
+    query.prepare("SELECT f.id, f.sync_state FROM folders f JOIN accounts a ON a.id=f.account_id "
+                  "WHERE a.email=:email AND f.remote_name=:remote LIMIT 1");
+    query.bindValue(":email", accountEmail);
+    query.bindValue(":remote", remoteName);
+    if (!query.exec()) {
+        outError = query.lastError().text();
+        return false;
+    }
+    if (!query.next()) {
+        outError = QString("unknown folder %1 for %2").arg(remoteName, accountEmail);
+        return false;
+    }
+    outFolderId = query.value(0).toLongLong();
+    outState = FolderSyncState::FromJson(query.value(1).toString());
+    return true;
+}
+
+// UIDs of the folder's local messages in [lo, hi]; hi < 0 means no upper bound.
+QSet<qint64> LocalUids(QSqlDatabase& db, qint64 folderId, qint64 lo = 0, qint64 hi = -1)
+{
+    QSet<qint64> uids;
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    query.prepare("SELECT uid FROM messages WHERE folder_id=:fid AND uid BETWEEN :lo AND :hi");
+    query.bindValue(":fid", folderId);
+    query.bindValue(":lo", lo);
+    query.bindValue(":hi", hi < 0 ? std::numeric_limits<qint64>::max() : hi);
+    if (query.exec()) {
+        while (query.next()) {
+            uids.insert(query.value(0).toLongLong());
+        }
+    }
+    return uids;
+}
+
+qint64 LocalCount(QSqlDatabase& db, qint64 folderId)
+{
+    QSqlQuery query(db);
+    query.prepare("SELECT COUNT(*) FROM messages WHERE folder_id=:fid");
+    query.bindValue(":fid", folderId);
+    if (!query.exec() || !query.next()) {
+        return -1;
+    }
+    return query.value(0).toLongLong();
+}
+
+// Deletes local messages in [lo, hi] whose UID is not in present. Returns the number removed,
+// -1 on error. Call inside a transaction.
+// The mailbox's UIDs up to hi (all of them if hi < 0), ascending. With ESEARCH the server
+// sends them as a compact set ("RETURN (ALL)") instead of one number per message.
+bool ListUids(ImapClient& client, bool esearch, qint64 hi, QVector<qint64>& out, QString& outError)
+{
+    out.clear();
+    const QString criteria = hi >= 0 ? QString("UID 1:%1").arg(hi) : QStringLiteral("ALL");
+    QString tag;
+    bool parsed = true;
+    if (esearch) {
+        tag = client.SubmitStreaming(QString("UID SEARCH RETURN (ALL) %1").arg(criteria),
+                                     {"ESEARCH"},
+                                     [&out, &parsed](QByteArrayView response) {
+                                         ImapEsearchEntry entry;
+                                         QVector<ImapSequenceRange> ranges;
+                                         if (!ParseEsearchResponse(response, entry)) {
+                                             parsed = false;
+                                             return;
+                                         }
+                                         if (entry.all.isEmpty()) {
+                                             return;
+                                         }
+                                         if (!ParseSequenceSet(entry.all, 0, ranges)) {
+                                             parsed = false;
+                                             return;
+                                         }
+                                         for (const ImapSequenceRange& range : ranges) {
+                                             for (qint64 uid = range.first; uid <= range.last; ++uid) {
+                                                 out.push_back(uid);
+                                             }
+                                         }
+                                     });
+    } else {
+        tag = client.SubmitStreaming(QString("UID SEARCH %1").arg(criteria),
+                                     {"SEARCH"},
+                                     [&out, &parsed](QByteArrayView response) {
+                                         parsed = ParseSearchResponse(response, out) && parsed;
+                                     });
+    }
+    if (!IsTaggedOk(client.Await(tag, kFetchTimeoutMs), tag)) {
+        outError = "UID SEARCH failed";
+        return false;
+    }
+    if (!parsed) {
+        outError = "Malformed UID SEARCH response";
+        return false;
+    }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+    return true;
+}
+
+int RemoveMissing(QSqlDatabase& db, qint64 folderId, const QSet<qint64>& present, qint64 lo = 0, qint64 hi = -1)
+{
+    QSqlQuery remove(db);
+    remove.prepare("DELETE FROM messages WHERE folder_id=:fid AND uid=:uid");
+    ngks::core::storage::ReindexQueue reindex(db);
+    QString error;
+    int removed = 0;
+    for (const qint64 uid : LocalUids(db, folderId, lo, hi)) {
+        if (present.contains(uid)) {
+            continue;
+        }
+        if (!reindex.Remove(folderId, uid, uid, error)) {
+            return -1;
+        }
+        remove.bindValue(":fid", folderId);
+        remove.bindValue(":uid", uid);
+        if (!remove.exec()) {
+            return -1;
+        }
+        ++removed;
+    }
+    return removed;
+}
+
+}
+
+SyncEngine::SyncEngine(ngks::core::storage::Db& db, JobQueue& jobs)
+    : db_(db)
+    , jobs_(jobs)
+    , headers_(db)
+{
+}
+
+void SyncEngine::SetAccountResolver(AccountResolver resolver)
+{
+    resolver_ = std::move(resolver);
+}
+
+void SyncEngine::SetHeaderProgressCallback(HeaderSync::ProgressCallback callback)
+{
+    headers_.SetProgressCallback(std::move(callback));
+}
+
+void SyncEngine::Tick()
+{
+    // Jobs only say where something changed; the sync itself finds out what, so several jobs
+    // for one mailbox collapse into one sync. Other job types are left for their handlers.
+    QStringList order;
+    QHash<QString, SyncJob> byMailbox;
+    SyncJob job;
+    while (jobs_.TryDequeue(JobType::FolderSync, job)) {
+        const QString key = job.accountEmail + '\n' + job.mailbox;
+        if (!byMailbox.contains(key)) {
+            order.push_back(key);
+            byMailbox.insert(key, job);
+        }
+    }
+
+    for (const QString& key : order) {
+        const SyncJob& next = byMailbox[key];
+        ResolveRequest account;
+        if (!resolver_ || !resolver_(next.accountEmail, account)) {
+            lastError_ = QString("no credentials for %1").arg(next.accountEmail);
+            continue;
+        }
+        FolderSyncStats stats;
+        QString error;
+        if (!SyncFolder(account, next.mailbox, stats, error)) {
+            lastError_ = error;
+        }
+    }
 }
+
+bool SyncEngine::SyncFolder(const ResolveRequest& account,
+                            const QString& remoteName,
+                            FolderSyncStats& outStats,
+                            QString& outError)
+{
+    ImapSessionLease session = ImapConnectionPool::Instance().Acquire(account, outError);
+    if (!session) {
+        return false;
+    }
+    return SyncFolder(*session, account.email, remoteName, outStats, outError);
+}
+
+bool SyncEngine::SyncFolder(ImapSession& session,
+                            const QString& accountEmail,
+                            const QString& remoteName,
+                            FolderSyncStats& outStats,
+                            QString& outError)
+{
+    outStats = FolderSyncStats();
+    outError.clear();
+    if (!db_.IsOpen()) {
+        outError = "DB is not open";
+        return false;
+    }
+    QSqlDatabase& sqlDb = db_.Handle();
+
+    qint64 folderId = -1;
+    FolderSyncState stored;
+    if (!LoadFolder(sqlDb, accountEmail, remoteName, folderId, stored, outError)) {
+        return false;
+    }
+
+    // --- SELECT, with as much of the resync folded into it as the server allows ---
+    QString ignored;
+    const bool qresync = session.HasCapability("QRESYNC") && session.EnableQresync(ignored);
+    const bool condstore = qresync || session.HasCapability("CONDSTORE");
+
+    QString selectParameters;
+    if (qresync && stored.IsKnown() && !stored.IsScanning() && stored.highestModSeq > 0) {
+        selectParameters = QString("(QRESYNC (%1 %2))").arg(stored.uidValidity).arg(stored.highestModSeq);
+    } else if (condstore) {
+        selectParameters = QStringLiteral("(CONDSTORE)");
+    } else {
+        // Fresh EXISTS/UIDNEXT are needed even if the session has the mailbox selected.
+        session.ForgetSelection();
+    }
+    if (!session.Select(remoteName, true, outError, selectParameters)) {
+        return false;
+    }
+    ++outStats.roundTrips;
+
+    ImapMailboxState current;
+    QVector<MessageUpdate> updates;
+    QVector<ImapSequenceRange> vanished;
+    for (const QString& line : session.SelectResponses()) {
+        const QByteArray raw = line.toUtf8();
+        if (ParseSelectResponse(raw, current)) {
+            continue;
+        }
+        MessageUpdate update;
+        if (ToUpdate(raw, update)) {
+            updates.push_back(update);
+            continue;
+        }
+        bool earlier = false;
+        QByteArrayView set;
+        if (ParseVanishedResponse(raw, earlier, set)) {
+            ParseSequenceSet(set, 0, vanished);
+        }
+    }
+    if (current.uidValidity <= 0) {
+        outError = "SELECT did not report UIDVALIDITY";
+        return false;
+    }
+
+    const bool useModSeq = condstore && !current.noModSeq && current.highestModSeq > 0;
+    const bool validityChanged = stored.IsKnown() && stored.uidValidity != current.uidValidity;
+    const bool resuming = stored.IsScanning() && !validityChanged;
+    const bool incremental = stored.IsKnown() && !validityChanged && !resuming && useModSeq && stored.highestModSeq > 0;
+    outStats.fullSync = !stored.IsKnown() || validityChanged || resuming;
+
+    // --- Full scan; what a QRESYNC SELECT reported only applies to an incremental sync ---
+    if (!incremental) {
+        if (!ScanFolder(session, folderId, stored, current, useModSeq, validityChanged, outStats, outError)) {
+            return false;
+        }
+        if (resuming && useModSeq && stored.highestModSeq > 0) {
+            // The windows above the checkpoint were listed before the interruption; what changed
+            // there since, and what arrived, comes in through an incremental pass.
+            FolderSyncStats catchUp;
+            session.ForgetSelection();
+            if (!SyncFolder(session, accountEmail, remoteName, catchUp, outError)) {
+                return false;
+            }
+            outStats.roundTrips += catchUp.roundTrips;
+            outStats.newMessages += catchUp.newMessages;
+            outStats.flagUpdates += catchUp.flagUpdates;
+            outStats.removed += catchUp.removed;
+            outStats.headersFetched += catchUp.headersFetched;
+            outStats.partsResumed += catchUp.partsResumed;
+            return true;
+        }
+        return FetchHeaders(session, folderId, outStats, outError);
+    }
+
+    if (current.highestModSeq == stored.highestModSeq && current.uidNext == stored.uidNext) {
+        outStats.unchanged = true;
+        // Picks up a header download an earlier run did not finish; nothing is sent otherwise.
+        return FetchHeaders(session, folderId, outStats, outError);
+    }
+
+    // --- One pipelined flight for whatever the SELECT did not cover ---
+    ImapClient& client = session.Client();
+    auto collect = [&updates](QByteArrayView response) {
+        MessageUpdate update;
+        if (ToUpdate(response, update)) {
+            updates.push_back(std::move(update));
+        }
+    };
+    const QString fetchItems = useModSeq ? QStringLiteral("(UID FLAGS MODSEQ)") : QStringLiteral("(UID FLAGS)");
+    QString fetchCommand;
+    if (qresync) {
+        if (current.uidNext > stored.uidNext) {
+            fetchCommand = QString("UID FETCH %1:* %2").arg(stored.uidNext).arg(fetchItems);
+        }
+    } else {
+        fetchCommand = QString("UID FETCH 1:* %1 (CHANGEDSINCE %2)").arg(fetchItems).arg(stored.highestModSeq);
+    }
+    if (!fetchCommand.isEmpty()) {
+        const QString tag = client.SubmitStreaming(fetchCommand, {"FETCH"}, collect);
+        if (!IsTaggedOk(client.Await(tag, kFetchTimeoutMs), tag)) {
+            outError = "UID FETCH failed";
+            return false;
+        }
+        ++outStats.roundTrips;
+    }
+
+    // --- Apply ---
+    if (!sqlDb.transaction()) {
+        outError = "Failed to start transaction";
+        return false;
+    }
+    auto fail = [&sqlDb, &outError](const QSqlQuery& query) {
+        outError = query.lastError().text();
+        sqlDb.rollback();
+        return false;
+    };
+
+    QSqlQuery removeRange(sqlDb);
+    removeRange.prepare("DELETE FROM messages WHERE folder_id=:fid AND uid BETWEEN :lo AND :hi");
+    ngks::core::storage::ReindexQueue reindex(sqlDb);
+    for (const ImapSequenceRange& range : vanished) {
+        if (!reindex.Remove(folderId, range.first, range.last, outError)) {
+            sqlDb.rollback();
+            return false;
+        }
+        removeRange.bindValue(":fid", folderId);
+        removeRange.bindValue(":lo", range.first);
+        removeRange.bindValue(":hi", range.last);
+        if (!removeRange.exec()) {
+            return fail(removeRange);
+        }
+        outStats.removed += removeRange.numRowsAffected();
+    }
+
+    QSqlQuery upsert(sqlDb);
+    upsert.prepare(kUpsertFlagsSql);
+    FlagWriter flagRows(sqlDb);
+    qint64 maxUid = 0;
+    for (const MessageUpdate& update : updates) {
+        if (!WriteFlags(upsert, flagRows, folderId, update, outError)) {
+            sqlDb.rollback();
+            return false;
+        }
+        maxUid = qMax(maxUid, update.uid);
+        if (update.uid >= stored.uidNext) {
+            ++outStats.newMessages;
+        } else {
+            ++outStats.flagUpdates;
+        }
+    }
+
+    FolderSyncState next;
+    next.uidValidity = current.uidValidity;
+    next.uidNext = current.uidNext > 0 ? current.uidNext : qMax(maxUid + 1, stored.uidNext);
+    next.highestModSeq = useModSeq ? current.highestModSeq : -1;
+    next.exists = current.exists;
+
+    QSqlQuery saveState(sqlDb);
+    saveState.prepare("UPDATE folders SET sync_state=:state WHERE id=:fid");
+    saveState.bindValue(":state", next.ToJson());
+    saveState.bindValue(":fid", folderId);
+    if (!saveState.exec()) {
+        return fail(saveState);
+    }
+    if (!sqlDb.commit()) {
+        outError = "Failed to commit sync transaction";
+        return false;
+    }
+
+    // CONDSTORE without QRESYNC has no expunge reporting; only search when the count is off.
+    if (!qresync && current.exists >= 0 && LocalCount(sqlDb, folderId) != current.exists) {
+        QSet<qint64> present;
+        const QString tag = client.SubmitStreaming("UID SEARCH ALL", {"SEARCH"}, [&present](QByteArrayView response) {
+            const QList<QByteArray> words = response.toByteArray().trimmed().split(' ');
+            for (int i = 2; i < words.size(); ++i) {
+                bool ok = false;
+                const qint64 uid = words[i].toLongLong(&ok);
+                if (ok) {
+                    present.insert(uid);
+                }
+            }
+        });
+        if (!IsTaggedOk(client.Await(tag, kFetchTimeoutMs), tag)) {
+            outError = "UID SEARCH failed";
+            return false;
+        }
+        ++outStats.roundTrips;
+        if (!sqlDb.transaction()) {
+            outError = "Failed to start transaction";
+            return false;
+        }
+        const int removed = RemoveMissing(sqlDb, folderId, present);
+        if (removed < 0 || !sqlDb.commit()) {
+            sqlDb.rollback();
+            outError = "Failed to remove expunged messages";
+            return false;
+        }
+        outStats.removed += removed;
+    }
+
+    return FetchHeaders(session, folderId, outStats, outError);
+}
+
+bool SyncEngine::ScanFolder(ImapSession& session,
+                            qint64 folderId,
+                            const FolderSyncState& stored,
+                            const ImapMailboxState& current,
+                            bool useModSeq,
+                            bool validityChanged,
+                            FolderSyncStats& outStats,
+                            QString& outError)
+{
+    QSqlDatabase& sqlDb = db_.Handle();
+    ImapClient& client = session.Client();
+    const bool resuming = stored.IsScanning() && !validityChanged;
+
+    // What the finished scan records. A resumed scan keeps the values it started with, so the
+    // next incremental pass covers everything that changed after the first window.
+    FolderSyncState base;
+    if (resuming) {
+        base = stored;
+    } else {
+        base.uidValidity = current.uidValidity;
+        base.uidNext = current.uidNext;
+        base.highestModSeq = useModSeq ? current.highestModSeq : -1;
+        base.exists = current.exists;
+    }
+    const QString fetchItems = useModSeq ? QStringLiteral("(UID FLAGS MODSEQ)") : QStringLiteral("(UID FLAGS)");
+
+    // Newest first, so the top of the list fills in first. The first window is open-ended
+    // ("lo:*") to include anything that arrived since the SELECT. Windows are cut from the
+    // UIDs the server lists, so each holds up to kScanWindowMessages messages however sparse
+    // the UIDs are.
+    qint64 hi = resuming ? stored.scanFloor - 1 : -1;
+    QVector<qint64> uids;
+    if (current.exists != 0) {
+        if (!ListUids(client, session.HasCapability("ESEARCH"), hi, uids, outError)) {
+            return false;
+        }
+        ++outStats.roundTrips;
+    }
+    qsizetype end = uids.size();
+    bool clear = validityChanged;
+    for (;;) {
+        const qsizetype first = qMax<qsizetype>(0, end - kScanWindowMessages);
+        const qint64 lo = first > 0 ? uids[first] : 1;
+
+        QVector<MessageUpdate> updates;
+        // An empty mailbox has nothing to FETCH, and some servers reject "1:*" on one.
+        if (current.exists != 0) {
+            const QString range = hi >= 0 ? QString("%1:%2").arg(lo).arg(hi) : QString("%1:*").arg(lo);
+            const QString tag = client.SubmitStreaming(QString("UID FETCH %1 %2").arg(range, fetchItems),
+                                                       {"FETCH"},
+                                                       [&updates](QByteArrayView response) {
+                                                           MessageUpdate update;
+                                                           if (ToUpdate(response, update)) {
+                                                               updates.push_back(std::move(update));
+                                                           }
+                                                       });
+            if (!IsTaggedOk(client.Await(tag, kFetchTimeoutMs), tag)) {
+                outError = "UID FETCH failed";
+                return false;
+            }
+            ++outStats.roundTrips;
+        }
+
+        // --- Apply the window together with its checkpoint ---
+        if (!sqlDb.transaction()) {
+            outError = "Failed to start transaction";
+            return false;
+        }
+        auto fail = [&sqlDb, &outError](const QSqlQuery& query) {
+            outError = query.lastError().text();
+            sqlDb.rollback();
+            return false;
+        };
+        if (clear) {
+            ngks::core::storage::ReindexQueue reindex(sqlDb);
+            if (!reindex.RemoveFolder(folderId, outError)) {
+                sqlDb.rollback();
+                return false;
+            }
+            QSqlQuery wipe(sqlDb);
+            wipe.prepare("DELETE FROM messages WHERE folder_id=:fid");
+            wipe.bindValue(":fid", folderId);
+            if (!wipe.exec()) {
+                return fail(wipe);
+            }
+        }
+        QSqlQuery upsert(sqlDb);
+        upsert.prepare(kUpsertFlagsSql);
+        FlagWriter flagRows(sqlDb);
+        QSet<qint64> seen;
+        for (const MessageUpdate& update : updates) {
+            if (!WriteFlags(upsert, flagRows, folderId, update, outError)) {
+                sqlDb.rollback();
+                return false;
+            }
+            seen.insert(update.uid);
+        }
+        // The scan is authoritative for its window: whatever it did not return is gone.
+        const int removed = RemoveMissing(sqlDb, folderId, seen, lo, hi);
+        if (removed < 0) {
+            sqlDb.rollback();
+            outError = "Failed to remove expunged messages";
+            return false;
+        }
+
+        FolderSyncState checkpoint = base;
+        checkpoint.scanFloor = lo > 1 ? lo : -1;
+        QSqlQuery saveState(sqlDb);
+        saveState.prepare("UPDATE folders SET sync_state=:state WHERE id=:fid");
+        saveState.bindValue(":state", checkpoint.ToJson());
+        saveState.bindValue(":fid", folderId);
+        if (!saveState.exec()) {
+            return fail(saveState);
+        }
+        if (!sqlDb.commit()) {
+            outError = "Failed to commit sync window";
+            return false;
+        }
+        outStats.removed += removed;
+        outStats.newMessages += updates.size();
+        clear = false;
+
+        if (lo <= 1) {
+            return true;
+        }
+        hi = lo - 1;
+        end = first;
+    }
+}
+
+bool SyncEngine::FetchHeaders(ImapSession& session, qint64 folderId, FolderSyncStats& outStats, QString& outError)
+{
+    HeaderSyncStats headerStats;
+    const bool ok = headers_.Run(session, folderId, headerStats, outError);
+    outStats.headersFetched = headerStats.messages;
+    if (!ok) {
+        return false;
+    }
+    PartFetcher parts(db_);
+    return parts.ResumePending(session, folderId, outStats.partsResumed, outError);
+}
+
+QString SyncEngine::LastError() const
+{
+    return lastError_;
+}
+
 }
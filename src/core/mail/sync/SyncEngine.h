@@ -1,8 +1,101 @@
 #pragma once
 
+#include <QString>
+#include <functional>
+
+#include "core/mail/providers/imap/ImapProvider.h"
+#include "core/mail/sync/FolderSyncState.h"
+#include "core/mail/sync/HeaderSync.h"
+
+namespace ngks::core::storage {
+class Db;
+}
+
+namespace ngks::core::mail::providers::imap {
+class ImapSession;
+struct ImapMailboxState;
+}
+
 namespace ngks::core::mail::sync {
+
+class JobQueue;
+
+struct FolderSyncStats {
+    // No usable state, or UIDVALIDITY changed: everything was fetched again.
+    bool fullSync = false;
+    // HIGHESTMODSEQ and UIDNEXT matched the stored state; only the SELECT was sent.
+    bool unchanged = false;
+    int roundTrips = 0;
+    int newMessages = 0;
+    int flagUpdates = 0;
+    int removed = 0;
+    int headersFetched = 0;
+    // Part downloads left unfinished by an earlier run, completed now.
+    int partsResumed = 0;
+};
+
+// Incremental mailbox sync into the messages table, using the best the server offers:
+// - QRESYNC (RFC 7162): SELECT ... (QRESYNC (uidvalidity modseq)) itself reports changed flags
+//   and VANISHED UIDs; new UIDs come from UID FETCH <uidnext>:*.
+// - CONDSTORE: UID FETCH 1:* (UID FLAGS) (CHANGEDSINCE modseq); expunges are looked for with
+//   UID SEARCH only when the message count does not add up.
+// - Neither: a full UID/FLAGS scan.
+// An unchanged folder costs one round trip. Per-folder UIDVALIDITY, UIDNEXT and HIGHESTMODSEQ
+// are kept in folders.sync_state; a UIDVALIDITY change drops the folder's messages and starts
+// over. Full scans run in windows of existing UIDs, each committed with a checkpoint, so an
+// interrupted scan resumes where it stopped. Messages without headers yet are then filled in by
+// the HeaderSync stage. Uses the database from the calling thread.
 class SyncEngine {
 public:
+    using AccountResolver =
+        std::function<bool(const QString& accountEmail, ngks::core::mail::providers::imap::ResolveRequest& out)>;
+
+    SyncEngine(ngks::core::storage::Db& db, JobQueue& jobs);
+
+    // Supplies connection details and credentials for the accounts named in queued jobs.
+    void SetAccountResolver(AccountResolver resolver);
+
+    // Forwarded to the header stage, e.g. to refresh the message list as windows land.
+    void SetHeaderProgressCallback(HeaderSync::ProgressCallback callback);
+
+    // Runs the queued jobs, one sync per distinct mailbox.
     void Tick();
+
+    bool SyncFolder(const ngks::core::mail::providers::imap::ResolveRequest& account,
+                    const QString& remoteName,
+                    FolderSyncStats& outStats,
+                    QString& outError);
+    // Same, on a session the caller already holds.
+    bool SyncFolder(ngks::core::mail::providers::imap::ImapSession& session,
+                    const QString& accountEmail,
+                    const QString& remoteName,
+                    FolderSyncStats& outStats,
+                    QString& outError);
+
+    QString LastError() const;
+
+private:
+    // Lists the folder's UIDs with UID SEARCH (ESEARCH if offered), then fetches their flags in
+    // windows of a fixed number of messages, newest first, committing each window with a
+    // checkpoint; continues below stored.scanFloor if an earlier scan was interrupted.
+    bool ScanFolder(ngks::core::mail::providers::imap::ImapSession& session,
+                    qint64 folderId,
+                    const FolderSyncState& stored,
+                    const ngks::core::mail::providers::imap::ImapMailboxState& current,
+                    bool useModSeq,
+                    bool validityChanged,
+                    FolderSyncStats& outStats,
+                    QString& outError);
+    bool FetchHeaders(ngks::core::mail::providers::imap::ImapSession& session,
+                      qint64 folderId,
+                      FolderSyncStats& outStats,
+                      QString& outError);
+
+    ngks::core::storage::Db& db_;
+    JobQueue& jobs_;
+    AccountResolver resolver_;
+    HeaderSync headers_;
+    QString lastError_;
 };
+
 }
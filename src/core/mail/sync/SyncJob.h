@@ -0,0 +1,57 @@
+#pragma once
+
+#include <QString>
+#include <QVector>
+
+namespace ngks::core::mail::sync {
+
+enum class JobType {
+    FolderSync,
+    BodyFetch,
+    FlagPush,
+    IndexUpdate
+};
+
+// Lower runs first. Interactive is for work a user is waiting on ("open this message").
+enum class JobPriority {
+    Interactive = 0,
+    Normal = 1,
+    Background = 2
+};
+
+// What changed, for FolderSync jobs.
+enum class SyncJobKind {
+    // New messages; fetch the sequence range, or every UID from uidFrom on.
+    NewMessages,
+    // Messages removed; sequences are the EXPUNGE numbers in arrival order, each relative to
+    // the mailbox state after the previous one.
+    Expunged,
+    // Flag changes reported by FETCH; sequences and, when the server included them, uids.
+    FlagsChanged,
+    // Changes could not be pinned down (reconnect, count mismatch): resync the whole folder.
+    FolderResync
+};
+
+// A unit of sync work for one mailbox. For FolderSync, sequence numbers are valid for the
+// mailbox as of when the job was queued, after every earlier job for the same mailbox.
+// BodyFetch and FlagPush name their messages in uids; FlagPush carries the STORE argument in
+// payload (e.g. "+FLAGS (\Seen)").
+struct SyncJob {
+    JobType type = JobType::FolderSync;
+    JobPriority priority = JobPriority::Normal;
+    SyncJobKind kind = SyncJobKind::FolderResync;
+    QString accountEmail;
+    // Server (host:port) for per-host limits; empty when unknown.
+    QString host;
+    QString mailbox;
+    qint64 firstSequence = -1;
+    qint64 lastSequence = -1;
+    qint64 uidFrom = -1;
+    QVector<qint64> sequences;
+    QVector<qint64> uids;
+    QString payload;
+    // Assigned by JobQueue::Enqueue.
+    quint64 id = 0;
+};
+
+}
@@ -1,10 +1,24 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 
 namespace ngks::core::mail::types {
+// One leaf of a message's MIME tree as described by BODYSTRUCTURE. Content is fetched per
+// part on demand and kept in the BlobStore; body stays empty until a caller loads it.
 struct MimePart {
+    std::string partId;  // IMAP section, e.g. "1.2"
     std::string contentType;
+    std::string charset;
+    std::string transferEncoding;
+    std::string filename;
+    std::string contentId;
+    std::int64_t size = 0;  // encoded octets on the server
+    bool attachment = false;
+    // Decoded content's BlobStore hash once fetched; empty before.
+    std::string blobHash;
+    // Where content fetched before the BlobStore was kept, until it is moved in.
+    std::string localPath;
     std::string body;
 };
 }
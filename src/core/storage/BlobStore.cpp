@@ -0,0 +1,413 @@
+#include "core/storage/BlobStore.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QVariant>
+#include <vector>
+
+#include "core/storage/Db.h"
+#include "core/storage/Query.h"
+#include "platform/common/Paths.h"
+
+namespace ngks::core::storage {
+
+namespace {
+
+QString HashHex(QCryptographicHash& hash)
+{
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+qint64 NowSecs()
+{
+    return QDateTime::currentSecsSinceEpoch();
+}
+
+bool WriteAll(QFile& file, QByteArrayView data)
+{
+    return file.write(data.data(), data.size()) == data.size();
+}
+
+}
+
+struct BlobView::Mapping {
+    QFile file;
+    uchar* data = nullptr;
+    qint64 size = 0;
+
+    ~Mapping()
+    {
+        if (data != nullptr) {
+            file.unmap(data);
+        }
+    }
+};
+
+QByteArrayView BlobView::Data() const
+{
+    if (!mapping_ || mapping_->data == nullptr) {
+        return QByteArrayView();
+    }
+    return QByteArrayView(reinterpret_cast<const char*>(mapping_->data), mapping_->size);
+}
+
+bool BlobView::IsNull() const
+{
+    return null_;
+}
+
+BlobStore::BlobStore(std::filesystem::path root, BlobStoreOptions options)
+    : root_(std::move(root))
+    , options_(options)
+{
+}
+
+BlobStore& BlobStore::Instance()
+{
+    static BlobStore store(ngks::platform::common::ArtifactsDir() / "blobs");
+    return store;
+}
+
+QString BlobStore::SegmentPath(qint64 segment) const
+{
+    return QString::fromStdString((root_ / "segments").string())
+        + QString("/%1.seg").arg(segment, 6, 10, QChar('0'));
+}
+
+QString BlobStore::LoosePath(const QString& hash) const
+{
+    return QString::fromStdString((root_ / "loose").string()) + '/' + hash.left(2) + '/' + hash;
+}
+
+QString BlobStore::StagingPath(const QString& name) const
+{
+    const QString dir = QString::fromStdString((root_ / "staging").string());
+    QDir().mkpath(dir);
+    return dir + '/' + name;
+}
+
+bool BlobStore::Put(Db& db, QByteArrayView data, QString& outHash, QString& outError)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(QByteArray::fromRawData(data.data(), data.size()));
+    outHash = HashHex(hash);
+    std::lock_guard<std::mutex> lk(mu_);
+    if (TouchLocked(db, outHash)) {
+        return true;
+    }
+    return StoreLocked(db, outHash, data, QString(), data.size(), outError);
+}
+
+bool BlobStore::PutFile(Db& db, const QString& path, QString& outHash, QString& outError)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        outError = QString("Failed to read %1: %2").arg(path, file.errorString());
+        return false;
+    }
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    if (!hash.addData(&file)) {
+        outError = QString("Failed to read %1").arg(path);
+        return false;
+    }
+    outHash = HashHex(hash);
+    const qint64 size = file.size();
+
+    std::lock_guard<std::mutex> lk(mu_);
+    bool ok = true;
+    if (!TouchLocked(db, outHash)) {
+        if (size >= options_.packThreshold) {
+            file.close();
+            ok = StoreLocked(db, outHash, QByteArrayView(), path, size, outError);
+        } else {
+            file.seek(0);
+            const QByteArray data = file.readAll();
+            file.close();
+            ok = StoreLocked(db, outHash, data, QString(), size, outError);
+        }
+    }
+    file.close();
+    if (ok) {
+        QFile::remove(path);
+    }
+    return ok;
+}
+
+bool BlobStore::StoreLocked(Db& db,
+                            const QString& hash,
+                            QByteArrayView data,
+                            const QString& file,
+                            qint64 size,
+                            QString& outError)
+{
+    if (file.isEmpty() && size < options_.packThreshold) {
+        qint64 segment = 0;
+        qint64 offset = 0;
+        return AppendLocked(data, segment, offset, outError)
+            && InsertLocked(db, hash, size, segment, offset, outError);
+    }
+    // Large: a file of its own, complete before its row exists.
+    const QString path = LoosePath(hash);
+    if (!QDir().mkpath(QFileInfo(path).absolutePath())) {
+        outError = QString("Failed to create %1").arg(QFileInfo(path).absolutePath());
+        return false;
+    }
+    QFile::remove(path);
+    if (!file.isEmpty()) {
+        if (!QFile::rename(file, path)) {
+            outError = QString("Failed to move %1 into the blob store").arg(file);
+            return false;
+        }
+    } else {
+        QFile out(path + QStringLiteral(".partial"));
+        if (!out.open(QIODevice::WriteOnly) || !WriteAll(out, data) || !out.flush()) {
+            outError = QString("Failed to write %1: %2").arg(out.fileName(), out.errorString());
+            out.remove();
+            return false;
+        }
+        out.close();
+        if (!QFile::rename(out.fileName(), path)) {
+            outError = QString("Failed to move %1 into place").arg(out.fileName());
+            return false;
+        }
+    }
+    return InsertLocked(db, hash, size, 0, 0, outError);
+}
+
+void BlobStore::ResumeSegmentLocked()
+{
+    if (activeSegment_ != 0) {
+        return;
+    }
+    // Numbering continues from the files on disk, which also covers a segment whose first blob
+    // never got its row.
+    const QString dir = QString::fromStdString((root_ / "segments").string());
+    QDir().mkpath(dir);
+    const QStringList existing = QDir(dir).entryList({"*.seg"}, QDir::Files, QDir::Name);
+    activeSegment_ = existing.isEmpty() ? 1 : qMax<qint64>(1, existing.last().section('.', 0, 0).toLongLong());
+}
+
+bool BlobStore::AppendLocked(QByteArrayView data, qint64& outSegment, qint64& outOffset, QString& outError)
+{
+    ResumeSegmentLocked();
+    QFile segment(SegmentPath(activeSegment_));
+    if (segment.exists() && segment.size() > 0 && segment.size() + data.size() > options_.segmentBytes) {
+        ++activeSegment_;
+        segment.setFileName(SegmentPath(activeSegment_));
+    }
+    if (!segment.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        outError = QString("Failed to open %1: %2").arg(segment.fileName(), segment.errorString());
+        return false;
+    }
+    // Bytes written without a row (a crash before InsertLocked) are dead space that
+    // compaction reclaims.
+    outOffset = segment.size();
+    if (!WriteAll(segment, data) || !segment.flush()) {
+        outError = QString("Failed to write %1: %2").arg(segment.fileName(), segment.errorString());
+        segment.resize(outOffset);
+        return false;
+    }
+    outSegment = activeSegment_;
+    return true;
+}
+
+bool BlobStore::InsertLocked(Db& db, const QString& hash, qint64 size, qint64 segment, qint64 offset, QString& outError)
+{
+    Query<Columns<>, Params<QString, qint64, qint64, qint64, qint64>> insert(
+        db,
+        "INSERT INTO blobs(hash, size, segment, offset, refs, created_at) VALUES(?, ?, ?, ?, 0, ?) "
+        "ON CONFLICT(hash) DO NOTHING");
+    if (!insert.Exec(hash, size, segment, offset, NowSecs())) {
+        outError = insert.Error();
+        return false;
+    }
+    return true;
+}
+
+bool BlobStore::TouchLocked(Db& db, const QString& hash)
+{
+    // The caller is about to reference it: restart the grace period so Collect cannot take an
+    // unreferenced blob in between.
+    Query<Columns<>, Params<qint64, QString>> touch(db, "UPDATE blobs SET created_at=? WHERE hash=?");
+    return touch.Exec(NowSecs(), hash) && touch.RowsAffected() > 0;
+}
+
+bool BlobStore::Contains(Db& db, const QString& hash)
+{
+    Query<Columns<int>, Params<QString>> query(db, "SELECT 1 FROM blobs WHERE hash=?");
+    return query.Exec(hash) && query.First().has_value();
+}
+
+bool BlobStore::Locate(Db& db, const QString& hash, qint64& outSegment, qint64& outOffset, qint64& outSize, QString& outError)
+{
+    Query<Columns<qint64, qint64, qint64>, Params<QString>> query(db, "SELECT segment, offset, size FROM blobs WHERE hash=?");
+    const auto row = query.Exec(hash) ? query.First() : std::nullopt;
+    if (!row) {
+        outError = query.Error().isEmpty() ? QString("no blob %1").arg(hash) : query.Error();
+        return false;
+    }
+    std::tie(outSegment, outOffset, outSize) = *row;
+    return true;
+}
+
+bool BlobStore::Read(Db& db, const QString& hash, BlobView& outView, QString& outError)
+{
+    outView = BlobView();
+    // Compaction can move a packed blob between the lookup and the open; look again once.
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        qint64 segment = 0;
+        qint64 offset = 0;
+        qint64 size = 0;
+        if (!Locate(db, hash, segment, offset, size, outError)) {
+            return false;
+        }
+        auto mapping = std::make_shared<BlobView::Mapping>();
+        mapping->file.setFileName(segment == 0 ? LoosePath(hash) : SegmentPath(segment));
+        if (!mapping->file.open(QIODevice::ReadOnly)) {
+            outError = QString("Failed to open %1: %2").arg(mapping->file.fileName(), mapping->file.errorString());
+            continue;
+        }
+        if (size > 0) {
+            mapping->data = mapping->file.map(offset, size);
+            if (mapping->data == nullptr) {
+                outError = QString("Failed to map %1: %2").arg(mapping->file.fileName(), mapping->file.errorString());
+                continue;
+            }
+        }
+        mapping->size = size;
+        outView.mapping_ = std::move(mapping);
+        outView.null_ = false;
+        outError.clear();
+        return true;
+    }
+    return false;
+}
+
+bool BlobStore::Collect(Db& db, BlobCollectStats& outStats, QString& outError)
+{
+    outStats = BlobCollectStats();
+    QSqlDatabase& sqlDb = db.Handle();
+    std::lock_guard<std::mutex> lk(mu_);
+
+    struct Dead {
+        QString hash;
+        qint64 segment = 0;
+        qint64 size = 0;
+    };
+    std::vector<Dead> dead;
+    {
+        Query<Columns<QString, qint64, qint64>, Params<qint64>> query(
+            db, "SELECT hash, segment, size FROM blobs WHERE refs<=0 AND created_at<?");
+        if (!query.Exec(NowSecs() - options_.collectGraceSecs)) {
+            outError = query.Error();
+            return false;
+        }
+        while (auto row = query.Next()) {
+            dead.push_back(Dead{std::get<0>(*row), std::get<1>(*row), std::get<2>(*row)});
+        }
+    }
+    // Rows first: a crash after this leaves stray files, never rows without content.
+    if (!sqlDb.transaction()) {
+        outError = "Failed to start transaction";
+        return false;
+    }
+    Query<Columns<>, Params<QString>> remove(db, "DELETE FROM blobs WHERE hash=? AND refs<=0");
+    for (const Dead& blob : dead) {
+        if (!remove.Exec(blob.hash)) {
+            outError = remove.Error();
+            sqlDb.rollback();
+            return false;
+        }
+    }
+    if (!sqlDb.commit()) {
+        outError = "Failed to commit blob removal";
+        return false;
+    }
+    for (const Dead& blob : dead) {
+        if (blob.segment == 0) {
+            QFile::remove(LoosePath(blob.hash));
+        }
+        outStats.blobsRemoved += 1;
+        outStats.bytesReclaimed += blob.size;
+    }
+
+    // Segments that are mostly dead space are rewritten: their live blobs are appended to the
+    // active segment and the old file goes. The active segment itself is left alone.
+    ResumeSegmentLocked();
+    const QString dir = QString::fromStdString((root_ / "segments").string());
+    for (const QString& name : QDir(dir).entryList({"*.seg"}, QDir::Files, QDir::Name)) {
+        const qint64 segment = name.section('.', 0, 0).toLongLong();
+        if (segment <= 0 || segment >= activeSegment_) {
+            continue;
+        }
+        const qint64 fileSize = QFileInfo(QDir(dir).filePath(name)).size();
+        struct Live {
+            QString hash;
+            qint64 offset = 0;
+            qint64 size = 0;
+        };
+        std::vector<Live> live;
+        qint64 liveBytes = 0;
+        {
+            Query<Columns<QString, qint64, qint64>, Params<qint64>> query(
+                db, "SELECT hash, offset, size FROM blobs WHERE segment=?");
+            if (!query.Exec(segment)) {
+                outError = query.Error();
+                return false;
+            }
+            while (auto row = query.Next()) {
+                live.push_back(Live{std::get<0>(*row), std::get<1>(*row), std::get<2>(*row)});
+                liveBytes += std::get<2>(*row);
+            }
+        }
+        if (liveBytes * 2 >= fileSize) {
+            continue;
+        }
+
+        QFile source(SegmentPath(segment));
+        if (!source.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+        if (!sqlDb.transaction()) {
+            outError = "Failed to start transaction";
+            return false;
+        }
+        Query<Columns<>, Params<qint64, qint64, QString>> move(db, "UPDATE blobs SET segment=?, offset=? WHERE hash=?");
+        bool ok = true;
+        for (const Live& blob : live) {
+            source.seek(blob.offset);
+            const QByteArray data = source.read(blob.size);
+            qint64 newSegment = 0;
+            qint64 newOffset = 0;
+            if (data.size() != blob.size || !AppendLocked(data, newSegment, newOffset, outError)
+                || !move.Exec(newSegment, newOffset, blob.hash)) {
+                if (outError.isEmpty()) {
+                    outError = move.Error().isEmpty() ? QString("Failed to read %1").arg(source.fileName()) : move.Error();
+                }
+                ok = false;
+                break;
+            }
+        }
+        if (!ok) {
+            sqlDb.rollback();
+            return false;
+        }
+        if (!sqlDb.commit()) {
+            outError = "Failed to commit segment compaction";
+            return false;
+        }
+        source.close();
+        QFile::remove(SegmentPath(segment));
+        outStats.segmentsCompacted += 1;
+        outStats.bytesReclaimed += fileSize - liveBytes;
+    }
+    return true;
+}
+
+} // namespace ngks::core::storage
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <QByteArrayView>
+#include <QString>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+
+namespace ngks::core::storage {
+
+class Db;
+
+struct BlobStoreOptions {
+    // Blobs below this size are packed into segment files; larger ones get a file each.
+    qint64 packThreshold = 256 * 1024;
+    // A segment stops taking blobs once it is this large.
+    qint64 segmentBytes = 64 * 1024 * 1024;
+    // Unreferenced blobs younger than this survive Collect: the row that will reference one may
+    // not be committed yet.
+    qint64 collectGraceSecs = 60 * 60;
+};
+
+struct BlobCollectStats {
+    qint64 blobsRemoved = 0;
+    qint64 bytesReclaimed = 0;
+    int segmentsCompacted = 0;
+};
+
+// A blob's content, mapped read-only. Stays valid while the view (or a copy of it) lives.
+class BlobView {
+public:
+    QByteArrayView Data() const;
+    bool IsNull() const;
+
+private:
+    friend class BlobStore;
+    struct Mapping;
+
+    std::shared_ptr<Mapping> mapping_;
+    bool null_ = true;
+};
+
+// Message content stored once per distinct content: a blob is keyed by the SHA-256 of its
+// bytes, so an attachment sent to many people, or a message Gmail shows under several labels,
+// is kept once however many message_parts rows name it. Small blobs are appended to
+// segment files (fewer files, and no per-file slack for the many short text parts); large
+// ones are a file each. The blobs table records where each blob is and how many
+// message_parts rows reference it; triggers on message_parts keep that count, in the same
+// transaction as the reference. Collect drops blobs nobody references and rewrites segments
+// that are mostly dead. Reads map the file rather than copying it.
+class BlobStore {
+public:
+    explicit BlobStore(std::filesystem::path root, BlobStoreOptions options = {});
+
+    // The store under ArtifactsDir()/blobs.
+    static BlobStore& Instance();
+
+    // Stores data unless the store has it already. The blob counts as unreferenced until a
+    // message_parts row names it.
+    bool Put(Db& db, QByteArrayView data, QString& outHash, QString& outError);
+    // Same for a file, which the store takes over: moved in or packed, then removed. A file that
+    // could not be stored is left where it is.
+    bool PutFile(Db& db, const QString& path, QString& outHash, QString& outError);
+    bool Contains(Db& db, const QString& hash);
+    bool Read(Db& db, const QString& hash, BlobView& outView, QString& outError);
+    bool Collect(Db& db, BlobCollectStats& outStats, QString& outError);
+
+    // Where to write content before PutFile; on the store's file system, so large blobs are
+    // moved in by rename.
+    QString StagingPath(const QString& name) const;
+
+private:
+    bool Locate(Db& db, const QString& hash, qint64& outSegment, qint64& outOffset, qint64& outSize, QString& outError);
+    // These need mu_. TouchLocked reports whether the blob is stored.
+    bool TouchLocked(Db& db, const QString& hash);
+    bool StoreLocked(Db& db,
+                     const QString& hash,
+                     QByteArrayView data,
+                     const QString& file,
+                     qint64 size,
+                     QString& outError);
+    void ResumeSegmentLocked();
+    bool AppendLocked(QByteArrayView data, qint64& outSegment, qint64& outOffset, QString& outError);
+    bool InsertLocked(Db& db, const QString& hash, qint64 size, qint64 segment, qint64 offset, QString& outError);
+
+    QString SegmentPath(qint64 segment) const;
+    QString LoosePath(const QString& hash) const;
+
+    std::filesystem::path root_;
+    BlobStoreOptions options_;
+    // Appends, new rows and compaction.
+    std::mutex mu_;
+    qint64 activeSegment_ = 0;
+};
+
+} // namespace ngks::core::storage
@@ -1,9 +1,38 @@
 #include "core/storage/Db.h"
 
 #include <QSqlDatabase>
+#include <QSqlQuery>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "core/storage/StatementCache.h"
 
 namespace ngks::core::storage {
 
+namespace {
+
+// synchronous=NORMAL is durable in WAL mode except for the last transactions before a power
+// loss; the sync checkpoints are written with their data, so a lost tail is re-fetched.
+const char* const kPragmas[] = {
+    "PRAGMA journal_mode=WAL",
+    "PRAGMA synchronous=NORMAL",
+    "PRAGMA busy_timeout=5000",
+    "PRAGMA cache_size=-16384",
+    "PRAGMA mmap_size=268435456",
+    "PRAGMA temp_store=MEMORY",
+};
+
+std::atomic<quint64> nextPooledId{1};
+
+// A thread's pooled connections by path; destroyed, and so closed, on the thread's exit.
+struct ThreadConnections {
+    std::map<std::string, std::unique_ptr<Db>> byPath;
+};
+
+}
+
 Db::Db() {
     if (QSqlDatabase::contains()) {
         QSqlDatabase existing = QSqlDatabase::database();
@@ -14,7 +43,15 @@ Db::Db() {
     }
 }
 
+Db::Db(const QString& connectionName)
+    : connectionName_(connectionName) {
+    QSqlDatabase created = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+    db_ = new QSqlDatabase(created);
+}
+
 Db::~Db() {
+    // Statements go before the connection they were prepared on.
+    statements_.reset();
     if (db_ != nullptr) {
         if (db_->isOpen()) {
             db_->close();
@@ -22,6 +59,19 @@ Db::~Db() {
         delete db_;
         db_ = nullptr;
     }
+    if (!connectionName_.isEmpty()) {
+        QSqlDatabase::removeDatabase(connectionName_);
+    }
+}
+
+Db& Db::ForThread(const std::filesystem::path& path) {
+    thread_local ThreadConnections connections;
+    std::unique_ptr<Db>& slot = connections.byPath[path.string()];
+    if (!slot || !slot->IsOpen()) {
+        slot = std::make_unique<Db>(QString("ngks_pooled_%1").arg(nextPooledId.fetch_add(1)));
+        slot->Open(path);
+    }
+    return *slot;
 }
 
 bool Db::Open(const std::filesystem::path& path) {
@@ -29,8 +79,16 @@ bool Db::Open(const std::filesystem::path& path) {
         return false;
     }
 
+    statements_.reset();
     db_->setDatabaseName(QString::fromStdString(path.string()));
     open_ = db_->open();
+    if (open_) {
+        // Best effort: an in-memory database, for one, stays in its own journal mode.
+        QSqlQuery pragma(*db_);
+        for (const char* statement : kPragmas) {
+            pragma.exec(statement);
+        }
+    }
     return open_;
 }
 
@@ -42,4 +100,11 @@ QSqlDatabase& Db::Handle() {
     return *db_;
 }
 
+StatementCache& Db::Statements() {
+    if (!statements_) {
+        statements_ = std::make_unique<StatementCache>(*db_);
+    }
+    return *statements_;
+}
+
 }
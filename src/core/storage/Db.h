@@ -1,25 +1,44 @@
 #pragma once
 
+#include <QString>
 #include <filesystem>
+#include <memory>
 
 class QSqlDatabase;
 
 namespace ngks::core::storage {
 
+class StatementCache;
+
+// One SQLite connection. Every connection opens in WAL mode, so readers on one connection run
+// alongside a write transaction on another instead of waiting for it; writers queue on the
+// busy timeout rather than failing.
 class Db {
 public:
     Db();
+    // A separate connection under its own name, e.g. for a worker thread; it must be created,
+    // used and destroyed on that thread. The name is released again on destruction.
+    explicit Db(const QString& connectionName);
     ~Db();
 
     Db(const Db&) = delete;
     Db& operator=(const Db&) = delete;
 
+    // The calling thread's pooled connection to path, opened on first use and closed when the
+    // thread exits. Lets threads that only have a database path, such as the UI or JobQueue
+    // workers, read and write without sharing a connection. Check IsOpen() before use.
+    static Db& ForThread(const std::filesystem::path& path);
+
     bool Open(const std::filesystem::path& path);
     bool IsOpen() const;
     QSqlDatabase& Handle();
+    // This connection's prepared statements (see Query.h).
+    StatementCache& Statements();
 
 private:
     QSqlDatabase* db_ = nullptr;
+    std::unique_ptr<StatementCache> statements_;
+    QString connectionName_;
     bool open_ = false;
 };
 
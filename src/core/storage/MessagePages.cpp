@@ -0,0 +1,98 @@
+#include "core/storage/MessagePages.h"
+
+#include "core/storage/Db.h"
+#include "core/storage/Query.h"
+
+namespace ngks::core::storage {
+
+namespace {
+
+constexpr const char* kColumns =
+    "m.id, m.uid, m.received_at, m.seen, m.flagged, m.size, m.subject, m.from_addr, m.thread_id";
+
+using PageQuery = Query<Columns<qint64, qint64, qint64, bool, bool, qint64, QString, QString, qint64, int>,
+                        Params<qint64, qint64, qint64, int>>;
+
+}
+
+MessagePages::MessagePages(Db& db)
+    : db_(db)
+{
+}
+
+QString MessagePages::PageSql(MessageView view)
+{
+    switch (view) {
+    case MessageView::Unread:
+        // seen=0 spelled as in the partial index's WHERE, or the planner will not use it.
+        return QString("SELECT %1, 1 FROM messages m WHERE m.folder_id=? AND m.seen=0 "
+                       "AND (m.received_at, m.id) < (?, ?) ORDER BY m.received_at DESC, m.id DESC LIMIT ?")
+            .arg(kColumns);
+    case MessageView::Threads:
+        // A row is its thread's newest message; both lookups stay inside idx_messages_folder_thread.
+        return QString("SELECT %1, (SELECT COUNT(*) FROM messages t WHERE t.folder_id=m.folder_id "
+                       "AND t.thread_id=m.thread_id) FROM messages m WHERE m.folder_id=? "
+                       "AND (m.received_at, m.id) < (?, ?) AND NOT EXISTS (SELECT 1 FROM messages n "
+                       "WHERE n.folder_id=m.folder_id AND n.thread_id=m.thread_id "
+                       "AND (n.received_at, n.id) > (m.received_at, m.id)) "
+                       "ORDER BY m.received_at DESC, m.id DESC LIMIT ?")
+            .arg(kColumns);
+    case MessageView::All:
+        break;
+    }
+    return QString("SELECT %1, 1 FROM messages m WHERE m.folder_id=? AND (m.received_at, m.id) < (?, ?) "
+                   "ORDER BY m.received_at DESC, m.id DESC LIMIT ?")
+        .arg(kColumns);
+}
+
+QString MessagePages::UnreadCountSql()
+{
+    return "SELECT COUNT(*) FROM messages WHERE folder_id=? AND seen=0";
+}
+
+bool MessagePages::Load(qint64 folderId,
+                        MessageView view,
+                        const MessageCursor& after,
+                        int limit,
+                        std::vector<MessageListRow>& outRows,
+                        MessageCursor& outNext,
+                        QString& outError)
+{
+    outRows.clear();
+    outNext = after;
+    if (limit <= 0) {
+        return true;
+    }
+    PageQuery query(db_, PageSql(view));
+    if (!query.Exec(folderId, after.receivedAt, after.id, limit)) {
+        outError = query.Error();
+        return false;
+    }
+    outRows.reserve(limit);
+    while (auto row = query.Next()) {
+        MessageListRow out;
+        std::tie(out.id, out.uid, out.receivedAt, out.seen, out.flagged, out.size, out.subject, out.from,
+                 out.threadId, out.threadSize) = std::move(*row);
+        outRows.push_back(std::move(out));
+    }
+    if (!outRows.empty()) {
+        outNext.receivedAt = outRows.back().receivedAt;
+        outNext.id = outRows.back().id;
+    }
+    return true;
+}
+
+bool MessagePages::UnreadCount(qint64 folderId, qint64& outCount, QString& outError)
+{
+    outCount = 0;
+    Query<Columns<qint64>, Params<qint64>> query(db_, UnreadCountSql());
+    const auto row = query.Exec(folderId) ? query.First() : std::nullopt;
+    if (!row) {
+        outError = query.Error();
+        return false;
+    }
+    outCount = std::get<0>(*row);
+    return true;
+}
+
+} // namespace ngks::core::storage
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <QString>
+#include <limits>
+#include <vector>
+
+namespace ngks::core::storage {
+
+class Db;
+
+enum class MessageView {
+    All,
+    Unread,
+    // One row per thread, its newest message, newest thread first.
+    Threads
+};
+
+// Where a page ends: the (received_at, id) of its last row. The next page starts after it.
+struct MessageCursor {
+    qint64 receivedAt = std::numeric_limits<qint64>::max();
+    qint64 id = std::numeric_limits<qint64>::max();
+};
+
+struct MessageListRow {
+    qint64 id = -1;
+    qint64 uid = -1;
+    qint64 receivedAt = 0;
+    bool seen = false;
+    bool flagged = false;
+    qint64 size = 0;
+    QString subject;
+    QString from;
+    qint64 threadId = 0;
+    // Messages in the thread within the folder; 1 outside the thread view.
+    int threadSize = 1;
+};
+
+// The message list's queries. Pages are keyset-paged newest first on indexes that match them
+// exactly (see Schema), so a page costs the same at the top of a folder as a million rows
+// down, and no page sorts. Statements come from the connection's StatementCache.
+class MessagePages {
+public:
+    explicit MessagePages(Db& db);
+
+    // Up to limit rows after `after` (default: from the top); outNext continues after them.
+    bool Load(qint64 folderId,
+              MessageView view,
+              const MessageCursor& after,
+              int limit,
+              std::vector<MessageListRow>& outRows,
+              MessageCursor& outNext,
+              QString& outError);
+    bool UnreadCount(qint64 folderId, qint64& outCount, QString& outError);
+
+    // For plan checks (tools/bench/MessageListBench.cpp).
+    static QString PageSql(MessageView view);
+    static QString UnreadCountSql();
+
+private:
+    Db& db_;
+};
+
+} // namespace ngks::core::storage
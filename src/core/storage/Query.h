@@ -0,0 +1,146 @@
+#pragma once
+
+#include <QByteArray>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QSqlRecord>
+#include <QString>
+#include <QVariant>
+#include <optional>
+#include <tuple>
+#include <utility>
+
+#include "core/storage/Db.h"
+#include "core/storage/StatementCache.h"
+
+namespace ngks::core::storage {
+
+template <typename... Types>
+struct Columns {};
+
+template <typename... Types>
+struct Params {};
+
+// How a C++ type is bound and read. Only the specializations below exist, so binding or
+// reading any other type does not compile.
+template <typename T>
+struct SqlType;
+
+template <>
+struct SqlType<qint64> {
+    static QVariant Bind(qint64 value) { return QVariant(value); }
+    static qint64 Read(const QSqlQuery& query, int column) { return query.value(column).toLongLong(); }
+};
+
+template <>
+struct SqlType<int> {
+    static QVariant Bind(int value) { return QVariant(value); }
+    static int Read(const QSqlQuery& query, int column) { return query.value(column).toInt(); }
+};
+
+template <>
+struct SqlType<bool> {
+    static QVariant Bind(bool value) { return QVariant(value ? 1 : 0); }
+    static bool Read(const QSqlQuery& query, int column) { return query.value(column).toLongLong() != 0; }
+};
+
+template <>
+struct SqlType<double> {
+    static QVariant Bind(double value) { return QVariant(value); }
+    static double Read(const QSqlQuery& query, int column) { return query.value(column).toDouble(); }
+};
+
+template <>
+struct SqlType<QString> {
+    static QVariant Bind(const QString& value) { return QVariant(value); }
+    static QString Read(const QSqlQuery& query, int column) { return query.value(column).toString(); }
+};
+
+template <>
+struct SqlType<QByteArray> {
+    static QVariant Bind(const QByteArray& value) { return QVariant(value); }
+    static QByteArray Read(const QSqlQuery& query, int column) { return query.value(column).toByteArray(); }
+};
+
+template <typename ColumnList, typename ParamList>
+class Query;
+
+// A statement from the connection's StatementCache with its parameter and column types in its
+// type:
+//   Query<Columns<qint64, QString>, Params<qint64>> folders(db, "SELECT id, remote_name FROM folders WHERE account_id=?");
+//   if (folders.Exec(accountId)) {
+//       while (auto row = folders.Next()) {
+//           const auto& [id, name] = *row;
+//       }
+//   }
+// Parameters bind positionally ('?'); an argument of the wrong type or count does not compile,
+// and a SELECT returning a different number of columns fails at Exec.
+template <typename... Cols, typename... Ps>
+class Query<Columns<Cols...>, Params<Ps...>> {
+public:
+    using Row = std::tuple<Cols...>;
+
+    Query(Db& db, const QString& sql)
+        : query_(db.Statements().Get(sql, error_))
+    {
+    }
+
+    bool IsValid() const { return query_ != nullptr; }
+
+    bool Exec(const Ps&... params)
+    {
+        if (query_ == nullptr) {
+            return false;
+        }
+        int index = 0;
+        (query_->bindValue(index++, SqlType<Ps>::Bind(params)), ...);
+        if (!query_->exec()) {
+            error_ = query_->lastError().text();
+            return false;
+        }
+        if constexpr (sizeof...(Cols) > 0) {
+            if (query_->record().count() != static_cast<int>(sizeof...(Cols))) {
+                error_ = QString("query returns %1 columns, expected %2")
+                             .arg(query_->record().count())
+                             .arg(sizeof...(Cols));
+                query_->finish();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::optional<Row> Next()
+    {
+        if (query_ == nullptr || !query_->next()) {
+            return std::nullopt;
+        }
+        return ReadRow(std::index_sequence_for<Cols...>{});
+    }
+
+    // The first row, releasing the statement right away.
+    std::optional<Row> First()
+    {
+        std::optional<Row> row = Next();
+        if (query_ != nullptr) {
+            query_->finish();
+        }
+        return row;
+    }
+
+    int RowsAffected() const { return query_ == nullptr ? -1 : query_->numRowsAffected(); }
+    qint64 LastInsertId() const { return query_ == nullptr ? -1 : query_->lastInsertId().toLongLong(); }
+    const QString& Error() const { return error_; }
+
+private:
+    template <std::size_t... I>
+    Row ReadRow(std::index_sequence<I...>) const
+    {
+        return Row(SqlType<Cols>::Read(*query_, static_cast<int>(I))...);
+    }
+
+    QString error_;
+    QSqlQuery* query_ = nullptr;
+};
+
+}
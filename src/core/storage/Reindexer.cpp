@@ -1,6 +1,518 @@
 #include "core/storage/Reindexer.h"
 
+#include <QElapsedTimer>
+#include <QFile>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QStringDecoder>
+#include <QThread>
+#include <QVariant>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+
+#include "core/storage/BlobStore.h"
+#include "core/storage/Db.h"
+#include "core/storage/Query.h"
+
 namespace ngks::core::storage {
-void Reindexer::Run() {
+
+namespace {
+
+// Messages with their headers in [?, ?], each with its display part if that has been fetched:
+// the first stored inline text part, plain text before HTML.
+constexpr const char* kDocumentsSql =
+    "SELECT m.id, m.subject, m.from_addr, m.to_addrs, "
+    "(SELECT group_concat(a.name || ' ' || a.email, ' ') FROM message_addresses a WHERE a.message_id=m.id), "
+    "p.blob_hash, p.local_path, p.charset, p.content_type "
+    "FROM messages m LEFT JOIN message_parts p ON p.id=(SELECT q.id FROM message_parts q "
+    "WHERE q.message_id=m.id AND q.is_attachment=0 AND (q.blob_hash<>'' OR q.local_path<>'') "
+    "AND q.content_type IN ('text/plain', 'text/html') ORDER BY q.content_type='text/html', q.id LIMIT 1) "
+    "WHERE m.id BETWEEN ? AND ? AND m.has_header=1";
+
+// Batches of documents the rebuild readers have ready for the writer; bounded so readers
+// cannot run far ahead of it.
+constexpr int kRebuildQueuedBatches = 4;
+// Rebuild batches per write transaction.
+constexpr int kRebuildBatchesPerCommit = 20;
+
+QString HtmlToText(const QString& html)
+{
+    QString out;
+    out.reserve(html.size() / 2);
+    qsizetype i = 0;
+    while (i < html.size()) {
+        const QChar c = html[i];
+        if (c == '<') {
+            const qsizetype end = html.indexOf('>', i);
+            if (end < 0) {
+                break;
+            }
+            const QStringView tag = QStringView(html).mid(i + 1, end - i - 1).trimmed();
+            // Skip what scripts and style sheets contain, not just their tags.
+            for (const char* skipped : {"script", "style"}) {
+                if (tag.startsWith(QLatin1String(skipped), Qt::CaseInsensitive)) {
+                    const qsizetype close = html.indexOf(QString("</%1").arg(QLatin1String(skipped)), end,
+                                                         Qt::CaseInsensitive);
+                    i = close < 0 ? html.size() : close;
+                    break;
+                }
+            }
+            if (i < end) {
+                i = end + 1;
+            }
+            out += ' ';
+            continue;
+        }
+        if (c == '&') {
+            const qsizetype end = html.indexOf(';', i);
+            if (end > i && end - i <= 8) {
+                const QStringView entity = QStringView(html).mid(i + 1, end - i - 1);
+                static const struct {
+                    const char* name;
+                    char16_t value;
+                } kEntities[] = {{"nbsp", u' '}, {"amp", u'&'}, {"lt", u'<'}, {"gt", u'>'}, {"quot", u'"'}, {"#39", u'\''}};
+                bool known = false;
+                for (const auto& candidate : kEntities) {
+                    if (entity.compare(QLatin1String(candidate.name), Qt::CaseInsensitive) == 0) {
+                        out += QChar(candidate.value);
+                        known = true;
+                        break;
+                    }
+                }
+                if (known) {
+                    i = end + 1;
+                    continue;
+                }
+            }
+        }
+        out += c;
+        ++i;
+    }
+    return out.simplified();
+}
+
+QString ReadBody(Db& db, const QString& hash, const QString& path, const QString& charset, bool html, int maxBytes)
+{
+    BlobView content;
+    QFile file(path);
+    QByteArray legacy;
+    QByteArrayView bytes;
+    QString error;
+    if (!hash.isEmpty()) {
+        if (!BlobStore::Instance().Read(db, hash, content, error)) {
+            return QString();
+        }
+        bytes = content.Data().first(qMin<qsizetype>(content.Data().size(), maxBytes));
+    } else if (!path.isEmpty() && file.open(QIODevice::ReadOnly)) {
+        // Fetched before the blob store; PartFetcher moves it in when the part is next read.
+        legacy = file.read(maxBytes);
+        bytes = legacy;
+    } else {
+        return QString();
+    }
+    QStringDecoder decoder(charset.isEmpty() ? "UTF-8" : charset.toUtf8().constData());
+    const QString text = decoder.isValid() ? decoder.decode(bytes) : QString::fromUtf8(bytes);
+    return html ? HtmlToText(text) : text;
+}
+
+bool ReadMeta(QSqlDatabase& db, const QString& key, QString& outValue)
+{
+    QSqlQuery query(db);
+    query.prepare("SELECT v FROM app_meta WHERE k=:k");
+    query.bindValue(":k", key);
+    if (!query.exec()) {
+        return false;
+    }
+    outValue = query.next() ? query.value(0).toString() : QString();
+    return true;
+}
+
+bool WriteMeta(QSqlDatabase& db, const QString& key, const QString& value)
+{
+    QSqlQuery query(db);
+    query.prepare("INSERT INTO app_meta(k, v) VALUES(:k, :v) ON CONFLICT(k) DO UPDATE SET v=excluded.v");
+    query.bindValue(":k", key);
+    query.bindValue(":v", value);
+    return query.exec();
+}
+
+}
+
+struct Reindexer::Document {
+    qint64 id = -1;
+    QString subject;
+    QString addresses;
+    QString body;
+};
+
+Reindexer::Reindexer(Db& db, ReindexOptions options)
+    : db_(db)
+    , options_(options)
+{
+}
+
+bool Reindexer::Ensure(QString& outError)
+{
+    QSqlQuery query(db_.Handle());
+    // Diacritics folded so "resume" finds "résumé"; prefix indexes keep search-as-you-type
+    // queries ("qua*") off a full term scan.
+    if (!query.exec("CREATE VIRTUAL TABLE IF NOT EXISTS message_fts USING fts5("
+                    "subject, addresses, body, tokenize='unicode61 remove_diacritics 2', prefix='2 3')")) {
+        outError = QString("full-text index unavailable: %1").arg(query.lastError().text());
+        return false;
+    }
+    // Subject matches rank above address matches, above body matches. Stored with the table,
+    // so ORDER BY rank uses it.
+    if (!query.exec("INSERT INTO message_fts(message_fts, rank) VALUES('rank', 'bm25(10.0, 4.0, 1.0)')")) {
+        outError = query.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+bool Reindexer::LoadDocuments(Db& db, qint64 firstId, qint64 lastId, std::vector<Document>& outDocs, QString& outError) const
+{
+    outDocs.clear();
+    Query<Columns<qint64, QString, QString, QString, QString, QString, QString, QString, QString>, Params<qint64, qint64>>
+        query(db, kDocumentsSql);
+    if (!query.Exec(firstId, lastId)) {
+        outError = query.Error();
+        return false;
+    }
+    while (auto row = query.Next()) {
+        const auto& [id, subject, from, to, addresses, hash, path, charset, contentType] = *row;
+        Document doc;
+        doc.id = id;
+        doc.subject = subject;
+        // Messages from before the address rows existed still have the display strings.
+        doc.addresses = addresses.isEmpty() ? from + ' ' + to : addresses;
+        doc.body = ReadBody(db, hash, path, charset, contentType == QLatin1String("text/html"), options_.maxBodyBytes);
+        outDocs.push_back(std::move(doc));
+    }
+    return true;
+}
+
+bool Reindexer::WriteDocuments(const std::vector<Document>& docs, bool replace, QString& outError)
+{
+    Query<Columns<>, Params<qint64>> remove(db_, "DELETE FROM message_fts WHERE rowid=?");
+    Query<Columns<>, Params<qint64, QString, QString, QString>> insert(
+        db_, "INSERT INTO message_fts(rowid, subject, addresses, body) VALUES(?, ?, ?, ?)");
+    for (const Document& doc : docs) {
+        if ((replace && !remove.Exec(doc.id)) || !insert.Exec(doc.id, doc.subject, doc.addresses, doc.body)) {
+            outError = remove.Error().isEmpty() ? insert.Error() : remove.Error();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Reindexer::Run(ReindexStats& outStats, QString& outError, const std::function<bool()>& stop)
+{
+    outStats = ReindexStats();
+    outError.clear();
+    if (!db_.IsOpen()) {
+        outError = "DB is not open";
+        return false;
+    }
+    QElapsedTimer clock;
+    clock.start();
+    if (!Ensure(outError)) {
+        return false;
+    }
+    QSqlDatabase& sqlDb = db_.Handle();
+    QString built;
+    if (!ReadMeta(sqlDb, "fts_built", built)) {
+        outError = "Failed to read index state";
+        return false;
+    }
+    if (built != QLatin1String("1")) {
+        if (!Rebuild(outStats, outError)) {
+            return false;
+        }
+    }
+
+    struct Entry {
+        qint64 id = -1;
+        bool deleted = false;
+        qint64 version = 0;
+    };
+    std::vector<Entry> entries;
+    std::vector<Document> docs;
+    std::vector<Document> one;
+    while (!stop || !stop()) {
+        entries.clear();
+        {
+            Query<Columns<qint64, bool, qint64>, Params<int>> queued(
+                db_, "SELECT message_id, deleted, version FROM fts_queue ORDER BY message_id LIMIT ?");
+            if (!queued.Exec(options_.batchSize)) {
+                outError = queued.Error();
+                return false;
+            }
+            while (auto row = queued.Next()) {
+                entries.push_back(Entry{std::get<0>(*row), std::get<1>(*row), std::get<2>(*row)});
+            }
+        }
+        if (entries.empty()) {
+            break;
+        }
+
+        // Bodies are read before the transaction, so the write lock is held only for the
+        // index writes.
+        docs.clear();
+        for (const Entry& entry : entries) {
+            if (entry.deleted) {
+                continue;
+            }
+            if (!LoadDocuments(db_, entry.id, entry.id, one, outError)) {
+                return false;
+            }
+            for (Document& doc : one) {
+                docs.push_back(std::move(doc));
+            }
+        }
+
+        if (!sqlDb.transaction()) {
+            outError = "Failed to start transaction";
+            return false;
+        }
+        Query<Columns<>, Params<qint64>> remove(db_, "DELETE FROM message_fts WHERE rowid=?");
+        Query<Columns<>, Params<qint64, qint64>> dequeue(db_, "DELETE FROM fts_queue WHERE message_id=? AND version=?");
+        bool ok = true;
+        for (const Entry& entry : entries) {
+            if (entry.deleted) {
+                ok = remove.Exec(entry.id);
+                outStats.removed += 1;
+            }
+            ok = ok && dequeue.Exec(entry.id, entry.version);
+            if (!ok) {
+                outError = remove.Error().isEmpty() ? dequeue.Error() : remove.Error();
+                break;
+            }
+        }
+        if (!ok || !WriteDocuments(docs, true, outError)) {
+            sqlDb.rollback();
+            return false;
+        }
+        if (!sqlDb.commit()) {
+            outError = "Failed to commit index batch";
+            return false;
+        }
+        outStats.indexed += static_cast<qint64>(docs.size());
+    }
+    outStats.elapsedMs = clock.elapsed();
+    return true;
+}
+
+bool Reindexer::Rebuild(ReindexStats& outStats, QString& outError)
+{
+    outStats = ReindexStats();
+    outError.clear();
+    QElapsedTimer clock;
+    clock.start();
+    QSqlDatabase& sqlDb = db_.Handle();
+
+    // A fresh table is much faster than deleting every row of the old one. Whatever is queued
+    // is covered by the rebuild; changes from here on queue again.
+    db_.Statements().Clear();
+    qint64 firstId = 0;
+    qint64 lastId = -1;
+    {
+        QSqlQuery query(sqlDb);
+        if (!sqlDb.transaction()) {
+            outError = "Failed to start transaction";
+            return false;
+        }
+        if (!WriteMeta(sqlDb, "fts_built", "0") || !query.exec("DROP TABLE IF EXISTS message_fts")
+            || !query.exec("DELETE FROM fts_queue") || !Ensure(outError)
+            // Merging segments while millions of rows go in would redo the same work many
+            // times; one optimize at the end instead.
+            || !query.exec("INSERT INTO message_fts(message_fts, rank) VALUES('automerge', 0)")
+            || !query.exec("SELECT MIN(id), MAX(id) FROM messages") || !query.next()) {
+            if (outError.isEmpty()) {
+                outError = query.lastError().text();
+            }
+            sqlDb.rollback();
+            return false;
+        }
+        if (!query.value(0).isNull()) {
+            firstId = query.value(0).toLongLong();
+            lastId = query.value(1).toLongLong();
+        }
+        query.finish();
+        if (!sqlDb.commit()) {
+            outError = "Failed to commit index reset";
+            return false;
+        }
+    }
+
+    // Readers take id ranges in turn on their own connections, reading and decoding bodies;
+    // this thread is the only writer.
+    const std::string dbPath = sqlDb.databaseName().toStdString();
+    const qint64 batch = qMax(1, options_.batchSize);
+    const int readers = options_.rebuildThreads > 0 ? options_.rebuildThreads : qMax(1, QThread::idealThreadCount());
+    std::atomic<qint64> nextId{firstId};
+    std::atomic<bool> abort{false};
+    std::mutex mu;
+    std::condition_variable ready;
+    std::condition_variable space;
+    std::deque<std::vector<Document>> batches;
+    int running = readers;
+    QString readError;
+
+    auto reader = [&]() {
+        Db& readerDb = Db::ForThread(dbPath);
+        std::vector<Document> docs;
+        QString error;
+        for (;;) {
+            const qint64 first = nextId.fetch_add(batch);
+            if (first > lastId || abort) {
+                break;
+            }
+            if (!readerDb.IsOpen() || !LoadDocuments(readerDb, first, qMin(lastId, first + batch - 1), docs, error)) {
+                std::lock_guard<std::mutex> lk(mu);
+                readError = readerDb.IsOpen() ? error : QString("cannot open database");
+                abort = true;
+                break;
+            }
+            if (docs.empty()) {
+                continue;
+            }
+            std::unique_lock<std::mutex> lk(mu);
+            space.wait(lk, [&]() { return abort || static_cast<int>(batches.size()) < kRebuildQueuedBatches; });
+            batches.push_back(std::move(docs));
+            docs.clear();
+            ready.notify_one();
+        }
+        std::lock_guard<std::mutex> lk(mu);
+        --running;
+        ready.notify_one();
+    };
+
+    std::vector<std::unique_ptr<QThread>> threads;
+    for (int i = 0; i < readers; ++i) {
+        threads.emplace_back(QThread::create(reader));
+        threads.back()->start();
+    }
+
+    bool ok = true;
+    int uncommitted = 0;
+    bool inTransaction = false;
+    for (;;) {
+        std::vector<Document> docs;
+        {
+            std::unique_lock<std::mutex> lk(mu);
+            ready.wait(lk, [&]() { return abort || !batches.empty() || running == 0; });
+            if (abort || batches.empty()) {
+                break;
+            }
+            docs = std::move(batches.front());
+            batches.pop_front();
+            space.notify_one();
+        }
+        if (!inTransaction) {
+            inTransaction = sqlDb.transaction();
+            if (!inTransaction) {
+                outError = "Failed to start transaction";
+                ok = false;
+                break;
+            }
+        }
+        if (!WriteDocuments(docs, false, outError)) {
+            ok = false;
+            break;
+        }
+        outStats.indexed += static_cast<qint64>(docs.size());
+        if (++uncommitted >= kRebuildBatchesPerCommit) {
+            if (!sqlDb.commit()) {
+                outError = "Failed to commit index batch";
+                inTransaction = false;
+                ok = false;
+                break;
+            }
+            inTransaction = false;
+            uncommitted = 0;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lk(mu);
+        if (!ok) {
+            abort = true;
+        }
+        if (!readError.isEmpty()) {
+            ok = false;
+            outError = readError;
+        }
+        space.notify_all();
+    }
+    for (auto& thread : threads) {
+        thread->wait();
+    }
+    if (!ok) {
+        if (inTransaction) {
+            sqlDb.rollback();
+        }
+        return false;
+    }
+    if (inTransaction && !sqlDb.commit()) {
+        outError = "Failed to commit index batch";
+        return false;
+    }
+
+    QSqlQuery query(sqlDb);
+    if (!query.exec("INSERT INTO message_fts(message_fts) VALUES('optimize')")
+        || !query.exec("INSERT INTO message_fts(message_fts, rank) VALUES('automerge', 4)")
+        || !WriteMeta(sqlDb, "fts_built", "1")) {
+        outError = query.lastError().text();
+        return false;
+    }
+    outStats.rebuilt = true;
+    outStats.elapsedMs = clock.elapsed();
+    return true;
 }
+
+ReindexQueue::ReindexQueue(QSqlDatabase& db)
+    : insert_(db)
+    , remove_(db)
+{
+    insert_.prepare("INSERT INTO fts_queue(message_id, deleted) SELECT id, 0 FROM messages "
+                    "WHERE folder_id=:fid AND uid=:uid "
+                    "ON CONFLICT(message_id) DO UPDATE SET deleted=0, version=version+1");
+    remove_.prepare("INSERT INTO fts_queue(message_id, deleted) SELECT id, 1 FROM messages "
+                    "WHERE folder_id=:fid AND uid BETWEEN :lo AND :hi "
+                    "ON CONFLICT(message_id) DO UPDATE SET deleted=1, version=version+1");
+}
+
+bool ReindexQueue::Add(qint64 folderId, qint64 uid, QString& outError)
+{
+    insert_.bindValue(":fid", folderId);
+    insert_.bindValue(":uid", uid);
+    if (!insert_.exec()) {
+        outError = insert_.lastError().text();
+        return false;
+    }
+    return true;
 }
+
+bool ReindexQueue::Remove(qint64 folderId, qint64 lo, qint64 hi, QString& outError)
+{
+    remove_.bindValue(":fid", folderId);
+    remove_.bindValue(":lo", lo);
+    remove_.bindValue(":hi", hi);
+    if (!remove_.exec()) {
+        outError = remove_.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+bool ReindexQueue::RemoveFolder(qint64 folderId, QString& outError)
+{
+    return Remove(folderId, std::numeric_limits<qint64>::min(), std::numeric_limits<qint64>::max(), outError);
+}
+
+} // namespace ngks::core::storage
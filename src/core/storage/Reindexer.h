@@ -1,8 +1,76 @@
 #pragma once
 
+#include <QSqlQuery>
+#include <QString>
+#include <functional>
+#include <vector>
+
+class QSqlDatabase;
+
 namespace ngks::core::storage {
+
+class Db;
+
+struct ReindexOptions {
+    // Queue entries (or, rebuilding, messages) per transaction.
+    int batchSize = 500;
+    // Decoded text read per body; the rest of a very long body is not searchable.
+    int maxBodyBytes = 256 * 1024;
+    // Rebuild threads reading and decoding bodies; 0 for one per core.
+    int rebuildThreads = 0;
+};
+
+struct ReindexStats {
+    qint64 indexed = 0;
+    qint64 removed = 0;
+    bool rebuilt = false;
+    qint64 elapsedMs = 0;
+};
+
+// Keeps message_fts, an FTS5 index over each message's subject, addresses and decoded display
+// text, in step with the messages table. Writers do not touch the index: they add the message
+// to fts_queue (ReindexQueue) in their own transaction, deletes included, so a sync window
+// costs one small insert per message. Run drains the queue in batches; bodies are read from
+// the BlobStore, outside the write transaction. The first Run on a store, or
+// Rebuild, indexes every message with several threads reading and decoding while one
+// connection writes, with FTS5 segment merging deferred to a single optimize at the end.
 class Reindexer {
 public:
-    void Run();
+    explicit Reindexer(Db& db, ReindexOptions options = {});
+
+    // Creates message_fts. Fails if the driver's SQLite was built without FTS5.
+    bool Ensure(QString& outError);
+    // Indexes what is queued; stop is polled between batches. Rebuilds first if the index has
+    // never been built.
+    bool Run(ReindexStats& outStats, QString& outError, const std::function<bool()>& stop = {});
+    bool Rebuild(ReindexStats& outStats, QString& outError);
+
+private:
+    struct Document;
+
+    bool LoadDocuments(Db& db, qint64 firstId, qint64 lastId, std::vector<Document>& outDocs, QString& outError) const;
+    // replace drops a message's current row first; a rebuild starts from an empty table.
+    bool WriteDocuments(const std::vector<Document>& docs, bool replace, QString& outError);
+
+    Db& db_;
+    ReindexOptions options_;
+};
+
+// Queues messages for the index from inside a writer's transaction. Adding a message that is
+// already queued moves its version on, so a Run that read the older version leaves it queued.
+class ReindexQueue {
+public:
+    explicit ReindexQueue(QSqlDatabase& db);
+
+    bool Add(qint64 folderId, qint64 uid, QString& outError);
+    // Queues the removal of the folder's messages with a UID in [lo, hi]; call it before
+    // deleting them, in the same transaction.
+    bool Remove(qint64 folderId, qint64 lo, qint64 hi, QString& outError);
+    bool RemoveFolder(qint64 folderId, QString& outError);
+
+private:
+    QSqlQuery insert_;
+    QSqlQuery remove_;
 };
-}
+
+} // namespace ngks::core::storage
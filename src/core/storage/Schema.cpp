@@ -8,7 +8,7 @@
 namespace ngks::core::storage {
 
 namespace {
-constexpr int kSchemaVersion = 2;
+constexpr int kSchemaVersion = 3;
 }
 
 Schema::Schema(Db& db)
@@ -35,7 +35,16 @@ bool Schema::Ensure()
         if (!MigrateToV2()) {
             return false;
         }
-        if (!SetVersion(kSchemaVersion)) {
+        if (!SetVersion(2)) {
+            return false;
+        }
+    }
+
+    if (version < 3) {
+        if (!MigrateToV3()) {
+            return false;
+        }
+        if (!SetVersion(3)) {
             return false;
         }
     }
@@ -111,7 +120,199 @@ bool Schema::EnsureTables()
     if (!query.exec("CREATE INDEX IF NOT EXISTS idx_folders_account ON folders(account_id)")) {
         return false;
     }
-    if (!query.exec("CREATE INDEX IF NOT EXISTS idx_folders_remote_name ON folders(account_id, remote_name)")) {
+    // Unique so folder rows (and their sync_state) survive a re-resolve as upserts. MigrateToV3
+    // removes the duplicates a v2 database may hold.
+    if (!query.exec("CREATE UNIQUE INDEX IF NOT EXISTS ux_folders_remote_name ON folders(account_id, remote_name)")) {
+        return false;
+    }
+
+    // Latest STATUS counts per folder, written by folder discovery so the tree can show them
+    // without a round trip.
+    if (!query.exec(
+            "CREATE TABLE IF NOT EXISTS folder_status ("
+            "  folder_id INTEGER PRIMARY KEY,"
+            "  messages INTEGER NOT NULL DEFAULT -1,"
+            "  unseen INTEGER NOT NULL DEFAULT -1,"
+            "  uid_next INTEGER NOT NULL DEFAULT -1,"
+            "  uid_validity INTEGER NOT NULL DEFAULT -1,"
+            "  highest_modseq INTEGER NOT NULL DEFAULT -1,"
+            "  updated_at TEXT NOT NULL,"
+            "  FOREIGN KEY(folder_id) REFERENCES folders(id)"
+            ")")) {
+        return false;
+    }
+
+    // One row per message per folder, keyed by IMAP UID. Flags and modseq come from the
+    // incremental sync; header fields are filled by the header stage (has_header=1).
+    // received_at is INTERNALDATE in UTC seconds, the list order; seen and flagged mirror those
+    // two flags for the list views; thread_id groups a thread (see ThreadId in MessageRows.h).
+    if (!query.exec(
+            "CREATE TABLE IF NOT EXISTS messages ("
+            "  id INTEGER PRIMARY KEY,"
+            "  folder_id INTEGER NOT NULL,"
+            "  uid INTEGER NOT NULL,"
+            "  modseq INTEGER NOT NULL DEFAULT 0,"
+            "  flags TEXT NOT NULL DEFAULT '',"
+            "  seen INTEGER NOT NULL DEFAULT 0,"
+            "  flagged INTEGER NOT NULL DEFAULT 0,"
+            "  internal_date TEXT NOT NULL DEFAULT '',"
+            "  received_at INTEGER NOT NULL DEFAULT 0,"
+            "  size INTEGER NOT NULL DEFAULT 0,"
+            "  subject TEXT NOT NULL DEFAULT '',"
+            "  from_addr TEXT NOT NULL DEFAULT '',"
+            "  to_addrs TEXT NOT NULL DEFAULT '',"
+            "  date_header TEXT NOT NULL DEFAULT '',"
+            "  message_id TEXT NOT NULL DEFAULT '',"
+            "  in_reply_to TEXT NOT NULL DEFAULT '',"
+            "  references_hdr TEXT NOT NULL DEFAULT '',"
+            "  thread_id INTEGER NOT NULL DEFAULT 0,"
+            "  has_header INTEGER NOT NULL DEFAULT 0,"
+            "  FOREIGN KEY(folder_id) REFERENCES folders(id)"
+            ")")) {
+        return false;
+    }
+    if (!query.exec("CREATE UNIQUE INDEX IF NOT EXISTS ux_messages_folder_uid ON messages(folder_id, uid)")) {
+        return false;
+    }
+    // The list views page newest first with a (received_at, id) cursor, so a page is a range
+    // scan of one of these whatever the folder size; OFFSET paging would not be. They carry
+    // every column a list row shows (see MessagePages), so a page never reads the table.
+    if (!query.exec("CREATE INDEX IF NOT EXISTS idx_messages_folder_received "
+                    "ON messages(folder_id, received_at DESC, id DESC, "
+                    "uid, seen, flagged, size, thread_id, subject, from_addr)")) {
+        return false;
+    }
+    // Unread view and unread counts; only unread rows are in it.
+    if (!query.exec("CREATE INDEX IF NOT EXISTS idx_messages_folder_unread "
+                    "ON messages(folder_id, received_at DESC, id DESC, "
+                    "seen, uid, flagged, size, thread_id, subject, from_addr) WHERE seen=0")) {
+        return false;
+    }
+    // Thread view: a thread's newest message and its size, without touching the rows.
+    if (!query.exec("CREATE INDEX IF NOT EXISTS idx_messages_folder_thread "
+                    "ON messages(folder_id, thread_id, received_at DESC, id DESC)")) {
+        return false;
+    }
+
+    // Flags other than \Seen and \Flagged (those are columns on messages), keywords included.
+    if (!query.exec(
+            "CREATE TABLE IF NOT EXISTS message_flags ("
+            "  message_id INTEGER NOT NULL,"
+            "  flag TEXT NOT NULL,"
+            "  PRIMARY KEY(message_id, flag),"
+            "  FOREIGN KEY(message_id) REFERENCES messages(id)"
+            ") WITHOUT ROWID")) {
+        return false;
+    }
+    if (!query.exec("CREATE INDEX IF NOT EXISTS idx_message_flags_flag ON message_flags(flag, message_id)")) {
+        return false;
+    }
+
+    // From, To and Cc from the envelope, one row per address; email is lower-case.
+    if (!query.exec(
+            "CREATE TABLE IF NOT EXISTS message_addresses ("
+            "  id INTEGER PRIMARY KEY,"
+            "  message_id INTEGER NOT NULL,"
+            "  role INTEGER NOT NULL,"
+            "  position INTEGER NOT NULL,"
+            "  name TEXT NOT NULL DEFAULT '',"
+            "  email TEXT NOT NULL,"
+            "  FOREIGN KEY(message_id) REFERENCES messages(id)"
+            ")")) {
+        return false;
+    }
+    if (!query.exec("CREATE INDEX IF NOT EXISTS idx_message_addresses_message ON message_addresses(message_id)")) {
+        return false;
+    }
+    if (!query.exec("CREATE INDEX IF NOT EXISTS idx_message_addresses_email "
+                    "ON message_addresses(email, role, message_id)")) {
+        return false;
+    }
+
+    // MIME leaves from BODYSTRUCTURE, recorded with the headers; no rows means the structure
+    // has not been fetched yet. blob_hash names the part's decoded content in the BlobStore
+    // once it has been fetched. local_path is the file layout before the store; PartFetcher
+    // moves such a file into the store the next time the part is asked for.
+    if (!query.exec(
+            "CREATE TABLE IF NOT EXISTS message_parts ("
+            "  id INTEGER PRIMARY KEY,"
+            "  message_id INTEGER NOT NULL,"
+            "  part_id TEXT NOT NULL,"
+            "  content_type TEXT NOT NULL,"
+            "  charset TEXT NOT NULL DEFAULT '',"
+            "  transfer_encoding TEXT NOT NULL DEFAULT '',"
+            "  filename TEXT NOT NULL DEFAULT '',"
+            "  content_id TEXT NOT NULL DEFAULT '',"
+            "  size INTEGER NOT NULL DEFAULT 0,"
+            "  is_attachment INTEGER NOT NULL DEFAULT 0,"
+            "  local_path TEXT NOT NULL DEFAULT '',"
+            "  blob_hash TEXT NOT NULL DEFAULT '',"
+            "  FOREIGN KEY(message_id) REFERENCES messages(id)"
+            ")")) {
+        return false;
+    }
+    if (!query.exec("CREATE UNIQUE INDEX IF NOT EXISTS ux_message_parts_message ON message_parts(message_id, part_id)")) {
+        return false;
+    }
+    // Messages are deleted from several places (expunge, UIDVALIDITY reset, stale folders).
+    if (!query.exec(
+            "CREATE TRIGGER IF NOT EXISTS trg_messages_delete_parts AFTER DELETE ON messages "
+            "BEGIN DELETE FROM message_parts WHERE message_id=old.id; END")) {
+        return false;
+    }
+    if (!query.exec(
+            "CREATE TRIGGER IF NOT EXISTS trg_messages_delete_flags AFTER DELETE ON messages "
+            "BEGIN DELETE FROM message_flags WHERE message_id=old.id; "
+            "DELETE FROM message_addresses WHERE message_id=old.id; END")) {
+        return false;
+    }
+
+    // Content in the BlobStore: where it is (segment 0 for a file of its own) and how many
+    // message_parts rows name it. The triggers below keep refs, so a reference and its count
+    // commit together.
+    if (!query.exec(
+            "CREATE TABLE IF NOT EXISTS blobs ("
+            "  hash TEXT PRIMARY KEY,"
+            "  size INTEGER NOT NULL,"
+            "  segment INTEGER NOT NULL,"
+            "  offset INTEGER NOT NULL,"
+            "  refs INTEGER NOT NULL DEFAULT 0,"
+            "  created_at INTEGER NOT NULL"
+            ") WITHOUT ROWID")) {
+        return false;
+    }
+    if (!query.exec("CREATE INDEX IF NOT EXISTS idx_blobs_unreferenced ON blobs(created_at) WHERE refs<=0")) {
+        return false;
+    }
+    if (!query.exec(
+            "CREATE TRIGGER IF NOT EXISTS trg_message_parts_blob_update AFTER UPDATE OF blob_hash ON message_parts "
+            "WHEN old.blob_hash IS NOT new.blob_hash "
+            "BEGIN UPDATE blobs SET refs=refs-1 WHERE hash=old.blob_hash; "
+            "UPDATE blobs SET refs=refs+1 WHERE hash=new.blob_hash; END")) {
+        return false;
+    }
+    if (!query.exec(
+            "CREATE TRIGGER IF NOT EXISTS trg_message_parts_blob_insert AFTER INSERT ON message_parts "
+            "WHEN new.blob_hash<>'' "
+            "BEGIN UPDATE blobs SET refs=refs+1 WHERE hash=new.blob_hash; END")) {
+        return false;
+    }
+    if (!query.exec(
+            "CREATE TRIGGER IF NOT EXISTS trg_message_parts_blob_delete AFTER DELETE ON message_parts "
+            "WHEN old.blob_hash<>'' "
+            "BEGIN UPDATE blobs SET refs=refs-1 WHERE hash=old.blob_hash; END")) {
+        return false;
+    }
+
+    // Messages waiting for the full-text index (see Reindexer). version moves on each time a
+    // queued message is queued again. Code that deletes messages queues them itself
+    // (ReindexQueue).
+    if (!query.exec(
+            "CREATE TABLE IF NOT EXISTS fts_queue ("
+            "  message_id INTEGER PRIMARY KEY,"
+            "  deleted INTEGER NOT NULL DEFAULT 0,"
+            "  version INTEGER NOT NULL DEFAULT 0"
+            ")")) {
         return false;
     }
 
@@ -155,4 +356,22 @@ bool Schema::MigrateToV2()
     return EnsureTables();
 }
 
+bool Schema::MigrateToV3()
+{
+    // Folders resolved before the upsert may be listed more than once; the first row of each
+    // stays. Nothing else in a v2 database refers to folder ids.
+    QSqlQuery query(db_.Handle());
+    if (!db_.Handle().transaction()) {
+        return false;
+    }
+    if (!query.exec("DROP INDEX IF EXISTS idx_folders_remote_name")
+        || !query.exec("DELETE FROM folders WHERE id NOT IN "
+                       "(SELECT MIN(id) FROM folders GROUP BY account_id, remote_name)")
+        || !query.exec("CREATE UNIQUE INDEX IF NOT EXISTS ux_folders_remote_name ON folders(account_id, remote_name)")) {
+        db_.Handle().rollback();
+        return false;
+    }
+    return db_.Handle().commit();
+}
+
 } // namespace ngks::core::storage
\ No newline at end of file
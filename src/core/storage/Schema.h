@@ -15,6 +15,7 @@ private:
     int CurrentVersion() const;
     bool SetVersion(int version);
     bool MigrateToV2();
+    bool MigrateToV3();
 
     Db& db_;
 };
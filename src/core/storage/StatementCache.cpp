@@ -0,0 +1,79 @@
+#include "core/storage/StatementCache.h"
+
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+
+namespace ngks::core::storage {
+
+StatementCache::StatementCache(QSqlDatabase& db, int capacity)
+    : db_(db)
+    , capacity_(qMax(1, capacity))
+{
+}
+
+StatementCache::~StatementCache() = default;
+
+QSqlQuery* StatementCache::Get(const QString& sql, QString& outError)
+{
+    ++clock_;
+    const auto it = entries_.find(sql);
+    if (it != entries_.end()) {
+        ++hits_;
+        it->second.lastUse = clock_;
+        QSqlQuery* query = it->second.query.get();
+        // finish() resets the statement but keeps it prepared; the caller rebinds every value.
+        query->finish();
+        return query;
+    }
+
+    ++misses_;
+    auto query = std::make_unique<QSqlQuery>(db_);
+    query->setForwardOnly(true);
+    if (!query->prepare(sql)) {
+        outError = query->lastError().text();
+        return nullptr;
+    }
+    if (static_cast<int>(entries_.size()) >= capacity_) {
+        EvictOldest();
+    }
+    Entry& entry = entries_[sql];
+    entry.query = std::move(query);
+    entry.lastUse = clock_;
+    return entry.query.get();
+}
+
+void StatementCache::Clear()
+{
+    entries_.clear();
+}
+
+int StatementCache::Size() const
+{
+    return static_cast<int>(entries_.size());
+}
+
+qint64 StatementCache::Hits() const
+{
+    return hits_;
+}
+
+qint64 StatementCache::Misses() const
+{
+    return misses_;
+}
+
+void StatementCache::EvictOldest()
+{
+    auto oldest = entries_.end();
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (oldest == entries_.end() || it->second.lastUse < oldest->second.lastUse) {
+            oldest = it;
+        }
+    }
+    if (oldest != entries_.end()) {
+        entries_.erase(oldest);
+    }
+}
+
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <QString>
+#include <memory>
+#include <unordered_map>
+
+class QSqlDatabase;
+class QSqlQuery;
+
+namespace ngks::core::storage {
+
+// Prepared statements of one connection, keyed by SQL text, so hot queries are parsed and
+// planned once instead of on every call. A statement handed out again is reset first, which
+// also ends any result set still open on it: a caller must not run the same SQL again while
+// iterating its rows. Past the capacity the least recently used statement is dropped.
+class StatementCache {
+public:
+    explicit StatementCache(QSqlDatabase& db, int capacity = 64);
+    ~StatementCache();
+
+    StatementCache(const StatementCache&) = delete;
+    StatementCache& operator=(const StatementCache&) = delete;
+
+    // The prepared, forward-only statement for sql; nullptr if it does not prepare. The pointer
+    // stays valid until the statement is evicted, so hold it for one unit of work, not longer.
+    QSqlQuery* Get(const QString& sql, QString& outError);
+    void Clear();
+
+    int Size() const;
+    qint64 Hits() const;
+    qint64 Misses() const;
+
+private:
+    struct Entry {
+        std::unique_ptr<QSqlQuery> query;
+        quint64 lastUse = 0;
+    };
+
+    void EvictOldest();
+
+    QSqlDatabase& db_;
+    int capacity_;
+    // std:: rather than QHash: entries own their statements and cannot be copied.
+    std::unordered_map<QString, Entry> entries_;
+    quint64 clock_ = 0;
+    qint64 hits_ = 0;
+    qint64 misses_ = 0;
+};
+
+}
@@ -5,6 +5,9 @@
 #include <QSqlQuery>
 #include <QVariant>
 
+#include "core/storage/Db.h"
+#include "platform/common/Paths.h"
+
 namespace ngks::ui::models {
 
 FolderTreeModel::FolderTreeModel(QObject* parent)
@@ -36,10 +39,12 @@ void FolderTreeModel::Reload()
     hasResolvedAccounts_ = false;
     firstInboxIndex_ = QModelIndex();
 
-    QSqlDatabase db = QSqlDatabase::database(); // default connection
-    if (!db.isValid() || !db.isOpen()) {
+    // The UI thread's own connection, so a reload reads alongside sync transactions.
+    ngks::core::storage::Db& storage = ngks::core::storage::Db::ForThread(ngks::platform::common::DbFilePath());
+    if (!storage.IsOpen()) {
         return;
     }
+    QSqlDatabase& db = storage.Handle();
 
     QSqlQuery qa(db);
     if (!qa.exec("SELECT id, email, provider FROM accounts WHERE status='RESOLVED' ORDER BY id ASC")) {
@@ -60,8 +65,10 @@ void FolderTreeModel::Reload()
 
         QSqlQuery qf(db);
         qf.prepare(
-            "SELECT id, remote_name, display_name, delimiter, attrs_json, special_use "
-            "FROM folders WHERE account_id = :aid ORDER BY id ASC");
+            "SELECT f.id, f.remote_name, f.display_name, f.delimiter, f.attrs_json, f.special_use, "
+            "COALESCE(s.messages, -1), COALESCE(s.unseen, -1) "
+            "FROM folders f LEFT JOIN folder_status s ON s.folder_id = f.id "
+            "WHERE f.account_id = :aid ORDER BY f.id ASC");
         qf.bindValue(":aid", accountId);
         if (!qf.exec()) {
             continue;
@@ -79,6 +86,8 @@ void FolderTreeModel::Reload()
             }
             const QString attrsJson = qf.value(4).toString();
             const QString specialUse = qf.value(5).toString();
+            const qint64 messageCount = qf.value(6).toLongLong();
+            const qint64 unseenCount = qf.value(7).toLongLong();
 
             QStringList parts = remoteName.split(delimiter, Qt::SkipEmptyParts);
             if (parts.isEmpty()) {
@@ -96,13 +105,19 @@ void FolderTreeModel::Reload()
                 QStandardItem* node = pathIndex.value(currentPath, nullptr);
                 if (!node) {
                     const bool isLeaf = (i == parts.size() - 1);
-                    node = MakeItem(isLeaf && !displayName.isEmpty() ? displayName : parts[i]);
+                    QString label = isLeaf && !displayName.isEmpty() ? displayName : parts[i];
+                    if (isLeaf && unseenCount > 0) {
+                        label += QString(" (%1)").arg(unseenCount);
+                    }
+                    node = MakeItem(label);
                     node->setData(accountId, AccountIdRole);
                     node->setData(isLeaf ? folderId : -1, FolderIdRole);
                     node->setData(isLeaf ? specialUse.toLower() : QString(), FolderRoleRole);
                     node->setData(false, IsAccountNodeRole);
                     if (isLeaf) {
                         node->setData(remoteName, Qt::ToolTipRole);
+                        node->setData(messageCount, MessageCountRole);
+                        node->setData(unseenCount, UnseenCountRole);
                     }
                     parent->appendRow(node);
                     pathIndex.insert(currentPath, node);
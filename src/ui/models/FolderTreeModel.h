@@ -10,7 +10,10 @@ public:
         AccountIdRole = Qt::UserRole + 1,
         FolderIdRole,
         FolderRoleRole,
-        IsAccountNodeRole
+        IsAccountNodeRole,
+        // From folder_status; -1 when unknown.
+        MessageCountRole,
+        UnseenCountRole
     };
 
     explicit FolderTreeModel(QObject* parent = nullptr);
@@ -0,0 +1,178 @@
+// Blob store at scale: stores the parts of synthetic messages that each appear in several
+// folders (as Gmail labels do) and share attachments, so most puts are duplicates. Prints put
+// rate, logical against stored bytes, mapped read latency, and what Collect reclaims once a
+// share of the messages is deleted.
+//   ngksmail_bench_blob_store --messages 100000 --folders 3 --reads 20000
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QRandomGenerator>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QString>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QVariant>
+#include <algorithm>
+#include <vector>
+
+#include "core/storage/BlobStore.h"
+#include "core/storage/Db.h"
+#include "core/storage/Schema.h"
+
+using namespace ngks::core::storage;
+
+namespace {
+
+// Distinct attachments the messages draw from; each is larger than the pack threshold.
+constexpr int kAttachments = 200;
+
+QByteArray Body(QRandomGenerator& random, int message)
+{
+    QByteArray body = QByteArray("Message ") + QByteArray::number(message) + "\n";
+    const int lines = 5 + random.bounded(60);
+    for (int i = 0; i < lines; ++i) {
+        body += QByteArray::number(random.generate64(), 36).repeated(2) + "\n";
+    }
+    return body;
+}
+
+qint64 DirBytes(const QString& path)
+{
+    qint64 total = 0;
+    QDirIterator it(path, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        total += QFileInfo(it.next()).size();
+    }
+    return total;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addOption({"messages", "Distinct messages.", "n", "100000"});
+    parser.addOption({"folders", "Folders each message appears in.", "n", "3"});
+    parser.addOption({"reads", "Random reads timed.", "n", "20000"});
+    parser.process(app);
+    const int messages = parser.value("messages").toInt();
+    const int folders = qMax(1, parser.value("folders").toInt());
+    const int reads = qMax(1, parser.value("reads").toInt());
+
+    QTextStream out(stdout);
+    QTemporaryDir dir;
+    Db db("ngks_bench_blob_store");
+    if (!dir.isValid() || !db.Open(dir.filePath("bench.sqlite").toStdString()) || !Schema(db).Ensure()) {
+        out << "failed to set up the bench store\n";
+        return 1;
+    }
+    BlobStoreOptions options;
+    // Everything counts as old enough to collect.
+    options.collectGraceSecs = -1;
+    BlobStore store(dir.filePath("blobs").toStdString(), options);
+
+    QRandomGenerator random(42);
+    std::vector<QByteArray> attachments;
+    for (int i = 0; i < kAttachments; ++i) {
+        attachments.push_back(QByteArray(static_cast<int>(options.packThreshold) + random.bounded(1 << 20),
+                                         static_cast<char>('a' + i % 26)));
+    }
+
+    QSqlDatabase& sqlDb = db.Handle();
+    QSqlQuery message(sqlDb);
+    message.prepare("INSERT INTO messages(folder_id, uid, message_id, has_header) VALUES(?, ?, ?, 1)");
+    QSqlQuery part(sqlDb);
+    part.prepare("INSERT INTO message_parts(message_id, part_id, content_type, blob_hash) VALUES(?, ?, ?, ?)");
+
+    QString error;
+    std::vector<QString> hashes;
+    qint64 logicalBytes = 0;
+    qint64 puts = 0;
+    QElapsedTimer timer;
+    timer.start();
+    for (int m = 0; m < messages; ++m) {
+        const QByteArray body = Body(random, m);
+        const QByteArray& attachment = attachments[random.bounded(kAttachments)];
+        const bool withAttachment = random.bounded(5) == 0;
+        for (int f = 1; f <= folders; ++f) {
+            QString bodyHash;
+            QString attachmentHash;
+            if (!store.Put(db, body, bodyHash, error)
+                || (withAttachment && !store.Put(db, attachment, attachmentHash, error))) {
+                out << "put failed: " << error << "\n";
+                return 1;
+            }
+            puts += withAttachment ? 2 : 1;
+            logicalBytes += body.size() + (withAttachment ? attachment.size() : 0);
+
+            message.addBindValue(f);
+            message.addBindValue(m + 1);
+            message.addBindValue(QString("<%1@bench.example>").arg(m));
+            if (!message.exec()) {
+                out << "insert failed: " << message.lastError().text() << "\n";
+                return 1;
+            }
+            const qint64 messageId = message.lastInsertId().toLongLong();
+            part.addBindValue(messageId);
+            part.addBindValue("1");
+            part.addBindValue("text/plain");
+            part.addBindValue(bodyHash);
+            part.exec();
+            if (withAttachment) {
+                part.addBindValue(messageId);
+                part.addBindValue("2");
+                part.addBindValue("application/pdf");
+                part.addBindValue(attachmentHash);
+                part.exec();
+            }
+            hashes.push_back(bodyHash);
+        }
+    }
+    const qint64 putMs = timer.elapsed();
+    out << "put count=" << puts << " ms=" << putMs << " per_sec=" << (puts * 1000) / qMax<qint64>(putMs, 1)
+        << " logical_mb=" << logicalBytes / (1024 * 1024)
+        << " stored_mb=" << DirBytes(dir.filePath("blobs")) / (1024 * 1024) << "\n";
+
+    std::vector<qint64> samples;
+    qint64 checksum = 0;
+    for (int i = 0; i < reads; ++i) {
+        const QString& hash = hashes[random.bounded(static_cast<int>(hashes.size()))];
+        timer.restart();
+        BlobView view;
+        if (!store.Read(db, hash, view, error)) {
+            out << "read failed: " << error << "\n";
+            return 1;
+        }
+        checksum += view.Data().isEmpty() ? 0 : view.Data().back();
+        samples.push_back(timer.nsecsElapsed());
+    }
+    std::sort(samples.begin(), samples.end());
+    out << "read count=" << samples.size() << " median_us=" << samples[samples.size() / 2] / 1e3
+        << " p99_us=" << samples[samples.size() * 99 / 100] / 1e3 << " checksum=" << checksum << "\n";
+
+    // Expunge every folder's copy of two messages in three; their bodies lose their last
+    // reference, shared attachments mostly do not.
+    QSqlQuery remove(sqlDb);
+    if (!remove.exec("DELETE FROM messages WHERE uid % 3 <> 0")) {
+        out << "delete failed: " << remove.lastError().text() << "\n";
+        return 1;
+    }
+    BlobCollectStats collected;
+    timer.restart();
+    if (!store.Collect(db, collected, error)) {
+        out << "collect failed: " << error << "\n";
+        return 1;
+    }
+    out << "collect ms=" << timer.elapsed() << " blobs=" << collected.blobsRemoved
+        << " reclaimed_mb=" << collected.bytesReclaimed / (1024 * 1024)
+        << " segments=" << collected.segmentsCompacted
+        << " stored_mb=" << DirBytes(dir.filePath("blobs")) / (1024 * 1024) << "\n";
+    return 0;
+}
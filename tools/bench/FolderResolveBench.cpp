@@ -0,0 +1,334 @@
+// Folder resolution at scale: builds ResolveAccount's folder list for a synthetic account with
+// tens of thousands of mailboxes, offline from LIST/SPECIAL-USE/STATUS responses and end to
+// end against the in-process fake IMAP server. Prints CPU ms for the offline merge (also for
+// the old nested-loop merge with per-folder JSON, at a size it finishes) and wall ms for the
+// full resolve.
+//   ngksmail_bench_folder_resolve --folders 50000 --legacy-folders 5000
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+#include <QTextStream>
+#include <QThread>
+#include <QVector>
+#include <condition_variable>
+#include <ctime>
+#include <mutex>
+
+#include "FakeImapServer.h"
+#include "core/logging/ProtocolTranscript.h"
+#include "core/mail/providers/imap/ImapConnectionPool.h"
+#include "core/mail/providers/imap/ImapFolderList.h"
+#include "core/mail/providers/imap/ImapProvider.h"
+#include "core/mail/providers/imap/ImapResponseParsers.h"
+#include "core/mail/providers/imap/ImapTokenizer.h"
+
+using namespace ngks::core::mail::providers::imap;
+using ngks::tools::fakeimap::FakeImapConfig;
+using ngks::tools::fakeimap::FakeMailbox;
+using ngks::tools::fakeimap::FakeImapServer;
+
+namespace {
+
+class ServerThread : public QThread {
+public:
+    explicit ServerThread(FakeImapConfig config)
+        : config_(std::move(config))
+    {
+    }
+
+    quint16 WaitForPort()
+    {
+        std::unique_lock<std::mutex> lk(mu_);
+        ready_.wait(lk, [this]() { return started_; });
+        return port_;
+    }
+
+protected:
+    void run() override
+    {
+        FakeImapServer server(config_);
+        QString error;
+        const bool listening = server.Listen(0, error);
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            port_ = listening ? server.Port() : 0;
+            started_ = true;
+        }
+        ready_.notify_all();
+        if (listening) {
+            exec();
+        }
+    }
+
+private:
+    FakeImapConfig config_;
+    std::mutex mu_;
+    std::condition_variable ready_;
+    bool started_ = false;
+    quint16 port_ = 0;
+};
+
+QString FolderName(int i)
+{
+    if (i == 0) {
+        return "INBOX";
+    }
+    static const char* const kSpecial[] = {"Sent", "Drafts", "Trash", "Archive", "Junk"};
+    if (i <= 5) {
+        return QString::fromLatin1(kSpecial[i - 1]);
+    }
+    return QString("Projects/Area %1/Team %2/Folder %3").arg(i / 1000).arg(i / 50).arg(i);
+}
+
+QString SpecialFor(int i)
+{
+    static const char* const kSpecial[] = {"\\Sent", "\\Drafts", "\\Trash", "\\Archive", "\\Junk"};
+    return i >= 1 && i <= 5 ? QString::fromLatin1(kSpecial[i - 1]) : QString();
+}
+
+struct Responses {
+    QByteArray buffer;
+    QList<QByteArrayView> list;
+    QList<QByteArrayView> special;
+    QList<QByteArrayView> status;
+};
+
+// Lays the responses out as they sit in the receive buffer: LIST-STATUS style, each STATUS
+// after its LIST line, then the SPECIAL-USE LIST.
+void BuildResponses(int folders, Responses& out)
+{
+    QList<qsizetype> listOffsets;
+    QList<qsizetype> statusOffsets;
+    QList<qsizetype> specialOffsets;
+    out.buffer.reserve(static_cast<qsizetype>(folders) * 200);
+    for (int i = 0; i < folders; ++i) {
+        const QByteArray name = FolderName(i).toUtf8();
+        const QString special = SpecialFor(i);
+        listOffsets.push_back(out.buffer.size());
+        out.buffer += "* LIST (" + QByteArray(i % 7 == 0 ? "\\HasChildren" : "\\HasNoChildren")
+            + (special.isEmpty() ? QByteArray() : ' ' + special.toLatin1()) + ") \"/\" \"" + name + "\"\r\n";
+        statusOffsets.push_back(out.buffer.size());
+        out.buffer += "* STATUS \"" + name + "\" (MESSAGES " + QByteArray::number(i * 3) + " UNSEEN "
+            + QByteArray::number(i % 11) + " UIDNEXT " + QByteArray::number(i * 3 + 1) + " UIDVALIDITY 7)\r\n";
+    }
+    for (int i = 1; i <= 5 && i < folders; ++i) {
+        specialOffsets.push_back(out.buffer.size());
+        out.buffer += "* LIST (\\HasNoChildren " + SpecialFor(i).toLatin1() + ") \"/\" \"" + FolderName(i).toUtf8() + "\"\r\n";
+    }
+    const auto view = [&out](qsizetype start) {
+        const qsizetype end = out.buffer.indexOf("\r\n", start);
+        return QByteArrayView(out.buffer.constData() + start, end - start);
+    };
+    for (const qsizetype offset : listOffsets) {
+        out.list.push_back(view(offset));
+    }
+    for (const qsizetype offset : statusOffsets) {
+        out.status.push_back(view(offset));
+    }
+    for (const qsizetype offset : specialOffsets) {
+        out.special.push_back(view(offset));
+    }
+}
+
+double CpuMsSince(std::clock_t start)
+{
+    return 1000.0 * static_cast<double>(std::clock() - start) / CLOCKS_PER_SEC;
+}
+
+// Current code path.
+qint64 RunBuilder(const Responses& responses, double& outCpuMs)
+{
+    const std::clock_t start = std::clock();
+    FolderListBuilder builder;
+    for (int i = 0; i < responses.list.size(); ++i) {
+        builder.AddListResponse(responses.list[i]);
+        builder.AddStatusResponse(responses.status[i]);
+    }
+    for (const QByteArrayView response : responses.special) {
+        builder.AddSpecialUseResponse(response);
+    }
+    const QVector<ResolvedFolder> folders = builder.Finish("/");
+    qint64 checksum = 0;
+    for (const ResolvedFolder& folder : folders) {
+        checksum += folder.AttrsJson().size() + folder.specialUse.size() + folder.status.messages;
+    }
+    outCpuMs = CpuMsSince(start);
+    return checksum;
+}
+
+struct LegacyFolder {
+    QString remoteName;
+    QString displayName;
+    QString attrsJson;
+    QString specialUse;
+    ResolvedFolderStatus status;
+};
+
+void AppendLegacy(QByteArrayView response, QVector<LegacyFolder>& folders)
+{
+    ImapListEntry entry;
+    if (!ParseListResponse(response, entry)) {
+        return;
+    }
+    LegacyFolder f;
+    f.remoteName = entry.MailboxName();
+    const QString delimiter = QString::fromUtf8(ImapTokenizer::Unescape(entry.delimiter));
+    QJsonArray attrs;
+    for (const QByteArrayView attr : entry.attributes) {
+        attrs.push_back(QString::fromLatin1(attr));
+        if (attr.size() > 1 && attr[1] != 'H') {
+            f.specialUse = QString::fromLatin1(attr);
+        }
+    }
+    QJsonObject attrsObj;
+    attrsObj.insert("attrs", attrs);
+    const QStringList parts = f.remoteName.split(delimiter.isEmpty() ? QChar('/') : delimiter[0], Qt::SkipEmptyParts);
+    f.displayName = parts.isEmpty() ? f.remoteName : parts.last();
+    f.attrsJson = QString::fromUtf8(QJsonDocument(attrsObj).toJson(QJsonDocument::Compact));
+    folders.push_back(f);
+}
+
+// The previous code path: JSON per folder and a nested-loop special-use merge.
+qint64 RunLegacy(const Responses& responses, int folders, double& outCpuMs)
+{
+    const std::clock_t start = std::clock();
+    QVector<LegacyFolder> out;
+    QVector<LegacyFolder> special;
+    QHash<QString, ResolvedFolderStatus> statuses;
+    for (int i = 0; i < folders; ++i) {
+        AppendLegacy(responses.list[i], out);
+        ImapStatusEntry entry;
+        if (ParseStatusResponse(responses.status[i], entry)) {
+            statuses[entry.MailboxName()].messages = entry.messages;
+        }
+    }
+    // The old merge compared every special-use entry against every folder; XLIST servers
+    // return the whole tree there, so that is folders x folders.
+    for (int i = 0; i < folders; ++i) {
+        AppendLegacy(responses.list[i], special);
+    }
+    for (const LegacyFolder& folder : special) {
+        for (LegacyFolder& existing : out) {
+            if (existing.remoteName.compare(folder.remoteName, Qt::CaseInsensitive) == 0 && !folder.specialUse.isEmpty()) {
+                existing.specialUse = folder.specialUse;
+            }
+        }
+    }
+    qint64 checksum = 0;
+    for (LegacyFolder& folder : out) {
+        folder.status = statuses.value(folder.remoteName);
+        checksum += folder.attrsJson.size() + folder.specialUse.size() + folder.status.messages;
+    }
+    outCpuMs = CpuMsSince(start);
+    return checksum;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    const QCommandLineOption foldersOpt("folders", "Mailboxes in the synthetic account.", "n", "50000");
+    const QCommandLineOption legacyOpt("legacy-folders", "Mailboxes for the old merge (0: skip).", "n", "5000");
+    const QCommandLineOption roundsOpt("rounds", "Offline rounds; the best is reported.", "n", "5");
+    const QCommandLineOption offlineOpt("offline-only", "Skip the run against the fake server.");
+    parser.addOption(foldersOpt);
+    parser.addOption(legacyOpt);
+    parser.addOption(roundsOpt);
+    parser.addOption(offlineOpt);
+    parser.process(app);
+
+    const int folders = qMax(6, parser.value(foldersOpt).toInt());
+    const int legacyFolders = qBound(0, parser.value(legacyOpt).toInt(), folders);
+    const int rounds = qMax(1, parser.value(roundsOpt).toInt());
+
+    Responses responses;
+    BuildResponses(folders, responses);
+    out << "folders=" << folders << " response_bytes=" << responses.buffer.size() << "\n";
+
+    double best = -1;
+    qint64 checksum = 0;
+    for (int round = 0; round < rounds; ++round) {
+        double cpuMs = 0;
+        checksum = RunBuilder(responses, cpuMs);
+        best = best < 0 || cpuMs < best ? cpuMs : best;
+    }
+    out << "offline_builder_cpu_ms=" << best << " us_per_folder=" << best * 1000.0 / folders
+        << " checksum=" << checksum << "\n";
+
+    if (legacyFolders > 0) {
+        double cpuMs = 0;
+        checksum = RunLegacy(responses, legacyFolders, cpuMs);
+        out << "offline_legacy_cpu_ms=" << cpuMs << " folders=" << legacyFolders << " checksum=" << checksum << "\n";
+    }
+    out.flush();
+
+    if (parser.isSet(offlineOpt)) {
+        return 0;
+    }
+
+    ngks::core::logging::TranscriptOptions transcriptOptions;
+    transcriptOptions.level = ngks::core::logging::TranscriptLevel::Off;
+    ngks::core::logging::ProtocolTranscript::SetDefaultOptions(transcriptOptions);
+
+    FakeImapConfig config = FakeImapConfig::Default();
+    config.mailboxes.clear();
+    config.mailboxes.reserve(folders);
+    for (int i = 0; i < folders; ++i) {
+        FakeMailbox mailbox;
+        mailbox.name = FolderName(i);
+        mailbox.messages = i % 100;
+        config.mailboxes.push_back(mailbox);
+    }
+
+    ServerThread server(config);
+    server.start();
+    const quint16 port = server.WaitForPort();
+    if (port == 0) {
+        out << "fake server failed to listen\n";
+        return 1;
+    }
+
+    ResolveRequest request;
+    request.email = "bench@example.com";
+    request.host = "127.0.0.1";
+    request.port = port;
+    request.tls = false;
+    request.username = "bench";
+    request.password = "bench";
+    request.allowCompress = false;
+
+    ImapProvider provider;
+    QVector<ResolvedFolder> resolved;
+    QString error;
+    QString transcriptPath;
+    QElapsedTimer wall;
+    wall.start();
+    const bool ok = provider.ResolveAccount(request, resolved, error, transcriptPath);
+    const qint64 wallNs = wall.nsecsElapsed();
+    int withStatus = 0;
+    for (const ResolvedFolder& folder : resolved) {
+        withStatus += folder.hasStatus ? 1 : 0;
+    }
+    out << "resolve_account ok=" << (ok ? "true" : "false") << " folders=" << resolved.size()
+        << " with_status=" << withStatus << " wall_ms=" << wallNs / 1e6;
+    if (!ok) {
+        out << " error=" << error;
+    }
+    out << "\n";
+
+    ImapConnectionPool::Instance().CloseIdle();
+    server.quit();
+    server.wait();
+    return ok ? 0 : 1;
+}
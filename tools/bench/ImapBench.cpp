@@ -0,0 +1,309 @@
+// Throughput benchmark: ImapClient and ImapProvider against the in-process fake IMAP server.
+// The server runs on its own thread on 127.0.0.1; latency and bandwidth shaping are applied
+// server-side. Prints commands/s, MB/s of protocol data and p50/p99 round-trip latency.
+//   ngksmail_bench_imap --messages 20000 --message-bytes 4096 --latency-ms 0 --bandwidth-kbps 0
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QTextStream>
+#include <QThread>
+#include <QVector>
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+#include "FakeImapServer.h"
+#include "core/logging/ProtocolTranscript.h"
+#include "core/mail/providers/imap/ImapClient.h"
+#include "core/mail/providers/imap/ImapConnection.h"
+#include "core/mail/providers/imap/ImapConnectionPool.h"
+#include "core/mail/providers/imap/ImapProvider.h"
+
+using namespace ngks::core::mail::providers::imap;
+using ngks::tools::fakeimap::FakeImapConfig;
+using ngks::tools::fakeimap::FakeImapServer;
+
+namespace {
+
+class ServerThread : public QThread {
+public:
+    explicit ServerThread(FakeImapConfig config)
+        : config_(std::move(config))
+    {
+    }
+
+    quint16 WaitForPort()
+    {
+        std::unique_lock<std::mutex> lk(mu_);
+        ready_.wait(lk, [this]() { return started_; });
+        return port_;
+    }
+
+protected:
+    void run() override
+    {
+        FakeImapServer server(config_);
+        QString error;
+        const bool listening = server.Listen(0, error);
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            port_ = listening ? server.Port() : 0;
+            started_ = true;
+        }
+        ready_.notify_all();
+        if (listening) {
+            exec();
+        }
+    }
+
+private:
+    FakeImapConfig config_;
+    std::mutex mu_;
+    std::condition_variable ready_;
+    bool started_ = false;
+    quint16 port_ = 0;
+};
+
+struct Sample {
+    QString name;
+    int commands = 0;
+    qint64 elapsedNs = 0;
+    qint64 bytes = 0;
+    QVector<qint64> latenciesNs;
+};
+
+qint64 Percentile(QVector<qint64> values, double p)
+{
+    if (values.isEmpty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[static_cast<int>(p * (values.size() - 1))];
+}
+
+void Report(QTextStream& out, const Sample& s)
+{
+    const double seconds = s.elapsedNs / 1e9;
+    out << s.name << " commands=" << s.commands
+        << " cmds_per_s=" << (seconds > 0 ? s.commands / seconds : 0.0)
+        << " mb_per_s=" << (seconds > 0 ? s.bytes / 1e6 / seconds : 0.0);
+    if (!s.latenciesNs.isEmpty()) {
+        out << " p50_ms=" << Percentile(s.latenciesNs, 0.50) / 1e6
+            << " p99_ms=" << Percentile(s.latenciesNs, 0.99) / 1e6;
+    }
+    out << "\n";
+    out.flush();
+}
+
+bool IsOk(const QStringList& lines, const QString& tag)
+{
+    return !lines.isEmpty() && lines.last().startsWith(tag + " OK", Qt::CaseInsensitive);
+}
+
+qint64 BytesIn(const ImapClient& client)
+{
+    return client.WireStats().protocolBytesIn;
+}
+
+// Runs command `rounds` times one after another and records each round trip.
+Sample Sequential(ImapClient& client, const QString& name, const QString& command, const QStringList& collect, int rounds)
+{
+    Sample s;
+    s.name = name;
+    const qint64 bytesBefore = BytesIn(client);
+    QElapsedTimer total;
+    total.start();
+    for (int i = 0; i < rounds; ++i) {
+        QElapsedTimer rtt;
+        rtt.start();
+        const QString tag = client.Submit(command, collect);
+        if (!IsOk(client.Await(tag, 60000), tag)) {
+            break;
+        }
+        s.latenciesNs.push_back(rtt.nsecsElapsed());
+        ++s.commands;
+    }
+    s.elapsedNs = total.nsecsElapsed();
+    s.bytes = BytesIn(client) - bytesBefore;
+    return s;
+}
+
+// Keeps `depth` commands in flight.
+Sample Pipelined(ImapClient& client, const QString& name, const QString& command, int rounds, int depth)
+{
+    Sample s;
+    s.name = name;
+    const qint64 bytesBefore = BytesIn(client);
+    QElapsedTimer total;
+    total.start();
+    while (s.commands < rounds) {
+        QStringList tags;
+        for (int i = 0; i < depth && s.commands + tags.size() < rounds; ++i) {
+            tags.push_back(client.Submit(command));
+        }
+        for (const QString& tag : tags) {
+            if (!IsOk(client.Await(tag, 60000), tag)) {
+                s.elapsedNs = total.nsecsElapsed();
+                return s;
+            }
+            ++s.commands;
+        }
+    }
+    s.elapsedNs = total.nsecsElapsed();
+    s.bytes = BytesIn(client) - bytesBefore;
+    return s;
+}
+
+// One large streamed FETCH; throughput is what matters, so one command per sample.
+Sample Streamed(ImapClient& client, const QString& name, const QString& command)
+{
+    Sample s;
+    s.name = name;
+    int responses = 0;
+    const qint64 bytesBefore = BytesIn(client);
+    QElapsedTimer total;
+    total.start();
+    const QString tag = client.SubmitStreaming(command, {"FETCH"}, [&responses](QByteArrayView) { ++responses; });
+    if (IsOk(client.Await(tag, 10 * 60 * 1000), tag)) {
+        s.commands = 1;
+    }
+    s.elapsedNs = total.nsecsElapsed();
+    s.latenciesNs.push_back(s.elapsedNs);
+    s.bytes = BytesIn(client) - bytesBefore;
+    s.name += QString(" responses=%1").arg(responses);
+    return s;
+}
+
+Sample IdleCycles(ImapClient& client, int rounds)
+{
+    Sample s;
+    s.name = "idle_enter_done";
+    QElapsedTimer total;
+    total.start();
+    for (int i = 0; i < rounds; ++i) {
+        QElapsedTimer rtt;
+        rtt.start();
+        if (!client.StartIdle(nullptr, nullptr) || !client.StopIdle(10000)) {
+            break;
+        }
+        s.latenciesNs.push_back(rtt.nsecsElapsed());
+        ++s.commands;
+    }
+    s.elapsedNs = total.nsecsElapsed();
+    return s;
+}
+
+Sample Resolve(const ResolveRequest& request, int rounds)
+{
+    Sample s;
+    s.name = "provider_resolve_account";
+    ImapProvider provider;
+    QElapsedTimer total;
+    total.start();
+    for (int i = 0; i < rounds; ++i) {
+        QElapsedTimer rtt;
+        rtt.start();
+        QVector<ResolvedFolder> folders;
+        QString error;
+        QString transcriptPath;
+        if (!provider.ResolveAccount(request, folders, error, transcriptPath)) {
+            break;
+        }
+        s.latenciesNs.push_back(rtt.nsecsElapsed());
+        ++s.commands;
+    }
+    s.elapsedNs = total.nsecsElapsed();
+    ImapConnectionPool::Instance().CloseIdle();
+    return s;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    const QCommandLineOption messagesOpt("messages", "Messages in INBOX.", "n", "20000");
+    const QCommandLineOption messageBytesOpt("message-bytes", "Approximate size of each message.", "bytes", "4096");
+    const QCommandLineOption latencyOpt("latency-ms", "Server-side delay before each response.", "ms", "0");
+    const QCommandLineOption bandwidthOpt("bandwidth-kbps", "Server outbound limit in KiB/s (0: unlimited).", "kbps", "0");
+    const QCommandLineOption roundsOpt("rounds", "Round trips for the latency cases.", "n", "2000");
+    parser.addOption(messagesOpt);
+    parser.addOption(messageBytesOpt);
+    parser.addOption(latencyOpt);
+    parser.addOption(bandwidthOpt);
+    parser.addOption(roundsOpt);
+    parser.process(app);
+
+    FakeImapConfig config = FakeImapConfig::Default();
+    config.mailboxes[0].messages = qMax(1, parser.value(messagesOpt).toInt());
+    config.messageBytes = qMax(256, parser.value(messageBytesOpt).toInt());
+    config.latencyMs = qMax(0, parser.value(latencyOpt).toInt());
+    config.bandwidthBytesPerSec = qMax<qint64>(0, parser.value(bandwidthOpt).toLongLong()) * 1024;
+    const int rounds = qMax(1, parser.value(roundsOpt).toInt());
+    // With latency, keep the sequential cases short enough to finish.
+    const int latencyRounds = config.latencyMs > 0 ? qMin(rounds, 200) : rounds;
+    const int messages = config.mailboxes[0].messages;
+
+    // Transcripts would measure the disk, not the client.
+    ngks::core::logging::TranscriptOptions transcriptOptions;
+    transcriptOptions.level = ngks::core::logging::TranscriptLevel::Off;
+    ngks::core::logging::ProtocolTranscript::SetDefaultOptions(transcriptOptions);
+
+    ServerThread server(config);
+    server.start();
+    const quint16 port = server.WaitForPort();
+    if (port == 0) {
+        out << "fake imapd failed to listen\n";
+        server.wait();
+        return 1;
+    }
+    out << "fake_imapd port=" << port << " messages=" << messages << " message_bytes=" << config.messageBytes
+        << " latency_ms=" << config.latencyMs << " bandwidth_bps=" << config.bandwidthBytesPerSec << "\n";
+
+    {
+        ImapClient client;
+        QElapsedTimer connectTimer;
+        connectTimer.start();
+        if (!client.Connect("127.0.0.1", port, false, QString()) || client.ReadGreeting().isEmpty()) {
+            out << "connect failed: " << client.LastError() << "\n";
+            server.quit();
+            server.wait();
+            return 1;
+        }
+        const QString loginTag = client.Submit("LOGIN bench bench");
+        client.Await(loginTag);
+        out << "connect_login_ms=" << connectTimer.nsecsElapsed() / 1e6 << "\n";
+
+        Report(out, Sequential(client, "noop_sequential", "NOOP", {}, latencyRounds));
+        Report(out, Pipelined(client, "noop_pipelined_depth16", "NOOP", rounds, 16));
+        Report(out, Sequential(client, "list_all", "LIST \"\" \"*\"", {"LIST"}, qMin(latencyRounds, 500)));
+        Report(out, Sequential(client, "status_inbox", "STATUS \"INBOX\" (MESSAGES UIDNEXT UNSEEN)", {"STATUS"},
+                               qMin(latencyRounds, 500)));
+        Report(out, Sequential(client, "select_inbox", "SELECT \"INBOX\"", {"EXISTS"}, 1));
+        Report(out, Sequential(client, "uid_search_all", "UID SEARCH ALL", {"SEARCH"}, 20));
+        Report(out, Streamed(client, "uid_fetch_headers_all", "UID FETCH 1:* (UID FLAGS RFC822.SIZE INTERNALDATE)"));
+        Report(out, Streamed(client, "uid_fetch_body_peek",
+                             QString("UID FETCH 1:%1 (UID BODY.PEEK[])").arg(qMin(messages, 5000))));
+        Report(out, IdleCycles(client, qMin(latencyRounds, 200)));
+        client.Disconnect();
+    }
+
+    ResolveRequest request;
+    request.email = "bench@example.com";
+    request.host = "127.0.0.1";
+    request.port = port;
+    request.tls = false;
+    request.username = "bench";
+    request.password = "bench";
+    Report(out, Resolve(request, 20));
+
+    server.quit();
+    server.wait();
+    return 0;
+}
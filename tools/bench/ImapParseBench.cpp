@@ -0,0 +1,124 @@
+// Microbenchmark: in-place IMAP tokenizer vs. the per-line QString + QRegularExpression path.
+// Parses a synthetic 50k-line LIST/FETCH response both ways and prints ns/line for each.
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QList>
+#include <QRegularExpression>
+#include <QString>
+#include <QTextStream>
+
+#include "core/mail/providers/imap/ImapResponseParsers.h"
+
+using namespace ngks::core::mail::providers::imap;
+
+namespace {
+
+constexpr int kLines = 50000;
+constexpr int kRounds = 5;
+
+// Builds the response the way it sits in the receive buffer, plus line offsets into it.
+QByteArray BuildResponse(QList<QByteArrayView>& outLines)
+{
+    QByteArray buffer;
+    buffer.reserve(kLines * 110);
+    QList<qsizetype> offsets;
+    for (int i = 0; i < kLines; ++i) {
+        offsets.push_back(buffer.size());
+        if (i % 2 == 0) {
+            buffer += QString("* LIST (\\HasNoChildren) \"/\" \"Projects/Area %1/Folder %2\"")
+                          .arg(i / 100)
+                          .arg(i)
+                          .toUtf8();
+        } else {
+            buffer += QString("* %1 FETCH (UID %2 FLAGS (\\Seen \\Answered) RFC822.SIZE %3 INTERNALDATE \"17-Jul-2024 02:44:25 -0700\")")
+                          .arg(i)
+                          .arg(100000 + i)
+                          .arg(2048 + i)
+                          .toUtf8();
+        }
+        buffer += "\r\n";
+    }
+    offsets.push_back(buffer.size());
+    for (int i = 0; i < kLines; ++i) {
+        outLines.push_back(QByteArrayView(buffer.constData() + offsets[i], offsets[i + 1] - offsets[i] - 2));
+    }
+    return buffer;
+}
+
+qint64 RunLegacy(const QList<QByteArrayView>& lines, qint64& checksum)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // Mirrors the pre-tokenizer code: UTF-16 conversion + trimmed() per line, then regexes.
+    QStringList converted;
+    for (const QByteArrayView raw : lines) {
+        converted.push_back(QString::fromUtf8(raw).trimmed());
+    }
+
+    const QRegularExpression listRe(
+        "^\\*\\s+(?:LIST|XLIST)\\s+\\(([^)]*)\\)\\s+\"([^\"]*)\"\\s+(.+)$",
+        QRegularExpression::CaseInsensitiveOption);
+    const QRegularExpression uidRe("\\bUID (\\d+)");
+    const QRegularExpression flagsRe("\\bFLAGS \\(([^)]*)\\)");
+    const QRegularExpression sizeRe("\\bRFC822\\.SIZE (\\d+)");
+
+    for (const QString& line : converted) {
+        const QRegularExpressionMatch m = listRe.match(line);
+        if (m.hasMatch()) {
+            checksum += m.captured(3).size() + m.captured(1).split(' ', Qt::SkipEmptyParts).size();
+            continue;
+        }
+        checksum += uidRe.match(line).captured(1).toLongLong();
+        checksum += flagsRe.match(line).captured(1).split(' ', Qt::SkipEmptyParts).size();
+        checksum += sizeRe.match(line).captured(1).toLongLong();
+    }
+    return timer.nsecsElapsed();
+}
+
+qint64 RunTokenizer(const QList<QByteArrayView>& lines, qint64& checksum)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    ImapListEntry list;
+    ImapFetchEntry fetch;
+    for (const QByteArrayView raw : lines) {
+        if (ParseListResponse(raw, list)) {
+            checksum += list.mailbox.size() + list.attributes.size();
+            continue;
+        }
+        if (ParseFetchResponse(raw, fetch)) {
+            checksum += fetch.uid + fetch.flags.size() + fetch.size;
+        }
+    }
+    return timer.nsecsElapsed();
+}
+
+}
+
+int main()
+{
+    QTextStream out(stdout);
+
+    QList<QByteArrayView> lines;
+    const QByteArray buffer = BuildResponse(lines);
+
+    qint64 bestLegacy = -1;
+    qint64 bestTokenizer = -1;
+    qint64 legacySum = 0;
+    qint64 tokenizerSum = 0;
+    for (int round = 0; round < kRounds; ++round) {
+        const qint64 legacy = RunLegacy(lines, legacySum);
+        const qint64 tokenizer = RunTokenizer(lines, tokenizerSum);
+        bestLegacy = (bestLegacy < 0 || legacy < bestLegacy) ? legacy : bestLegacy;
+        bestTokenizer = (bestTokenizer < 0 || tokenizer < bestTokenizer) ? tokenizer : bestTokenizer;
+    }
+
+    out << "lines=" << lines.size() << " bytes=" << buffer.size() << " rounds=" << kRounds << "\n";
+    out << "legacy_qstring_regex_ms=" << bestLegacy / 1e6 << " ns_per_line=" << bestLegacy / lines.size() << "\n";
+    out << "tokenizer_ms=" << bestTokenizer / 1e6 << " ns_per_line=" << bestTokenizer / lines.size() << "\n";
+    out << "speedup=" << static_cast<double>(bestLegacy) / qMax<qint64>(bestTokenizer, 1) << "x\n";
+    out << "checksums=" << legacySum << "/" << tokenizerSum << "\n";
+    return 0;
+}
@@ -0,0 +1,215 @@
+// Message list at scale: fills a temporary database with one large folder (1M messages by
+// default), checks with EXPLAIN QUERY PLAN that every list query is a covering index range,
+// without a table scan, a row lookup or a sort, then times 50-row pages at random depths in each view. Exits non-zero
+// if a plan regresses, or, with --strict, if a page's median exceeds --budget-us.
+//   ngksmail_bench_message_list --messages 1000000 --pages 2000 --strict
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QString>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QVariant>
+#include <algorithm>
+#include <vector>
+
+#include "core/storage/Db.h"
+#include "core/storage/MessagePages.h"
+#include "core/storage/Schema.h"
+
+using namespace ngks::core::storage;
+
+namespace {
+
+constexpr int kPageSize = 50;
+constexpr qint64 kFolderId = 1;
+
+bool Populate(Db& db, int messages, QString& outError)
+{
+    QSqlDatabase& sqlDb = db.Handle();
+    QSqlQuery query(sqlDb);
+    if (!query.exec("INSERT INTO accounts(email, provider, imap_host, imap_port, tls_mode, auth_method, "
+                    "credential_ref, status, created_at) VALUES('bench@example.com', 'imap', 'localhost', 993, "
+                    "'TLS', 'PASSWORD', '', 'ok', datetime('now'))")
+        || !query.exec("INSERT INTO folders(account_id, remote_name, display_name, delimiter, attrs_json, "
+                       "special_use, created_at) VALUES(1, 'INBOX', 'INBOX', '/', '[]', '', datetime('now'))")) {
+        outError = query.lastError().text();
+        return false;
+    }
+    QSqlQuery insert(sqlDb);
+    insert.prepare("INSERT INTO messages(folder_id, uid, flags, seen, flagged, received_at, size, subject, "
+                   "from_addr, thread_id, has_header) VALUES(1, ?, ?, ?, ?, ?, ?, ?, ?, ?, 1)");
+    QRandomGenerator random(42);
+    const qint64 start = 1262304000;  // 2010-01-01
+    const int threads = qMax(1, messages / 3);
+    sqlDb.transaction();
+    for (int uid = 1; uid <= messages; ++uid) {
+        const bool seen = random.bounded(10) >= 3;
+        insert.addBindValue(uid);
+        insert.addBindValue(seen ? QStringLiteral("\\Seen") : QString());
+        insert.addBindValue(seen ? 1 : 0);
+        insert.addBindValue(random.bounded(50) == 0 ? 1 : 0);
+        // Roughly in UID order with some jitter, like a real mailbox.
+        insert.addBindValue(start + qint64(uid) * 300 + random.bounded(3600));
+        insert.addBindValue(random.bounded(2000, 200000));
+        insert.addBindValue(QString("Subject line of message %1").arg(uid));
+        insert.addBindValue(QString("Sender %1 <sender%1@example.com>").arg(uid % 997));
+        insert.addBindValue(qint64(random.bounded(threads)) + 1);
+        if (!insert.exec()) {
+            outError = insert.lastError().text();
+            sqlDb.rollback();
+            return false;
+        }
+        if (uid % 100000 == 0) {
+            sqlDb.commit();
+            sqlDb.transaction();
+        }
+    }
+    if (!sqlDb.commit()) {
+        outError = sqlDb.lastError().text();
+        return false;
+    }
+    query.exec("ANALYZE");
+    return true;
+}
+
+// The plan's detail lines; a full scan of messages, an index that is not covering (a row lookup
+// per result) or a temp b-tree (a sort) fails the check.
+bool CheckPlan(Db& db, const QString& name, const QString& sql, int params, QTextStream& out)
+{
+    QSqlQuery query(db.Handle());
+    query.prepare("EXPLAIN QUERY PLAN " + sql);
+    for (int i = 0; i < params; ++i) {
+        query.addBindValue(1);
+    }
+    if (!query.exec()) {
+        out << name << ": " << query.lastError().text() << "\n";
+        return false;
+    }
+    bool ok = true;
+    QStringList lines;
+    while (query.next()) {
+        const QString detail = query.value(3).toString();
+        lines.push_back(detail);
+        if ((detail.startsWith("SCAN") && !detail.contains("INDEX"))
+            || (detail.contains("INDEX") && !detail.contains("COVERING INDEX")) || detail.contains("TEMP B-TREE")) {
+            ok = false;
+        }
+    }
+    out << "plan " << name << (ok ? " ok" : " REGRESSED") << "\n";
+    for (const QString& line : lines) {
+        out << "    " << line << "\n";
+    }
+    return ok;
+}
+
+// Median and worst microseconds for pages starting at random depths of the view.
+void TimePages(Db& db, MessageView view, const char* name, int pages, qint64 budgetUs, bool& overBudget,
+               QTextStream& out)
+{
+    // Cursors spread over the whole folder, taken from the index itself.
+    std::vector<MessageCursor> cursors;
+    QSqlQuery keys(db.Handle());
+    keys.setForwardOnly(true);
+    keys.exec(view == MessageView::Unread
+                  ? "SELECT received_at, id FROM messages WHERE folder_id=1 AND seen=0 ORDER BY received_at DESC, id DESC"
+                  : "SELECT received_at, id FROM messages WHERE folder_id=1 ORDER BY received_at DESC, id DESC");
+    std::vector<MessageCursor> all;
+    while (keys.next()) {
+        all.push_back(MessageCursor{keys.value(0).toLongLong(), keys.value(1).toLongLong()});
+    }
+    if (all.empty()) {
+        return;
+    }
+    QRandomGenerator random(7);
+    cursors.push_back(MessageCursor());
+    while (static_cast<int>(cursors.size()) < pages) {
+        cursors.push_back(all[random.bounded(static_cast<quint32>(all.size()))]);
+    }
+
+    MessagePages list(db);
+    std::vector<MessageListRow> rows;
+    std::vector<qint64> samples;
+    samples.reserve(cursors.size());
+    qint64 rowsRead = 0;
+    for (const MessageCursor& cursor : cursors) {
+        MessageCursor next;
+        QString error;
+        QElapsedTimer timer;
+        timer.start();
+        if (!list.Load(kFolderId, view, cursor, kPageSize, rows, next, error)) {
+            out << name << ": " << error << "\n";
+            return;
+        }
+        samples.push_back(timer.nsecsElapsed());
+        rowsRead += static_cast<qint64>(rows.size());
+    }
+    std::sort(samples.begin(), samples.end());
+    const qint64 medianUs = samples[samples.size() / 2] / 1000;
+    const qint64 p99Us = samples[samples.size() * 99 / 100] / 1000;
+    overBudget = overBudget || medianUs > budgetUs;
+    out << name << " pages=" << samples.size() << " rows=" << rowsRead << " median_us=" << medianUs
+        << " p99_us=" << p99Us << " max_us=" << samples.back() / 1000
+        << (medianUs > budgetUs ? " OVER BUDGET" : "") << "\n";
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addOption({"messages", "Messages in the folder.", "n", "1000000"});
+    parser.addOption({"pages", "Pages timed per view.", "n", "2000"});
+    parser.addOption({"budget-us", "Median page budget in microseconds.", "us", "1000"});
+    parser.addOption({"strict", "Fail when a view's median page is over budget."});
+    parser.process(app);
+    const int messages = parser.value("messages").toInt();
+    const int pages = qMax(1, parser.value("pages").toInt());
+    const qint64 budgetUs = parser.value("budget-us").toLongLong();
+
+    QTextStream out(stdout);
+    QTemporaryDir dir;
+    Db db("ngks_bench_message_list");
+    QString error;
+    if (!dir.isValid() || !db.Open(dir.filePath("bench.sqlite").toStdString()) || !Schema(db).Ensure()) {
+        out << "failed to set up the bench database\n";
+        return 1;
+    }
+    QElapsedTimer fill;
+    fill.start();
+    if (!Populate(db, messages, error)) {
+        out << "populate failed: " << error << "\n";
+        return 1;
+    }
+    out << "messages=" << messages << " populate_ms=" << fill.elapsed() << "\n";
+
+    bool plansOk = true;
+    plansOk = CheckPlan(db, "all", MessagePages::PageSql(MessageView::All), 4, out) && plansOk;
+    plansOk = CheckPlan(db, "unread", MessagePages::PageSql(MessageView::Unread), 4, out) && plansOk;
+    plansOk = CheckPlan(db, "threads", MessagePages::PageSql(MessageView::Threads), 4, out) && plansOk;
+    plansOk = CheckPlan(db, "unread_count", MessagePages::UnreadCountSql(), 1, out) && plansOk;
+
+    bool overBudget = false;
+    TimePages(db, MessageView::All, "all", pages, budgetUs, overBudget, out);
+    TimePages(db, MessageView::Unread, "unread", pages, budgetUs, overBudget, out);
+    TimePages(db, MessageView::Threads, "threads", pages, budgetUs, overBudget, out);
+
+    qint64 unread = 0;
+    QElapsedTimer count;
+    count.start();
+    if (MessagePages(db).UnreadCount(kFolderId, unread, error)) {
+        out << "unread_count=" << unread << " us=" << count.nsecsElapsed() / 1000 << "\n";
+    }
+
+    if (!plansOk) {
+        return 1;
+    }
+    return parser.isSet("strict") && overBudget ? 2 : 0;
+}
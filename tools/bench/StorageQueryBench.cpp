@@ -0,0 +1,153 @@
+// Microbenchmark: the message_parts lookup StoredParts runs per opened message, three ways on a
+// temporary database: a QSqlQuery prepared on every call (the old path), the same statement
+// from the connection's StatementCache, and the typed Query over it. Prints ns/lookup for each.
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QString>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QVariant>
+
+#include "core/storage/Db.h"
+#include "core/storage/Query.h"
+#include "core/storage/Schema.h"
+#include "core/storage/StatementCache.h"
+
+using namespace ngks::core::storage;
+
+namespace {
+
+constexpr int kMessages = 20000;
+constexpr int kPartsPerMessage = 3;
+constexpr int kLookups = 50000;
+constexpr int kRounds = 3;
+
+const char* const kSql =
+    "SELECT p.part_id, p.content_type, p.charset, p.transfer_encoding, p.filename, p.content_id, p.size, "
+    "p.is_attachment, p.local_path FROM message_parts p JOIN messages m ON m.id=p.message_id "
+    "WHERE m.folder_id=? AND m.uid=? ORDER BY p.id";
+
+bool Populate(Db& db)
+{
+    QSqlDatabase& sqlDb = db.Handle();
+    QSqlQuery query(sqlDb);
+    if (!sqlDb.transaction()
+        || !query.exec("INSERT INTO accounts(email, provider, imap_host, imap_port, tls_mode, auth_method, "
+                       "credential_ref, status, created_at) VALUES('bench@example.com', 'imap', 'localhost', 993, "
+                       "'TLS', 'PASSWORD', '', 'ok', datetime('now'))")
+        || !query.exec("INSERT INTO folders(account_id, remote_name, display_name, delimiter, attrs_json, "
+                       "special_use, created_at) VALUES(1, 'INBOX', 'INBOX', '/', '[]', '', datetime('now'))")) {
+        return false;
+    }
+    QSqlQuery message(sqlDb);
+    message.prepare("INSERT INTO messages(folder_id, uid, subject, has_header) VALUES(1, ?, 'subject', 1)");
+    QSqlQuery part(sqlDb);
+    part.prepare("INSERT INTO message_parts(message_id, part_id, content_type, charset, transfer_encoding, size) "
+                 "VALUES(?, ?, 'text/plain', 'utf-8', 'quoted-printable', 2048)");
+    for (int uid = 1; uid <= kMessages; ++uid) {
+        message.bindValue(0, uid);
+        if (!message.exec()) {
+            return false;
+        }
+        const qint64 messageId = message.lastInsertId().toLongLong();
+        for (int p = 1; p <= kPartsPerMessage; ++p) {
+            part.bindValue(0, messageId);
+            part.bindValue(1, QString::number(p));
+            if (!part.exec()) {
+                return false;
+            }
+        }
+    }
+    return sqlDb.commit();
+}
+
+qint64 Uid(int i)
+{
+    return 1 + (static_cast<qint64>(i) * 7919) % kMessages;
+}
+
+qint64 RunPrepareEachCall(Db& db, qint64& checksum)
+{
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < kLookups; ++i) {
+        QSqlQuery query(db.Handle());
+        query.setForwardOnly(true);
+        query.prepare(kSql);
+        query.addBindValue(1);
+        query.addBindValue(Uid(i));
+        query.exec();
+        while (query.next()) {
+            checksum += query.value(0).toString().size() + query.value(6).toLongLong();
+        }
+    }
+    return timer.nsecsElapsed();
+}
+
+qint64 RunCached(Db& db, qint64& checksum)
+{
+    QString error;
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < kLookups; ++i) {
+        QSqlQuery* query = db.Statements().Get(kSql, error);
+        query->bindValue(0, 1);
+        query->bindValue(1, Uid(i));
+        query->exec();
+        while (query->next()) {
+            checksum += query->value(0).toString().size() + query->value(6).toLongLong();
+        }
+    }
+    return timer.nsecsElapsed();
+}
+
+qint64 RunTyped(Db& db, qint64& checksum)
+{
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < kLookups; ++i) {
+        Query<Columns<QString, QString, QString, QString, QString, QString, qint64, bool, QString>, Params<qint64, qint64>>
+            query(db, kSql);
+        query.Exec(1, Uid(i));
+        while (auto row = query.Next()) {
+            checksum += std::get<0>(*row).size() + std::get<6>(*row);
+        }
+    }
+    return timer.nsecsElapsed();
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+
+    QTemporaryDir dir;
+    Db db("ngks_bench_storage_query");
+    if (!dir.isValid() || !db.Open(dir.filePath("bench.sqlite").toStdString()) || !Schema(db).Ensure()
+        || !Populate(db)) {
+        out << "failed to set up the bench database\n";
+        return 1;
+    }
+
+    qint64 best[3] = {-1, -1, -1};
+    qint64 sums[3] = {0, 0, 0};
+    for (int round = 0; round < kRounds; ++round) {
+        const qint64 runs[3] = {RunPrepareEachCall(db, sums[0]), RunCached(db, sums[1]), RunTyped(db, sums[2])};
+        for (int i = 0; i < 3; ++i) {
+            best[i] = (best[i] < 0 || runs[i] < best[i]) ? runs[i] : best[i];
+        }
+    }
+
+    out << "messages=" << kMessages << " lookups=" << kLookups << " rounds=" << kRounds << "\n";
+    out << "prepare_each_call_ms=" << best[0] / 1e6 << " ns_per_lookup=" << best[0] / kLookups << "\n";
+    out << "cached_statement_ms=" << best[1] / 1e6 << " ns_per_lookup=" << best[1] / kLookups << "\n";
+    out << "typed_query_ms=" << best[2] / 1e6 << " ns_per_lookup=" << best[2] / kLookups << "\n";
+    out << "speedup=" << static_cast<double>(best[0]) / qMax<qint64>(best[2], 1) << "x\n";
+    out << "statement_cache hits=" << db.Statements().Hits() << " misses=" << db.Statements().Misses() << "\n";
+    out << "checksums=" << sums[0] << "/" << sums[1] << "/" << sums[2] << "\n";
+    return 0;
+}
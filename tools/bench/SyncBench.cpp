@@ -0,0 +1,339 @@
+// Sync pipeline smoke bench: drives the sync stages end to end against two in-process fake
+// IMAP servers, one advertising IDLE and ESEARCH and one advertising neither, into a temporary
+// store. Per server: SyncEngine::SyncFolder on INBOX (full scan, then a resync), HeaderSync::Run
+// over the whole folder again, SearchService remotely (ESEARCH or plain SEARCH) and locally,
+// and ImapIdleManager watching INBOX (IDLE with server pushes, or the STATUS poll fallback).
+// Then FolderSyncScheduler::SyncAccount fans the first account out over several connections.
+// Prints wall ms and the stage's own counters; exits non-zero as soon as a stage fails.
+//   ngksmail_bench_sync --messages 20000 --latency-ms 0 --watch-ms 2000
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QSqlQuery>
+#include <QString>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QThread>
+#include <QTimer>
+#include <QVector>
+#include <condition_variable>
+#include <mutex>
+
+#include "FakeImapServer.h"
+#include "core/logging/ProtocolTranscript.h"
+#include "core/mail/providers/imap/FolderMirrorService.h"
+#include "core/mail/providers/imap/ImapConnectionPool.h"
+#include "core/mail/providers/imap/ImapIdleManager.h"
+#include "core/mail/providers/imap/ImapProvider.h"
+#include "core/mail/search/SearchService.h"
+#include "core/mail/sync/FolderSyncScheduler.h"
+#include "core/mail/sync/HeaderSync.h"
+#include "core/mail/sync/JobQueue.h"
+#include "core/mail/sync/SyncEngine.h"
+#include "core/storage/Db.h"
+#include "core/storage/Schema.h"
+
+using namespace ngks::core::mail::providers::imap;
+using namespace ngks::core::mail::search;
+using namespace ngks::core::mail::sync;
+using ngks::core::storage::Db;
+using ngks::core::storage::Schema;
+using ngks::tools::fakeimap::FakeImapConfig;
+using ngks::tools::fakeimap::FakeImapServer;
+
+namespace {
+
+class ServerThread : public QThread {
+public:
+    explicit ServerThread(FakeImapConfig config)
+        : config_(std::move(config))
+    {
+    }
+
+    quint16 WaitForPort()
+    {
+        std::unique_lock<std::mutex> lk(mu_);
+        ready_.wait(lk, [this]() { return started_; });
+        return port_;
+    }
+
+protected:
+    void run() override
+    {
+        FakeImapServer server(config_);
+        QString error;
+        const bool listening = server.Listen(0, error);
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            port_ = listening ? server.Port() : 0;
+            started_ = true;
+        }
+        ready_.notify_all();
+        if (listening) {
+            exec();
+        }
+    }
+
+private:
+    FakeImapConfig config_;
+    std::mutex mu_;
+    std::condition_variable ready_;
+    bool started_ = false;
+    quint16 port_ = 0;
+};
+
+double MsSince(const QElapsedTimer& timer)
+{
+    return timer.nsecsElapsed() / 1e6;
+}
+
+bool Fail(QTextStream& out, const QString& stage, const QString& error)
+{
+    out << stage << " FAILED: " << error << "\n";
+    out.flush();
+    return false;
+}
+
+// What the app does when an account is added: ResolveAccount, then mirror accounts/folders.
+bool AddAccount(QTextStream& out, Db& db, const ResolveRequest& account)
+{
+    ImapProvider provider;
+    QVector<ResolvedFolder> folders;
+    QString error;
+    QString transcriptPath;
+    int accountId = -1;
+    if (!provider.ResolveAccount(account, folders, error, transcriptPath)
+        || !FolderMirrorService().MirrorResolvedAccount(db, account, QString(), folders, accountId, error)) {
+        return Fail(out, "add_account", error);
+    }
+    out << "add_account " << account.email << " folders=" << folders.size() << "\n";
+    return true;
+}
+
+bool SyncInbox(QTextStream& out, Db& db, const ResolveRequest& account)
+{
+    JobQueue jobs;
+    SyncEngine engine(db, jobs);
+    for (const char* pass : {"sync_folder_full", "sync_folder_resync"}) {
+        FolderSyncStats stats;
+        QString error;
+        QElapsedTimer timer;
+        timer.start();
+        if (!engine.SyncFolder(account, "INBOX", stats, error)) {
+            return Fail(out, pass, error);
+        }
+        out << pass << " full=" << (stats.fullSync ? "true" : "false")
+            << " unchanged=" << (stats.unchanged ? "true" : "false") << " round_trips=" << stats.roundTrips
+            << " new=" << stats.newMessages << " flag_updates=" << stats.flagUpdates << " removed=" << stats.removed
+            << " headers=" << stats.headersFetched << " ms=" << MsSince(timer) << "\n";
+    }
+    return true;
+}
+
+// The header stage on its own: every INBOX message is marked headerless again first.
+bool RefetchHeaders(QTextStream& out, Db& db, const ResolveRequest& account)
+{
+    QSqlQuery folder(db.Handle());
+    folder.prepare("SELECT f.id FROM folders f JOIN accounts a ON a.id=f.account_id "
+                   "WHERE a.email=? AND f.remote_name='INBOX'");
+    folder.addBindValue(account.email);
+    if (!folder.exec() || !folder.next()) {
+        return Fail(out, "header_sync", "INBOX is not in the store");
+    }
+    const qint64 folderId = folder.value(0).toLongLong();
+    QSqlQuery reset(db.Handle());
+    reset.prepare("UPDATE messages SET has_header=0 WHERE folder_id=?");
+    reset.addBindValue(folderId);
+    if (!reset.exec()) {
+        return Fail(out, "header_sync", "cannot reset has_header");
+    }
+
+    QString error;
+    ImapSessionLease session = ImapConnectionPool::Instance().Acquire(account, error);
+    if (!session || !session->Select("INBOX", true, error)) {
+        return Fail(out, "header_sync", error);
+    }
+    int progress = 0;
+    HeaderSync headers(db);
+    headers.SetProgressCallback([&progress](qint64, int) { ++progress; });
+    HeaderSyncStats stats;
+    if (!headers.Run(*session, folderId, stats, error)) {
+        return Fail(out, "header_sync", error);
+    }
+    out << "header_sync messages=" << stats.messages << " windows=" << stats.windows << " callbacks=" << progress
+        << " last_window=" << stats.lastWindow << " max_in_flight=" << stats.maxInFlight
+        << " rtt_ms=" << stats.roundTripMs << " mb=" << stats.bytes / 1e6 << " ms=" << stats.elapsedMs << "\n";
+    return true;
+}
+
+bool SearchInbox(QTextStream& out, Db& db, const ResolveRequest& account, bool esearch)
+{
+    SearchService service(db);
+    // BODY always goes to the server; the fake server matches UNSEEN as the odd UIDs.
+    SearchQuery remote;
+    remote.body = "xxxx";
+    remote.seen = FlagFilter::Unset;
+    // Headers are all local by now, so this one never leaves the store.
+    SearchQuery local;
+    local.subject = "Message 1";
+
+    const auto run = [&](const QString& name, const SearchQuery& query) {
+        SearchResult result;
+        QString error;
+        QElapsedTimer timer;
+        timer.start();
+        if (!service.Search(account, "INBOX", query, result, error)) {
+            return Fail(out, name, error);
+        }
+        const char* source = result.source == SearchSource::Local ? "local"
+                             : result.source == SearchSource::Remote ? "remote" : "mixed";
+        out << name << " source=" << source << " matches=" << result.uids.Count()
+            << " round_trips=" << result.roundTrips << " ms=" << MsSince(timer) << "\n";
+        return true;
+    };
+    return run(esearch ? "search_remote_esearch" : "search_remote_search", remote) && run("search_local", local);
+}
+
+// Watches INBOX for watchMs. With IDLE the fake server appends a message every idlePushMs;
+// without it the manager has to fall back to polling.
+bool Watch(QTextStream& out, const ResolveRequest& account, int watchMs)
+{
+    JobQueue jobs;
+    ImapIdleOptions options;
+    options.pollMinMs = 100;
+    options.pollInitialMs = 200;
+    options.pollMaxMs = 1000;
+    ImapIdleManager manager(jobs, options);
+    int queued = 0;
+    QObject::connect(&manager, &ImapIdleManager::JobQueued, [&queued](const QString&, const QString&) { ++queued; });
+
+    QElapsedTimer timer;
+    timer.start();
+    manager.Watch(account, "INBOX");
+    QEventLoop loop;
+    QTimer::singleShot(watchMs, &loop, &QEventLoop::quit);
+    loop.exec();
+    const int idling = manager.IdlingCount();
+    const int polling = manager.PollingCount();
+    manager.StopAll();
+    if (idling + polling != 1) {
+        return Fail(out, "watch_inbox", "mailbox is neither idling nor polled");
+    }
+    out << "watch_inbox mode=" << (idling == 1 ? "idle" : "poll") << " jobs=" << queued
+        << " ms=" << MsSince(timer) << "\n";
+    return true;
+}
+
+bool SyncAccount(QTextStream& out, Db& db, const ResolveRequest& account)
+{
+    FolderSyncScheduler scheduler(db);
+    FolderSyncReport report;
+    QString error;
+    if (!scheduler.SyncAccount(account, report, error)) {
+        return Fail(out, "sync_account", error);
+    }
+    out << "sync_account connections=" << report.connections << " synced=" << report.synced
+        << " failed=" << report.failed << " new=" << report.newMessages << " headers=" << report.headersFetched
+        << " indexed=" << report.indexed << " ms=" << report.elapsedMs << "\n";
+    for (const QString& folderError : report.errors) {
+        out << "  " << folderError << "\n";
+    }
+    return report.failed == 0 || Fail(out, "sync_account", "some folders failed");
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    const QCommandLineOption messagesOpt("messages", "Messages in INBOX.", "n", "20000");
+    const QCommandLineOption messageBytesOpt("message-bytes", "Approximate size of each message.", "bytes", "4096");
+    const QCommandLineOption latencyOpt("latency-ms", "Server-side delay before each response.", "ms", "0");
+    const QCommandLineOption watchOpt("watch-ms", "How long INBOX is watched.", "ms", "2000");
+    parser.addOption(messagesOpt);
+    parser.addOption(messageBytesOpt);
+    parser.addOption(latencyOpt);
+    parser.addOption(watchOpt);
+    parser.process(app);
+
+    ngks::core::logging::TranscriptOptions transcriptOptions;
+    transcriptOptions.level = ngks::core::logging::TranscriptLevel::Off;
+    ngks::core::logging::ProtocolTranscript::SetDefaultOptions(transcriptOptions);
+
+    FakeImapConfig full = FakeImapConfig::Default();
+    full.mailboxes[0].messages = qMax(1, parser.value(messagesOpt).toInt());
+    full.messageBytes = qMax(256, parser.value(messageBytesOpt).toInt());
+    full.latencyMs = qMax(0, parser.value(latencyOpt).toInt());
+    full.idlePushMs = 100;
+    FakeImapConfig basic = full;
+    basic.advertiseIdle = false;
+    basic.advertiseEsearch = false;
+    const int watchMs = qMax(500, parser.value(watchOpt).toInt());
+
+    ServerThread fullServer(full);
+    ServerThread basicServer(basic);
+    fullServer.start();
+    basicServer.start();
+    const quint16 fullPort = fullServer.WaitForPort();
+    const quint16 basicPort = basicServer.WaitForPort();
+
+    QTemporaryDir dir;
+    Db db("ngks_bench_sync");
+    int rc = 0;
+    if (fullPort == 0 || basicPort == 0) {
+        out << "fake imapd failed to listen\n";
+        rc = 1;
+    } else if (!dir.isValid() || !db.Open(dir.filePath("bench.sqlite").toStdString()) || !Schema(db).Ensure()) {
+        out << "failed to set up the bench store\n";
+        rc = 1;
+    }
+    out << "fake_imapd inbox_messages=" << full.mailboxes[0].messages << " message_bytes=" << full.messageBytes
+        << " latency_ms=" << full.latencyMs << "\n";
+
+    ResolveRequest fullAccount;
+    fullAccount.email = "full@example.com";
+    fullAccount.host = "127.0.0.1";
+    fullAccount.port = fullPort;
+    fullAccount.tls = false;
+    fullAccount.username = "bench";
+    fullAccount.password = "bench";
+    fullAccount.allowCompress = false;
+    ResolveRequest basicAccount = fullAccount;
+    basicAccount.email = "basic@example.com";
+    basicAccount.port = basicPort;
+
+    struct Server {
+        const char* name;
+        ResolveRequest account;
+        bool esearch;
+    };
+    const Server servers[] = {{"idle_esearch", fullAccount, true}, {"no_idle_no_esearch", basicAccount, false}};
+    for (const Server& server : servers) {
+        if (rc != 0) {
+            break;
+        }
+        const ResolveRequest& account = server.account;
+        out << "== " << server.name << "\n";
+        if (!AddAccount(out, db, account) || !SyncInbox(out, db, account) || !RefetchHeaders(out, db, account)
+            || !SearchInbox(out, db, account, server.esearch) || !Watch(out, account, watchMs)) {
+            rc = 1;
+        }
+    }
+    if (rc == 0) {
+        out << "== fan_out\n";
+        rc = SyncAccount(out, db, fullAccount) ? 0 : 1;
+    }
+    out.flush();
+
+    ImapConnectionPool::Instance().CloseIdle();
+    fullServer.quit();
+    basicServer.quit();
+    fullServer.wait();
+    basicServer.wait();
+    return rc;
+}
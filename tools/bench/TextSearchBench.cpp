@@ -0,0 +1,178 @@
+// Full-text search at scale: fills a temporary store with synthetic messages whose display
+// text is on disk (bodies shared between messages, as repeated mail often is), builds the FTS5
+// index with Reindexer::Rebuild on all cores, then times an incremental Run over freshly
+// queued messages and ranked searches with snippets. Prints build rate and per-query ms.
+//   ngksmail_bench_text_search --messages 2000000 --queries 200
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QRandomGenerator>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QString>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QVariant>
+#include <algorithm>
+#include <vector>
+
+#include "core/mail/search/TextSearch.h"
+#include "core/storage/Db.h"
+#include "core/storage/Reindexer.h"
+#include "core/storage/Schema.h"
+
+using namespace ngks::core::storage;
+using ngks::core::mail::search::TextSearch;
+using ngks::core::mail::search::TextSearchHit;
+
+namespace {
+
+constexpr int kBodyFiles = 2000;
+
+const char* const kWords[] = {
+    "quarterly", "report",  "invoice", "meeting", "schedule", "project", "budget",   "review",  "release",
+    "deadline",  "contract", "travel", "expense", "shipping", "order",   "customer", "support", "feedback",
+    "design",    "launch",   "hiring", "offsite", "security", "update",  "payment",  "renewal", "résumé",
+};
+
+QString Sentence(QRandomGenerator& random, int words)
+{
+    QStringList out;
+    for (int i = 0; i < words; ++i) {
+        out.push_back(QString::fromUtf8(kWords[random.bounded(static_cast<int>(std::size(kWords)))]));
+    }
+    return out.join(' ');
+}
+
+bool Populate(Db& db, const QString& bodyDir, int messages, QString& outError)
+{
+    QRandomGenerator random(42);
+    QStringList bodies;
+    for (int i = 0; i < kBodyFiles; ++i) {
+        const QString path = QDir(bodyDir).filePath(QString("body%1.txt").arg(i));
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly)) {
+            outError = "cannot write " + path;
+            return false;
+        }
+        for (int line = 0; line < 20; ++line) {
+            file.write(Sentence(random, 12).toUtf8() + "\n");
+        }
+        bodies.push_back(path);
+    }
+
+    QSqlDatabase& sqlDb = db.Handle();
+    QSqlQuery query(sqlDb);
+    if (!query.exec("INSERT INTO accounts(email, provider, imap_host, imap_port, tls_mode, auth_method, "
+                    "credential_ref, status, created_at) VALUES('bench@example.com', 'imap', 'localhost', 993, "
+                    "'TLS', 'PASSWORD', '', 'ok', datetime('now'))")
+        || !query.exec("INSERT INTO folders(account_id, remote_name, display_name, delimiter, attrs_json, "
+                       "special_use, created_at) VALUES(1, 'INBOX', 'INBOX', '/', '[]', '', datetime('now'))")) {
+        outError = query.lastError().text();
+        return false;
+    }
+    QSqlQuery message(sqlDb);
+    message.prepare("INSERT INTO messages(id, folder_id, uid, subject, from_addr, to_addrs, has_header) "
+                    "VALUES(?, 1, ?, ?, ?, 'Bench User <bench@example.com>', 1)");
+    QSqlQuery part(sqlDb);
+    part.prepare("INSERT INTO message_parts(message_id, part_id, content_type, charset, local_path) "
+                 "VALUES(?, '1', 'text/plain', 'utf-8', ?)");
+    sqlDb.transaction();
+    for (int id = 1; id <= messages; ++id) {
+        message.addBindValue(id);
+        message.addBindValue(id);
+        message.addBindValue(Sentence(random, 5));
+        message.addBindValue(QString("Sender %1 <sender%1@example.com>").arg(id % 997));
+        part.addBindValue(id);
+        part.addBindValue(bodies[random.bounded(kBodyFiles)]);
+        if (!message.exec() || !part.exec()) {
+            outError = message.lastError().text() + part.lastError().text();
+            sqlDb.rollback();
+            return false;
+        }
+        if (id % 100000 == 0) {
+            sqlDb.commit();
+            sqlDb.transaction();
+        }
+    }
+    return sqlDb.commit();
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addOption({"messages", "Messages in the store.", "n", "200000"});
+    parser.addOption({"queries", "Searches timed.", "n", "200"});
+    parser.addOption({"threads", "Rebuild threads; 0 for one per core.", "n", "0"});
+    parser.process(app);
+    const int messages = parser.value("messages").toInt();
+    const int queries = qMax(1, parser.value("queries").toInt());
+
+    QTextStream out(stdout);
+    QTemporaryDir dir;
+    Db db("ngks_bench_text_search");
+    QString error;
+    if (!dir.isValid() || !db.Open(dir.filePath("bench.sqlite").toStdString()) || !Schema(db).Ensure()
+        || !Populate(db, dir.path(), messages, error)) {
+        out << "failed to set up the bench store: " << error << "\n";
+        return 1;
+    }
+
+    ReindexOptions options;
+    options.rebuildThreads = parser.value("threads").toInt();
+    Reindexer reindexer(db, options);
+    ReindexStats stats;
+    if (!reindexer.Rebuild(stats, error)) {
+        out << "rebuild failed: " << error << "\n";
+        return 1;
+    }
+    out << "rebuild messages=" << stats.indexed << " ms=" << stats.elapsedMs
+        << " per_sec=" << (stats.indexed * 1000) / qMax<qint64>(stats.elapsedMs, 1) << "\n";
+
+    // What a sync window leaves behind: queued messages, indexed by the next Run.
+    {
+        QSqlQuery queue(db.Handle());
+        queue.exec(QString("INSERT INTO fts_queue(message_id) SELECT id FROM messages WHERE id > %1")
+                       .arg(qMax(0, messages - 10000)));
+    }
+    if (!reindexer.Run(stats, error)) {
+        out << "run failed: " << error << "\n";
+        return 1;
+    }
+    out << "incremental messages=" << stats.indexed << " ms=" << stats.elapsedMs << "\n";
+
+    TextSearch search(db);
+    QRandomGenerator random(7);
+    std::vector<qint64> samples;
+    std::vector<TextSearchHit> hits;
+    qint64 hitCount = 0;
+    for (int i = 0; i < queries; ++i) {
+        // Two words, the second typed halfway.
+        QString text = Sentence(random, 2);
+        text.chop(random.bounded(3));
+        QElapsedTimer timer;
+        timer.start();
+        if (!search.Search(text, hits, error)) {
+            out << "search failed: " << error << "\n";
+            return 1;
+        }
+        samples.push_back(timer.nsecsElapsed());
+        hitCount += static_cast<qint64>(hits.size());
+        if (i == 0 && !hits.empty()) {
+            out << "example \"" << text << "\": " << hits.front().subject << " | " << hits.front().snippet << "\n";
+        }
+    }
+    std::sort(samples.begin(), samples.end());
+    out << "search queries=" << samples.size() << " hits=" << hitCount
+        << " median_ms=" << samples[samples.size() / 2] / 1e6
+        << " p99_ms=" << samples[samples.size() * 99 / 100] / 1e6 << "\n";
+    return 0;
+}
@@ -0,0 +1,119 @@
+// Microbenchmark: cost of protocol transcripts on the receive path.
+// Logs a synthetic FETCH-heavy stream through the old per-line QTextStream + flush path and
+// through ProtocolTranscript at each level, and prints ns/line as seen by the protocol thread.
+#include <QByteArray>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QList>
+#include <QString>
+#include <QTextStream>
+
+#include "core/logging/ProtocolTranscript.h"
+
+using namespace ngks::core::logging;
+
+namespace {
+
+constexpr int kLines = 200000;
+
+QList<QByteArray> BuildLines()
+{
+    QList<QByteArray> lines;
+    lines.reserve(kLines);
+    for (int i = 0; i < kLines; ++i) {
+        if (i % 50 == 0) {
+            lines.push_back(QString("A%1 OK FETCH completed").arg(i, 5, 10, QChar('0')).toUtf8());
+        } else if (i % 10 == 0) {
+            QByteArray literal(2048, 'x');
+            lines.push_back(QString("* %1 FETCH (UID %2 BODY[HEADER] {%3}\r\n")
+                                .arg(i)
+                                .arg(100000 + i)
+                                .arg(literal.size())
+                                .toUtf8()
+                            + literal + ")");
+        } else {
+            lines.push_back(QString("* %1 FETCH (UID %2 FLAGS (\\Seen) RFC822.SIZE %3)")
+                                .arg(i)
+                                .arg(100000 + i)
+                                .arg(4096 + i)
+                                .toUtf8());
+        }
+    }
+    return lines;
+}
+
+// The pre-ProtocolTranscript behaviour: a fresh QTextStream and a flush for every line.
+qint64 RunLegacy(const QList<QByteArray>& lines, const QString& path)
+{
+    QFile file(path);
+    file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text);
+    QElapsedTimer timer;
+    timer.start();
+    for (const QByteArray& line : lines) {
+        QTextStream ts(&file);
+        ts << "S " << QString::fromUtf8(line).trimmed() << '\n';
+        ts.flush();
+    }
+    return timer.nsecsElapsed();
+}
+
+// Measures the time the producer spends in Append; the drain cost is reported separately.
+qint64 RunTranscript(const QList<QByteArray>& lines, const QString& path, TranscriptOptions options,
+                     qint64& outDrainNs, std::uint64_t& outDropped)
+{
+    QFile::remove(path);
+    ProtocolTranscript transcript(options);
+    transcript.Open(std::filesystem::path(path.toStdU16String()));
+
+    QElapsedTimer timer;
+    timer.start();
+    for (const QByteArray& line : lines) {
+        transcript.Append('S', std::string_view(line.constData(), line.size()));
+    }
+    const qint64 appendNs = timer.nsecsElapsed();
+    transcript.Close();
+    outDrainNs = timer.nsecsElapsed() - appendNs;
+    outDropped = transcript.DroppedLines();
+    return appendNs;
+}
+
+}
+
+int main()
+{
+    QTextStream out(stdout);
+    const QList<QByteArray> lines = BuildLines();
+    const QString path = QDir::temp().filePath("ngksmail_transcript_bench.txt");
+
+    const qint64 legacy = RunLegacy(lines, path);
+    out << "lines=" << lines.size() << "\n";
+    out << "legacy_textstream_flush ns_per_line=" << legacy / lines.size() << "\n";
+
+    struct Case {
+        const char* name;
+        TranscriptLevel level;
+        int sample;
+    };
+    const Case cases[] = {
+        {"off", TranscriptLevel::Off, 1},
+        {"commands", TranscriptLevel::CommandsOnly, 1},
+        {"full", TranscriptLevel::Full, 1},
+        {"elide", TranscriptLevel::FullElideLiterals, 1},
+        {"full_sample16", TranscriptLevel::Full, 16},
+    };
+    for (const Case& c : cases) {
+        TranscriptOptions options;
+        options.level = c.level;
+        options.untaggedSampleEvery = c.sample;
+        options.ringCapacity = 16384;
+        qint64 drainNs = 0;
+        std::uint64_t dropped = 0;
+        const qint64 appendNs = RunTranscript(lines, path, options, drainNs, dropped);
+        out << c.name << " ns_per_line=" << appendNs / lines.size() << " drain_ms=" << drainNs / 1e6
+            << " dropped=" << dropped << "\n";
+    }
+
+    QFile::remove(path);
+    return 0;
+}
@@ -0,0 +1,749 @@
+#include "FakeImapServer.h"
+
+#include <QElapsedTimer>
+#include <QHostAddress>
+#include <QList>
+#include <QTcpSocket>
+#include <QTimer>
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <memory>
+
+namespace ngks::tools::fakeimap {
+
+namespace {
+
+// Responses are generated this many messages at a time, so large FETCHes stream.
+constexpr int kFetchBatch = 64;
+// Generation pauses while this much is queued in the socket.
+constexpr qint64 kSocketHighWater = 1024 * 1024;
+constexpr int kPumpIntervalMs = 5;
+
+struct Range {
+    qint64 first = 0;
+    qint64 last = 0;
+};
+
+// Splits on spaces outside of brackets, parentheses and quotes.
+QList<QByteArray> SplitWords(const QByteArray& text)
+{
+    QList<QByteArray> words;
+    QByteArray current;
+    int depth = 0;
+    bool quoted = false;
+    for (const char c : text) {
+        if (quoted) {
+            current += c;
+            if (c == '"') {
+                quoted = false;
+            }
+            continue;
+        }
+        if (c == '"') {
+            quoted = true;
+        } else if (c == '[' || c == '(') {
+            ++depth;
+        } else if (c == ']' || c == ')') {
+            --depth;
+        } else if (c == ' ' && depth == 0) {
+            if (!current.isEmpty()) {
+                words.push_back(current);
+                current.clear();
+            }
+            continue;
+        }
+        current += c;
+    }
+    if (!current.isEmpty()) {
+        words.push_back(current);
+    }
+    return words;
+}
+
+QByteArray Unquote(QByteArray word)
+{
+    if (word.size() >= 2 && word.startsWith('"') && word.endsWith('"')) {
+        word = word.mid(1, word.size() - 2);
+        word.replace("\\\"", "\"");
+        word.replace("\\\\", "\\");
+    }
+    return word;
+}
+
+QByteArray Quote(const QString& text)
+{
+    QByteArray out = text.toUtf8();
+    out.replace("\\", "\\\\");
+    out.replace("\"", "\\\"");
+    return '"' + out + '"';
+}
+
+QByteArray StripParens(QByteArray text)
+{
+    if (text.startsWith('(') && text.endsWith(')')) {
+        text = text.mid(1, text.size() - 2);
+    }
+    return text;
+}
+
+// "1:*", "5", "2,4:7"; '*' is the highest number in the mailbox.
+bool ParseSequenceSet(const QByteArray& text, qint64 max, QVector<Range>& out)
+{
+    for (const QByteArray& part : text.split(',')) {
+        const QList<QByteArray> bounds = part.split(':');
+        if (bounds.isEmpty() || bounds.size() > 2) {
+            return false;
+        }
+        Range range;
+        bool ok = true;
+        for (int i = 0; i < bounds.size(); ++i) {
+            qint64 value = bounds[i] == "*" ? max : bounds[i].toLongLong(&ok);
+            if (!ok) {
+                return false;
+            }
+            (i == 0 ? range.first : range.last) = value;
+        }
+        if (bounds.size() == 1) {
+            range.last = range.first;
+        }
+        if (range.first > range.last) {
+            std::swap(range.first, range.last);
+        }
+        range.first = qMax<qint64>(range.first, 1);
+        range.last = qMin(range.last, max);
+        if (range.first <= range.last) {
+            out.push_back(range);
+        }
+    }
+    return true;
+}
+
+// Sorted, distinct numbers as a compact set: 1:3,5,8:9.
+QByteArray SequenceSet(const QVector<qint64>& numbers)
+{
+    QByteArray out;
+    for (qsizetype i = 0; i < numbers.size();) {
+        qsizetype j = i;
+        while (j + 1 < numbers.size() && numbers[j + 1] == numbers[j] + 1) {
+            ++j;
+        }
+        if (!out.isEmpty()) {
+            out += ',';
+        }
+        out += QByteArray::number(numbers[i]);
+        if (j > i) {
+            out += ':' + QByteArray::number(numbers[j]);
+        }
+        i = j + 1;
+    }
+    return out;
+}
+
+QByteArray SpecialUse(const QString& name)
+{
+    static const char* const kSpecial[][2] = {
+        {"Sent", "\\Sent"}, {"Drafts", "\\Drafts"}, {"Trash", "\\Trash"},
+        {"Junk", "\\Junk"}, {"Archive", "\\Archive"},
+    };
+    for (const auto& special : kSpecial) {
+        if (name.compare(QLatin1String(special[0]), Qt::CaseInsensitive) == 0) {
+            return special[1];
+        }
+    }
+    return {};
+}
+
+}
+
+// One client connection. Responses are queued with the time they may start going out
+// (latency) and drained through a token bucket (bandwidth); long responses are produced in
+// batches by a generator so only a bounded amount is ever buffered.
+class FakeImapServer::Session : public QObject {
+public:
+    Session(FakeImapServer& server, QTcpSocket* socket)
+        : QObject(&server)
+        , server_(server)
+        , socket_(socket)
+    {
+        socket_->setParent(this);
+        clock_.start();
+        pumpTimer_.setSingleShot(true);
+        connect(&pumpTimer_, &QTimer::timeout, this, [this]() { Pump(); });
+        connect(&pushTimer_, &QTimer::timeout, this, [this]() { PushNewMessage(); });
+        connect(socket_, &QTcpSocket::readyRead, this, [this]() { OnReadyRead(); });
+        connect(socket_, &QTcpSocket::bytesWritten, this, [this]() { Pump(); });
+        connect(socket_, &QTcpSocket::disconnected, this, [this]() { deleteLater(); });
+
+        Queue("* OK [CAPABILITY " + server_.Capabilities() + "] fake imapd ready\r\n");
+    }
+
+private:
+    using Generator = std::function<bool(QByteArray& out)>;
+
+    struct Outgoing {
+        qint64 readyAtMs = 0;
+        QByteArray bytes;
+        // Appends the next part to bytes; returns false once the response is complete.
+        Generator more;
+    };
+
+    void OnReadyRead()
+    {
+        in_ += socket_->readAll();
+        for (;;) {
+            const qsizetype eol = in_.indexOf("\r\n");
+            if (eol < 0) {
+                return;
+            }
+            const QByteArray line = in_.left(eol);
+            in_.remove(0, eol + 2);
+            HandleLine(line);
+        }
+    }
+
+    void HandleLine(const QByteArray& line)
+    {
+        if (!idleTag_.isEmpty()) {
+            if (line.trimmed().compare("DONE", Qt::CaseInsensitive) == 0) {
+                pushTimer_.stop();
+                Queue(idleTag_ + " OK IDLE terminated\r\n");
+                idleTag_.clear();
+            }
+            return;
+        }
+        if (!saslTag_.isEmpty()) {
+            Queue(saslTag_ + " OK AUTHENTICATE completed\r\n");
+            saslTag_.clear();
+            return;
+        }
+
+        const QList<QByteArray> words = SplitWords(line);
+        if (words.size() < 2) {
+            Queue("* BAD empty command\r\n");
+            return;
+        }
+        const QByteArray tag = words[0];
+        QByteArray verb = words[1].toUpper();
+        QList<QByteArray> args = words.mid(2);
+        bool uid = false;
+        if (verb == "UID" && !args.isEmpty()) {
+            uid = true;
+            verb = args.takeFirst().toUpper();
+        }
+
+        if (verb == "CAPABILITY") {
+            Queue("* CAPABILITY " + server_.Capabilities() + "\r\n" + tag + " OK CAPABILITY completed\r\n");
+        } else if (verb == "LOGIN") {
+            Queue(tag + " OK [CAPABILITY " + server_.Capabilities() + "] LOGIN completed\r\n");
+        } else if (verb == "AUTHENTICATE") {
+            if (args.size() >= 2) {
+                Queue(tag + " OK AUTHENTICATE completed\r\n");
+            } else {
+                saslTag_ = tag;
+                Queue("+ \r\n");
+            }
+        } else if (verb == "NOOP" || verb == "CHECK") {
+            Queue(tag + " OK " + verb + " completed\r\n");
+        } else if (verb == "NAMESPACE") {
+            Queue("* NAMESPACE ((\"\" \"/\")) NIL NIL\r\n" + tag + " OK NAMESPACE completed\r\n");
+        } else if (verb == "LIST" || verb == "XLIST") {
+            List(tag, verb, args);
+        } else if (verb == "STATUS") {
+            Status(tag, args);
+        } else if (verb == "SELECT" || verb == "EXAMINE") {
+            Select(tag, verb, args);
+        } else if (verb == "CLOSE" || verb == "UNSELECT") {
+            selected_ = nullptr;
+            Queue(tag + " OK " + verb + " completed\r\n");
+        } else if (verb == "FETCH") {
+            Fetch(tag, uid, args);
+        } else if (verb == "SEARCH") {
+            Search(tag, uid, args);
+        } else if (verb == "IDLE" && server_.Config().advertiseIdle) {
+            idleTag_ = tag;
+            Queue("+ idling\r\n");
+            if (server_.Config().idlePushMs > 0 && selected_ != nullptr) {
+                pushTimer_.start(server_.Config().idlePushMs);
+            }
+        } else if (verb == "LOGOUT") {
+            Queue("* BYE fake imapd logging out\r\n" + tag + " OK LOGOUT completed\r\n");
+            closeWhenDrained_ = true;
+        } else {
+            Queue(tag + " BAD unsupported command\r\n");
+        }
+    }
+
+    void List(const QByteArray& tag, const QByteArray& verb, QList<QByteArray> args)
+    {
+        const bool specialOnly = !args.isEmpty() && args.front().startsWith('(');
+        if (specialOnly) {
+            args.removeFirst();
+        }
+        // LIST-STATUS: LIST "" "*" RETURN (... STATUS (items)).
+        QByteArray statusItems;
+        if (args.size() >= 4 && args[2].toUpper() == "RETURN") {
+            const QList<QByteArray> options = SplitWords(StripParens(args[3]));
+            for (int i = 0; i + 1 < options.size(); ++i) {
+                if (options[i].toUpper() == "STATUS") {
+                    statusItems = options[i + 1];
+                }
+            }
+        }
+        QByteArray out;
+        for (const FakeMailbox& mailbox : server_.Config().mailboxes) {
+            const QByteArray special = SpecialUse(mailbox.name);
+            if (specialOnly && special.isEmpty()) {
+                continue;
+            }
+            QByteArray attributes = "\\HasNoChildren";
+            if (!special.isEmpty()) {
+                attributes += ' ' + special;
+            }
+            out += "* " + verb + " (" + attributes + ") \"/\" " + Quote(mailbox.name) + "\r\n";
+            if (!statusItems.isEmpty()) {
+                out += StatusLine(mailbox, statusItems);
+            }
+        }
+        Queue(out + tag + " OK " + verb + " completed\r\n");
+    }
+
+    void Status(const QByteArray& tag, const QList<QByteArray>& args)
+    {
+        FakeMailbox* mailbox = args.isEmpty() ? nullptr : server_.FindMailbox(QString::fromUtf8(Unquote(args[0])));
+        if (mailbox == nullptr || args.size() < 2) {
+            Queue(tag + " NO no such mailbox\r\n");
+            return;
+        }
+        Queue(StatusLine(*mailbox, args[1]) + tag + " OK STATUS completed\r\n");
+    }
+
+    QByteArray StatusLine(const FakeMailbox& mailbox, const QByteArray& itemList) const
+    {
+        QByteArray items;
+        for (const QByteArray& item : SplitWords(StripParens(itemList))) {
+            const QByteArray name = item.toUpper();
+            qint64 value = -1;
+            if (name == "MESSAGES") {
+                value = mailbox.messages;
+            } else if (name == "UIDNEXT") {
+                value = mailbox.messages + 1;
+            } else if (name == "UIDVALIDITY") {
+                value = mailbox.uidValidity;
+            } else if (name == "UNSEEN") {
+                value = mailbox.messages / 2;
+            } else if (name == "RECENT") {
+                value = 0;
+            } else if (name == "HIGHESTMODSEQ") {
+                value = mailbox.messages + 1;
+            }
+            if (value >= 0) {
+                items += (items.isEmpty() ? "" : " ") + name + ' ' + QByteArray::number(value);
+            }
+        }
+        return "* STATUS " + Quote(mailbox.name) + " (" + items + ")\r\n";
+    }
+
+    void Select(const QByteArray& tag, const QByteArray& verb, const QList<QByteArray>& args)
+    {
+        selected_ = args.isEmpty() ? nullptr : server_.FindMailbox(QString::fromUtf8(Unquote(args[0])));
+        if (selected_ == nullptr) {
+            Queue(tag + " NO no such mailbox\r\n");
+            return;
+        }
+        const QByteArray messages = QByteArray::number(selected_->messages);
+        Queue("* FLAGS (\\Answered \\Flagged \\Deleted \\Seen \\Draft)\r\n"
+              "* " + messages + " EXISTS\r\n"
+              "* 0 RECENT\r\n"
+              "* OK [UIDVALIDITY " + QByteArray::number(selected_->uidValidity) + "] UIDs valid\r\n"
+              "* OK [UIDNEXT " + QByteArray::number(selected_->messages + 1) + "] predicted next UID\r\n"
+              + tag + (verb == "EXAMINE" ? " OK [READ-ONLY] " : " OK [READ-WRITE] ") + verb + " completed\r\n");
+    }
+
+    void Fetch(const QByteArray& tag, bool uid, const QList<QByteArray>& args)
+    {
+        QVector<Range> ranges;
+        if (selected_ == nullptr || args.size() < 2
+            || !ParseSequenceSet(args[0], selected_->messages, ranges)) {
+            Queue(tag + " BAD FETCH needs a selected mailbox, a set and items\r\n");
+            return;
+        }
+
+        QList<QByteArray> items = SplitWords(StripParens(args[1]));
+        const QByteArray macro = items.size() == 1 ? items[0].toUpper() : QByteArray();
+        if (macro == "FAST" || macro == "ALL" || macro == "FULL") {
+            items = {"FLAGS", "INTERNALDATE", "RFC822.SIZE"};
+            if (macro != "FAST") {
+                items.push_back("ENVELOPE");
+            }
+            if (macro == "FULL") {
+                items.push_back("BODY");
+            }
+        }
+        if (uid && !items.contains("UID")) {
+            items.prepend("UID");
+        }
+
+        // Copied into the generator: the mailbox may grow (IDLE push) while this streams.
+        const FakeMailbox mailbox = *selected_;
+        auto next = std::make_shared<std::pair<int, qint64>>(0, ranges.isEmpty() ? 0 : ranges[0].first);
+        QueueGenerated([this, tag, items, ranges, mailbox, next](QByteArray& out) {
+            for (int produced = 0; produced < kFetchBatch; ++produced) {
+                if (next->first >= ranges.size()) {
+                    out += tag + " OK FETCH completed\r\n";
+                    return false;
+                }
+                AppendFetch(out, mailbox, next->second, items);
+                if (++next->second > ranges[next->first].last) {
+                    ++next->first;
+                    if (next->first < ranges.size()) {
+                        next->second = ranges[next->first].first;
+                    }
+                }
+            }
+            return true;
+        });
+    }
+
+    void AppendFetch(QByteArray& out, const FakeMailbox& mailbox, qint64 number, const QList<QByteArray>& items) const
+    {
+        const QByteArray header = server_.MessageHeader(mailbox, number);
+        const QByteArray& body = body_;
+        QByteArray parts;
+        for (const QByteArray& item : items) {
+            const QByteArray name = item.toUpper();
+            if (!parts.isEmpty()) {
+                parts += ' ';
+            }
+            if (name == "UID") {
+                parts += "UID " + QByteArray::number(number);
+            } else if (name == "FLAGS") {
+                parts += number % 2 == 0 ? "FLAGS (\\Seen)" : "FLAGS ()";
+            } else if (name == "RFC822.SIZE") {
+                parts += "RFC822.SIZE " + QByteArray::number(header.size() + body.size());
+            } else if (name == "INTERNALDATE") {
+                parts += "INTERNALDATE \"17-Jul-2024 10:00:00 +0000\"";
+            } else if (name == "MODSEQ") {
+                parts += "MODSEQ (" + QByteArray::number(number) + ")";
+            } else if (name == "ENVELOPE") {
+                const QByteArray n = QByteArray::number(number);
+                parts += "ENVELOPE (\"Wed, 17 Jul 2024 10:00:00 +0000\" \"Message " + n + "\" "
+                         "((\"Sender " + n + "\" NIL \"sender" + n + "\" \"example.com\")) "
+                         "((\"Sender " + n + "\" NIL \"sender" + n + "\" \"example.com\")) "
+                         "((\"Sender " + n + "\" NIL \"sender" + n + "\" \"example.com\")) "
+                         "((NIL NIL \"me\" \"example.com\")) NIL NIL NIL \"<" + n + "@fake.invalid>\")";
+            } else if (name == "BODY" || name == "BODYSTRUCTURE") {
+                parts += name + " (\"TEXT\" \"PLAIN\" (\"CHARSET\" \"US-ASCII\") NIL NIL \"7BIT\" "
+                         + QByteArray::number(body.size()) + ' ' + QByteArray::number(body.count('\n')) + ")";
+            } else {
+                AppendSection(parts, name, header, body);
+            }
+        }
+        out += "* " + QByteArray::number(number) + " FETCH (" + parts + ")\r\n";
+    }
+
+    // BODY[...], BODY.PEEK[...], BINARY[...], RFC822, RFC822.HEADER, RFC822.TEXT. Partial
+    // ranges (<a.b>) are answered in full.
+    static void AppendSection(QByteArray& out, QByteArray name, const QByteArray& header, const QByteArray& body)
+    {
+        name.replace(".PEEK", "");
+        const qsizetype partial = name.indexOf("]<");
+        if (partial >= 0) {
+            name.truncate(partial + 1);
+        }
+        const qsizetype open = name.indexOf('[');
+        const QByteArray section = open < 0 ? QByteArray() : name.mid(open + 1, name.size() - open - 2);
+        const QByteArray base = open < 0 ? name : name.left(open);
+
+        QByteArray data;
+        if (name == "RFC822.HEADER" || section.startsWith("HEADER")) {
+            data = header;
+        } else if (name == "RFC822.TEXT" || section == "TEXT" || section == "1") {
+            data = body;
+        } else if (name == "RFC822" || base == "BODY" || base == "BINARY") {
+            data = header + body;
+        } else {
+            out += name + " NIL";
+            return;
+        }
+        out += name + " {" + QByteArray::number(data.size()) + "}\r\n" + data;
+    }
+
+    void Search(const QByteArray& tag, bool uid, const QList<QByteArray>& args)
+    {
+        if (selected_ == nullptr) {
+            Queue(tag + " BAD no mailbox selected\r\n");
+            return;
+        }
+        // ALL, SEEN, UNSEEN and UID/sequence sets; anything else matches every message.
+        // RETURN (...) is answered with ESEARCH when the server advertises it.
+        QVector<Range> ranges;
+        int parity = -1;
+        bool extended = false;
+        QList<QByteArray> returnOptions;
+        for (int i = 0; i < args.size(); ++i) {
+            const QByteArray key = args[i].toUpper();
+            if (key == "RETURN" && i + 1 < args.size() && args[i + 1].startsWith('(')) {
+                extended = server_.Config().advertiseEsearch;
+                returnOptions = SplitWords(StripParens(args[++i].toUpper()));
+            } else if (key == "SEEN") {
+                parity = 0;
+            } else if (key == "UNSEEN") {
+                parity = 1;
+            } else if (key == "UID" && i + 1 < args.size()) {
+                ParseSequenceSet(args[++i], selected_->messages, ranges);
+            } else if (!key.isEmpty() && (key[0] == '*' || (key[0] >= '0' && key[0] <= '9'))) {
+                ParseSequenceSet(key, selected_->messages, ranges);
+            }
+        }
+        if (ranges.isEmpty()) {
+            ranges.push_back({1, selected_->messages});
+        }
+
+        QVector<qint64> matches;
+        for (const Range& range : ranges) {
+            for (qint64 n = range.first; n <= range.last; ++n) {
+                if (parity < 0 || n % 2 == parity) {
+                    matches.push_back(n);
+                }
+            }
+        }
+        std::sort(matches.begin(), matches.end());
+        matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+
+        QByteArray out;
+        if (extended) {
+            // RFC 4731: RETURN () means ALL; MIN, MAX and ALL are left out when nothing matched.
+            if (returnOptions.isEmpty()) {
+                returnOptions.push_back("ALL");
+            }
+            out = "* ESEARCH (TAG \"" + tag + "\")" + (uid ? " UID" : "");
+            for (const QByteArray& option : returnOptions) {
+                if (option == "COUNT") {
+                    out += " COUNT " + QByteArray::number(matches.size());
+                } else if (matches.isEmpty()) {
+                    continue;
+                } else if (option == "MIN") {
+                    out += " MIN " + QByteArray::number(matches.front());
+                } else if (option == "MAX") {
+                    out += " MAX " + QByteArray::number(matches.back());
+                } else if (option == "ALL") {
+                    out += " ALL " + SequenceSet(matches);
+                }
+            }
+        } else {
+            out = "* SEARCH";
+            for (const qint64 n : matches) {
+                out += ' ' + QByteArray::number(n);
+            }
+        }
+        Queue(out + "\r\n" + tag + " OK SEARCH completed\r\n");
+    }
+
+    void PushNewMessage()
+    {
+        FakeMailbox* mailbox = selected_;
+        if (mailbox == nullptr || idleTag_.isEmpty()) {
+            pushTimer_.stop();
+            return;
+        }
+        ++mailbox->messages;
+        Queue("* " + QByteArray::number(mailbox->messages) + " EXISTS\r\n");
+    }
+
+    void Queue(QByteArray bytes)
+    {
+        Outgoing outgoing;
+        outgoing.readyAtMs = clock_.elapsed() + server_.Config().latencyMs;
+        outgoing.bytes = std::move(bytes);
+        out_.push_back(std::move(outgoing));
+        Pump();
+    }
+
+    void QueueGenerated(Generator more)
+    {
+        Outgoing outgoing;
+        outgoing.readyAtMs = clock_.elapsed() + server_.Config().latencyMs;
+        outgoing.more = std::move(more);
+        out_.push_back(std::move(outgoing));
+        Pump();
+    }
+
+    void Pump()
+    {
+        const qint64 bandwidth = server_.Config().bandwidthBytesPerSec;
+        const qint64 now = clock_.elapsed();
+        if (bandwidth > 0) {
+            // Up to 50 ms worth of burst.
+            tokens_ = qMin<double>(tokens_ + (now - refillAtMs_) * bandwidth / 1000.0, bandwidth / 20.0);
+        }
+        refillAtMs_ = now;
+
+        while (!out_.empty() && out_.front().readyAtMs <= now) {
+            if (socket_->bytesToWrite() > kSocketHighWater) {
+                return; // bytesWritten resumes
+            }
+            Outgoing& front = out_.front();
+            if (sent_ == front.bytes.size()) {
+                front.bytes.clear();
+                sent_ = 0;
+                if (!front.more || !front.more(front.bytes)) {
+                    front.more = nullptr;
+                }
+                if (front.bytes.isEmpty()) {
+                    out_.pop_front();
+                    continue;
+                }
+            }
+            qint64 chunk = front.bytes.size() - sent_;
+            if (bandwidth > 0) {
+                chunk = qMin(chunk, static_cast<qint64>(tokens_));
+                if (chunk <= 0) {
+                    break;
+                }
+                tokens_ -= chunk;
+            }
+            socket_->write(front.bytes.constData() + sent_, chunk);
+            sent_ += chunk;
+        }
+
+        if (out_.empty()) {
+            if (closeWhenDrained_) {
+                socket_->disconnectFromHost();
+            }
+            return;
+        }
+        const qint64 wait = out_.front().readyAtMs > now ? out_.front().readyAtMs - now : kPumpIntervalMs;
+        if (!pumpTimer_.isActive()) {
+            pumpTimer_.start(static_cast<int>(wait));
+        }
+    }
+
+    FakeImapServer& server_;
+    QTcpSocket* socket_ = nullptr;
+    QByteArray in_;
+    const QByteArray& body_ = server_.body_;
+    FakeMailbox* selected_ = nullptr;
+    QByteArray idleTag_;
+    QByteArray saslTag_;
+    bool closeWhenDrained_ = false;
+
+    std::deque<Outgoing> out_;
+    qint64 sent_ = 0;
+    double tokens_ = 0;
+    qint64 refillAtMs_ = 0;
+    QElapsedTimer clock_;
+    QTimer pumpTimer_;
+    QTimer pushTimer_;
+};
+
+FakeImapConfig FakeImapConfig::Default()
+{
+    FakeImapConfig config;
+    config.mailboxes = {
+        {QStringLiteral("INBOX"), 1000, 1},
+        {QStringLiteral("Sent"), 200, 1},
+        {QStringLiteral("Drafts"), 5, 1},
+        {QStringLiteral("Trash"), 50, 1},
+        {QStringLiteral("Archive"), 5000, 1},
+    };
+    return config;
+}
+
+bool FakeImapConfig::ParseMailbox(const QString& spec, FakeMailbox& out)
+{
+    const qsizetype eq = spec.lastIndexOf('=');
+    if (eq <= 0) {
+        return false;
+    }
+    bool ok = false;
+    out.name = spec.left(eq);
+    out.messages = spec.mid(eq + 1).toInt(&ok);
+    out.uidValidity = 1;
+    return ok && out.messages >= 0;
+}
+
+FakeImapServer::FakeImapServer(FakeImapConfig config, QObject* parent)
+    : QObject(parent)
+    , config_(std::move(config))
+{
+    // Fixed body sized so header + body lands near messageBytes.
+    const int bodyBytes = qMax(78, config_.messageBytes - 320);
+    const QByteArray line = QByteArray(76, 'x') + "\r\n";
+    body_.reserve(bodyBytes + line.size());
+    while (body_.size() < bodyBytes) {
+        body_ += line;
+    }
+    mailboxIndex_.reserve(config_.mailboxes.size());
+    for (int i = 0; i < config_.mailboxes.size(); ++i) {
+        mailboxIndex_.insert(config_.mailboxes[i].name, i);
+    }
+    connect(&server_, &QTcpServer::newConnection, this, [this]() { OnNewConnection(); });
+}
+
+FakeImapServer::~FakeImapServer() = default;
+
+bool FakeImapServer::Listen(quint16 port, QString& outError)
+{
+    if (!server_.listen(QHostAddress::LocalHost, port)) {
+        outError = server_.errorString();
+        return false;
+    }
+    return true;
+}
+
+quint16 FakeImapServer::Port() const
+{
+    return server_.serverPort();
+}
+
+FakeMailbox* FakeImapServer::FindMailbox(const QString& name)
+{
+    const int index = mailboxIndex_.value(name.compare("INBOX", Qt::CaseInsensitive) == 0 ? QString("INBOX") : name, -1);
+    return index < 0 ? nullptr : &config_.mailboxes[index];
+}
+
+const FakeImapConfig& FakeImapServer::Config() const
+{
+    return config_;
+}
+
+QByteArray FakeImapServer::Capabilities() const
+{
+    QByteArray caps = "IMAP4rev1 LITERAL+ NAMESPACE SPECIAL-USE LIST-STATUS UIDPLUS AUTH=PLAIN AUTH=XOAUTH2";
+    if (config_.advertiseIdle) {
+        caps += " IDLE";
+    }
+    if (config_.advertiseEsearch) {
+        caps += " ESEARCH";
+    }
+    return caps;
+}
+
+QByteArray FakeImapServer::MessageHeader(const FakeMailbox& mailbox, qint64 uid) const
+{
+    const QByteArray n = QByteArray::number(uid);
+    return "Date: Wed, 17 Jul 2024 10:00:00 +0000\r\n"
+           "From: Sender " + n + " <sender" + n + "@example.com>\r\n"
+           "To: Me <me@example.com>\r\n"
+           "Subject: Message " + n + " in " + mailbox.name.toUtf8() + "\r\n"
+           "Message-ID: <" + n + "@fake.invalid>\r\n"
+           "MIME-Version: 1.0\r\n"
+           "Content-Type: text/plain; charset=us-ascii\r\n"
+           "\r\n";
+}
+
+QByteArray FakeImapServer::MessageBody() const
+{
+    return body_;
+}
+
+void FakeImapServer::OnNewConnection()
+{
+    while (QTcpSocket* socket = server_.nextPendingConnection()) {
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        new Session(*this, socket);
+    }
+}
+
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QObject>
+#include <QString>
+#include <QTcpServer>
+#include <QVector>
+
+namespace ngks::tools::fakeimap {
+
+struct FakeMailbox {
+    QString name;
+    int messages = 0;
+    qint64 uidValidity = 1;
+};
+
+struct FakeImapConfig {
+    QVector<FakeMailbox> mailboxes;
+    // Approximate size of every synthesized message (header + body).
+    int messageBytes = 4096;
+    // Delay before each command's response starts going out.
+    int latencyMs = 0;
+    // Outbound shaping per connection; 0 is unlimited.
+    qint64 bandwidthBytesPerSec = 0;
+    bool advertiseIdle = true;
+    // UID SEARCH RETURN (...) then answers with ESEARCH (RFC 4731) instead of SEARCH.
+    bool advertiseEsearch = true;
+    // While a client idles, a new message is appended to its mailbox every idlePushMs (0: never).
+    int idlePushMs = 0;
+
+    // INBOX with 1000 messages plus Sent, Drafts, Trash and Archive.
+    static FakeImapConfig Default();
+    // Parses "NAME=COUNT", e.g. "INBOX=50000". Returns false on malformed input.
+    static bool ParseMailbox(const QString& spec, FakeMailbox& out);
+};
+
+// Loopback IMAP server that synthesizes mailboxes of any size for benchmarks and local runs.
+// Plain TCP on 127.0.0.1; any LOGIN or AUTHENTICATE succeeds. Supports CAPABILITY, NAMESPACE,
+// LIST (incl. SPECIAL-USE and LIST-STATUS), STATUS, SELECT/EXAMINE, FETCH/UID FETCH,
+// SEARCH/UID SEARCH (incl. ESEARCH), NOOP, IDLE and LOGOUT. UIDs equal sequence numbers and
+// nothing is ever expunged. Message content is generated on demand, so a million-message
+// mailbox costs no memory.
+class FakeImapServer : public QObject {
+    Q_OBJECT
+
+public:
+    explicit FakeImapServer(FakeImapConfig config, QObject* parent = nullptr);
+    ~FakeImapServer() override;
+
+    // port 0 picks a free port; see Port().
+    bool Listen(quint16 port, QString& outError);
+    quint16 Port() const;
+
+    FakeMailbox* FindMailbox(const QString& name);
+    const FakeImapConfig& Config() const;
+    QByteArray Capabilities() const;
+
+    // Deterministic message content; uid is 1-based.
+    QByteArray MessageHeader(const FakeMailbox& mailbox, qint64 uid) const;
+    QByteArray MessageBody() const;
+
+private:
+    class Session;
+
+    void OnNewConnection();
+
+    FakeImapConfig config_;
+    QTcpServer server_;
+    QByteArray body_;
+    QHash<QString, int> mailboxIndex_;
+};
+
+}
@@ -0,0 +1,72 @@
+// ngksmail_fake_imapd: loopback IMAP server with synthetic mailboxes.
+//   ngksmail_fake_imapd --port 1143 --mailbox INBOX=50000 --mailbox Archive=200000 \
+//       --message-bytes 8192 --latency-ms 40 --bandwidth-kbps 20000 --idle-push-ms 5000
+// Point the app at it with --resolve-test --host 127.0.0.1 --port 1143 --tls false --allow-localhost.
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QTextStream>
+
+#include "FakeImapServer.h"
+
+using ngks::tools::fakeimap::FakeImapConfig;
+using ngks::tools::fakeimap::FakeImapServer;
+using ngks::tools::fakeimap::FakeMailbox;
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    const QCommandLineOption portOpt("port", "Listen port on 127.0.0.1 (0 picks one).", "port", "1143");
+    const QCommandLineOption mailboxOpt("mailbox", "Mailbox as NAME=COUNT; repeatable. Default: a small set.", "spec");
+    const QCommandLineOption messageBytesOpt("message-bytes", "Approximate size of each message.", "bytes", "4096");
+    const QCommandLineOption latencyOpt("latency-ms", "Delay before each response.", "ms", "0");
+    const QCommandLineOption bandwidthOpt("bandwidth-kbps", "Outbound limit per connection in KiB/s (0: unlimited).", "kbps", "0");
+    const QCommandLineOption noIdleOpt("no-idle", "Do not advertise IDLE.");
+    const QCommandLineOption noEsearchOpt("no-esearch", "Do not advertise ESEARCH.");
+    const QCommandLineOption idlePushOpt("idle-push-ms", "Append a message to idling clients' mailbox every N ms.", "ms", "0");
+    parser.addOption(portOpt);
+    parser.addOption(mailboxOpt);
+    parser.addOption(messageBytesOpt);
+    parser.addOption(latencyOpt);
+    parser.addOption(bandwidthOpt);
+    parser.addOption(noIdleOpt);
+    parser.addOption(noEsearchOpt);
+    parser.addOption(idlePushOpt);
+    parser.process(app);
+
+    FakeImapConfig config = FakeImapConfig::Default();
+    if (parser.isSet(mailboxOpt)) {
+        config.mailboxes.clear();
+        for (const QString& spec : parser.values(mailboxOpt)) {
+            FakeMailbox mailbox;
+            if (!FakeImapConfig::ParseMailbox(spec, mailbox)) {
+                err << "invalid --mailbox " << spec << " (expected NAME=COUNT)\n";
+                return 2;
+            }
+            config.mailboxes.push_back(mailbox);
+        }
+    }
+    config.messageBytes = qMax(256, parser.value(messageBytesOpt).toInt());
+    config.latencyMs = qMax(0, parser.value(latencyOpt).toInt());
+    config.bandwidthBytesPerSec = qMax<qint64>(0, parser.value(bandwidthOpt).toLongLong()) * 1024;
+    config.advertiseIdle = !parser.isSet(noIdleOpt);
+    config.advertiseEsearch = !parser.isSet(noEsearchOpt);
+    config.idlePushMs = qMax(0, parser.value(idlePushOpt).toInt());
+
+    FakeImapServer server(config);
+    QString error;
+    if (!server.Listen(static_cast<quint16>(parser.value(portOpt).toUInt()), error)) {
+        err << "listen failed: " << error << "\n";
+        return 1;
+    }
+    out << "fake imapd listening on 127.0.0.1:" << server.Port() << "\n";
+    for (const FakeMailbox& mailbox : config.mailboxes) {
+        out << "  " << mailbox.name << " messages=" << mailbox.messages << "\n";
+    }
+    out.flush();
+    return app.exec();
+}